@@ -0,0 +1,80 @@
+#include "chunkmanifest.h"
+#include "chunkstoreprotocol.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+
+namespace
+{
+
+constexpr quint32 ManifestMagic = 0x4f42434d; // "OBCM"
+constexpr quint32 ManifestVersion = 1;
+constexpr int DigestSize = 32;
+
+}
+
+bool ChunkManifest::load(const QString &path, bool headerOnly)
+{
+    chunks.clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    imageDigest.resize(DigestSize);
+    in >> magic >> version >> imageSize;
+    in.readRawData(imageDigest.data(), DigestSize);
+    in >> count;
+    if (in.status() != QDataStream::Ok || magic != ManifestMagic || version != ManifestVersion) {
+        return false;
+    }
+    if (headerOnly) {
+        return true;
+    }
+
+    chunks.reserve(count);
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        Chunk chunk;
+        chunk.digest.resize(DigestSize);
+        in.readRawData(chunk.digest.data(), DigestSize);
+        in >> chunk.length;
+        chunks.append(chunk);
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+bool ChunkManifest::save(const QString &path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << ManifestMagic << ManifestVersion << imageSize;
+    out.writeRawData(imageDigest.constData(), DigestSize);
+    out << quint32(chunks.count());
+    for (const Chunk &chunk : chunks) {
+        out.writeRawData(chunk.digest.constData(), DigestSize);
+        out << chunk.length;
+    }
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+QString ChunkManifest::chunkPath(const QByteArray &digest)
+{
+    // Fanned out by the first byte to keep directories small.
+    const QString hex = QString::fromLatin1(digest.toHex());
+    return ChunkStoreProtocol::chunkDir() + QLatin1Char('/') + hex.left(2) + QLatin1Char('/') + hex.mid(2);
+}
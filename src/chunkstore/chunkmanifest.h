@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// The list of chunks a deduplicated backup image is made of, in order. It
+// replaces the .sfs in the slot's backup directory; the chunks themselves
+// live once in the shared chunk store, named after their SHA-256.
+struct ChunkManifest {
+    struct Chunk {
+        QByteArray digest;
+        quint32 length = 0;
+    };
+
+    qint64 imageSize = 0;
+    QByteArray imageDigest;
+    QList<Chunk> chunks;
+
+    // With headerOnly just the image size and digest are read.
+    bool load(const QString &path, bool headerOnly = false);
+    bool save(const QString &path) const;
+
+    static QString chunkPath(const QByteArray &digest);
+};
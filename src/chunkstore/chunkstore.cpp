@@ -0,0 +1,336 @@
+#include "chunkstore.h"
+#include "chunkstoreprotocol.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSet>
+#include <QStringList>
+
+#include <array>
+
+namespace
+{
+
+// Cut when the top bits of the rolling hash are zero: more of them before the
+// average size and fewer after, which narrows the spread of chunk sizes.
+constexpr quint64 MaskSmall = ((quint64(1) << 18) - 1) << 46;
+constexpr quint64 MaskLarge = ((quint64(1) << 14) - 1) << 50;
+
+// Fixed pseudo-random values per byte. Generated rather than tabulated, but
+// deterministically: a different table would cut differently and share
+// nothing with chunks already stored.
+const std::array<quint64, 256> &gearTable()
+{
+    static const std::array<quint64, 256> table = []() {
+        std::array<quint64, 256> values;
+        quint64 state = 0x4f6273696469616eULL;
+        for (quint64 &value : values) {
+            // splitmix64
+            quint64 z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+        return values;
+    }();
+    return table;
+}
+
+// Held by every command that reads or changes the store, so a collection
+// never sweeps chunks an ingest has written but not yet referenced.
+bool lockStore(QLockFile *lock)
+{
+    QDir().mkpath(ChunkStoreProtocol::chunkDir());
+    // An ingest takes minutes; only an owner that died makes the lock stale.
+    lock->setStaleLockTime(0);
+    return lock->tryLock(60 * 1000);
+}
+
+}
+
+ChunkStore::ChunkStore(QTextStream &out)
+    : m_out(out)
+{
+}
+
+bool ChunkStore::ingest(const QString &stagingDir, const QString &slotDir)
+{
+    // A failed image is of no use later, and would only fill the disk.
+    const bool ok = ingestImages(stagingDir, slotDir);
+    discard(stagingDir);
+    return ok;
+}
+
+bool ChunkStore::discard(const QString &stagingDir)
+{
+    if (!QDir(stagingDir).removeRecursively()) {
+        m_out << "Cannot remove " << stagingDir << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStore::ingestImages(const QString &stagingDir, const QString &slotDir)
+{
+    QLockFile lock(ChunkStoreProtocol::chunkDir() + QStringLiteral("/.lock"));
+    if (!lockStore(&lock)) {
+        m_out << "The chunk store is in use.\n";
+        return false;
+    }
+
+    if (!QDir().mkpath(slotDir)) {
+        m_out << "Cannot create " << slotDir << "\n";
+        return false;
+    }
+
+    QStringList images;
+    QDirIterator it(stagingDir, {QStringLiteral("*.sfs")}, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        images << it.next();
+    }
+    if (images.isEmpty()) {
+        m_out << "No backup image found in " << stagingDir << "\n";
+        return false;
+    }
+
+    for (const QString &image : std::as_const(images)) {
+        if (!ingestImage(image, slotDir)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ChunkStore::ingestImage(const QString &imagePath, const QString &slotDir)
+{
+    QFile image(imagePath);
+    if (!image.open(QIODevice::ReadOnly)) {
+        m_out << "Cannot open " << imagePath << "\n";
+        return false;
+    }
+
+    const qint64 size = image.size();
+    uchar *data = size > 0 ? image.map(0, size) : nullptr;
+    if (size > 0 && !data) {
+        m_out << "Cannot map " << imagePath << "\n";
+        return false;
+    }
+
+    ChunkManifest manifest;
+    manifest.imageSize = size;
+    QCryptographicHash imageHash(QCryptographicHash::Sha256);
+    qint64 writtenBytes = 0;
+    int writtenChunks = 0;
+
+    for (qint64 offset = 0; offset < size;) {
+        const qint64 length = cutPoint(data + offset, size - offset);
+        const QByteArrayView chunkData(reinterpret_cast<const char *>(data + offset), length);
+
+        ChunkManifest::Chunk chunk;
+        chunk.digest = QCryptographicHash::hash(chunkData, QCryptographicHash::Sha256);
+        chunk.length = quint32(length);
+        imageHash.addData(chunkData);
+
+        bool written = false;
+        if (!writeChunk(chunk.digest, chunkData.constData(), length, &written)) {
+            m_out << "Cannot write chunk " << chunk.digest.toHex() << "\n";
+            return false;
+        }
+        if (written) {
+            writtenBytes += length;
+            writtenChunks++;
+        }
+
+        manifest.chunks.append(chunk);
+        offset += length;
+    }
+    manifest.imageDigest = imageHash.result();
+
+    const QFileInfo info(imagePath);
+    const QString baseName = info.completeBaseName();
+    if (!manifest.save(slotDir + QLatin1Char('/') + baseName + ChunkStoreProtocol::manifestSuffix())) {
+        m_out << "Cannot write the manifest for " << imagePath << "\n";
+        return false;
+    }
+
+    const QString sidecar = info.absolutePath() + QLatin1Char('/') + baseName + QStringLiteral(".json");
+    if (QFile::exists(sidecar)) {
+        const QString target = slotDir + QLatin1Char('/') + baseName + QStringLiteral(".json");
+        QFile::remove(target);
+        if (!QFile::rename(sidecar, target) && QFile::copy(sidecar, target)) {
+            QFile::remove(sidecar);
+        }
+    }
+
+    image.unmap(data);
+    image.close();
+    QFile::remove(imagePath);
+
+    m_out << "Stored " << info.fileName() << ": " << manifest.chunks.count() << " chunks, " << writtenChunks
+          << " new (" << writtenBytes << " of " << size << " bytes written)\n";
+    return true;
+}
+
+bool ChunkStore::writeChunk(const QByteArray &digest, const char *data, qint64 length, bool *written)
+{
+    const QString path = ChunkManifest::chunkPath(digest);
+    const QFileInfo existing(path);
+    if (existing.exists() && existing.size() == length) {
+        *written = false;
+        return true;
+    }
+
+    QDir().mkpath(existing.absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data, length) != length || !file.commit()) {
+        return false;
+    }
+    *written = true;
+    return true;
+}
+
+bool ChunkStore::materialize(const QString &manifestPath, const QString &outputPath)
+{
+    QLockFile lock(ChunkStoreProtocol::chunkDir() + QStringLiteral("/.lock"));
+    if (!lockStore(&lock)) {
+        m_out << "The chunk store is in use.\n";
+        return false;
+    }
+
+    ChunkManifest manifest;
+    if (!manifest.load(manifestPath)) {
+        m_out << "Cannot read " << manifestPath << "\n";
+        return false;
+    }
+
+    QDir().mkpath(QFileInfo(outputPath).absolutePath());
+    QSaveFile output(outputPath);
+    if (!output.open(QIODevice::WriteOnly)) {
+        m_out << "Cannot write " << outputPath << "\n";
+        return false;
+    }
+
+    QCryptographicHash imageHash(QCryptographicHash::Sha256);
+    QByteArray buffer;
+    qint64 done = 0;
+    int lastPercent = -1;
+
+    for (const ChunkManifest::Chunk &chunk : std::as_const(manifest.chunks)) {
+        QFile file(ChunkManifest::chunkPath(chunk.digest));
+        if (!file.open(QIODevice::ReadOnly)) {
+            m_out << "Missing chunk " << chunk.digest.toHex() << "\n";
+            return false;
+        }
+
+        buffer.resize(chunk.length);
+        if (file.read(buffer.data(), chunk.length) != chunk.length
+            || QCryptographicHash::hash(buffer, QCryptographicHash::Sha256) != chunk.digest) {
+            m_out << "Corrupt chunk " << chunk.digest.toHex() << "\n";
+            return false;
+        }
+
+        imageHash.addData(buffer);
+        if (output.write(buffer) != buffer.size()) {
+            m_out << "Cannot write " << outputPath << "\n";
+            return false;
+        }
+
+        done += chunk.length;
+        const int percent = manifest.imageSize > 0 ? int(done * 100 / manifest.imageSize) : 100;
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            m_out << percent << "%\r";
+            m_out.flush();
+        }
+    }
+
+    if (done != manifest.imageSize || imageHash.result() != manifest.imageDigest) {
+        m_out << "\nThe reassembled image does not match " << manifestPath << "\n";
+        return false;
+    }
+
+    if (!output.commit()) {
+        m_out << "\nCannot write " << outputPath << "\n";
+        return false;
+    }
+
+    m_out << "\nRestored " << QFileInfo(outputPath).fileName() << " from " << manifest.chunks.count() << " chunks\n";
+    return true;
+}
+
+bool ChunkStore::collectGarbage()
+{
+    QLockFile lock(ChunkStoreProtocol::chunkDir() + QStringLiteral("/.lock"));
+    if (!lockStore(&lock)) {
+        m_out << "The chunk store is in use.\n";
+        return false;
+    }
+
+    QSet<QString> referenced;
+    QDirIterator manifests(ChunkStoreProtocol::backupRoot(), {QLatin1Char('*') + ChunkStoreProtocol::manifestSuffix()},
+                           QDir::Files, QDirIterator::Subdirectories);
+    while (manifests.hasNext()) {
+        const QString path = manifests.next();
+        ChunkManifest manifest;
+        // A manifest that can't be read might still need its chunks.
+        if (!manifest.load(path)) {
+            m_out << "Cannot read " << path << ", not collecting\n";
+            return false;
+        }
+        for (const ChunkManifest::Chunk &chunk : std::as_const(manifest.chunks)) {
+            referenced.insert(ChunkManifest::chunkPath(chunk.digest));
+        }
+    }
+
+    int removed = 0;
+    qint64 freed = 0;
+    QDirIterator chunks(ChunkStoreProtocol::chunkDir(), QDir::Files, QDirIterator::Subdirectories);
+    while (chunks.hasNext()) {
+        const QString path = chunks.next();
+        if (referenced.contains(path) || chunks.fileName() == QLatin1String(".lock")) {
+            continue;
+        }
+
+        const qint64 size = chunks.fileInfo().size();
+        if (QFile::remove(path)) {
+            removed++;
+            freed += size;
+        }
+    }
+
+    m_out << "Freed " << freed << " bytes from " << removed << " unreferenced chunks\n";
+    return true;
+}
+
+qint64 ChunkStore::cutPoint(const uchar *data, qint64 length)
+{
+    if (length <= MinChunkSize) {
+        return length;
+    }
+
+    const std::array<quint64, 256> &gear = gearTable();
+    const qint64 normal = qMin(AverageChunkSize, length);
+    const qint64 limit = qMin(MaxChunkSize, length);
+    quint64 hash = 0;
+
+    // Nothing before the minimum size can be a cut point, so it isn't hashed.
+    qint64 i = MinChunkSize;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & MaskSmall)) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & MaskLarge)) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QTextStream>
+
+#include "chunkmanifest.h"
+
+// Content-defined chunking store for backup images. Consecutive backups of
+// a slot are mostly the same SquashFS blocks; cutting images where their
+// content says so (a gear rolling hash, as in FastCDC) rather than at fixed
+// offsets keeps those blocks in identical chunks even when data before them
+// moved, so each is stored only once.
+class ChunkStore
+{
+public:
+    static constexpr qint64 MinChunkSize = 16 * 1024;
+    static constexpr qint64 AverageChunkSize = 64 * 1024;
+    static constexpr qint64 MaxChunkSize = 256 * 1024;
+
+    explicit ChunkStore(QTextStream &out);
+
+    // Splits every .sfs under stagingDir into the store, leaving a manifest
+    // (and the image's sidecar) in slotDir in its place. stagingDir is
+    // removed afterwards, whether that worked or not.
+    bool ingest(const QString &stagingDir, const QString &slotDir);
+    // Removes the staging directory of a backup that never got ingested.
+    bool discard(const QString &stagingDir);
+    // Reassembles the image a manifest describes, checking every chunk.
+    bool materialize(const QString &manifestPath, const QString &outputPath);
+    // Removes chunks no manifest under the backup root refers to.
+    bool collectGarbage();
+
+private:
+    bool ingestImages(const QString &stagingDir, const QString &slotDir);
+    bool ingestImage(const QString &imagePath, const QString &slotDir);
+    bool writeChunk(const QByteArray &digest, const char *data, qint64 length, bool *written);
+
+    static qint64 cutPoint(const uchar *data, qint64 length);
+
+    QTextStream &m_out;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QString>
+
+// Paths shared by the KCM, the privileged helper and the chunk store tool.
+namespace ChunkStoreProtocol
+{
+
+inline QString program()
+{
+    return QStringLiteral(KCM_OBSIDIANOS_LIBEXECDIR "/kcm_obsidianos_chunkstore");
+}
+
+inline QString backupRoot()
+{
+    return QStringLiteral("/var/backups/obsidianctl");
+}
+
+inline QString chunkDir()
+{
+    return backupRoot() + QStringLiteral("/chunks");
+}
+
+// New backups are written here before being split into chunks, each into
+// its own subdirectory so one that failed is never taken for the next.
+inline QString ingestDir()
+{
+    return backupRoot() + QStringLiteral("/.staging/ingest");
+}
+
+// The staging subdirectory of a backup of slot started at time (ms since
+// the epoch).
+inline QString ingestDir(const QString &slot, qint64 time)
+{
+    return ingestDir() + QStringLiteral("/%1-%2").arg(slot).arg(time);
+}
+
+// Deduplicated backups are reassembled here for a rollback.
+inline QString restoreDir()
+{
+    return backupRoot() + QStringLiteral("/.staging/restore");
+}
+
+inline QString manifestSuffix()
+{
+    return QStringLiteral(".manifest");
+}
+
+}
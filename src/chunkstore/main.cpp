@@ -0,0 +1,34 @@
+#include "chunkstore.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QTextStream out(stdout);
+    const QStringList args = app.arguments().mid(1);
+    const QString command = args.value(0);
+    ChunkStore store(out);
+
+    bool ok = false;
+    if (command == QStringLiteral("ingest") && args.count() == 3) {
+        ok = store.ingest(args.at(1), args.at(2));
+    } else if (command == QStringLiteral("discard") && args.count() == 2) {
+        ok = store.discard(args.at(1));
+    } else if (command == QStringLiteral("materialize") && args.count() == 3) {
+        ok = store.materialize(args.at(1), args.at(2));
+    } else if (command == QStringLiteral("gc") && args.count() == 1) {
+        ok = store.collectGarbage();
+    } else {
+        out << "Usage: kcm_obsidianos_chunkstore ingest <staging dir> <slot dir>\n"
+               "       kcm_obsidianos_chunkstore discard <staging dir>\n"
+               "       kcm_obsidianos_chunkstore materialize <manifest> <image>\n"
+               "       kcm_obsidianos_chunkstore gc\n";
+        return 2;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QString>
+
+namespace HelperProtocol
+{
+
+inline QString service()
+{
+    return QStringLiteral("org.obsidianos.kcm.helper");
+}
+
+inline QString path()
+{
+    return QStringLiteral("/Helper");
+}
+
+inline QString interface()
+{
+    return QStringLiteral("org.obsidianos.kcm.Helper");
+}
+
+inline QString action()
+{
+    return QStringLiteral("org.obsidianos.kcm.helper.execute");
+}
+
+inline QString notAuthorizedError()
+{
+    return QStringLiteral("org.obsidianos.kcm.Error.NotAuthorized");
+}
+
+}
@@ -0,0 +1,26 @@
+#include "helperprotocol.h"
+#include "privilegedhelper.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMetaType>
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    qDBusRegisterMetaType<QList<QStringList>>();
+
+    PrivilegedHelper helper;
+
+    QDBusConnection bus = QDBusConnection::systemBus();
+    if (!bus.registerObject(HelperProtocol::path(), &helper, QDBusConnection::ExportAllSlots)) {
+        return 1;
+    }
+
+    if (!bus.registerService(HelperProtocol::service())) {
+        return 1;
+    }
+
+    return app.exec();
+}
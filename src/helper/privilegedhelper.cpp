@@ -0,0 +1,383 @@
+#include "privilegedhelper.h"
+#include "helperprotocol.h"
+#include "../chunkstore/chunkstoreprotocol.h"
+#include "../slottool/slottoolprotocol.h"
+
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QDBusServiceWatcher>
+#include <QDir>
+#include <QMap>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+namespace
+{
+
+constexpr int IdleTimeout = 5 * 60 * 1000;
+constexpr int AuthorizationTimeout = 10 * 60 * 1000;
+
+bool isBackupFile(const QString &path)
+{
+    const QString root = QStringLiteral("/var/backups/obsidianctl/");
+
+    if (!QDir::isAbsolutePath(path) || QDir::cleanPath(path) != path || !path.startsWith(root)) {
+        return false;
+    }
+
+    return path.endsWith(QStringLiteral(".sfs")) || path.endsWith(QStringLiteral(".json"))
+        || path.endsWith(ChunkStoreProtocol::manifestSuffix());
+}
+
+bool isSlotBackupDir(const QString &path)
+{
+    static const QRegularExpression slotDir(QStringLiteral("^/var/backups/obsidianctl/slot_[a-z]$"));
+    return slotDir.match(path).hasMatch();
+}
+
+// A backup's own directory in the staging area, never the area itself.
+bool isIngestDir(const QString &path)
+{
+    static const QRegularExpression ingestDir(QStringLiteral("^%1/[a-z]-\\d+$").arg(QRegularExpression::escape(ChunkStoreProtocol::ingestDir())));
+    return ingestDir.match(path).hasMatch();
+}
+
+bool validateChunkStore(const QStringList &args, QString *error)
+{
+    const QString command = args.value(0);
+
+    if (command == QStringLiteral("gc") && args.count() == 1) {
+        return true;
+    }
+
+    if (command == QStringLiteral("ingest") && args.count() == 3) {
+        if (isIngestDir(args.at(1)) && isSlotBackupDir(args.at(2))) {
+            return true;
+        }
+        *error = QStringLiteral("Refusing to ingest into %1.").arg(args.at(2));
+        return false;
+    }
+
+    if (command == QStringLiteral("discard") && args.count() == 2) {
+        if (isIngestDir(args.at(1))) {
+            return true;
+        }
+        *error = QStringLiteral("Refusing to discard %1.").arg(args.at(1));
+        return false;
+    }
+
+    if (command == QStringLiteral("materialize") && args.count() == 3) {
+        const QString &output = args.at(2);
+        if (isBackupFile(args.at(1)) && args.at(1).endsWith(ChunkStoreProtocol::manifestSuffix())
+            && QDir::cleanPath(output) == output && output.startsWith(ChunkStoreProtocol::restoreDir() + QLatin1Char('/'))
+            && output.endsWith(QStringLiteral(".sfs"))) {
+            return true;
+        }
+        *error = QStringLiteral("Refusing to materialize %1 to %2.").arg(args.at(1), output);
+        return false;
+    }
+
+    *error = QStringLiteral("Unknown chunk store command: %1").arg(command);
+    return false;
+}
+
+}
+
+PrivilegedHelper::PrivilegedHelper(QObject *parent)
+    : QObject(parent)
+    , m_nextId(1)
+    , m_clientWatcher(new QDBusServiceWatcher(this))
+{
+    m_clientWatcher->setConnection(QDBusConnection::systemBus());
+    m_clientWatcher->setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+
+    // Unique bus names are never reused, so dropping the cache entry when the
+    // client disconnects is enough to scope an authorization to one session.
+    // Jobs already running are left to complete rather than killed half-way.
+    connect(m_clientWatcher, &QDBusServiceWatcher::serviceUnregistered, this, [this](const QString &service) {
+        m_authorizedClients.remove(service);
+        m_clientWatcher->removeWatchedService(service);
+    });
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(IdleTimeout);
+    connect(&m_idleTimer, &QTimer::timeout, qApp, &QCoreApplication::quit);
+    updateIdleTimer();
+}
+
+PrivilegedHelper::~PrivilegedHelper()
+{
+}
+
+uint PrivilegedHelper::Execute(const QList<QStringList> &commands)
+{
+    if (commands.isEmpty()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("No commands given."));
+        return 0;
+    }
+
+    for (const QStringList &argv : commands) {
+        QString error;
+        if (!validate(argv, &error)) {
+            sendErrorReply(QDBusError::InvalidArgs, error);
+            return 0;
+        }
+    }
+
+    const QString sender = message().service();
+    if (m_authorizedClients.contains(sender)) {
+        const uint id = createJob(sender, commands);
+        // Start after the reply went out so the client knows the id before
+        // the first Output signal arrives.
+        QTimer::singleShot(0, this, [this, id]() {
+            startStep(id);
+        });
+        return id;
+    }
+
+    setDelayedReply(true);
+    checkAuthorization(message(), commands);
+    return 0;
+}
+
+void PrivilegedHelper::Cancel(uint id)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end() || it->owner != message().service()) {
+        return;
+    }
+
+    if (it->process) {
+        it->process->kill();
+    } else {
+        finishJob(id, -1);
+    }
+}
+
+bool PrivilegedHelper::validate(const QStringList &argv, QString *error) const
+{
+    if (argv.isEmpty()) {
+        *error = QStringLiteral("Empty command line.");
+        return false;
+    }
+
+    const QString &program = argv.constFirst();
+
+    if (program == QStringLiteral("obsidianctl")) {
+        return true;
+    }
+
+    if (program == ChunkStoreProtocol::program()) {
+        return validateChunkStore(argv.mid(1), error);
+    }
+
+    if (program == SlotToolProtocol::program()) {
+        static const QRegularExpression arguments(QStringLiteral("^(packages [a-z]( --since \\d+)?|(sync|health) [a-z]|verify [a-z]( --record)?( --idle)?( --limit \\d+)?|[a-z])$"));
+        const QStringList slotArgs = argv.mid(1);
+        const bool separate = std::none_of(slotArgs.cbegin(), slotArgs.cend(), [](const QString &arg) {
+            return arg.contains(QLatin1Char(' '));
+        });
+        if (separate && arguments.match(slotArgs.join(QLatin1Char(' '))).hasMatch()) {
+            return true;
+        }
+        // Without a mode word the tool compares the slots.
+        static const QStringList modes = {QStringLiteral("packages"), QStringLiteral("sync"), QStringLiteral("health"), QStringLiteral("verify")};
+        const QString mode = modes.contains(slotArgs.value(0)) ? slotArgs.constFirst() : QStringLiteral("diff");
+        *error = QStringLiteral("Refusing to run the slot tool's %1 mode with \"%2\".").arg(mode, slotArgs.join(QLatin1Char(' ')));
+        return false;
+    }
+
+    if (program == QStringLiteral("rm")) {
+        bool hasPath = false;
+        for (const QString &arg : argv.mid(1)) {
+            if (!hasPath && (arg == QStringLiteral("-f") || arg == QStringLiteral("-v"))) {
+                continue;
+            }
+
+            hasPath = true;
+            if (!isBackupFile(arg)) {
+                *error = QStringLiteral("Refusing to remove %1: not a backup file.").arg(arg);
+                return false;
+            }
+        }
+
+        if (!hasPath) {
+            *error = QStringLiteral("No files to remove.");
+            return false;
+        }
+        return true;
+    }
+
+    *error = QStringLiteral("Command not allowed: %1").arg(program);
+    return false;
+}
+
+void PrivilegedHelper::checkAuthorization(const QDBusMessage &message, const QList<QStringList> &commands)
+{
+    QDBusArgument subject;
+    subject.beginStructure();
+    subject << QStringLiteral("system-bus-name");
+    subject << QVariantMap{{QStringLiteral("name"), message.service()}};
+    subject.endStructure();
+
+    QDBusArgument details;
+    details.beginMap(QMetaType::fromType<QString>(), QMetaType::fromType<QString>());
+    details.endMap();
+
+    const uint allowUserInteraction = 1;
+
+    QDBusMessage check = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.PolicyKit1"),
+                                                        QStringLiteral("/org/freedesktop/PolicyKit1/Authority"),
+                                                        QStringLiteral("org.freedesktop.PolicyKit1.Authority"),
+                                                        QStringLiteral("CheckAuthorization"));
+    check << QVariant::fromValue(subject) << HelperProtocol::action() << QVariant::fromValue(details)
+          << allowUserInteraction << QString();
+
+    m_idleTimer.stop();
+
+    auto *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(check, AuthorizationTimeout), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, message, commands](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+
+        bool authorized = false;
+        const QDBusMessage reply = watcher->reply();
+        if (reply.type() == QDBusMessage::ReplyMessage && !reply.arguments().isEmpty()) {
+            bool challenge = false;
+            QMap<QString, QString> resultDetails;
+
+            const QDBusArgument result = reply.arguments().constFirst().value<QDBusArgument>();
+            result.beginStructure();
+            result >> authorized >> challenge >> resultDetails;
+            result.endStructure();
+        }
+
+        if (!authorized) {
+            QDBusConnection::systemBus().send(message.createErrorReply(HelperProtocol::notAuthorizedError(),
+                                                                       QStringLiteral("Not authorized.")));
+            updateIdleTimer();
+            return;
+        }
+
+        const QString sender = message.service();
+        m_authorizedClients.insert(sender);
+        m_clientWatcher->addWatchedService(sender);
+
+        const uint id = createJob(sender, commands);
+        QDBusConnection::systemBus().send(message.createReply(QVariant(id)));
+        startStep(id);
+    });
+}
+
+uint PrivilegedHelper::createJob(const QString &owner, const QList<QStringList> &commands)
+{
+    Job job;
+    job.owner = owner;
+    job.commands = commands;
+
+    const uint id = m_nextId++;
+    m_jobs.insert(id, job);
+    updateIdleTimer();
+    return id;
+}
+
+void PrivilegedHelper::startStep(uint id)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
+
+    const QStringList argv = it->commands.at(it->step);
+    const QString program = QStandardPaths::findExecutable(argv.constFirst());
+    if (program.isEmpty()) {
+        sendToOwner(it->owner, QStringLiteral("Output"),
+                    {QVariant(id), QVariant(QStringLiteral("%1: command not found\n").arg(argv.constFirst()).toUtf8())});
+        finishJob(id, 127);
+        return;
+    }
+
+    QProcess *process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::MergedChannels);
+    it->process = process;
+
+    connect(process, &QProcess::readyReadStandardOutput, this, [this, id, process]() {
+        const QByteArray data = process->readAllStandardOutput();
+        auto it = m_jobs.constFind(id);
+        if (!data.isEmpty() && it != m_jobs.constEnd()) {
+            sendToOwner(it->owner, QStringLiteral("Output"), {QVariant(id), QVariant(data)});
+        }
+    });
+
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, id, process](int exitCode, QProcess::ExitStatus exitStatus) {
+        process->deleteLater();
+
+        auto it = m_jobs.find(id);
+        if (it == m_jobs.end()) {
+            return;
+        }
+
+        const QByteArray data = process->readAllStandardOutput();
+        if (!data.isEmpty()) {
+            sendToOwner(it->owner, QStringLiteral("Output"), {QVariant(id), QVariant(data)});
+        }
+        it->process = nullptr;
+
+        if (exitStatus == QProcess::CrashExit) {
+            finishJob(id, -1);
+        } else if (exitCode == 0 && it->step + 1 < it->commands.count()) {
+            it->step++;
+            startStep(id);
+        } else {
+            finishJob(id, exitCode);
+        }
+    });
+
+    connect(process, &QProcess::errorOccurred, this, [this, id, process](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) {
+            return;
+        }
+
+        process->deleteLater();
+        auto it = m_jobs.find(id);
+        if (it != m_jobs.end()) {
+            it->process = nullptr;
+            finishJob(id, 127);
+        }
+    });
+
+    process->start(program, argv.mid(1));
+}
+
+void PrivilegedHelper::finishJob(uint id, int exitCode)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
+
+    sendToOwner(it->owner, QStringLiteral("Finished"), {QVariant(id), QVariant(exitCode)});
+    m_jobs.erase(it);
+    updateIdleTimer();
+}
+
+void PrivilegedHelper::sendToOwner(const QString &owner, const QString &signal, const QVariantList &arguments)
+{
+    QDBusMessage message = QDBusMessage::createTargetedSignal(owner, HelperProtocol::path(), HelperProtocol::interface(), signal);
+    message.setArguments(arguments);
+    QDBusConnection::systemBus().send(message);
+}
+
+void PrivilegedHelper::updateIdleTimer()
+{
+    if (m_jobs.isEmpty()) {
+        m_idleTimer.start();
+    } else {
+        m_idleTimer.stop();
+    }
+}
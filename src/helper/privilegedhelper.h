@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QDBusContext>
+#include <QDBusMessage>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+class QDBusServiceWatcher;
+class QProcess;
+
+class PrivilegedHelper : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.obsidianos.kcm.Helper")
+
+public:
+    explicit PrivilegedHelper(QObject *parent = nullptr);
+    ~PrivilegedHelper() override;
+
+public Q_SLOTS:
+    // Runs the command lines in order, stopping at the first failure. Returns
+    // a job id; progress arrives as Output/Finished signals sent to the caller.
+    uint Execute(const QList<QStringList> &commands);
+    void Cancel(uint id);
+
+private:
+    struct Job {
+        QString owner;
+        QList<QStringList> commands;
+        int step = 0;
+        QProcess *process = nullptr;
+    };
+
+    bool validate(const QStringList &argv, QString *error) const;
+    void checkAuthorization(const QDBusMessage &message, const QList<QStringList> &commands);
+    uint createJob(const QString &owner, const QList<QStringList> &commands);
+    void startStep(uint id);
+    void finishJob(uint id, int exitCode);
+    void sendToOwner(const QString &owner, const QString &signal, const QVariantList &arguments);
+    void updateIdleTimer();
+
+    uint m_nextId;
+    QHash<uint, Job> m_jobs;
+    QSet<QString> m_authorizedClients;
+    QDBusServiceWatcher *m_clientWatcher;
+    QTimer m_idleTimer;
+};
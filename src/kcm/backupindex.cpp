@@ -0,0 +1,146 @@
+#include "backupindex.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace
+{
+
+constexpr quint32 IndexMagic = 0x4f424958; // "OBIX"
+// Bump when the entry layout changes; older files are simply rebuilt.
+constexpr quint32 IndexVersion = 3;
+
+}
+
+BackupIndex::BackupIndex(const QString &root)
+    : m_root(root)
+    , m_dirty(false)
+{
+    QString name = root;
+    name.replace(QLatin1Char('/'), QLatin1Char('_'));
+    m_indexPath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                  + QStringLiteral("/kcm_obsidianos/backup-index") + name + QStringLiteral(".bin");
+}
+
+bool BackupIndex::load()
+{
+    m_entries.clear();
+    m_dirty = false;
+
+    QFile file(m_indexPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString root;
+    quint32 count = 0;
+    in >> magic >> version >> root >> count;
+    if (magic != IndexMagic || version != IndexVersion || root != m_root) {
+        return false;
+    }
+
+    m_entries.reserve(count);
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        BackupInfo backup;
+        qint64 modified = 0;
+        qint64 created = 0;
+        in >> backup.path >> backup.slot >> modified >> backup.size >> backup.isFullBackup
+           >> backup.compressor >> backup.checksum >> backup.sourceVersion >> backup.metadataModified
+           >> backup.blockSize >> backup.inodeCount >> created >> backup.uncompressedSize >> backup.imageError
+           >> backup.deduplicated >> backup.imageSize;
+        backup.timestamp = QDateTime::fromMSecsSinceEpoch(modified);
+        if (created > 0) {
+            backup.created = QDateTime::fromSecsSinceEpoch(created);
+        }
+        m_entries.insert(backup.path, backup);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        m_entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool BackupIndex::save()
+{
+    if (!m_dirty) {
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(m_indexPath).absolutePath());
+
+    QSaveFile file(m_indexPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << IndexMagic << IndexVersion << m_root << quint32(m_entries.count());
+    for (const BackupInfo &backup : std::as_const(m_entries)) {
+        out << backup.path << backup.slot << backup.timestamp.toMSecsSinceEpoch() << backup.size << backup.isFullBackup
+            << backup.compressor << backup.checksum << backup.sourceVersion << backup.metadataModified
+            << backup.blockSize << backup.inodeCount << (backup.created.isValid() ? backup.created.toSecsSinceEpoch() : qint64(0))
+            << backup.uncompressedSize << backup.imageError << backup.deduplicated << backup.imageSize;
+    }
+
+    if (!file.commit()) {
+        return false;
+    }
+    m_dirty = false;
+    return true;
+}
+
+bool BackupIndex::lookup(BackupInfo *backup) const
+{
+    auto it = m_entries.constFind(backup->path);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+
+    const BackupInfo &entry = it.value();
+    if (entry.timestamp != backup->timestamp || entry.size != backup->size
+        || entry.metadataModified != backup->metadataModified) {
+        return false;
+    }
+
+    backup->isFullBackup = entry.isFullBackup;
+    backup->compressor = entry.compressor;
+    backup->checksum = entry.checksum;
+    backup->sourceVersion = entry.sourceVersion;
+    backup->blockSize = entry.blockSize;
+    backup->inodeCount = entry.inodeCount;
+    backup->created = entry.created;
+    backup->uncompressedSize = entry.uncompressedSize;
+    backup->imageError = entry.imageError;
+    backup->imageSize = entry.imageSize;
+    return true;
+}
+
+void BackupIndex::insert(const BackupInfo &backup)
+{
+    m_entries.insert(backup.path, backup);
+    m_dirty = true;
+}
+
+void BackupIndex::retain(const QSet<QString> &paths)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (paths.contains(it.key())) {
+            ++it;
+        } else {
+            it = m_entries.erase(it);
+            m_dirty = true;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include "backupinfo.h"
+
+// Catalogue of everything known about the backups in one root, kept in the
+// user's cache dir because the roots themselves are root-owned. One read
+// restores the metadata of every backup; an entry is only trusted while the
+// image's and sidecar's stamps still match it, otherwise the sidecar is read
+// again and the entry replaced.
+class BackupIndex
+{
+public:
+    explicit BackupIndex(const QString &root);
+
+    bool load();
+    bool save();
+
+    // Fills in the metadata of backup if the index has an entry with the
+    // same stamps.
+    bool lookup(BackupInfo *backup) const;
+    void insert(const BackupInfo &backup);
+    // Drops entries for images that no longer exist.
+    void retain(const QSet<QString> &paths);
+
+private:
+    QString m_root;
+    QString m_indexPath;
+    QHash<QString, BackupInfo> m_entries;
+    bool m_dirty;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QDateTime>
+#include <QString>
+
+struct BackupInfo {
+    QString path;
+    QString slot;
+    QDateTime timestamp;
+    qint64 size;
+    bool isFullBackup;
+    // A chunk store manifest rather than a .sfs. size is then the
+    // manifest's and imageSize that of the image it reassembles to.
+    bool deduplicated = false;
+    qint64 imageSize = -1;
+    QString compressor;
+    QString checksum;
+    QString sourceVersion;
+    // From the image's own superblock; see SquashfsImage.
+    quint32 blockSize = 0;
+    quint32 inodeCount = 0;
+    QDateTime created;
+    qint64 uncompressedSize = -1;
+    // Empty while the image's structure checks out.
+    QString imageError;
+    // Modification time of the .json sidecar in ms since epoch, -1 without one.
+    // Together with timestamp and size it tells whether an entry changed.
+    qint64 metadataModified = -1;
+};
@@ -1,10 +1,32 @@
 #include "backupmanager.h"
+#include "backupscanner.h"
+#include "retentionpolicy.h"
+#include "../chunkstore/chunkstoreprotocol.h"
+
+#include <KConfigGroup>
+#include <KSharedConfig>
 
 #include <QDir>
-#include <QFile>
 #include <QFileInfo>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QFileSystemWatcher>
+#include <QLocale>
+#include <QSet>
+#include <QStorageInfo>
+#include <QThread>
+
+namespace
+{
+
+constexpr qsizetype CleanupPathsPerCommand = 256;
+
+// The metadata obsidianctl writes next to a backup image.
+QString sidecarPath(const QString &image)
+{
+    const QFileInfo info(image);
+    return info.absolutePath() + QStringLiteral("/") + info.completeBaseName() + QStringLiteral(".json");
+}
+
+}
 
 BackupModel::BackupModel(QObject *parent)
     : QAbstractListModel(parent)
@@ -37,9 +59,37 @@ QVariant BackupModel::data(const QModelIndex &index, int role) const
     case SizeRole:
         return backup.size;
     case SizeStringRole:
-        return formatSize(backup.size);
+        return formatSize(backup.deduplicated ? qMax<qint64>(backup.imageSize, 0) : backup.size);
     case IsFullBackupRole:
         return backup.isFullBackup;
+    case DeduplicatedRole:
+        return backup.deduplicated;
+    case CompressorRole:
+        return backup.compressor;
+    case ChecksumRole:
+        return backup.checksum;
+    case SourceVersionRole:
+        return backup.sourceVersion;
+    case VerifyStateRole:
+        return stateName(m_verification.value(backup.path).state);
+    case VerifiedAtRole:
+        return m_verification.value(backup.path).verifiedAt;
+    case VerifyProgressRole: {
+        const BackupVerifier::Result result = m_verification.value(backup.path);
+        return backup.size > 0 ? double(result.bytesDone) / backup.size : 0.0;
+    }
+    case VerifyThroughputRole:
+        return m_verification.value(backup.path).throughput;
+    case BlockSizeRole:
+        return backup.blockSize;
+    case InodeCountRole:
+        return backup.inodeCount;
+    case CreatedRole:
+        return backup.created;
+    case UncompressedSizeRole:
+        return backup.uncompressedSize;
+    case ImageErrorRole:
+        return backup.imageError;
     }
 
     return QVariant();
@@ -53,7 +103,20 @@ QHash<int, QByteArray> BackupModel::roleNames() const
         {TimestampRole, "timestamp"},
         {SizeRole, "size"},
         {SizeStringRole, "sizeString"},
-        {IsFullBackupRole, "isFullBackup"}
+        {IsFullBackupRole, "isFullBackup"},
+        {DeduplicatedRole, "deduplicated"},
+        {CompressorRole, "compressor"},
+        {ChecksumRole, "checksum"},
+        {SourceVersionRole, "sourceVersion"},
+        {VerifyStateRole, "verifyState"},
+        {VerifiedAtRole, "verifiedAt"},
+        {VerifyProgressRole, "verifyProgress"},
+        {VerifyThroughputRole, "verifyThroughput"},
+        {BlockSizeRole, "blockSize"},
+        {InodeCountRole, "inodeCount"},
+        {CreatedRole, "created"},
+        {UncompressedSizeRole, "uncompressedSize"},
+        {ImageErrorRole, "imageError"}
     };
 }
 
@@ -64,13 +127,99 @@ void BackupModel::setBackups(const QList<BackupInfo> &backups)
     endResetModel();
 }
 
+void BackupModel::insertBackups(QList<BackupInfo> backups)
+{
+    const auto newerFirst = [](const BackupInfo &a, const BackupInfo &b) {
+        return a.timestamp > b.timestamp;
+    };
+    std::sort(backups.begin(), backups.end(), newerFirst);
+
+    int row = 0;
+    qsizetype i = 0;
+    while (i < backups.count()) {
+        row = std::upper_bound(m_backups.begin() + row, m_backups.end(), backups.at(i), newerFirst) - m_backups.begin();
+
+        qsizetype end = i + 1;
+        while (end < backups.count() && (row == m_backups.count() || newerFirst(backups.at(end), m_backups.at(row)))) {
+            end++;
+        }
+
+        beginInsertRows(QModelIndex(), row, row + int(end - i) - 1);
+        for (qsizetype j = i; j < end; j++) {
+            m_backups.insert(row + int(j - i), backups.at(j));
+        }
+        endInsertRows();
+
+        row += int(end - i);
+        i = end;
+    }
+}
+
+void BackupModel::upsertBackups(const QList<BackupInfo> &backups)
+{
+    QList<BackupInfo> added;
+
+    for (const BackupInfo &backup : backups) {
+        const int row = indexOfPath(backup.path);
+        if (row < 0) {
+            added.append(backup);
+        } else if (m_backups.at(row).timestamp == backup.timestamp) {
+            m_backups[row] = backup;
+            Q_EMIT dataChanged(index(row), index(row));
+        } else {
+            // Its position in the newest-first order changes.
+            removeAt(row);
+            added.append(backup);
+        }
+    }
+
+    if (!added.isEmpty()) {
+        insertBackups(added);
+    }
+}
+
+void BackupModel::removePaths(const QStringList &paths)
+{
+    for (const QString &path : paths) {
+        removeAt(indexOfPath(path));
+    }
+}
+
+void BackupModel::setVerification(const QString &path, const BackupVerifier::Result &result)
+{
+    m_verification.insert(path, result);
+
+    const int row = indexOfPath(path);
+    if (row >= 0) {
+        Q_EMIT dataChanged(index(row), index(row), {VerifyStateRole, VerifiedAtRole, VerifyProgressRole, VerifyThroughputRole});
+    }
+}
+
+void BackupModel::setVerifications(const QHash<QString, BackupVerifier::Result> &results)
+{
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it) {
+        setVerification(it.key(), it.value());
+    }
+}
+
+BackupVerifier::Result BackupModel::verification(const QString &path) const
+{
+    return m_verification.value(path);
+}
+
 void BackupModel::clear()
 {
     beginResetModel();
     m_backups.clear();
+    m_verification.clear();
     endResetModel();
 }
 
+const QList<BackupInfo> &BackupModel::backups() const
+{
+    return m_backups;
+}
+
 BackupInfo BackupModel::backupAt(int index) const
 {
     if (index >= 0 && index < m_backups.count()) {
@@ -79,15 +228,45 @@ BackupInfo BackupModel::backupAt(int index) const
     return BackupInfo();
 }
 
+int BackupModel::indexOfPath(const QString &path) const
+{
+    for (int i = 0; i < m_backups.count(); i++) {
+        if (m_backups.at(i).path == path) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 void BackupModel::removeAt(int index)
 {
     if (index >= 0 && index < m_backups.count()) {
         beginRemoveRows(QModelIndex(), index, index);
+        m_verification.remove(m_backups.at(index).path);
         m_backups.removeAt(index);
         endRemoveRows();
     }
 }
 
+QString BackupModel::stateName(BackupVerifier::State state)
+{
+    switch (state) {
+    case BackupVerifier::State::Unknown:
+        break;
+    case BackupVerifier::State::Verifying:
+        return QStringLiteral("verifying");
+    case BackupVerifier::State::Verified:
+        return QStringLiteral("verified");
+    case BackupVerifier::State::Mismatch:
+        return QStringLiteral("mismatch");
+    case BackupVerifier::State::NoChecksum:
+        return QStringLiteral("nochecksum");
+    case BackupVerifier::State::Failed:
+        return QStringLiteral("failed");
+    }
+    return QStringLiteral("unknown");
+}
+
 QString BackupModel::formatSize(qint64 bytes) const
 {
     if (bytes == 0) {
@@ -106,22 +285,50 @@ QString BackupModel::formatSize(qint64 bytes) const
     return QStringLiteral("%1 %2").arg(size, 0, 'f', 1).arg(units.at(unitIndex));
 }
 
-BackupManager::BackupManager(QObject *parent)
+BackupManager::BackupManager(CommandExecutor *executor, QObject *parent)
     : QObject(parent)
     , m_model(new BackupModel(this))
-    , m_process(nullptr)
-    , m_busy(false)
-    , m_pendingDeleteIndex(-1)
+    , m_contents(new BackupTreeModel(executor, this))
+    , m_executor(executor)
+    , m_log(new LogBuffer(this))
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_scanThread(new QThread(this))
+    , m_scanner(new BackupScanner)
+    , m_scanGeneration(0)
+    , m_scanning(false)
+    , m_verifier(new BackupVerifier(this))
+    , m_benchmark(new CompressionBenchmark(executor, this))
 {
+    connect(m_executor, &CommandExecutor::jobOutput, this, &BackupManager::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &BackupManager::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &BackupManager::onJobFailed);
+
+    m_rescanTimer.setSingleShot(true);
+    m_rescanTimer.setInterval(500);
+    connect(&m_rescanTimer, &QTimer::timeout, this, &BackupManager::refreshBackups);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, &m_rescanTimer, qOverload<>(&QTimer::start));
+    watchBackupDirs();
+
+    m_scanner->moveToThread(m_scanThread);
+    connect(m_scanThread, &QThread::finished, m_scanner, &QObject::deleteLater);
+    connect(m_scanner, &BackupScanner::batchReady, this, &BackupManager::onScanBatch);
+    connect(m_scanner, &BackupScanner::finished, this, &BackupManager::onScanFinished);
+    m_scanThread->start();
+
+    connect(m_verifier, &BackupVerifier::progress, m_model, &BackupModel::setVerification);
+    connect(m_verifier, &BackupVerifier::finished, this, &BackupManager::onVerifyFinished);
+    connect(m_verifier, &BackupVerifier::activeChanged, this, &BackupManager::verifyingChanged);
+
+    connect(m_benchmark, &CompressionBenchmark::failed, this, [this](const QString &message) {
+        Q_EMIT errorOccurred(tr("Benchmark Failed"), message);
+    });
 }
 
 BackupManager::~BackupManager()
 {
-    if (m_process) {
-        m_process->kill();
-        m_process->waitForFinished();
-        delete m_process;
-    }
+    m_scanner->cancel(m_scanGeneration);
+    m_scanThread->quit();
+    m_scanThread->wait();
 }
 
 BackupModel *BackupManager::model() const
@@ -129,27 +336,247 @@ BackupModel *BackupManager::model() const
     return m_model;
 }
 
+BackupTreeModel *BackupManager::contents() const
+{
+    return m_contents;
+}
+
 bool BackupManager::busy() const
 {
-    return m_busy;
+    return !m_jobs.isEmpty();
+}
+
+bool BackupManager::scanning() const
+{
+    return m_scanning;
+}
+
+bool BackupManager::cleanupActive() const
+{
+    return m_cleanup.job != 0;
+}
+
+int BackupManager::cleanupRemoved() const
+{
+    return m_cleanup.removed;
+}
+
+int BackupManager::cleanupTotal() const
+{
+    return m_cleanup.total;
+}
+
+qint64 BackupManager::cleanupFreedBytes() const
+{
+    return m_cleanup.freedBytes;
+}
+
+bool BackupManager::verifying() const
+{
+    return m_verifier->isActive();
+}
+
+CompressionBenchmark *BackupManager::benchmark() const
+{
+    return m_benchmark;
+}
+
+QString BackupManager::compressionProfile() const
+{
+    const KConfigGroup group = KSharedConfig::openConfig(QStringLiteral("kcm_obsidianosrc"))->group(QStringLiteral("Backups"));
+    return group.readEntry("CompressionProfile", QString());
+}
+
+void BackupManager::setCompressionProfile(const QString &profile)
+{
+    if (profile == compressionProfile()) {
+        return;
+    }
+
+    KConfigGroup group = KSharedConfig::openConfig(QStringLiteral("kcm_obsidianosrc"))->group(QStringLiteral("Backups"));
+    group.writeEntry("CompressionProfile", profile);
+    group.sync();
+    Q_EMIT compressionProfileChanged();
 }
 
-QString BackupManager::output() const
+LogBuffer *BackupManager::log() const
 {
-    return m_output;
+    return m_log;
 }
 
 void BackupManager::refreshBackups()
 {
-    parseBackups();
-    Q_EMIT refreshFinished();
+    m_rescanTimer.stop();
+    watchBackupDirs();
+
+    // A newer scan supersedes whatever is still running.
+    m_scanner->cancel(m_scanGeneration);
+    const quint64 generation = ++m_scanGeneration;
+    const QStringList dirs = backupDirs();
+
+    // The scanner only reports differences against what is listed already.
+    const QList<BackupInfo> known = m_model->backups();
+    QMetaObject::invokeMethod(m_scanner, [scanner = m_scanner, generation, dirs, known]() {
+        scanner->scan(generation, dirs, known);
+    }, Qt::QueuedConnection);
+
+    if (!m_scanning) {
+        m_scanning = true;
+        Q_EMIT scanningChanged();
+    }
+}
+
+void BackupManager::cancelScan()
+{
+    if (!m_scanning) {
+        return;
+    }
+
+    m_scanner->cancel(m_scanGeneration);
+    m_scanning = false;
+    Q_EMIT scanningChanged();
+}
+
+void BackupManager::onScanBatch(quint64 generation, const QList<BackupInfo> &backups)
+{
+    if (generation != m_scanGeneration || !m_scanning) {
+        return;
+    }
+
+    m_model->upsertBackups(backups);
+    m_model->setVerifications(m_verifier->cachedResults(backups));
+}
+
+void BackupManager::onScanFinished(quint64 generation, bool cancelled, const QStringList &removed)
+{
+    if (generation != m_scanGeneration || !m_scanning) {
+        return;
+    }
+
+    m_model->removePaths(removed);
+    m_scanning = false;
+    Q_EMIT scanningChanged();
+
+    if (!cancelled) {
+        Q_EMIT refreshFinished();
+    }
+}
+
+void BackupManager::browseBackup(int index)
+{
+    m_contents->setImagePath(m_model->backupAt(index).path);
+}
+
+void BackupManager::extractFromBackup(const QStringList &paths, const QString &destination)
+{
+    const QString imagePath = m_contents->imagePath();
+    if (imagePath.isEmpty() || paths.isEmpty() || destination.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Error"), tr("Select the files to extract and a destination folder."));
+        return;
+    }
+
+    // Extended attributes are left out: restoring security.* ones would
+    // need root, and unsquashfs gives up on the first it can't set. The
+    // paths are names, not patterns, however many * and [ they contain.
+    CommandExecutor::Job job;
+    job.program = QStringLiteral("unsquashfs");
+    job.arguments << QStringLiteral("-f") << QStringLiteral("-no-progress") << QStringLiteral("-no-xattrs") << QStringLiteral("-no-wildcards")
+                  << QStringLiteral("-d") << destination << imagePath << paths;
+    job.privileged = false;
+    job.resources << QStringLiteral("backup:%1").arg(imagePath);
+
+    const quint64 id = submit(Operation::Extract, job);
+    m_pendingExtracts.insert(id, destination);
+}
+
+void BackupManager::verifyBackup(int index)
+{
+    const BackupInfo backup = m_model->backupAt(index);
+    if (backup.path.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Error"), tr("Invalid backup selection."));
+        return;
+    }
+
+    m_verifyRequested.insert(backup.path);
+    m_verifier->verify({backup}, true);
+}
+
+void BackupManager::verifyAllBackups()
+{
+    m_verifier->verify(m_model->backups());
+}
+
+void BackupManager::cancelVerification()
+{
+    m_verifier->cancel();
+}
+
+void BackupManager::onVerifyFinished(const QString &path, const BackupVerifier::Result &result)
+{
+    m_model->setVerification(path, result);
+    if (!m_verifyRequested.remove(path)) {
+        return;
+    }
+
+    const QString name = QFileInfo(path).fileName();
+    switch (result.state) {
+    case BackupVerifier::State::Verified:
+        Q_EMIT operationSucceeded(tr("Backup Verified"), tr("%1 matches its checksum (%2/s).")
+                                      .arg(name, QLocale().formattedDataSize(qint64(result.throughput))));
+        break;
+    case BackupVerifier::State::Mismatch:
+        Q_EMIT errorOccurred(tr("Backup Corrupted"), tr("%1 does not match the checksum recorded when it was created.").arg(name));
+        break;
+    case BackupVerifier::State::NoChecksum:
+        Q_EMIT errorOccurred(tr("Cannot Verify Backup"), tr("%1 has no checksum to compare against.").arg(name));
+        break;
+    case BackupVerifier::State::Failed:
+        Q_EMIT errorOccurred(tr("Cannot Verify Backup"), tr("%1 could not be read.").arg(name));
+        break;
+    case BackupVerifier::State::Unknown:
+    case BackupVerifier::State::Verifying:
+        break;
+    }
 }
 
-void BackupManager::createBackup(const QString &slot, const QString &customDir, bool fullBackup)
+void BackupManager::benchmarkCompression(const QString &slot)
+{
+    // The other slot isn't mounted, but both run the same system, so the
+    // running one's files compress alike.
+    m_benchmark->start(QStringLiteral("/usr"), slotDataSize(slot));
+}
+
+void BackupManager::cancelBenchmark()
+{
+    m_benchmark->cancel();
+}
+
+void BackupManager::createBackup(const QString &slot, const QString &customDir, bool fullBackup, bool deduplicate)
 {
     QStringList args;
     args << slot;
 
+    if (deduplicate) {
+        // The image is written to the staging area and then split into the
+        // chunk store, leaving a manifest in the slot's backup directory.
+        const QString staging = ChunkStoreProtocol::ingestDir(slot, QDateTime::currentMSecsSinceEpoch());
+        args << QStringLiteral("--backup-dir") << staging;
+        if (fullBackup) {
+            args << QStringLiteral("--full-backup");
+        }
+
+        CommandExecutor::Job job;
+        job.batch << (QStringList() << QStringLiteral("obsidianctl") << QStringLiteral("backup-slot") << args)
+                  << QStringList{ChunkStoreProtocol::program(), QStringLiteral("ingest"), staging,
+                                 ChunkStoreProtocol::backupRoot() + QStringLiteral("/slot_") + slot};
+        job.resources << QStringLiteral("slot:%1").arg(slot) << QStringLiteral("chunkstore");
+        const quint64 id = submit(Operation::Create, job);
+        // The ingest clears the staging directory itself, but never runs if
+        // obsidianctl failed.
+        m_pendingStaging.insert(id, {ChunkStoreProtocol::program(), QStringLiteral("discard"), staging});
+        return;
+    }
+
     if (!customDir.isEmpty()) {
         args << QStringLiteral("--backup-dir") << customDir;
     }
@@ -158,8 +585,9 @@ void BackupManager::createBackup(const QString &slot, const QString &customDir,
         args << QStringLiteral("--full-backup");
     }
 
-    m_currentOperation = QStringLiteral("create");
-    startProcess(QStringLiteral("backup-slot"), args);
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("backup-slot"), args);
+    job.resources << QStringLiteral("slot:%1").arg(slot);
+    submit(Operation::Create, job);
 }
 
 void BackupManager::restoreBackup(int index, const QString &targetSlot)
@@ -170,11 +598,40 @@ void BackupManager::restoreBackup(int index, const QString &targetSlot)
         return;
     }
 
+    // Better refused here than found out halfway through the rollback.
+    if (m_model->verification(backup.path).state == BackupVerifier::State::Mismatch) {
+        Q_EMIT errorOccurred(tr("Backup Corrupted"),
+                             tr("%1 failed verification and cannot be restored.").arg(QFileInfo(backup.path).fileName()));
+        return;
+    }
+    if (!backup.imageError.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Backup Damaged"), tr("%1 cannot be restored: %2").arg(QFileInfo(backup.path).fileName(), backup.imageError));
+        return;
+    }
+
+    if (backup.deduplicated) {
+        // rollback-slot needs a real image, so reassemble one first. It is
+        // dropped afterwards by a job of its own, since the batch stops at a
+        // failed rollback.
+        const QString image = ChunkStoreProtocol::restoreDir() + QLatin1Char('/') + QFileInfo(backup.path).completeBaseName()
+                              + QStringLiteral(".sfs");
+
+        CommandExecutor::Job job;
+        job.batch << QStringList{ChunkStoreProtocol::program(), QStringLiteral("materialize"), backup.path, image}
+                  << QStringList{QStringLiteral("obsidianctl"), QStringLiteral("rollback-slot"), targetSlot, image};
+        job.resources << QStringLiteral("slot:%1").arg(targetSlot) << QStringLiteral("backup:%1").arg(backup.path)
+                      << QStringLiteral("chunkstore");
+        const quint64 id = submit(Operation::Restore, job);
+        m_pendingStaging.insert(id, {QStringLiteral("rm"), QStringLiteral("-f"), image});
+        return;
+    }
+
     QStringList args;
     args << targetSlot << backup.path;
 
-    m_currentOperation = QStringLiteral("restore");
-    startProcess(QStringLiteral("rollback-slot"), args);
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("rollback-slot"), args);
+    job.resources << QStringLiteral("slot:%1").arg(targetSlot) << QStringLiteral("backup:%1").arg(backup.path);
+    submit(Operation::Restore, job);
 }
 
 void BackupManager::deleteBackup(int index)
@@ -185,110 +642,145 @@ void BackupManager::deleteBackup(int index)
         return;
     }
 
-    if (m_busy) {
-        return;
+    for (const QString &path : std::as_const(m_pendingDeletes)) {
+        if (path == backup.path) {
+            return;
+        }
     }
 
-    m_pendingDeleteIndex = index;
-    m_currentOperation = QStringLiteral("delete");
-
-    if (m_process) {
-        m_process->disconnect();
-        m_process->kill();
-        m_process->waitForFinished(1000);
-        delete m_process;
-        m_process = nullptr;
+    CommandExecutor::Job job;
+    job.program = QStringLiteral("rm");
+    job.arguments << QStringLiteral("-f") << backup.path;
+    if (backup.metadataModified >= 0) {
+        job.arguments << sidecarPath(backup.path);
+    }
+    job.resources << QStringLiteral("backup:%1").arg(backup.path);
+    if (backup.deduplicated) {
+        // Frees whatever chunks only this backup used.
+        job.batch << (QStringList() << job.program << job.arguments)
+                  << QStringList{ChunkStoreProtocol::program(), QStringLiteral("gc")};
+        job.resources << QStringLiteral("chunkstore");
     }
 
-    m_process = new QProcess(this);
-
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
-        Q_UNUSED(exitStatus)
+    const quint64 id = submit(Operation::Delete, job);
+    m_pendingDeletes.insert(id, backup.path);
+}
 
-        m_busy = false;
-        Q_EMIT busyChanged();
+void BackupManager::cleanupBackups(int olderThanDays)
+{
+    if (m_cleanup.job) {
+        return;
+    }
 
-        if (exitCode == 0) {
-            if (m_pendingDeleteIndex >= 0) {
-                m_model->removeAt(m_pendingDeleteIndex);
-                m_pendingDeleteIndex = -1;
-            }
-            Q_EMIT operationSucceeded(tr("Success"), tr("Backup deleted successfully!"));
-        } else {
-            QString errorOutput = QString::fromUtf8(m_process->readAllStandardError()).trimmed();
-            if (errorOutput.isEmpty()) {
-                errorOutput = tr("Failed to delete backup with exit code %1").arg(exitCode);
-            }
-            Q_EMIT errorOccurred(tr("Error"), errorOutput);
+    const QDateTime cutoffTime = QDateTime::currentDateTime().addDays(-olderThanDays);
+    QList<BackupInfo> backups;
+    for (const BackupInfo &backup : m_model->backups()) {
+        if (backup.timestamp < cutoffTime) {
+            backups << backup;
         }
+    }
 
-        m_currentOperation.clear();
-        m_pendingDeleteIndex = -1;
-
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
-        }
-    });
+    if (!startCleanup(backups)) {
+        Q_EMIT operationSucceeded(tr("Cleanup Complete"), tr("No backups older than %1 days.").arg(olderThanDays));
+    }
+}
 
-    connect(m_process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
-        m_busy = false;
-        Q_EMIT busyChanged();
+const RetentionPolicy::ChunkUsage &BackupManager::chunkUsage() const
+{
+    // Reading every manifest takes a moment, too long to repeat while the
+    // rules are being edited.
+    const QList<BackupInfo> &backups = m_model->backups();
+    if (!m_chunkUsage.isCurrent(backups)) {
+        m_chunkUsage = RetentionPolicy::ChunkUsage::load(backups);
+    }
+    return m_chunkUsage;
+}
 
-        QString errorMsg;
-        switch (error) {
-            case QProcess::FailedToStart:
-                errorMsg = tr("Failed to start process. Make sure pkexec is installed.");
-                break;
-            case QProcess::Crashed:
-                errorMsg = tr("Process crashed.");
-                break;
-            default:
-                errorMsg = tr("Unknown process error occurred.");
-                break;
-        }
-        Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        m_currentOperation.clear();
-        m_pendingDeleteIndex = -1;
+QVariantMap BackupManager::planRetention(const QVariantMap &rules) const
+{
+    const RetentionPolicy::Plan plan = RetentionPolicy::plan(m_model->backups(), RetentionPolicy::rulesFromMap(rules),
+                                                             backupStorageFree(), chunkUsage());
 
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
-        }
-    });
+    QStringList paths;
+    paths.reserve(plan.remove.count());
+    for (const BackupInfo &backup : plan.remove) {
+        paths << backup.path;
+    }
 
-    m_busy = true;
-    Q_EMIT busyChanged();
+    return {
+        {QStringLiteral("count"), plan.remove.count()},
+        {QStringLiteral("paths"), paths},
+        {QStringLiteral("reclaimedBytes"), plan.reclaimedBytes},
+        {QStringLiteral("reclaimed"), QLocale().formattedDataSize(plan.reclaimedBytes)},
+        {QStringLiteral("remainingBytes"), plan.remainingBytes},
+        {QStringLiteral("remaining"), QLocale().formattedDataSize(plan.remainingBytes)},
+        {QStringLiteral("budgetMet"), plan.budgetMet}
+    };
+}
 
-    m_output.clear();
-    Q_EMIT outputChanged();
+void BackupManager::applyRetention(const QVariantMap &rules)
+{
+    if (m_cleanup.job) {
+        return;
+    }
 
-    QStringList args;
-    args << QStringLiteral("rm") << QStringLiteral("-f") << backup.path;
-    m_process->start(QStringLiteral("pkexec"), args);
+    const RetentionPolicy::Plan plan = RetentionPolicy::plan(m_model->backups(), RetentionPolicy::rulesFromMap(rules),
+                                                             backupStorageFree(), chunkUsage());
+    if (!startCleanup(plan.remove)) {
+        Q_EMIT operationSucceeded(tr("Cleanup Complete"), tr("All backups are within the retention policy."));
+    }
 }
 
-void BackupManager::cleanupBackups(int olderThanDays)
+bool BackupManager::startCleanup(const QList<BackupInfo> &backups)
 {
-    QDateTime cutoffTime = QDateTime::currentDateTime().addDays(-olderThanDays);
-    int deletedCount = 0;
-
-    for (int i = m_model->rowCount() - 1; i >= 0; i--) {
-        BackupInfo backup = m_model->backupAt(i);
-        if (backup.timestamp < cutoffTime) {
-            QProcess process;
-            process.start(QStringLiteral("pkexec"), {QStringLiteral("rm"), QStringLiteral("-f"), backup.path});
-            process.waitForFinished(30000);
+    const QList<QString> pending = m_pendingDeletes.values();
+    const QSet<QString> pendingDeletes(pending.begin(), pending.end());
+
+    Cleanup cleanup;
+    QStringList paths;
+    QStringList resources;
+    bool collectChunks = false;
+    for (const BackupInfo &backup : backups) {
+        if (pendingDeletes.contains(backup.path)) {
+            continue;
+        }
+        collectChunks = collectChunks || backup.deduplicated;
 
-            if (process.exitCode() == 0) {
-                m_model->removeAt(i);
-                deletedCount++;
-            }
+        cleanup.pending << backup.path;
+        cleanup.sizes.insert(backup.path, backup.size);
+        paths << backup.path;
+        if (backup.metadataModified >= 0) {
+            paths << sidecarPath(backup.path);
         }
+        resources << QStringLiteral("backup:%1").arg(backup.path);
+    }
+
+    if (cleanup.sizes.isEmpty()) {
+        return false;
     }
 
-    Q_EMIT operationSucceeded(tr("Cleanup Complete"), tr("Deleted %1 old backups.").arg(deletedCount));
+    // One privileged job, and so one authorization, for the whole set. It is
+    // split into several rm invocations only to stay clear of ARG_MAX. What
+    // rm -v prints is translated and never read; it only says when to look
+    // which backups are gone.
+    CommandExecutor::Job job;
+    job.resources = resources;
+    for (qsizetype i = 0; i < paths.count(); i += CleanupPathsPerCommand) {
+        QStringList argv = {QStringLiteral("rm"), QStringLiteral("-f"), QStringLiteral("-v")};
+        argv << paths.mid(i, CleanupPathsPerCommand);
+        job.batch << argv;
+    }
+    // The chunks' share of the freed space comes from its report.
+    if (collectChunks) {
+        job.batch << QStringList{ChunkStoreProtocol::program(), QStringLiteral("gc")};
+        job.resources << QStringLiteral("chunkstore");
+    }
+
+    cleanup.total = cleanup.sizes.count();
+    m_cleanup = cleanup;
+    m_cleanup.job = submit(Operation::Cleanup, job);
+    Q_EMIT cleanupProgressChanged();
+    return true;
 }
 
 QString BackupManager::backupPath(int index) const
@@ -316,190 +808,287 @@ bool BackupManager::backupIsFullBackup(int index) const
     return m_model->backupAt(index).isFullBackup;
 }
 
-void BackupManager::startProcess(const QString &command, const QStringList &args, bool usePolkit)
+bool BackupManager::backupIsDeduplicated(int index) const
 {
-    if (m_busy) {
-        return;
+    return m_model->backupAt(index).deduplicated;
+}
+
+QString BackupManager::backupCompressor(int index) const
+{
+    return m_model->backupAt(index).compressor;
+}
+
+QString BackupManager::backupChecksum(int index) const
+{
+    return m_model->backupAt(index).checksum;
+}
+
+QString BackupManager::backupSourceVersion(int index) const
+{
+    return m_model->backupAt(index).sourceVersion;
+}
+
+QString BackupManager::backupVerification(int index) const
+{
+    const BackupInfo backup = m_model->backupAt(index);
+    const BackupVerifier::Result result = m_model->verification(backup.path);
+    const QString when = QLocale().toString(result.verifiedAt, QLocale::ShortFormat);
+    const QString speed = QLocale().formattedDataSize(qint64(result.throughput));
+
+    switch (result.state) {
+    case BackupVerifier::State::Verified:
+        return tr("Matches its checksum (checked %1 at %2/s)").arg(when, speed);
+    case BackupVerifier::State::Mismatch:
+        return tr("Does not match its checksum (checked %1)").arg(when);
+    case BackupVerifier::State::Verifying:
+        return tr("Verifying...");
+    case BackupVerifier::State::NoChecksum:
+        return tr("No checksum was recorded");
+    case BackupVerifier::State::Failed:
+        return tr("Could not be read");
+    case BackupVerifier::State::Unknown:
+        break;
     }
+    return tr("Not verified yet");
+}
+
+QVariantMap BackupManager::backupImageInfo(int index) const
+{
+    const BackupInfo backup = m_model->backupAt(index);
+    const QLocale locale;
+
+    return {
+        {QStringLiteral("blockSize"), backup.blockSize ? locale.formattedDataSize(backup.blockSize) : QString()},
+        {QStringLiteral("inodeCount"), backup.inodeCount ? locale.toString(backup.inodeCount) : QString()},
+        {QStringLiteral("created"), locale.toString(backup.created, QLocale::ShortFormat)},
+        {QStringLiteral("uncompressedSize"), backup.uncompressedSize >= 0 ? locale.formattedDataSize(backup.uncompressedSize) : QString()},
+        {QStringLiteral("error"), backup.imageError}
+    };
+}
 
-    if (m_process) {
-        m_process->disconnect();
-        m_process->kill();
-        m_process->waitForFinished(1000);
-        delete m_process;
-        m_process = nullptr;
+quint64 BackupManager::submit(Operation operation, const CommandExecutor::Job &job)
+{
+    const bool wasBusy = busy();
+    if (!wasBusy) {
+        m_log->clear();
     }
 
-    m_process = new QProcess(this);
-    m_process->setProcessChannelMode(QProcess::MergedChannels);
+    const quint64 id = m_executor->submit(job);
+    m_jobs.insert(id, operation);
 
-    connect(m_process, &QProcess::readyReadStandardOutput, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardOutput());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
-        }
-    });
+    if (!wasBusy) {
+        Q_EMIT busyChanged();
+    }
+    return id;
+}
 
-    connect(m_process, &QProcess::readyReadStandardError, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardError());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
-        }
-    });
+void BackupManager::onJobOutput(quint64 id, const QString &data)
+{
+    if (!m_jobs.contains(id)) {
+        return;
+    }
 
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
-        Q_UNUSED(exitStatus)
+    m_log->append(data);
 
-        if (m_process) {
-            QString remainingOutput = QString::fromUtf8(m_process->readAllStandardOutput());
-            QString remainingError = QString::fromUtf8(m_process->readAllStandardError());
+    if (id == m_cleanup.job) {
+        parseCleanupOutput(data);
+    }
+}
 
-            if (!remainingOutput.isEmpty()) {
-                m_output += remainingOutput;
-            }
-            if (!remainingError.isEmpty()) {
-                m_output += remainingError;
-            }
-            Q_EMIT outputChanged();
-        }
+void BackupManager::onJobFinished(quint64 id, int exitCode)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
 
-        m_busy = false;
+    const Operation operation = it.value();
+    // Submitting may have moved the entry.
+    removeStaging(id, operation, exitCode != 0);
+    const QString deletedPath = m_pendingDeletes.take(id);
+    const QString extractedTo = m_pendingExtracts.take(id);
+    m_jobs.remove(id);
+
+    if (m_jobs.isEmpty()) {
         Q_EMIT busyChanged();
+    }
+
+    if (operation == Operation::RemoveStaging) {
+        return;
+    }
+
+    if (operation == Operation::Cleanup) {
+        if (!m_cleanup.pendingLine.isEmpty()) {
+            parseCleanupOutput(QStringLiteral("\n"));
+        }
+        // A failed rm may have skipped some and still removed later ones.
+        checkCleanupProgress(false);
+        const Cleanup cleanup = std::exchange(m_cleanup, Cleanup());
+        Q_EMIT cleanupProgressChanged();
 
+        const QString freed = QLocale().formattedDataSize(cleanup.freedBytes);
         if (exitCode == 0) {
-            if (m_currentOperation == QStringLiteral("create")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("Backup created successfully!"));
-                refreshBackups();
-            } else if (m_currentOperation == QStringLiteral("restore")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("Backup restored successfully!"));
-            }
+            Q_EMIT operationSucceeded(tr("Cleanup Complete"), tr("Deleted %1 backups, freeing %2.").arg(cleanup.removed).arg(freed));
         } else {
-            QString errorMsg = m_output.trimmed();
-            if (errorMsg.isEmpty()) {
-                errorMsg = tr("Operation failed with exit code %1").arg(exitCode);
-            }
-            Q_EMIT errorOccurred(tr("Error"), errorMsg);
+            Q_EMIT errorOccurred(tr("Cleanup Incomplete"),
+                                 tr("Deleted %1 of %2 backups (%3 freed) before an error occurred:\n%4")
+                                     .arg(cleanup.removed).arg(cleanup.total).arg(freed).arg(m_log->tail().trimmed()));
         }
+        return;
+    }
 
-        m_currentOperation.clear();
-
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
+    if (exitCode == 0) {
+        switch (operation) {
+        case Operation::Create:
+            Q_EMIT operationSucceeded(tr("Success"), tr("Backup created successfully!"));
+            refreshBackups();
+            break;
+        case Operation::Restore:
+            Q_EMIT operationSucceeded(tr("Success"), tr("Backup restored successfully!"));
+            break;
+        case Operation::Delete:
+            m_model->removeAt(m_model->indexOfPath(deletedPath));
+            Q_EMIT operationSucceeded(tr("Success"), tr("Backup deleted successfully!"));
+            break;
+        case Operation::Extract:
+            Q_EMIT operationSucceeded(tr("Success"), tr("Files extracted to %1.").arg(extractedTo));
+            break;
+        case Operation::Cleanup:
+        case Operation::RemoveStaging:
+            break;
         }
-    });
+    } else {
+        QString errorMsg = m_log->tail().trimmed();
+        if (errorMsg.isEmpty()) {
+            errorMsg = operation == Operation::Delete
+                ? tr("Failed to delete backup with exit code %1").arg(exitCode)
+                : tr("Operation failed with exit code %1").arg(exitCode);
+        }
+        Q_EMIT errorOccurred(tr("Error"), errorMsg);
+    }
+}
+
+void BackupManager::onJobFailed(quint64 id, QProcess::ProcessError error)
+{
+    auto it = m_jobs.constFind(id);
+    if (it == m_jobs.constEnd()) {
+        return;
+    }
+    const Operation operation = it.value();
+    removeStaging(id, operation, true);
+    m_jobs.remove(id);
+    m_pendingDeletes.remove(id);
+    m_pendingExtracts.remove(id);
+
+    if (id == m_cleanup.job) {
+        // Whatever went before the failure is gone for good.
+        checkCleanupProgress(false);
+        m_cleanup = Cleanup();
+        Q_EMIT cleanupProgressChanged();
+    }
 
-    connect(m_process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
-        m_busy = false;
+    if (m_jobs.isEmpty()) {
         Q_EMIT busyChanged();
+    }
 
-        QString errorMsg;
-        switch (error) {
-            case QProcess::FailedToStart:
-                errorMsg = tr("Failed to start process. Make sure pkexec and obsidianctl are installed.");
-                break;
-            case QProcess::Crashed:
-                errorMsg = tr("Process crashed.");
-                break;
-            case QProcess::Timedout:
-                errorMsg = tr("Process timed out.");
-                break;
-            default:
-                errorMsg = tr("Unknown process error occurred.");
-                break;
-        }
-        Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        m_currentOperation.clear();
+    if (operation != Operation::RemoveStaging) {
+        Q_EMIT errorOccurred(tr("Error"), CommandExecutor::errorString(error));
+    }
+}
+
+void BackupManager::removeStaging(quint64 id, Operation operation, bool failed)
+{
+    const QStringList argv = m_pendingStaging.take(id);
+    if (argv.isEmpty() || (operation == Operation::Create && !failed)) {
+        return;
+    }
 
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
+    // Submitted while the finished job still counts as busy, so the log it
+    // left isn't cleared.
+    CommandExecutor::Job job;
+    job.batch << argv;
+    submit(Operation::RemoveStaging, job);
+}
+
+void BackupManager::parseCleanupOutput(const QString &data)
+{
+    m_cleanup.pendingLine += data;
+
+    qsizetype start = 0;
+    qsizetype end;
+    while ((end = m_cleanup.pendingLine.indexOf(QLatin1Char('\n'), start)) >= 0) {
+        const QStringView line = QStringView(m_cleanup.pendingLine).sliced(start, end - start).trimmed();
+        if (line.startsWith(u"Freed ")) {
+            // "Freed <bytes> bytes from <n> unreferenced chunks"
+            m_cleanup.freedBytes += line.sliced(6).split(u' ').constFirst().toLongLong();
+            Q_EMIT cleanupProgressChanged();
         }
-    });
+        start = end + 1;
+    }
+    m_cleanup.pendingLine.remove(0, start);
 
-    m_busy = true;
-    Q_EMIT busyChanged();
+    checkCleanupProgress(true);
+}
 
-    m_output.clear();
-    Q_EMIT outputChanged();
+void BackupManager::checkCleanupProgress(bool untilPresent)
+{
+    QStringList removed;
+    for (auto it = m_cleanup.pending.begin(); it != m_cleanup.pending.end();) {
+        if (QFileInfo::exists(*it)) {
+            if (untilPresent) {
+                break;
+            }
+            ++it;
+            continue;
+        }
+        m_cleanup.removed++;
+        m_cleanup.freedBytes += m_cleanup.sizes.take(*it);
+        removed << *it;
+        it = m_cleanup.pending.erase(it);
+    }
 
-    if (usePolkit) {
-        QStringList fullArgs;
-        fullArgs << QStringLiteral("obsidianctl") << command << args;
-        m_process->start(QStringLiteral("pkexec"), fullArgs);
-    } else {
-        QStringList fullArgs;
-        fullArgs << command << args;
-        m_process->start(QStringLiteral("obsidianctl"), fullArgs);
+    if (!removed.isEmpty()) {
+        // The watcher may have dropped the rows already.
+        m_model->removePaths(removed);
+        Q_EMIT cleanupProgressChanged();
     }
 }
 
-void BackupManager::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+qint64 BackupManager::slotDataSize(const QString &slot) const
 {
-    Q_UNUSED(exitCode)
-    Q_UNUSED(exitStatus)
+    // The newest backup of the slot knows how much data it holds; failing
+    // that the running system's root is the best guess.
+    const QList<BackupInfo> &backups = m_model->backups();
+    for (const BackupInfo &backup : backups) {
+        if (backup.slot == slot && backup.uncompressedSize > 0) {
+            return backup.uncompressedSize;
+        }
+    }
+
+    const QStorageInfo root(QDir::rootPath());
+    return root.bytesTotal() - root.bytesFree();
 }
 
-void BackupManager::onProcessReadyRead()
+qint64 BackupManager::backupStorageFree()
 {
+    return QStorageInfo(QStringLiteral("/var/backups/obsidianctl")).bytesAvailable();
 }
 
-void BackupManager::parseBackups()
+QStringList BackupManager::backupDirs()
 {
-    QList<BackupInfo> backups;
-
-    QStringList backupDirs = {
+    return {
         QStringLiteral("/var/backups/obsidianctl/slot_a"),
         QStringLiteral("/var/backups/obsidianctl/slot_b")
     };
+}
 
-    for (const QString &dirPath : backupDirs) {
-        QDir dir(dirPath);
-        if (!dir.exists()) {
-            continue;
-        }
-
-        QString slotName = QFileInfo(dirPath).fileName();
-        slotName = slotName.mid(5);
-
-        QStringList filters;
-        filters << QStringLiteral("*.sfs");
-        QFileInfoList files = dir.entryInfoList(filters, QDir::Files, QDir::Time);
-
-        for (const QFileInfo &fileInfo : files) {
-            BackupInfo backup;
-            backup.path = fileInfo.absoluteFilePath();
-            backup.slot = slotName;
-            backup.timestamp = fileInfo.lastModified();
-            backup.size = fileInfo.size();
-            backup.isFullBackup = false;
-
-            QString metadataPath = fileInfo.absolutePath() + QStringLiteral("/") +
-                                   fileInfo.completeBaseName() + QStringLiteral(".json");
-            QFile metadataFile(metadataPath);
-            if (metadataFile.open(QIODevice::ReadOnly)) {
-                QJsonDocument doc = QJsonDocument::fromJson(metadataFile.readAll());
-                if (doc.isObject()) {
-                    QJsonObject obj = doc.object();
-                    backup.isFullBackup = obj.value(QStringLiteral("is_full_backup")).toBool(false);
-                }
-                metadataFile.close();
-            }
-
-            backups.append(backup);
+void BackupManager::watchBackupDirs()
+{
+    // The directories may only appear with the first backup.
+    const QStringList watched = m_watcher->directories();
+    for (const QString &dirPath : backupDirs()) {
+        if (!watched.contains(dirPath) && QFileInfo(dirPath).isDir()) {
+            m_watcher->addPath(dirPath);
         }
     }
-
-    std::sort(backups.begin(), backups.end(), [](const BackupInfo &a, const BackupInfo &b) {
-        return a.timestamp > b.timestamp;
-    });
-
-    m_model->setBackups(backups);
 }
\ No newline at end of file
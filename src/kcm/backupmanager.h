@@ -3,16 +3,24 @@
 #include <QObject>
 #include <QAbstractListModel>
 #include <QDateTime>
+#include <QHash>
 #include <QProcess>
+#include <QSet>
+#include <QTimer>
+#include <QVariantMap>
 #include <qqmlregistration.h>
 
-struct BackupInfo {
-    QString path;
-    QString slot;
-    QDateTime timestamp;
-    qint64 size;
-    bool isFullBackup;
-};
+#include "backupinfo.h"
+#include "backuptreemodel.h"
+#include "backupverifier.h"
+#include "commandexecutor.h"
+#include "compressionbenchmark.h"
+#include "logbuffer.h"
+#include "retentionpolicy.h"
+
+class BackupScanner;
+class QFileSystemWatcher;
+class QThread;
 
 class BackupModel : public QAbstractListModel
 {
@@ -26,7 +34,20 @@ public:
         TimestampRole,
         SizeRole,
         SizeStringRole,
-        IsFullBackupRole
+        IsFullBackupRole,
+        DeduplicatedRole,
+        CompressorRole,
+        ChecksumRole,
+        SourceVersionRole,
+        VerifyStateRole,
+        VerifiedAtRole,
+        VerifyProgressRole,
+        VerifyThroughputRole,
+        BlockSizeRole,
+        InodeCountRole,
+        CreatedRole,
+        UncompressedSizeRole,
+        ImageErrorRole
     };
 
     explicit BackupModel(QObject *parent = nullptr);
@@ -36,61 +57,188 @@ public:
     QHash<int, QByteArray> roleNames() const override;
 
     void setBackups(const QList<BackupInfo> &backups);
+    // Merges backups into the newest-first order, inserting each contiguous
+    // run of rows in one go.
+    void insertBackups(QList<BackupInfo> backups);
+    // Updates entries already listed in place and inserts the rest.
+    void upsertBackups(const QList<BackupInfo> &backups);
+    void removePaths(const QStringList &paths);
+    void setVerification(const QString &path, const BackupVerifier::Result &result);
+    void setVerifications(const QHash<QString, BackupVerifier::Result> &results);
+    BackupVerifier::Result verification(const QString &path) const;
     void clear();
+    const QList<BackupInfo> &backups() const;
     BackupInfo backupAt(int index) const;
+    int indexOfPath(const QString &path) const;
     void removeAt(int index);
 
 private:
     QString formatSize(qint64 bytes) const;
+    static QString stateName(BackupVerifier::State state);
     QList<BackupInfo> m_backups;
+    // Kept apart from BackupInfo so rescans don't wipe it.
+    QHash<QString, BackupVerifier::Result> m_verification;
 };
 
 class BackupManager : public QObject
 {
     Q_OBJECT
     QML_ELEMENT
+    QML_UNCREATABLE("Provided by the KCM")
     Q_PROPERTY(BackupModel* model READ model CONSTANT)
+    Q_PROPERTY(BackupTreeModel* contents READ contents CONSTANT)
     Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
-    Q_PROPERTY(QString output READ output NOTIFY outputChanged)
+    Q_PROPERTY(bool scanning READ scanning NOTIFY scanningChanged)
+    Q_PROPERTY(bool cleanupActive READ cleanupActive NOTIFY cleanupProgressChanged)
+    Q_PROPERTY(int cleanupRemoved READ cleanupRemoved NOTIFY cleanupProgressChanged)
+    Q_PROPERTY(int cleanupTotal READ cleanupTotal NOTIFY cleanupProgressChanged)
+    Q_PROPERTY(qint64 cleanupFreedBytes READ cleanupFreedBytes NOTIFY cleanupProgressChanged)
+    Q_PROPERTY(bool verifying READ verifying NOTIFY verifyingChanged)
+    Q_PROPERTY(CompressionBenchmark* benchmark READ benchmark CONSTANT)
+    // Profile id picked in the benchmark, remembered per host. Advisory
+    // only: obsidianctl chooses the compression of new backups itself.
+    Q_PROPERTY(QString compressionProfile READ compressionProfile WRITE setCompressionProfile NOTIFY compressionProfileChanged)
+    Q_PROPERTY(LogBuffer* log READ log CONSTANT)
 
 public:
-    explicit BackupManager(QObject *parent = nullptr);
+    explicit BackupManager(CommandExecutor *executor, QObject *parent = nullptr);
     ~BackupManager() override;
 
     BackupModel *model() const;
+    BackupTreeModel *contents() const;
     bool busy() const;
-    QString output() const;
+    bool scanning() const;
+    bool cleanupActive() const;
+    int cleanupRemoved() const;
+    int cleanupTotal() const;
+    qint64 cleanupFreedBytes() const;
+    bool verifying() const;
+    CompressionBenchmark *benchmark() const;
+    QString compressionProfile() const;
+    void setCompressionProfile(const QString &profile);
+    LogBuffer *log() const;
 
     Q_INVOKABLE void refreshBackups();
-    Q_INVOKABLE void createBackup(const QString &slot, const QString &customDir = QString(), bool fullBackup = false);
+    Q_INVOKABLE void cancelScan();
+    // With deduplicate the image goes into the shared chunk store instead,
+    // which keeps only what changed since earlier backups; customDir is
+    // ignored then.
+    Q_INVOKABLE void createBackup(const QString &slot, const QString &customDir = QString(), bool fullBackup = false,
+                                  bool deduplicate = false);
     Q_INVOKABLE void restoreBackup(int index, const QString &targetSlot);
     Q_INVOKABLE void deleteBackup(int index);
     Q_INVOKABLE void cleanupBackups(int olderThanDays);
+    // Dry run of the retention policy: what applyRetention() would delete
+    // and how much space that frees, without touching anything.
+    Q_INVOKABLE QVariantMap planRetention(const QVariantMap &rules) const;
+    Q_INVOKABLE void applyRetention(const QVariantMap &rules);
+    // Points contents at the backup's image.
+    Q_INVOKABLE void browseBackup(int index);
+    // Copies files or whole subtrees out of the browsed backup into
+    // destination, keeping their paths below the image root. Only the
+    // blocks of those files are read.
+    Q_INVOKABLE void extractFromBackup(const QStringList &paths, const QString &destination);
+    Q_INVOKABLE void verifyBackup(int index);
+    // Hashes every backup without a valid cached result.
+    Q_INVOKABLE void verifyAllBackups();
+    Q_INVOKABLE void cancelVerification();
+    // Runs the compressors over a sample of the running system and projects
+    // the results to the size of slot's backups.
+    Q_INVOKABLE void benchmarkCompression(const QString &slot);
+    Q_INVOKABLE void cancelBenchmark();
     Q_INVOKABLE QString backupPath(int index) const;
     Q_INVOKABLE QString backupSlot(int index) const;
     Q_INVOKABLE QString backupTimestamp(int index) const;
     Q_INVOKABLE QString backupSize(int index) const;
     Q_INVOKABLE bool backupIsFullBackup(int index) const;
+    Q_INVOKABLE bool backupIsDeduplicated(int index) const;
+    Q_INVOKABLE QString backupCompressor(int index) const;
+    Q_INVOKABLE QString backupChecksum(int index) const;
+    Q_INVOKABLE QString backupSourceVersion(int index) const;
+    Q_INVOKABLE QString backupVerification(int index) const;
+    // Superblock details; empty strings for what the image doesn't say.
+    Q_INVOKABLE QVariantMap backupImageInfo(int index) const;
 
 Q_SIGNALS:
     void busyChanged();
-    void outputChanged();
+    void scanningChanged();
+    void cleanupProgressChanged();
+    void verifyingChanged();
+    void compressionProfileChanged();
     void errorOccurred(const QString &title, const QString &message);
     void operationSucceeded(const QString &title, const QString &message);
     void refreshFinished();
 
 private Q_SLOTS:
-    void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onProcessReadyRead();
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
+    void onScanBatch(quint64 generation, const QList<BackupInfo> &backups);
+    void onScanFinished(quint64 generation, bool cancelled, const QStringList &removed);
+    void onVerifyFinished(const QString &path, const BackupVerifier::Result &result);
 
 private:
-    void startProcess(const QString &command, const QStringList &args, bool usePolkit = true);
-    void parseBackups();
+    enum class Operation {
+        Create,
+        Restore,
+        Delete,
+        Cleanup,
+        Extract,
+        // Clearing up after one of the above; silent either way.
+        RemoveStaging
+    };
+
+    // Progress of the running cleanup batch. A backup counts as removed once
+    // its file is gone, whatever rm has to say about it.
+    struct Cleanup {
+        quint64 job = 0;
+        int total = 0;
+        int removed = 0;
+        qint64 freedBytes = 0;
+        // Backups not seen gone yet, in the order rm is given them.
+        QStringList pending;
+        QHash<QString, qint64> sizes;
+        QString pendingLine;
+    };
+
+    quint64 submit(Operation operation, const CommandExecutor::Job &job);
+    // Returns false if there was nothing to delete.
+    bool startCleanup(const QList<BackupInfo> &backups);
+    // Submits the staging cleanup of a finished job, if it needs one.
+    void removeStaging(quint64 id, Operation operation, bool failed);
+    void parseCleanupOutput(const QString &data);
+    // With untilPresent, stops at the first backup still there: rm works
+    // through its arguments in order, so the rest can't be gone yet.
+    void checkCleanupProgress(bool untilPresent);
+    void watchBackupDirs();
+
+    qint64 slotDataSize(const QString &slot) const;
+    // Chunk use of the listed deduplicated backups, reloaded when they change.
+    const RetentionPolicy::ChunkUsage &chunkUsage() const;
+
+    static qint64 backupStorageFree();
+    static QStringList backupDirs();
 
     BackupModel *m_model;
-    QProcess *m_process;
-    bool m_busy;
-    QString m_output;
-    QString m_currentOperation;
-    int m_pendingDeleteIndex;
+    BackupTreeModel *m_contents;
+    CommandExecutor *m_executor;
+    QHash<quint64, Operation> m_jobs;
+    QHash<quint64, QString> m_pendingDeletes;
+    QHash<quint64, QString> m_pendingExtracts;
+    // The command that removes what a job left in the staging area.
+    QHash<quint64, QStringList> m_pendingStaging;
+    Cleanup m_cleanup;
+    mutable RetentionPolicy::ChunkUsage m_chunkUsage;
+    LogBuffer *m_log;
+    QFileSystemWatcher *m_watcher;
+    // Batches the burst of change events a single backup or delete causes.
+    QTimer m_rescanTimer;
+    QThread *m_scanThread;
+    BackupScanner *m_scanner;
+    quint64 m_scanGeneration;
+    bool m_scanning;
+    BackupVerifier *m_verifier;
+    // Paths of backups verified on explicit request, reported when done.
+    QSet<QString> m_verifyRequested;
+    CompressionBenchmark *m_benchmark;
 };
\ No newline at end of file
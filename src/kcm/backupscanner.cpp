@@ -0,0 +1,161 @@
+#include "backupscanner.h"
+#include "squashfsimage.h"
+#include "../chunkstore/chunkmanifest.h"
+#include "../chunkstore/chunkstoreprotocol.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+BackupScanner::BackupScanner(QObject *parent)
+    : QObject(parent)
+    , m_cancelled(0)
+{
+}
+
+void BackupScanner::cancel(quint64 generation)
+{
+    quint64 current = m_cancelled.loadRelaxed();
+    while (current < generation && !m_cancelled.testAndSetRelaxed(current, generation, current)) {
+    }
+}
+
+void BackupScanner::scan(quint64 generation, const QStringList &dirs, const QList<BackupInfo> &known)
+{
+    QHash<QString, const BackupInfo *> previous;
+    previous.reserve(known.count());
+    for (const BackupInfo &backup : known) {
+        previous.insert(backup.path, &backup);
+    }
+
+    QList<BackupInfo> batch;
+    batch.reserve(BatchSize);
+
+    for (const QString &dirPath : dirs) {
+        QDir dir(dirPath);
+        if (!dir.exists()) {
+            continue;
+        }
+
+        const QString slotName = QFileInfo(dirPath).fileName().mid(5);
+
+        // Loaded once; afterwards the copy in memory is kept in step.
+        auto indexIt = m_indexes.find(dir.absolutePath());
+        if (indexIt == m_indexes.end()) {
+            indexIt = m_indexes.insert(dir.absolutePath(), BackupIndex(dir.absolutePath()));
+            indexIt->load();
+        }
+        BackupIndex &index = indexIt.value();
+        QSet<QString> seen;
+
+        // One listing stats both images and sidecars.
+        QHash<QString, qint64> sidecars;
+        const QFileInfoList metadataFiles = dir.entryInfoList({QStringLiteral("*.json")}, QDir::Files);
+        for (const QFileInfo &info : metadataFiles) {
+            sidecars.insert(info.completeBaseName(), info.lastModified().toMSecsSinceEpoch());
+        }
+
+        const QFileInfoList images = dir.entryInfoList({QStringLiteral("*.sfs"), QLatin1Char('*') + ChunkStoreProtocol::manifestSuffix()},
+                                                       QDir::Files);
+        for (const QFileInfo &fileInfo : images) {
+            if (isCancelled(generation)) {
+                // Entries gathered so far are valid on their own.
+                index.save();
+                Q_EMIT finished(generation, true, QStringList());
+                return;
+            }
+
+            BackupInfo backup;
+            backup.path = fileInfo.absoluteFilePath();
+            backup.slot = slotName;
+            backup.timestamp = fileInfo.lastModified();
+            backup.size = fileInfo.size();
+            backup.isFullBackup = false;
+            backup.deduplicated = backup.path.endsWith(ChunkStoreProtocol::manifestSuffix());
+            backup.metadataModified = sidecars.value(fileInfo.completeBaseName(), -1);
+
+            seen.insert(backup.path);
+
+            const BackupInfo *old = previous.take(backup.path);
+            if (old && old->timestamp == backup.timestamp && old->size == backup.size
+                && old->metadataModified == backup.metadataModified) {
+                // Keeps a deleted or outdated index complete without any I/O.
+                if (!index.lookup(&backup)) {
+                    index.insert(*old);
+                }
+                continue;
+            }
+
+            if (!index.lookup(&backup)) {
+                if (backup.metadataModified >= 0) {
+                    readMetadata(fileInfo.absolutePath() + QStringLiteral("/") + fileInfo.completeBaseName() + QStringLiteral(".json"),
+                                 &backup);
+                }
+                readImage(&backup);
+                index.insert(backup);
+            }
+
+            batch.append(backup);
+            if (batch.count() >= BatchSize) {
+                Q_EMIT batchReady(generation, batch);
+                batch.clear();
+            }
+        }
+
+        index.retain(seen);
+        index.save();
+    }
+
+    if (!batch.isEmpty()) {
+        Q_EMIT batchReady(generation, batch);
+    }
+    Q_EMIT finished(generation, false, previous.keys());
+}
+
+bool BackupScanner::isCancelled(quint64 generation) const
+{
+    return m_cancelled.loadRelaxed() >= generation;
+}
+
+void BackupScanner::readImage(BackupInfo *backup)
+{
+    if (backup->deduplicated) {
+        ChunkManifest manifest;
+        if (manifest.load(backup->path, true)) {
+            backup->imageSize = manifest.imageSize;
+        } else {
+            backup->imageError = tr("The chunk manifest cannot be read.");
+        }
+        return;
+    }
+
+    const SquashfsImage::Info image = SquashfsImage::inspect(backup->path, true);
+    if (backup->compressor.isEmpty()) {
+        backup->compressor = image.compressor;
+    }
+    backup->blockSize = image.blockSize;
+    backup->inodeCount = image.inodeCount;
+    backup->created = image.created;
+    backup->uncompressedSize = image.uncompressedSize;
+    backup->imageError = image.error;
+}
+
+void BackupScanner::readMetadata(const QString &path, BackupInfo *backup)
+{
+    QFile metadataFile(path);
+    if (metadataFile.open(QIODevice::ReadOnly)) {
+        QJsonDocument doc = QJsonDocument::fromJson(metadataFile.readAll());
+        if (doc.isObject()) {
+            const QJsonObject obj = doc.object();
+            backup->isFullBackup = obj.value(QStringLiteral("is_full_backup")).toBool(false);
+            backup->compressor = obj.value(QStringLiteral("compressor")).toString(obj.value(QStringLiteral("compression")).toString());
+            backup->checksum = obj.value(QStringLiteral("checksum")).toString(obj.value(QStringLiteral("sha256")).toString());
+            backup->sourceVersion = obj.value(QStringLiteral("source_version")).toString(obj.value(QStringLiteral("version")).toString());
+        }
+        metadataFile.close();
+    }
+}
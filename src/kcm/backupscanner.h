@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QStringList>
+
+#include "backupindex.h"
+#include "backupinfo.h"
+
+// Walks the backup roots on a worker thread and reports what differs from the
+// entries the caller already has: new or changed backups arrive in batches so
+// the list fills in while slow disks are still being read, removed ones with
+// finished(). Sidecars and image headers are only read for entries whose
+// stamps changed and that the root's BackupIndex doesn't already cover, so a
+// rescan of an unchanged directory is one directory listing and a cold start
+// one index read. Every scan
+// carries a generation number; results of a cancelled or superseded scan can
+// be told apart and dropped.
+class BackupScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int BatchSize = 64;
+
+    explicit BackupScanner(QObject *parent = nullptr);
+
+    // Thread-safe. Stops every scan up to and including this generation.
+    void cancel(quint64 generation);
+
+public Q_SLOTS:
+    void scan(quint64 generation, const QStringList &dirs, const QList<BackupInfo> &known);
+
+Q_SIGNALS:
+    void batchReady(quint64 generation, const QList<BackupInfo> &backups);
+    void finished(quint64 generation, bool cancelled, const QStringList &removed);
+
+private:
+    bool isCancelled(quint64 generation) const;
+    static void readMetadata(const QString &path, BackupInfo *backup);
+    static void readImage(BackupInfo *backup);
+
+    QAtomicInteger<quint64> m_cancelled;
+    QHash<QString, BackupIndex> m_indexes;
+};
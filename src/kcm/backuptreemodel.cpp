@@ -0,0 +1,327 @@
+#include "backuptreemodel.h"
+
+#include <QLocale>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+
+// unsquashfs names the image root after its default extraction directory.
+const QString ListingRoot = QStringLiteral("squashfs-root");
+
+}
+
+BackupTreeModel::Node::~Node()
+{
+    qDeleteAll(children);
+}
+
+BackupTreeModel::BackupTreeModel(CommandExecutor *executor, QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_executor(executor)
+    , m_root(new Node)
+{
+    m_root->type = QLatin1Char('d');
+
+    connect(m_executor, &CommandExecutor::jobOutput, this, &BackupTreeModel::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &BackupTreeModel::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &BackupTreeModel::onJobFailed);
+}
+
+BackupTreeModel::~BackupTreeModel()
+{
+    delete m_root;
+}
+
+QString BackupTreeModel::imagePath() const
+{
+    return m_imagePath;
+}
+
+void BackupTreeModel::setImagePath(const QString &imagePath)
+{
+    if (m_imagePath == imagePath) {
+        return;
+    }
+
+    // Forgotten first: cancelling a queued job reports its failure right
+    // away, which would otherwise touch m_jobs and the old nodes.
+    const auto jobs = std::exchange(m_jobs, {});
+    m_output.clear();
+    for (auto it = jobs.constBegin(); it != jobs.constEnd(); ++it) {
+        m_executor->cancel(it.key());
+    }
+
+    beginResetModel();
+    delete m_root;
+    m_root = new Node;
+    m_root->type = QLatin1Char('d');
+    m_imagePath = imagePath;
+    endResetModel();
+
+    Q_EMIT imagePathChanged();
+
+    if (!m_imagePath.isEmpty()) {
+        load(m_root);
+    }
+}
+
+QModelIndex BackupTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    if (column != 0 || row < 0 || row >= node->children.count()) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, node->children.at(row));
+}
+
+QModelIndex BackupTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+    return indexFor(nodeFor(child)->parent);
+}
+
+int BackupTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return 0;
+    }
+    return nodeFor(parent)->children.count();
+}
+
+int BackupTreeModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return 1;
+}
+
+bool BackupTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    if (node->type != QLatin1Char('d')) {
+        return false;
+    }
+    // Unread directories claim children so the view offers to expand them.
+    return node->state != State::Loaded || !node->children.isEmpty();
+}
+
+bool BackupTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    return !m_imagePath.isEmpty() && node->type == QLatin1Char('d') && node->state == State::NotLoaded;
+}
+
+void BackupTreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (canFetchMore(parent)) {
+        load(nodeFor(parent));
+    }
+}
+
+QVariant BackupTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    const Node *node = nodeFor(index);
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return node->name;
+    case PathRole:
+        return node->path;
+    case IsDirRole:
+        return node->type == QLatin1Char('d');
+    case SizeRole:
+        return node->size;
+    case SizeStringRole:
+        return node->type == QLatin1Char('-') ? QLocale().formattedDataSize(node->size) : QString();
+    case ModeRole:
+        return node->mode;
+    case OwnerRole:
+        return node->owner;
+    case ModifiedRole:
+        return node->modified;
+    case LinkTargetRole:
+        return node->linkTarget;
+    case LoadingRole:
+        return node->state == State::Loading;
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> BackupTreeModel::roleNames() const
+{
+    // Keeps "display" for TreeViewDelegate.
+    QHash<int, QByteArray> roles = QAbstractItemModel::roleNames();
+    roles.insert(NameRole, "name");
+    roles.insert(PathRole, "path");
+    roles.insert(IsDirRole, "isDir");
+    roles.insert(SizeRole, "size");
+    roles.insert(SizeStringRole, "sizeString");
+    roles.insert(ModeRole, "mode");
+    roles.insert(OwnerRole, "owner");
+    roles.insert(ModifiedRole, "modified");
+    roles.insert(LinkTargetRole, "linkTarget");
+    roles.insert(LoadingRole, "loading");
+    return roles;
+}
+
+void BackupTreeModel::onJobOutput(quint64 id, const QString &data)
+{
+    if (m_jobs.contains(id)) {
+        m_output[id] += data;
+    }
+}
+
+void BackupTreeModel::onJobFinished(quint64 id, int exitCode)
+{
+    Node *node = m_jobs.take(id);
+    const QString listing = m_output.take(id);
+    if (!node) {
+        return;
+    }
+
+    // A directory that can't be read shows up empty rather than being
+    // retried on every expand.
+    if (exitCode != 0) {
+        setState(node, State::Loaded);
+        Q_EMIT listingFailed(node->path, listing.trimmed().section(QLatin1Char('\n'), -1));
+        return;
+    }
+
+    populate(node, listing);
+}
+
+void BackupTreeModel::onJobFailed(quint64 id, QProcess::ProcessError error)
+{
+    Node *node = m_jobs.take(id);
+    m_output.remove(id);
+    if (!node) {
+        return;
+    }
+
+    setState(node, State::Loaded);
+    Q_EMIT listingFailed(node->path, CommandExecutor::errorString(error));
+}
+
+BackupTreeModel::Node *BackupTreeModel::nodeFor(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<Node *>(index.internalPointer()) : m_root;
+}
+
+QModelIndex BackupTreeModel::indexFor(Node *node) const
+{
+    if (!node || node == m_root) {
+        return QModelIndex();
+    }
+    return createIndex(int(node->parent->children.indexOf(node)), 0, node);
+}
+
+void BackupTreeModel::load(Node *node)
+{
+    // -max-depth counts from the image root, so asking for one level below
+    // the directory lists its entries and nothing deeper. -no-wildcards
+    // keeps a name with * or [ in it from matching its siblings too.
+    const int depth = node->path.isEmpty() ? 0 : int(node->path.count(QLatin1Char('/'))) + 1;
+
+    CommandExecutor::Job job;
+    job.program = QStringLiteral("unsquashfs");
+    job.arguments << QStringLiteral("-ll") << QStringLiteral("-max-depth") << QString::number(depth + 1) << QStringLiteral("-no-wildcards")
+                  << m_imagePath;
+    if (!node->path.isEmpty()) {
+        job.arguments << node->path;
+    }
+    job.privileged = false;
+    job.resources << QStringLiteral("backup:%1").arg(m_imagePath);
+
+    m_jobs.insert(m_executor->submit(job), node);
+    setState(node, State::Loading);
+}
+
+void BackupTreeModel::populate(Node *node, const QString &listing)
+{
+    // e.g. "-rw-r--r-- root/root   1234 2024-05-01 10:00 squashfs-root/etc/fstab"
+    // Device nodes show "major, minor" instead of a size.
+    static const QRegularExpression entryPattern(QStringLiteral(
+        R"(^([-dlcbps][-rwxsStT]{9})\s+(\S+)\s+(\d+|\d+,\s*\d+)\s+(\d{4}-\d{2}-\d{2} \d{2}:\d{2})\s+(.*)$)"));
+
+    const QString prefix = node->path.isEmpty() ? ListingRoot + QLatin1Char('/')
+                                                : ListingRoot + QLatin1Char('/') + node->path + QLatin1Char('/');
+
+    QList<Node *> children;
+    const QStringList lines = listing.split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    for (const QString &line : lines) {
+        const QRegularExpressionMatch match = entryPattern.match(line);
+        if (!match.hasMatch()) {
+            continue;
+        }
+
+        const QString mode = match.captured(1);
+        QString name = match.captured(5);
+        QString target;
+        if (mode.startsWith(QLatin1Char('l'))) {
+            const qsizetype arrow = name.indexOf(QStringLiteral(" -> "));
+            if (arrow >= 0) {
+                target = name.mid(arrow + 4);
+                name.truncate(arrow);
+            }
+        }
+
+        // The listing also includes the directory itself and its ancestors.
+        if (!name.startsWith(prefix)) {
+            continue;
+        }
+        name = name.mid(prefix.size());
+        if (name.isEmpty() || name.contains(QLatin1Char('/'))) {
+            continue;
+        }
+
+        auto *child = new Node;
+        child->name = name;
+        child->path = node->path.isEmpty() ? name : node->path + QLatin1Char('/') + name;
+        child->type = mode.at(0);
+        child->size = match.captured(3).contains(QLatin1Char(',')) ? 0 : match.captured(3).toLongLong();
+        child->mode = mode;
+        child->owner = match.captured(2);
+        child->modified = QDateTime::fromString(match.captured(4), QStringLiteral("yyyy-MM-dd HH:mm"));
+        child->linkTarget = target;
+        child->parent = node;
+        child->state = child->type == QLatin1Char('d') ? State::NotLoaded : State::Loaded;
+        children.append(child);
+    }
+
+    std::sort(children.begin(), children.end(), [](const Node *a, const Node *b) {
+        const bool aDir = a->type == QLatin1Char('d');
+        const bool bDir = b->type == QLatin1Char('d');
+        if (aDir != bDir) {
+            return aDir;
+        }
+        return a->name.localeAwareCompare(b->name) < 0;
+    });
+
+    if (!children.isEmpty()) {
+        beginInsertRows(indexFor(node), 0, int(children.count()) - 1);
+        node->children = children;
+        endInsertRows();
+    }
+    setState(node, State::Loaded);
+}
+
+void BackupTreeModel::setState(Node *node, State state)
+{
+    node->state = state;
+
+    const QModelIndex index = indexFor(node);
+    if (index.isValid()) {
+        Q_EMIT dataChanged(index, index, {LoadingRole});
+    }
+}
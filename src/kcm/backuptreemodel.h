@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QDateTime>
+#include <QHash>
+#include <QProcess>
+#include <qqmlregistration.h>
+
+#include "commandexecutor.h"
+
+// The directory tree inside one backup image, read a directory at a time as
+// the view expands it. Each directory costs one unsquashfs listing limited to
+// its own depth, which only decodes that directory's metadata blocks, so
+// browsing stays fast however large the image is.
+class BackupTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by BackupManager")
+    Q_PROPERTY(QString imagePath READ imagePath NOTIFY imagePathChanged)
+
+public:
+    enum Roles {
+        NameRole = Qt::UserRole + 1,
+        PathRole,
+        IsDirRole,
+        SizeRole,
+        SizeStringRole,
+        ModeRole,
+        OwnerRole,
+        ModifiedRole,
+        LinkTargetRole,
+        LoadingRole
+    };
+
+    explicit BackupTreeModel(CommandExecutor *executor, QObject *parent = nullptr);
+    ~BackupTreeModel() override;
+
+    QString imagePath() const;
+    // Starts over with the root of another image; an empty path clears it.
+    void setImagePath(const QString &imagePath);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+Q_SIGNALS:
+    void imagePathChanged();
+    void listingFailed(const QString &path, const QString &message);
+
+private Q_SLOTS:
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
+
+private:
+    enum class State {
+        NotLoaded,
+        Loading,
+        Loaded
+    };
+
+    struct Node {
+        ~Node();
+
+        QString name;
+        // Relative to the image root, without a leading slash; empty for the root.
+        QString path;
+        QChar type;
+        qint64 size = 0;
+        QString mode;
+        QString owner;
+        QDateTime modified;
+        QString linkTarget;
+        Node *parent = nullptr;
+        QList<Node *> children;
+        State state = State::NotLoaded;
+    };
+
+    Node *nodeFor(const QModelIndex &index) const;
+    QModelIndex indexFor(Node *node) const;
+    void load(Node *node);
+    void populate(Node *node, const QString &listing);
+    void setState(Node *node, State state);
+
+    CommandExecutor *m_executor;
+    QString m_imagePath;
+    Node *m_root;
+    QHash<quint64, Node *> m_jobs;
+    QHash<quint64, QString> m_output;
+};
@@ -0,0 +1,333 @@
+#include "backupverifier.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+
+namespace
+{
+
+// Bump when the cache layout changes.
+constexpr int CacheVersion = 1;
+// Large enough that mapping costs nothing next to hashing, small enough to
+// keep address space use modest with several images in flight.
+constexpr qint64 MapWindow = 64 * 1024 * 1024;
+// Fallback for files that can't be mapped (e.g. on some network mounts).
+constexpr qint64 ReadBlock = 4 * 1024 * 1024;
+constexpr qint64 ProgressIntervalMs = 250;
+
+QString stateName(BackupVerifier::State state)
+{
+    return state == BackupVerifier::State::Verified ? QStringLiteral("verified") : QStringLiteral("mismatch");
+}
+
+}
+
+BackupVerifier::BackupVerifier(QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_cachePath(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                  + QStringLiteral("/kcm_obsidianos/backup-verification.json"))
+{
+    qRegisterMetaType<BackupVerifier::Result>();
+
+    // Images usually share one disk; beyond a few readers they only compete
+    // for it.
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), 4));
+
+    loadCache();
+}
+
+BackupVerifier::~BackupVerifier()
+{
+    m_generation.fetchAndAddOrdered(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QHash<QString, BackupVerifier::Result> BackupVerifier::cachedResults(const QList<BackupInfo> &backups) const
+{
+    QHash<QString, Result> results;
+    for (const BackupInfo &backup : backups) {
+        if (m_running.contains(backup.path)) {
+            Result result;
+            result.state = State::Verifying;
+            results.insert(backup.path, result);
+        } else if (backup.checksum.isEmpty() || backup.deduplicated) {
+            Result result;
+            result.state = State::NoChecksum;
+            results.insert(backup.path, result);
+        } else if (const CacheEntry *entry = cacheEntry(backup)) {
+            results.insert(backup.path, entry->result);
+        }
+    }
+    return results;
+}
+
+void BackupVerifier::verify(const QList<BackupInfo> &backups, bool force)
+{
+    const bool wasActive = isActive();
+    const quint64 generation = m_generation.loadAcquire();
+
+    for (const BackupInfo &backup : backups) {
+        if (m_running.contains(backup.path) || (!force && cacheEntry(backup))) {
+            continue;
+        }
+
+        // Deduplicated images are checked chunk by chunk when reassembled.
+        QCryptographicHash::Algorithm algorithm;
+        QByteArray expected;
+        if (backup.deduplicated || !parseChecksum(backup.checksum, &algorithm, &expected)) {
+            Result result;
+            result.state = State::NoChecksum;
+            Q_EMIT finished(backup.path, result);
+            continue;
+        }
+
+        m_running.insert(backup.path);
+        m_pool.start([this, backup, algorithm, expected, generation]() {
+            hash(backup, algorithm, expected, generation);
+        });
+
+        Result result;
+        result.state = State::Verifying;
+        Q_EMIT progress(backup.path, result);
+    }
+
+    if (isActive() != wasActive) {
+        Q_EMIT activeChanged();
+    }
+}
+
+void BackupVerifier::cancel()
+{
+    // Queued images report back without being read, running ones stop at
+    // the next window; either way through onHashed(). Later rounds are not
+    // affected.
+    m_generation.fetchAndAddOrdered(1);
+}
+
+bool BackupVerifier::isActive() const
+{
+    return !m_running.isEmpty();
+}
+
+// Runs on a pool thread: only the arguments and m_generation may be touched.
+void BackupVerifier::hash(const BackupInfo &backup, QCryptographicHash::Algorithm algorithm, const QByteArray &expected, quint64 generation)
+{
+    const auto cancelled = [this, generation]() {
+        return m_generation.loadAcquire() != generation;
+    };
+
+    Result result;
+    result.state = State::Failed;
+
+    QFile file(backup.path);
+    if (cancelled() || !file.open(QIODevice::ReadOnly)) {
+        result.state = cancelled() ? State::Unknown : State::Failed;
+        QMetaObject::invokeMethod(this, [this, backup, result]() {
+            onHashed(backup, result);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    QCryptographicHash hash(algorithm);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 lastProgress = 0;
+
+    const qint64 size = file.size();
+    QByteArray buffer;
+    bool ok = true;
+    while (result.bytesDone < size) {
+        if (cancelled()) {
+            ok = false;
+            break;
+        }
+
+        const qint64 length = qMin(MapWindow, size - result.bytesDone);
+        if (uchar *data = file.map(result.bytesDone, length)) {
+            hash.addData(QByteArrayView(reinterpret_cast<const char *>(data), length));
+            file.unmap(data);
+            result.bytesDone += length;
+        } else {
+            if (buffer.isEmpty()) {
+                buffer.resize(ReadBlock);
+                file.seek(result.bytesDone);
+            }
+            const qint64 read = file.read(buffer.data(), buffer.size());
+            if (read <= 0) {
+                ok = false;
+                break;
+            }
+            hash.addData(QByteArrayView(buffer.constData(), read));
+            result.bytesDone += read;
+        }
+
+        const qint64 elapsed = timer.elapsed();
+        if (elapsed - lastProgress >= ProgressIntervalMs) {
+            lastProgress = elapsed;
+            result.state = State::Verifying;
+            result.throughput = result.bytesDone * 1000.0 / qMax<qint64>(elapsed, 1);
+            QMetaObject::invokeMethod(this, [this, path = backup.path, result]() {
+                Q_EMIT progress(path, result);
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    result.throughput = result.bytesDone * 1000.0 / qMax<qint64>(timer.elapsed(), 1);
+    if (ok) {
+        result.state = hash.result() == expected ? State::Verified : State::Mismatch;
+        result.verifiedAt = QDateTime::currentDateTime();
+    } else {
+        result.state = cancelled() ? State::Unknown : State::Failed;
+    }
+
+    QMetaObject::invokeMethod(this, [this, backup, result]() {
+        onHashed(backup, result);
+    }, Qt::QueuedConnection);
+}
+
+void BackupVerifier::onHashed(const BackupInfo &backup, const Result &result)
+{
+    m_running.remove(backup.path);
+
+    // Only a completed comparison is worth remembering; a read error may be
+    // gone next time.
+    if (result.state == State::Verified || result.state == State::Mismatch) {
+        CacheEntry entry;
+        entry.modified = backup.timestamp.toMSecsSinceEpoch();
+        entry.size = backup.size;
+        entry.checksum = backup.checksum;
+        entry.result = result;
+        m_cache.insert(backup.path, entry);
+        saveCache();
+    }
+
+    Q_EMIT finished(backup.path, result);
+    if (!isActive()) {
+        Q_EMIT activeChanged();
+    }
+}
+
+const BackupVerifier::CacheEntry *BackupVerifier::cacheEntry(const BackupInfo &backup) const
+{
+    auto it = m_cache.constFind(backup.path);
+    if (it == m_cache.constEnd()) {
+        return nullptr;
+    }
+
+    const CacheEntry &entry = it.value();
+    if (entry.modified != backup.timestamp.toMSecsSinceEpoch() || entry.size != backup.size
+        || entry.checksum != backup.checksum) {
+        return nullptr;
+    }
+    return &entry;
+}
+
+void BackupVerifier::loadCache()
+{
+    QFile file(m_cachePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QJsonObject cache = QJsonDocument::fromJson(file.readAll()).object();
+    if (cache.value(QStringLiteral("cache_version")).toInt() != CacheVersion) {
+        return;
+    }
+
+    const QJsonArray entries = cache.value(QStringLiteral("entries")).toArray();
+    for (const QJsonValue &value : entries) {
+        const QJsonObject obj = value.toObject();
+        CacheEntry entry;
+        entry.modified = obj.value(QStringLiteral("modified")).toInteger();
+        entry.size = obj.value(QStringLiteral("size")).toInteger();
+        entry.checksum = obj.value(QStringLiteral("checksum")).toString();
+        entry.result.state = obj.value(QStringLiteral("state")).toString() == QLatin1String("verified") ? State::Verified
+                                                                                                          : State::Mismatch;
+        entry.result.verifiedAt = QDateTime::fromMSecsSinceEpoch(obj.value(QStringLiteral("verified_at")).toInteger());
+        entry.result.bytesDone = entry.size;
+        entry.result.throughput = obj.value(QStringLiteral("throughput")).toDouble();
+        m_cache.insert(obj.value(QStringLiteral("path")).toString(), entry);
+    }
+}
+
+void BackupVerifier::saveCache() const
+{
+    QDir().mkpath(QFileInfo(m_cachePath).absolutePath());
+
+    QJsonArray entries;
+    for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); ++it) {
+        // Drop results for images that are gone.
+        if (!QFileInfo::exists(it.key())) {
+            continue;
+        }
+        entries.append(QJsonObject{
+            {QStringLiteral("path"), it.key()},
+            {QStringLiteral("modified"), it->modified},
+            {QStringLiteral("size"), it->size},
+            {QStringLiteral("checksum"), it->checksum},
+            {QStringLiteral("state"), stateName(it->result.state)},
+            {QStringLiteral("verified_at"), it->result.verifiedAt.toMSecsSinceEpoch()},
+            {QStringLiteral("throughput"), it->result.throughput}
+        });
+    }
+
+    QJsonObject cache;
+    cache.insert(QStringLiteral("cache_version"), CacheVersion);
+    cache.insert(QStringLiteral("entries"), entries);
+
+    QSaveFile file(m_cachePath);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+}
+
+bool BackupVerifier::parseChecksum(const QString &checksum, QCryptographicHash::Algorithm *algorithm, QByteArray *digest)
+{
+    // Also accept sha256sum's "<hex>  <file>" output.
+    QString hex = checksum.trimmed().section(QLatin1Char(' '), 0, 0);
+    QString name;
+    const qsizetype colon = hex.indexOf(QLatin1Char(':'));
+    if (colon >= 0) {
+        name = hex.left(colon).toLower();
+        hex = hex.mid(colon + 1);
+    }
+
+    *digest = QByteArray::fromHex(hex.toLatin1());
+    if (digest->isEmpty() || digest->size() * 2 != hex.size()) {
+        return false;
+    }
+
+    if (name == QLatin1String("blake2b")) {
+        *algorithm = QCryptographicHash::Blake2b_512;
+        return digest->size() == 64;
+    }
+    if (name == QLatin1String("sha3-256")) {
+        *algorithm = QCryptographicHash::Sha3_256;
+        return digest->size() == 32;
+    }
+
+    // Otherwise the digest length tells the SHA-2 variant.
+    switch (digest->size()) {
+    case 32:
+        *algorithm = QCryptographicHash::Sha256;
+        return true;
+    case 48:
+        *algorithm = QCryptographicHash::Sha384;
+        return true;
+    case 64:
+        *algorithm = QCryptographicHash::Sha512;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+#include "backupinfo.h"
+
+// Checks backup images against the checksum written when they were created.
+// Images are hashed on a thread pool, one image per thread, reading through
+// large mmap windows. Results are cached on disk together with the image's
+// mtime, size and expected checksum, so an unchanged image is only hashed
+// once.
+class BackupVerifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class State {
+        Unknown,
+        Verifying,
+        Verified,
+        Mismatch,
+        NoChecksum,
+        Failed
+    };
+
+    struct Result {
+        State state = State::Unknown;
+        QDateTime verifiedAt;
+        qint64 bytesDone = 0;
+        // Bytes per second of the last or running hash, 0 if none.
+        double throughput = 0;
+    };
+
+    explicit BackupVerifier(QObject *parent = nullptr);
+    ~BackupVerifier() override;
+
+    // Results still valid for these backups, without hashing anything.
+    QHash<QString, Result> cachedResults(const QList<BackupInfo> &backups) const;
+    // Queues every backup whose cached result is missing or stale, or all of
+    // them with force. Backups already being hashed are skipped.
+    void verify(const QList<BackupInfo> &backups, bool force = false);
+    void cancel();
+    bool isActive() const;
+
+Q_SIGNALS:
+    void progress(const QString &path, const BackupVerifier::Result &result);
+    void finished(const QString &path, const BackupVerifier::Result &result);
+    void activeChanged();
+
+private:
+    struct CacheEntry {
+        qint64 modified = 0;
+        qint64 size = 0;
+        QString checksum;
+        Result result;
+    };
+
+    void hash(const BackupInfo &backup, QCryptographicHash::Algorithm algorithm, const QByteArray &expected, quint64 generation);
+    void onHashed(const BackupInfo &backup, const Result &result);
+    const CacheEntry *cacheEntry(const BackupInfo &backup) const;
+    void loadCache();
+    void saveCache() const;
+
+    // Algorithm and raw digest of a "sha256:<hex>" or bare hex checksum.
+    static bool parseChecksum(const QString &checksum, QCryptographicHash::Algorithm *algorithm, QByteArray *digest);
+
+    QThreadPool m_pool;
+    // Bumped by cancel(); tasks queued before that see a newer value and
+    // stop, those queued after it carry the new one.
+    QAtomicInteger<quint64> m_generation;
+    QHash<QString, CacheEntry> m_cache;
+    QSet<QString> m_running;
+    QString m_cachePath;
+};
+
+Q_DECLARE_METATYPE(BackupVerifier::Result)
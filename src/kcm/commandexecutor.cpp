@@ -0,0 +1,469 @@
+#include "commandexecutor.h"
+#include "../helper/helperprotocol.h"
+
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QMetaObject>
+
+namespace
+{
+
+// Generous because the first call of a session waits for the polkit dialog.
+constexpr int HelperCallTimeout = 10 * 60 * 1000;
+
+constexpr qsizetype ReadBufferSize = 64 * 1024;
+
+}
+
+CommandExecutor::CommandExecutor(QObject *parent)
+    : QObject(parent)
+    , m_nextId(1)
+    , m_helperAvailable(false)
+    , m_helperWatcher(new QDBusServiceWatcher(HelperProtocol::service(), QDBusConnection::systemBus(),
+                                              QDBusServiceWatcher::WatchForUnregistration, this))
+{
+    m_readBuffer.resize(ReadBufferSize);
+
+    qDBusRegisterMetaType<QList<QStringList>>();
+
+    QDBusConnection bus = QDBusConnection::systemBus();
+    bus.connect(HelperProtocol::service(), HelperProtocol::path(), HelperProtocol::interface(),
+                QStringLiteral("Output"), this, SLOT(onHelperOutput(uint,QByteArray)));
+    bus.connect(HelperProtocol::service(), HelperProtocol::path(), HelperProtocol::interface(),
+                QStringLiteral("Finished"), this, SLOT(onHelperFinished(uint,int)));
+    connect(m_helperWatcher, &QDBusServiceWatcher::serviceUnregistered, this, &CommandExecutor::onHelperGone);
+
+    probeHelper();
+}
+
+CommandExecutor::~CommandExecutor()
+{
+    m_queue.clear();
+
+    for (Entry &entry : m_running) {
+        if (entry.process) {
+            entry.process->disconnect();
+            entry.process->kill();
+            entry.process->waitForFinished();
+            delete entry.process;
+        }
+        delete entry.decoder;
+    }
+    m_running.clear();
+}
+
+CommandExecutor::Job CommandExecutor::obsidianctl(const QString &command, const QStringList &args, bool privileged)
+{
+    Job job;
+    job.program = QStringLiteral("obsidianctl");
+    job.arguments << command << args;
+    job.privileged = privileged;
+    return job;
+}
+
+QString CommandExecutor::errorString(QProcess::ProcessError error)
+{
+    switch (error) {
+        case QProcess::FailedToStart:
+            return tr("Failed to start process. Make sure pkexec and obsidianctl are installed.");
+        case QProcess::Crashed:
+            return tr("Process crashed.");
+        case QProcess::Timedout:
+            return tr("Process timed out.");
+        default:
+            return tr("Unknown process error occurred.");
+    }
+}
+
+quint64 CommandExecutor::submit(const Job &job)
+{
+    Entry entry;
+    entry.id = m_nextId++;
+    entry.job = job;
+    m_queue.append(entry);
+
+    // Deferred so the caller can record the id before any signal for it fires.
+    QMetaObject::invokeMethod(this, [this]() {
+        schedule();
+    }, Qt::QueuedConnection);
+    return entry.id;
+}
+
+void CommandExecutor::cancel(quint64 id)
+{
+    for (int i = 0; i < m_queue.count(); i++) {
+        if (m_queue.at(i).id == id) {
+            m_queue.removeAt(i);
+            Q_EMIT jobFailed(id, QProcess::Crashed);
+            return;
+        }
+    }
+
+    auto it = m_running.find(id);
+    if (it == m_running.end()) {
+        return;
+    }
+
+    if (it->process) {
+        it->process->kill();
+    } else if (it->helperId) {
+        QDBusMessage call = QDBusMessage::createMethodCall(HelperProtocol::service(), HelperProtocol::path(),
+                                                           HelperProtocol::interface(), QStringLiteral("Cancel"));
+        call << it->helperId;
+        QDBusConnection::systemBus().send(call);
+    } else {
+        // Still waiting for the helper to accept it; the reply handler
+        // cancels the helper side once it knows the id.
+        fail(id, QProcess::Crashed);
+    }
+}
+
+bool CommandExecutor::isActive(quint64 id) const
+{
+    if (m_running.contains(id)) {
+        return true;
+    }
+
+    for (const Entry &entry : m_queue) {
+        if (entry.id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int CommandExecutor::runningCount() const
+{
+    return m_running.count();
+}
+
+int CommandExecutor::queuedCount() const
+{
+    return m_queue.count();
+}
+
+void CommandExecutor::onHelperOutput(uint helperId, const QByteArray &data)
+{
+    const quint64 id = m_helperJobs.value(helperId);
+    if (!id) {
+        m_earlyHelperOutput[helperId] += data;
+        return;
+    }
+
+    auto it = m_running.find(id);
+    if (it != m_running.end()) {
+        emitOutput(*it, data);
+    }
+}
+
+void CommandExecutor::onHelperFinished(uint helperId, int exitCode)
+{
+    const quint64 id = m_helperJobs.value(helperId);
+    if (!id) {
+        m_earlyHelperExit.insert(helperId, exitCode);
+        return;
+    }
+
+    complete(id, exitCode);
+}
+
+void CommandExecutor::onHelperGone()
+{
+    // Its jobs died with it, and a restarted helper counts its ids from 1
+    // again, so none of them may be matched up with its signals.
+    QList<quint64> orphaned;
+    for (const Entry &entry : std::as_const(m_running)) {
+        if (entry.helperId) {
+            orphaned << entry.id;
+        }
+    }
+    m_helperJobs.clear();
+    m_earlyHelperOutput.clear();
+    m_earlyHelperExit.clear();
+
+    // It normally just went idle; activation starts it again if it is still
+    // installed.
+    m_helperAvailable = false;
+    probeHelper();
+
+    for (const quint64 id : std::as_const(orphaned)) {
+        // A receiver of an earlier failure may have cancelled it.
+        if (m_running.contains(id)) {
+            fail(id, QProcess::Crashed);
+        }
+    }
+}
+
+QList<QStringList> CommandExecutor::commandLines(const Job &job)
+{
+    if (!job.batch.isEmpty()) {
+        return job.batch;
+    }
+
+    QStringList argv;
+    argv << job.program << job.arguments;
+    return {argv};
+}
+
+void CommandExecutor::probeHelper()
+{
+    QDBusConnectionInterface *bus = QDBusConnection::systemBus().interface();
+    if (!bus) {
+        return;
+    }
+
+    auto *watcher = new QDBusPendingCallWatcher(bus->asyncCall(QStringLiteral("ListActivatableNames")), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+
+        QDBusPendingReply<QStringList> reply = *watcher;
+        if (!reply.isError() && reply.value().contains(HelperProtocol::service())) {
+            m_helperAvailable = true;
+        }
+    });
+}
+
+void CommandExecutor::schedule()
+{
+    // Later jobs may overtake a blocked one as long as they don't touch the
+    // same resources, so an unrelated health check never waits on a backup.
+    for (int i = 0; i < m_queue.count();) {
+        if (conflicts(m_queue.at(i).job)) {
+            i++;
+            continue;
+        }
+
+        Entry entry = m_queue.takeAt(i);
+        const quint64 id = entry.id;
+        m_running.insert(id, entry);
+        start(m_running[id]);
+    }
+}
+
+bool CommandExecutor::conflicts(const Job &job) const
+{
+    for (const Entry &running : m_running) {
+        for (const QString &resource : job.resources) {
+            if (running.job.resources.contains(resource)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CommandExecutor::start(Entry &entry)
+{
+    const quint64 id = entry.id;
+    const bool viaHelper = entry.job.privileged && m_helperAvailable;
+
+    entry.decoder = new QStringDecoder(QStringDecoder::Utf8);
+
+    Q_EMIT jobStarted(id);
+
+    if (viaHelper) {
+        startHelperJob(id);
+    } else {
+        startProcessStep(id);
+    }
+}
+
+void CommandExecutor::startHelperJob(quint64 id)
+{
+    auto it = m_running.find(id);
+    if (it == m_running.end()) {
+        return;
+    }
+
+    QDBusMessage call = QDBusMessage::createMethodCall(HelperProtocol::service(), HelperProtocol::path(),
+                                                       HelperProtocol::interface(), QStringLiteral("Execute"));
+    call << QVariant::fromValue(commandLines(it->job));
+
+    auto *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(call, HelperCallTimeout), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, id](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+
+        QDBusPendingReply<uint> reply = *watcher;
+        auto it = m_running.find(id);
+
+        if (it == m_running.end()) {
+            if (!reply.isError()) {
+                QDBusMessage call = QDBusMessage::createMethodCall(HelperProtocol::service(), HelperProtocol::path(),
+                                                                   HelperProtocol::interface(), QStringLiteral("Cancel"));
+                call << reply.value();
+                QDBusConnection::systemBus().send(call);
+            }
+            return;
+        }
+
+        if (reply.isError()) {
+            const QDBusError error = reply.error();
+            if (error.name() == HelperProtocol::notAuthorizedError()) {
+                Q_EMIT jobOutput(id, tr("Not authorized."));
+                complete(id, 126);
+                return;
+            }
+
+            // The helper refuses commands outside its allow-list (e.g. files
+            // in a custom backup directory); those still work through pkexec.
+            if (error.type() != QDBusError::InvalidArgs) {
+                m_helperAvailable = false;
+            }
+            startProcessStep(id);
+            return;
+        }
+
+        const uint helperId = reply.value();
+        it->helperId = helperId;
+        m_helperJobs.insert(helperId, id);
+
+        const QByteArray early = m_earlyHelperOutput.take(helperId);
+        if (!early.isEmpty()) {
+            emitOutput(*it, early);
+        }
+
+        auto exit = m_earlyHelperExit.find(helperId);
+        if (exit != m_earlyHelperExit.end()) {
+            const int exitCode = exit.value();
+            m_earlyHelperExit.erase(exit);
+            complete(id, exitCode);
+        }
+    });
+}
+
+void CommandExecutor::startProcessStep(quint64 id)
+{
+    auto it = m_running.find(id);
+    if (it == m_running.end()) {
+        return;
+    }
+
+    const QStringList argv = commandLines(it->job).at(it->step);
+
+    QProcess *process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::MergedChannels);
+    it->process = process;
+
+    connect(process, &QProcess::readyReadStandardOutput, this, [this, id]() {
+        readOutput(id);
+    });
+
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, id](int exitCode, QProcess::ExitStatus exitStatus) {
+        readOutput(id);
+
+        auto it = m_running.find(id);
+        if (it == m_running.end()) {
+            return;
+        }
+
+        it->process->disconnect(this);
+        it->process->deleteLater();
+        it->process = nullptr;
+
+        if (exitStatus == QProcess::CrashExit) {
+            fail(id, QProcess::Crashed);
+        } else if (exitCode == 0 && it->step + 1 < commandLines(it->job).count()) {
+            it->step++;
+            startProcessStep(id);
+        } else {
+            complete(id, exitCode);
+        }
+    });
+
+    connect(process, &QProcess::errorOccurred, this, [this, id](QProcess::ProcessError error) {
+        // Every other error is followed by finished(), which reports it.
+        if (error != QProcess::FailedToStart) {
+            return;
+        }
+
+        fail(id, error);
+    });
+
+    if (it->job.privileged) {
+        process->start(QStringLiteral("pkexec"), argv);
+    } else {
+        process->start(argv.constFirst(), argv.mid(1));
+    }
+}
+
+void CommandExecutor::readOutput(quint64 id)
+{
+    auto it = m_running.find(id);
+    if (it == m_running.end() || !it->process) {
+        return;
+    }
+
+    QProcess *process = it->process;
+    while (process->bytesAvailable() > 0) {
+        const qint64 count = process->read(m_readBuffer.data(), m_readBuffer.size());
+        if (count <= 0) {
+            break;
+        }
+
+        emitOutput(*it, QByteArrayView(m_readBuffer.constData(), count));
+
+        // A receiver may have cancelled the job.
+        it = m_running.find(id);
+        if (it == m_running.end() || it->process != process) {
+            return;
+        }
+    }
+}
+
+void CommandExecutor::emitOutput(Entry &entry, QByteArrayView data)
+{
+    // Decode straight into a buffer that keeps its capacity between reads;
+    // an incomplete sequence at the end stays in the decoder for next time.
+    m_decodeBuffer.resize(entry.decoder->requiredSpace(data.size()));
+    QChar *end = entry.decoder->appendToBuffer(m_decodeBuffer.data(), data);
+    m_decodeBuffer.resize(end - m_decodeBuffer.constData());
+
+    if (!m_decodeBuffer.isEmpty()) {
+        Q_EMIT jobOutput(entry.id, m_decodeBuffer);
+    }
+}
+
+void CommandExecutor::complete(quint64 id, int exitCode)
+{
+    release(id);
+
+    // The helper reports a crashed or killed command as a negative code.
+    if (exitCode < 0) {
+        Q_EMIT jobFailed(id, QProcess::Crashed);
+    } else {
+        Q_EMIT jobFinished(id, exitCode);
+    }
+    schedule();
+}
+
+void CommandExecutor::fail(quint64 id, QProcess::ProcessError error)
+{
+    release(id);
+    Q_EMIT jobFailed(id, error);
+    schedule();
+}
+
+void CommandExecutor::release(quint64 id)
+{
+    auto it = m_running.find(id);
+    if (it == m_running.end()) {
+        return;
+    }
+
+    if (it->process) {
+        it->process->disconnect(this);
+        it->process->deleteLater();
+    }
+    if (it->helperId) {
+        m_helperJobs.remove(it->helperId);
+    }
+    delete it->decoder;
+    m_running.erase(it);
+}
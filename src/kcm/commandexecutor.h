@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QStringDecoder>
+#include <QStringList>
+
+class QDBusServiceWatcher;
+
+class CommandExecutor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // A job waits in the queue while any running job holds one of its
+    // resources (e.g. "slot:a", "bootloader"). Jobs without resources never wait.
+    struct Job {
+        QString program;
+        QStringList arguments;
+        bool privileged = true;
+        QStringList resources;
+        // When set, these command lines run in order instead of
+        // program/arguments and the job stops at the first failing one.
+        QList<QStringList> batch;
+    };
+
+    explicit CommandExecutor(QObject *parent = nullptr);
+    ~CommandExecutor() override;
+
+    static Job obsidianctl(const QString &command, const QStringList &args = QStringList(), bool privileged = true);
+    static QString errorString(QProcess::ProcessError error);
+
+    quint64 submit(const Job &job);
+    void cancel(quint64 id);
+    bool isActive(quint64 id) const;
+    int runningCount() const;
+    int queuedCount() const;
+
+Q_SIGNALS:
+    void jobStarted(quint64 id);
+    void jobOutput(quint64 id, const QString &data);
+    void jobFinished(quint64 id, int exitCode);
+    void jobFailed(quint64 id, QProcess::ProcessError error);
+
+private Q_SLOTS:
+    void onHelperOutput(uint helperId, const QByteArray &data);
+    void onHelperFinished(uint helperId, int exitCode);
+    void onHelperGone();
+
+private:
+    struct Entry {
+        quint64 id = 0;
+        Job job;
+        QProcess *process = nullptr;
+        // Kept for the whole job so a character split across reads (or
+        // across batch steps) still decodes correctly.
+        QStringDecoder *decoder = nullptr;
+        int step = 0;
+        uint helperId = 0;
+    };
+
+    static QList<QStringList> commandLines(const Job &job);
+
+    void probeHelper();
+    void schedule();
+    bool conflicts(const Job &job) const;
+    void start(Entry &entry);
+    void startHelperJob(quint64 id);
+    void startProcessStep(quint64 id);
+    void readOutput(quint64 id);
+    void emitOutput(Entry &entry, QByteArrayView data);
+    void complete(quint64 id, int exitCode);
+    void fail(quint64 id, QProcess::ProcessError error);
+    void release(quint64 id);
+
+    quint64 m_nextId;
+    QList<Entry> m_queue;
+    QHash<quint64, Entry> m_running;
+    bool m_helperAvailable;
+    QDBusServiceWatcher *m_helperWatcher;
+    QHash<uint, quint64> m_helperJobs;
+    QHash<uint, QByteArray> m_earlyHelperOutput;
+    QHash<uint, int> m_earlyHelperExit;
+    // Reused for every read so streaming output doesn't allocate per chunk.
+    QByteArray m_readBuffer;
+    QString m_decodeBuffer;
+};
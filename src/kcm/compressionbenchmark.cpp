@@ -0,0 +1,517 @@
+#include "compressionbenchmark.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <algorithm>
+
+namespace
+{
+
+// Large enough for the ratio to settle, small enough to run every profile
+// in a few minutes.
+constexpr qint64 SampleSize = 128 * 1024 * 1024;
+// Longer files only contribute their start, so one big file can't make up
+// the whole sample.
+constexpr qint64 MaxSampledFileSize = 4 * 1024 * 1024;
+
+// mksquashfs runs under a shell whose `times` reports the CPU time of its
+// children, which is what the compressor threads used.
+const QString BenchmarkScript = QStringLiteral("mksquashfs \"$@\" >/dev/null && times");
+
+}
+
+bool CompressionBenchmark::Profile::isValid() const
+{
+    return !compressor.isEmpty();
+}
+
+QString CompressionBenchmark::Profile::id() const
+{
+    return QStringLiteral("%1:%2:%3").arg(compressor).arg(level).arg(threads);
+}
+
+CompressionBenchmark::Profile CompressionBenchmark::Profile::fromId(const QString &id)
+{
+    static const QRegularExpression pattern(QStringLiteral("^([a-z0-9]+)(?::(\\d+))?(?::(\\d+))?$"));
+    const QRegularExpressionMatch match = pattern.match(id);
+
+    Profile profile;
+    if (match.hasMatch()) {
+        profile.compressor = match.captured(1);
+        profile.level = match.captured(2).toInt();
+        profile.threads = match.captured(3).toInt();
+    }
+    return profile;
+}
+
+CompressionBenchmark::CompressionBenchmark(CommandExecutor *executor, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_executor(executor)
+    , m_current(-1)
+    , m_job(0)
+    , m_sampler(nullptr)
+    , m_cancelled(false)
+    , m_sampleBytes(0)
+    , m_sourceBytes(0)
+{
+    connect(m_executor, &CommandExecutor::jobStarted, this, &CompressionBenchmark::onJobStarted);
+    connect(m_executor, &CommandExecutor::jobOutput, this, &CompressionBenchmark::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &CompressionBenchmark::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &CompressionBenchmark::onJobFailed);
+}
+
+CompressionBenchmark::~CompressionBenchmark()
+{
+    cancel();
+}
+
+QList<CompressionBenchmark::Profile> CompressionBenchmark::candidates()
+{
+    const int all = QThread::idealThreadCount();
+    const int half = qMax(1, all / 2);
+
+    // Half the cores shows what leaving the desktop responsive costs.
+    QList<Profile> profiles = {
+        {QStringLiteral("lz4"), 0, all},
+        {QStringLiteral("lzo"), 0, all},
+        {QStringLiteral("gzip"), 6, all},
+        {QStringLiteral("gzip"), 9, all},
+        {QStringLiteral("zstd"), 3, all},
+        {QStringLiteral("zstd"), 9, all},
+        {QStringLiteral("zstd"), 15, all},
+        {QStringLiteral("zstd"), 15, half},
+        {QStringLiteral("zstd"), 19, all},
+        {QStringLiteral("xz"), 0, all},
+        {QStringLiteral("xz"), 0, half},
+    };
+    if (half == all) {
+        profiles.removeAt(10);
+        profiles.removeAt(7);
+    }
+    return profiles;
+}
+
+int CompressionBenchmark::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_results.count();
+}
+
+QVariant CompressionBenchmark::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_results.count()) {
+        return QVariant();
+    }
+
+    const Result &result = m_results.at(index.row());
+    const bool done = result.state == State::Done;
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case LabelRole:
+        return label(result.profile);
+    case IdRole:
+        return result.profile.id();
+    case CompressorRole:
+        return result.profile.compressor;
+    case LevelRole:
+        return result.profile.level;
+    case ThreadsRole:
+        return result.profile.threads;
+    case StateRole:
+        return stateName(result.state);
+    case RatioRole:
+        return done && m_sampleBytes > 0 ? double(result.imageBytes) / m_sampleBytes : 0.0;
+    case ProjectedSizeRole:
+        return done ? qint64(result.imageBytes * projectionFactor()) : qint64(0);
+    case ProjectedSizeStringRole:
+        return done ? QLocale().formattedDataSize(qint64(result.imageBytes * projectionFactor())) : QString();
+    case ProjectedSecondsRole:
+        return done ? result.wallMs / 1000.0 * projectionFactor() : 0.0;
+    case CpuUsageRole:
+        // Average number of cores kept busy.
+        return done && result.wallMs > 0 ? result.cpuSeconds / (result.wallMs / 1000.0) : 0.0;
+    case ErrorRole:
+        return result.error;
+    case RecommendedRole:
+        return done && result.profile.id() == m_recommended;
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> CompressionBenchmark::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[IdRole] = "profileId";
+    roles[LabelRole] = "label";
+    roles[CompressorRole] = "compressor";
+    roles[LevelRole] = "level";
+    roles[ThreadsRole] = "threads";
+    roles[StateRole] = "state";
+    roles[RatioRole] = "ratio";
+    roles[ProjectedSizeRole] = "projectedSize";
+    roles[ProjectedSizeStringRole] = "projectedSizeString";
+    roles[ProjectedSecondsRole] = "projectedSeconds";
+    roles[CpuUsageRole] = "cpuUsage";
+    roles[ErrorRole] = "error";
+    roles[RecommendedRole] = "recommended";
+    return roles;
+}
+
+bool CompressionBenchmark::running() const
+{
+    return m_sampler || m_current >= 0;
+}
+
+double CompressionBenchmark::progress() const
+{
+    if (m_results.isEmpty()) {
+        return 0;
+    }
+
+    const int finished = std::count_if(m_results.cbegin(), m_results.cend(), [](const Result &result) {
+        return result.state == State::Done || result.state == State::Failed;
+    });
+    return double(finished) / m_results.count();
+}
+
+qint64 CompressionBenchmark::sampleBytes() const
+{
+    return m_sampleBytes;
+}
+
+QString CompressionBenchmark::recommended() const
+{
+    return m_recommended;
+}
+
+void CompressionBenchmark::start(const QString &sourceRoot, qint64 sourceBytes)
+{
+    if (running()) {
+        return;
+    }
+
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kcm_obsidianos");
+    QDir().mkpath(cacheDir);
+    // On disk rather than in /tmp, which is often RAM.
+    m_workDir = std::make_unique<QTemporaryDir>(cacheDir + QStringLiteral("/benchmark-XXXXXX"));
+    if (!m_workDir->isValid() || !QDir().mkpath(m_workDir->filePath(QStringLiteral("sample")))) {
+        m_workDir.reset();
+        Q_EMIT failed(tr("Cannot create a directory for the benchmark sample."));
+        return;
+    }
+
+    beginResetModel();
+    m_results.clear();
+    const QList<Profile> profiles = candidates();
+    for (const Profile &profile : profiles) {
+        m_results.append(Result{profile});
+    }
+    m_recommended.clear();
+    m_sampleBytes = 0;
+    m_sourceBytes = sourceBytes;
+    endResetModel();
+
+    m_cancelled = false;
+    const QString sampleDir = m_workDir->filePath(QStringLiteral("sample"));
+    auto sampled = std::make_shared<qint64>(0);
+    m_sampler = QThread::create([this, sourceRoot, sampleDir, sampled]() {
+        *sampled = takeSample(sourceRoot, sampleDir, m_cancelled);
+    });
+    connect(m_sampler, &QThread::finished, this, [this, sampled]() {
+        onSampled(*sampled);
+    });
+    m_sampler->start(QThread::LowPriority);
+
+    Q_EMIT runningChanged();
+    Q_EMIT progressChanged();
+}
+
+void CompressionBenchmark::cancel()
+{
+    if (!running()) {
+        return;
+    }
+
+    if (m_sampler) {
+        m_cancelled = true;
+        m_sampler->disconnect(this);
+        m_sampler->wait();
+        delete m_sampler;
+        m_sampler = nullptr;
+    }
+    if (m_job) {
+        m_executor->cancel(m_job);
+        m_job = 0;
+    }
+
+    for (Result &result : m_results) {
+        if (result.state == State::Queued || result.state == State::Running) {
+            result.state = State::Failed;
+            result.error = tr("Cancelled");
+        }
+    }
+    if (!m_results.isEmpty()) {
+        Q_EMIT dataChanged(index(0), index(m_results.count() - 1));
+    }
+    stop();
+}
+
+void CompressionBenchmark::onSampled(qint64 bytes)
+{
+    m_sampler->deleteLater();
+    m_sampler = nullptr;
+
+    if (bytes <= 0) {
+        beginResetModel();
+        m_results.clear();
+        endResetModel();
+        stop();
+        Q_EMIT failed(tr("No readable files to sample were found."));
+        return;
+    }
+
+    m_sampleBytes = bytes;
+    Q_EMIT progressChanged();
+    m_current = 0;
+    runNext();
+}
+
+void CompressionBenchmark::runNext()
+{
+    if (m_current >= m_results.count()) {
+        stop();
+        return;
+    }
+
+    Result &result = m_results[m_current];
+    result.state = State::Running;
+    Q_EMIT dataChanged(index(m_current), index(m_current));
+
+    QStringList arguments = {QStringLiteral("-c"), BenchmarkScript, QStringLiteral("sh"),
+                             m_workDir->filePath(QStringLiteral("sample")), imagePath(),
+                             QStringLiteral("-noappend"), QStringLiteral("-no-progress"),
+                             QStringLiteral("-comp"), result.profile.compressor};
+    if (result.profile.level > 0) {
+        arguments << QStringLiteral("-Xcompression-level") << QString::number(result.profile.level);
+    }
+    if (result.profile.threads > 0) {
+        arguments << QStringLiteral("-processors") << QString::number(result.profile.threads);
+    }
+
+    CommandExecutor::Job job;
+    job.program = QStringLiteral("sh");
+    job.arguments = arguments;
+    job.privileged = false;
+    // Timings mean nothing while another benchmark shares the CPU.
+    job.resources << QStringLiteral("benchmark");
+
+    m_output.clear();
+    m_jobTimer.invalidate();
+    m_job = m_executor->submit(job);
+}
+
+void CompressionBenchmark::onJobStarted(quint64 id)
+{
+    if (id == m_job) {
+        m_jobTimer.start();
+    }
+}
+
+void CompressionBenchmark::onJobOutput(quint64 id, const QString &data)
+{
+    if (id == m_job) {
+        m_output += data;
+    }
+}
+
+void CompressionBenchmark::onJobFinished(quint64 id, int exitCode)
+{
+    if (id != m_job) {
+        return;
+    }
+
+    Result &result = m_results[m_current];
+    result.wallMs = m_jobTimer.isValid() ? m_jobTimer.elapsed() : 0;
+
+    if (exitCode != 0) {
+        // Most likely a compressor this mksquashfs wasn't built with.
+        const QStringList lines = m_output.split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+        finishRun(State::Failed, lines.isEmpty() ? tr("mksquashfs exited with code %1").arg(exitCode) : lines.constLast().trimmed());
+        return;
+    }
+
+    // The last line of `times` is the children's user and system time.
+    static const QRegularExpression timesLine(QStringLiteral("(\\d+)m([\\d.,]+)s\\s+(\\d+)m([\\d.,]+)s"));
+    QRegularExpressionMatchIterator it = timesLine.globalMatch(m_output);
+    QRegularExpressionMatch match;
+    while (it.hasNext()) {
+        match = it.next();
+    }
+    if (match.hasMatch()) {
+        auto seconds = [&match](int minutes, int rest) {
+            return match.captured(minutes).toInt() * 60 + match.captured(rest).replace(QLatin1Char(','), QLatin1Char('.')).toDouble();
+        };
+        result.cpuSeconds = seconds(1, 2) + seconds(3, 4);
+    }
+
+    result.imageBytes = QFileInfo(imagePath()).size();
+    finishRun(State::Done, QString());
+}
+
+void CompressionBenchmark::onJobFailed(quint64 id, QProcess::ProcessError error)
+{
+    if (id != m_job) {
+        return;
+    }
+    finishRun(State::Failed, CommandExecutor::errorString(error));
+}
+
+void CompressionBenchmark::finishRun(State state, const QString &error)
+{
+    Result &result = m_results[m_current];
+    result.state = state;
+    result.error = error;
+    QFile::remove(imagePath());
+
+    m_job = 0;
+    updateRecommended();
+    Q_EMIT dataChanged(index(0), index(m_results.count() - 1));
+    Q_EMIT progressChanged();
+
+    m_current++;
+    runNext();
+}
+
+void CompressionBenchmark::stop()
+{
+    m_current = -1;
+    m_job = 0;
+    m_workDir.reset();
+    Q_EMIT runningChanged();
+    Q_EMIT progressChanged();
+}
+
+void CompressionBenchmark::updateRecommended()
+{
+    qint64 smallest = -1;
+    for (const Result &result : std::as_const(m_results)) {
+        if (result.state == State::Done && (smallest < 0 || result.imageBytes < smallest)) {
+            smallest = result.imageBytes;
+        }
+    }
+
+    m_recommended.clear();
+    qint64 fastest = -1;
+    for (const Result &result : std::as_const(m_results)) {
+        if (result.state != State::Done || result.imageBytes > smallest + smallest / 10) {
+            continue;
+        }
+        if (fastest < 0 || result.wallMs < fastest) {
+            fastest = result.wallMs;
+            m_recommended = result.profile.id();
+        }
+    }
+}
+
+double CompressionBenchmark::projectionFactor() const
+{
+    if (m_sampleBytes <= 0 || m_sourceBytes <= 0) {
+        return 1;
+    }
+    return double(m_sourceBytes) / m_sampleBytes;
+}
+
+QString CompressionBenchmark::imagePath() const
+{
+    return m_workDir->filePath(QStringLiteral("sample.sfs"));
+}
+
+qint64 CompressionBenchmark::takeSample(const QString &sourceRoot, const QString &sampleDir, const std::atomic<bool> &cancelled)
+{
+    struct Candidate {
+        QString path;
+        qint64 size;
+    };
+
+    QList<Candidate> files;
+    QDirIterator it(sourceRoot, QDir::Files | QDir::Hidden | QDir::NoSymLinks, QDirIterator::Subdirectories);
+    while (it.hasNext() && !cancelled) {
+        const QString path = it.next();
+        const QFileInfo info = it.fileInfo();
+        if (info.size() > 0 && info.isReadable()) {
+            files.append({path, info.size()});
+        }
+    }
+
+    // A fixed seed samples the same files every run, so results stay
+    // comparable between runs on the same system.
+    QRandomGenerator random(0x6f627364);
+    std::shuffle(files.begin(), files.end(), random);
+
+    qint64 total = 0;
+    int copied = 0;
+    QByteArray buffer;
+    for (const Candidate &candidate : std::as_const(files)) {
+        if (cancelled || total >= SampleSize) {
+            break;
+        }
+
+        QFile source(candidate.path);
+        if (!source.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        buffer = source.read(std::min({candidate.size, MaxSampledFileSize, SampleSize - total}));
+        if (buffer.isEmpty()) {
+            continue;
+        }
+
+        QFile target(sampleDir + QLatin1Char('/') + QString::number(copied));
+        if (!target.open(QIODevice::WriteOnly) || target.write(buffer) != buffer.size()) {
+            return 0;
+        }
+        total += buffer.size();
+        copied++;
+    }
+
+    return cancelled ? 0 : total;
+}
+
+QString CompressionBenchmark::label(const Profile &profile)
+{
+    QString text = profile.compressor;
+    if (profile.level > 0) {
+        text += QLatin1Char(' ') + QString::number(profile.level);
+    }
+    if (profile.threads > 0) {
+        text += QLatin1String(", ") + tr("%n thread(s)", nullptr, profile.threads);
+    }
+    return text;
+}
+
+QString CompressionBenchmark::stateName(State state)
+{
+    switch (state) {
+    case State::Queued:
+        return QStringLiteral("queued");
+    case State::Running:
+        return QStringLiteral("running");
+    case State::Done:
+        return QStringLiteral("done");
+    case State::Failed:
+        return QStringLiteral("failed");
+    }
+    return QString();
+}
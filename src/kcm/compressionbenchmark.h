@@ -0,0 +1,134 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QProcess>
+#include <QStringList>
+#include <qqmlregistration.h>
+
+#include <atomic>
+#include <memory>
+
+#include "commandexecutor.h"
+
+class QTemporaryDir;
+class QThread;
+
+// Measures what the SquashFS compressors cost on this machine. A sample of
+// the running system's files is packed once per profile (compressor, level
+// and thread count) and the resulting size, wall time and CPU time are
+// scaled up to the size of the slot being backed up.
+class CompressionBenchmark : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by BackupManager")
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(qint64 sampleBytes READ sampleBytes NOTIFY progressChanged)
+    Q_PROPERTY(QString recommended READ recommended NOTIFY progressChanged)
+
+public:
+    enum Roles {
+        IdRole = Qt::UserRole + 1,
+        LabelRole,
+        CompressorRole,
+        LevelRole,
+        ThreadsRole,
+        StateRole,
+        RatioRole,
+        ProjectedSizeRole,
+        ProjectedSizeStringRole,
+        ProjectedSecondsRole,
+        CpuUsageRole,
+        ErrorRole,
+        RecommendedRole
+    };
+
+    // Level and threads of 0 leave mksquashfs's defaults.
+    struct Profile {
+        QString compressor;
+        int level = 0;
+        int threads = 0;
+
+        bool isValid() const;
+        // "compressor:level:threads", as passed to createBackup().
+        QString id() const;
+        static Profile fromId(const QString &id);
+    };
+
+    explicit CompressionBenchmark(CommandExecutor *executor, QObject *parent = nullptr);
+    ~CompressionBenchmark() override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    bool running() const;
+    double progress() const;
+    qint64 sampleBytes() const;
+    // Id of the fastest profile whose image is within a tenth of the
+    // smallest one, empty until one has finished.
+    QString recommended() const;
+
+    // Samples sourceRoot and projects the results to sourceBytes.
+    void start(const QString &sourceRoot, qint64 sourceBytes);
+    void cancel();
+
+    static QList<Profile> candidates();
+
+Q_SIGNALS:
+    void runningChanged();
+    void progressChanged();
+    void failed(const QString &message);
+
+private Q_SLOTS:
+    void onJobStarted(quint64 id);
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
+
+private:
+    enum class State {
+        Queued,
+        Running,
+        Done,
+        Failed
+    };
+
+    struct Result {
+        Profile profile;
+        State state = State::Queued;
+        qint64 imageBytes = 0;
+        qint64 wallMs = 0;
+        double cpuSeconds = 0;
+        QString error;
+    };
+
+    void onSampled(qint64 bytes);
+    void runNext();
+    void finishRun(State state, const QString &error);
+    void stop();
+    void updateRecommended();
+    double projectionFactor() const;
+    QString imagePath() const;
+
+    static qint64 takeSample(const QString &sourceRoot, const QString &sampleDir, const std::atomic<bool> &cancelled);
+    static QString label(const Profile &profile);
+    static QString stateName(State state);
+
+    CommandExecutor *m_executor;
+    QList<Result> m_results;
+    int m_current;
+    quint64 m_job;
+    QElapsedTimer m_jobTimer;
+    QString m_output;
+    QString m_recommended;
+
+    std::unique_ptr<QTemporaryDir> m_workDir;
+    QThread *m_sampler;
+    std::atomic<bool> m_cancelled;
+    qint64 m_sampleBytes;
+    qint64 m_sourceBytes;
+};
@@ -1,35 +1,55 @@
 #include "environmentmanager.h"
+#include "../slottool/slottoolprotocol.h"
 
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+#include <QLocale>
 #include <QStandardPaths>
 
-EnvironmentManager::EnvironmentManager(QObject *parent)
+namespace
+{
+
+KConfigGroup verificationGroup()
+{
+    return KSharedConfig::openConfig(QStringLiteral("kcm_obsidianosrc"))->group(QStringLiteral("Verification"));
+}
+
+}
+
+EnvironmentManager::EnvironmentManager(CommandExecutor *executor, QObject *parent)
     : QObject(parent)
-    , m_process(nullptr)
-    , m_busy(false)
+    , m_executor(executor)
+    , m_log(new LogBuffer(this))
+    , m_outputModel(new LogLineModel(m_log, this))
     , m_enableNetworking(false)
     , m_mountEssentials(true)
     , m_mountHome(false)
     , m_mountRoot(false)
+    , m_verifyJob(0)
 {
+    connect(m_executor, &CommandExecutor::jobOutput, this, &EnvironmentManager::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &EnvironmentManager::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &EnvironmentManager::onJobFailed);
 }
 
 EnvironmentManager::~EnvironmentManager()
 {
-    if (m_process) {
-        m_process->kill();
-        m_process->waitForFinished();
-        delete m_process;
-    }
 }
 
 bool EnvironmentManager::busy() const
 {
-    return m_busy;
+    return !m_jobs.isEmpty();
+}
+
+LogBuffer *EnvironmentManager::log() const
+{
+    return m_log;
 }
 
-QString EnvironmentManager::output() const
+LogLineModel *EnvironmentManager::outputModel() const
 {
-    return m_output;
+    return m_outputModel;
 }
 
 bool EnvironmentManager::enableNetworking() const
@@ -52,6 +72,48 @@ bool EnvironmentManager::mountRoot() const
     return m_mountRoot;
 }
 
+bool EnvironmentManager::verifying() const
+{
+    return m_verifyJob != 0;
+}
+
+double EnvironmentManager::verifyProgress() const
+{
+    return m_verifyProgress.bytesTotal > 0 ? double(m_verifyProgress.bytesDone) / m_verifyProgress.bytesTotal : 0;
+}
+
+qint64 EnvironmentManager::verifyBytesDone() const
+{
+    return m_verifyProgress.bytesDone;
+}
+
+qint64 EnvironmentManager::verifyBytesTotal() const
+{
+    return m_verifyProgress.bytesTotal;
+}
+
+double EnvironmentManager::verifyThroughput() const
+{
+    return m_verifyProgress.bytesRate.rate();
+}
+
+qint64 EnvironmentManager::verifyMismatches() const
+{
+    return m_verifyProgress.mismatches;
+}
+
+QString EnvironmentManager::verifyThrottle() const
+{
+    // Verifying reads the whole partition, so by default it yields to
+    // everything else.
+    return verificationGroup().readEntry("Throttle", QStringLiteral("idle"));
+}
+
+int EnvironmentManager::verifyLimit() const
+{
+    return verificationGroup().readEntry("Limit", 100);
+}
+
 void EnvironmentManager::setEnableNetworking(bool enabled)
 {
     if (m_enableNetworking != enabled) {
@@ -84,10 +146,32 @@ void EnvironmentManager::setMountRoot(bool enabled)
     }
 }
 
-void EnvironmentManager::enterSlot(const QString &slot)
+void EnvironmentManager::setVerifyThrottle(const QString &throttle)
+{
+    if (throttle == verifyThrottle()) {
+        return;
+    }
+
+    KConfigGroup group = verificationGroup();
+    group.writeEntry("Throttle", throttle);
+    group.sync();
+    Q_EMIT verifyThrottleChanged();
+}
+
+void EnvironmentManager::setVerifyLimit(int limit)
 {
-    m_currentOperation = QStringLiteral("enter-slot");
+    if (limit <= 0 || limit == verifyLimit()) {
+        return;
+    }
+
+    KConfigGroup group = verificationGroup();
+    group.writeEntry("Limit", limit);
+    group.sync();
+    Q_EMIT verifyThrottleChanged();
+}
 
+void EnvironmentManager::enterSlot(const QString &slot)
+{
     QStringList args;
     args << QStringLiteral("obsidianctl") << QStringLiteral("enter-slot") << slot;
 
@@ -117,8 +201,8 @@ void EnvironmentManager::enterSlot(const QString &slot)
         return;
     }
 
-    m_output = tr("Opening terminal for slot %1...").arg(slot.toUpper());
-    Q_EMIT outputChanged();
+    m_log->clear();
+    m_log->append(tr("Opening terminal for slot %1...").arg(slot.toUpper()));
 
     QProcess *terminalProcess = new QProcess(this);
     connect(terminalProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
@@ -138,146 +222,214 @@ void EnvironmentManager::enterSlot(const QString &slot)
 
 void EnvironmentManager::verifyIntegrity(const QString &slot)
 {
-    m_currentOperation = QStringLiteral("verify-integrity");
-    startProcess(QStringLiteral("verify-integrity"), {slot});
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("verify-integrity"), {slot});
+    job.resources << QStringLiteral("slot:%1").arg(slot);
+    submit(Operation::VerifyIntegrity, job);
 }
 
-void EnvironmentManager::clearOutput()
+void EnvironmentManager::verifyBlocks(const QString &slot, bool record)
 {
-    m_output.clear();
-    Q_EMIT outputChanged();
+    if (m_verifyJob) {
+        return;
+    }
+
+    QStringList args = {QStringLiteral("verify"), slot};
+    if (record) {
+        args << QStringLiteral("--record");
+    }
+    const QString throttle = verifyThrottle();
+    if (throttle == QStringLiteral("idle")) {
+        args << QStringLiteral("--idle");
+    } else if (throttle == QStringLiteral("limit")) {
+        args << QStringLiteral("--limit") << QString::number(verifyLimit());
+    }
+
+    m_verifySlot = slot;
+    m_verifyLines.clear();
+    m_verifyResult.clear();
+    m_verifyProgress = VerifyProgress();
+    m_verifyClock.start();
+
+    CommandExecutor::Job job;
+    job.program = SlotToolProtocol::program();
+    job.arguments = args;
+    job.resources << QStringLiteral("slot:%1").arg(slot);
+    m_verifyJob = submit(Operation::VerifyBlocks, job);
+    Q_EMIT verifyProgressChanged();
 }
 
-void EnvironmentManager::startProcess(const QString &command, const QStringList &args, bool usePolkit)
+void EnvironmentManager::cancelVerification()
 {
-    if (m_busy) {
+    if (!m_verifyJob) {
         return;
     }
 
-    if (m_process) {
-        m_process->disconnect();
-        m_process->kill();
-        m_process->waitForFinished(1000);
-        delete m_process;
-        m_process = nullptr;
+    // Forgotten first, so the kill isn't reported as a failure.
+    const quint64 id = m_verifyJob;
+    m_jobs.remove(id);
+    m_verifyJob = 0;
+    m_executor->cancel(id);
+
+    m_log->append(tr("\nVerification stopped. It continues from where it stopped next time.\n"));
+    if (m_jobs.isEmpty()) {
+        Q_EMIT busyChanged();
     }
+    Q_EMIT verifyProgressChanged();
+}
 
-    m_process = new QProcess(this);
-    m_process->setProcessChannelMode(QProcess::MergedChannels);
+void EnvironmentManager::clearOutput()
+{
+    m_log->clear();
+}
 
-    connect(m_process, &QProcess::readyReadStandardOutput, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardOutput());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
-        }
-    });
-
-    connect(m_process, &QProcess::readyReadStandardError, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardError());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
-        }
-    });
-
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
-        Q_UNUSED(exitStatus)
-
-        if (m_process) {
-            QString remainingOutput = QString::fromUtf8(m_process->readAllStandardOutput());
-            QString remainingError = QString::fromUtf8(m_process->readAllStandardError());
-
-            if (!remainingOutput.isEmpty()) {
-                m_output += remainingOutput;
-            }
-            if (!remainingError.isEmpty()) {
-                m_output += remainingError;
-            }
-            Q_EMIT outputChanged();
-        }
+quint64 EnvironmentManager::submit(Operation operation, const CommandExecutor::Job &job)
+{
+    const bool wasBusy = busy();
+    if (!wasBusy) {
+        m_log->clear();
+    }
+
+    const quint64 id = m_executor->submit(job);
+    m_jobs.insert(id, operation);
 
-        m_busy = false;
+    if (!wasBusy) {
         Q_EMIT busyChanged();
+    }
+    return id;
+}
 
-        if (exitCode == 0) {
-            if (m_currentOperation == QStringLiteral("verify-integrity")) {
-                m_output += QStringLiteral("\n\nIntegrity verification completed successfully.");
-                Q_EMIT outputChanged();
-                Q_EMIT operationSucceeded(tr("Success"), tr("Slot integrity verified successfully."));
-            }
-        } else {
-            QString errorMsg = m_output.trimmed();
-            if (errorMsg.isEmpty()) {
-                errorMsg = tr("Operation failed with exit code %1").arg(exitCode);
-            }
-            Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        }
+void EnvironmentManager::onJobOutput(quint64 id, const QString &data)
+{
+    if (!m_jobs.contains(id)) {
+        return;
+    }
 
-        m_currentOperation.clear();
+    if (m_jobs.value(id) == Operation::VerifyBlocks) {
+        readVerifyLines(m_verifyLines.read(data));
+        return;
+    }
 
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
-        }
-    });
+    m_log->append(data);
+}
 
-    connect(m_process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
-        m_busy = false;
+void EnvironmentManager::onJobFinished(quint64 id, int exitCode)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
+
+    const Operation operation = it.value();
+    m_jobs.erase(it);
+
+    if (m_jobs.isEmpty()) {
         Q_EMIT busyChanged();
+    }
 
-        QString errorMsg;
-        switch (error) {
-            case QProcess::FailedToStart:
-                errorMsg = tr("Failed to start process. Make sure pkexec and obsidianctl are installed.");
-                break;
-            case QProcess::Crashed:
-                errorMsg = tr("Process crashed.");
-                break;
-            case QProcess::Timedout:
-                errorMsg = tr("Process timed out.");
-                break;
-            default:
-                errorMsg = tr("Unknown process error occurred.");
-                break;
-        }
-        Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        m_currentOperation.clear();
+    if (operation == Operation::VerifyBlocks) {
+        finishVerification(exitCode);
+        return;
+    }
 
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
+    if (exitCode == 0) {
+        switch (operation) {
+        case Operation::VerifyIntegrity:
+            m_log->append(QStringLiteral("\n\nIntegrity verification completed successfully."));
+            Q_EMIT operationSucceeded(tr("Success"), tr("Slot integrity verified successfully."));
+            break;
+        case Operation::VerifyBlocks:
+            break;
         }
-    });
-
-    m_busy = true;
-    Q_EMIT busyChanged();
+    } else {
+        QString errorMsg = m_log->tail().trimmed();
+        if (errorMsg.isEmpty()) {
+            errorMsg = tr("Operation failed with exit code %1").arg(exitCode);
+        }
+        Q_EMIT errorOccurred(tr("Error"), errorMsg);
+    }
+}
 
-    m_output.clear();
-    Q_EMIT outputChanged();
+void EnvironmentManager::onJobFailed(quint64 id, QProcess::ProcessError error)
+{
+    if (!m_jobs.remove(id)) {
+        return;
+    }
 
-    if (usePolkit) {
-        QStringList fullArgs;
-        fullArgs << QStringLiteral("obsidianctl") << command << args;
-        m_process->start(QStringLiteral("pkexec"), fullArgs);
-    } else {
-        QStringList fullArgs;
-        fullArgs << command << args;
-        m_process->start(QStringLiteral("obsidianctl"), fullArgs);
+    if (m_jobs.isEmpty()) {
+        Q_EMIT busyChanged();
     }
+    if (id == m_verifyJob) {
+        m_verifyJob = 0;
+        Q_EMIT verifyProgressChanged();
+    }
+
+    Q_EMIT errorOccurred(tr("Error"), CommandExecutor::errorString(error));
 }
 
-void EnvironmentManager::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void EnvironmentManager::readVerifyLines(const QStringList &lines)
 {
-    Q_UNUSED(exitCode)
-    Q_UNUSED(exitStatus)
+    bool progressed = false;
+    for (const QString &line : lines) {
+        const QStringList fields = line.split(QLatin1Char('\t'));
+        if (fields.count() == 2 && fields.at(0) == SlotToolProtocol::ResultField) {
+            m_verifyResult = fields.at(1);
+            continue;
+        }
+        if (fields.count() == 3 && fields.at(0) == SlotToolProtocol::MismatchField) {
+            const QLocale locale;
+            m_log->append(tr("Differs at offset %1: %2\n").arg(locale.toString(fields.at(1).toLongLong()), locale.formattedDataSize(fields.at(2).toLongLong())));
+            continue;
+        }
+        if (fields.count() != 4 || fields.at(0) != SlotToolProtocol::VerifyField) {
+            m_log->append(line + QLatin1Char('\n'));
+            continue;
+        }
+
+        VerifyProgress &progress = m_verifyProgress;
+        const qint64 bytesDone = fields.at(1).toLongLong();
+        // A resumed run starts with the bytes of the earlier ones, which
+        // weren't read just now; the first sample only sets the baseline.
+        progress.bytesRate.sample(m_verifyClock.elapsed(), bytesDone);
+        progress.bytesDone = bytesDone;
+        progress.bytesTotal = fields.at(2).toLongLong();
+        progress.mismatches = fields.at(3).toLongLong();
+        progressed = true;
+    }
+
+    if (progressed) {
+        Q_EMIT verifyProgressChanged();
+    }
 }
 
-void EnvironmentManager::onProcessReadyRead()
+void EnvironmentManager::finishVerification(int exitCode)
 {
-}
\ No newline at end of file
+    readVerifyLines(m_verifyLines.finish());
+    m_verifyJob = 0;
+    Q_EMIT verifyProgressChanged();
+
+    const QString slot = m_verifySlot.toUpper();
+    if (exitCode == 0 && m_verifyResult == QStringLiteral("verified")) {
+        m_log->append(tr("\nEvery block of slot %1 matches its reference.\n").arg(slot));
+        Q_EMIT operationSucceeded(tr("Success"), tr("Slot %1 matches its recorded reference.").arg(slot));
+    } else if (exitCode == 0 && m_verifyResult == QStringLiteral("recorded")) {
+        m_log->append(tr("\nRecorded a reference for slot %1.\n").arg(slot));
+        Q_EMIT operationSucceeded(tr("Success"), tr("Recorded a reference for slot %1. Later verifications compare against it.").arg(slot));
+    } else if (m_verifyResult == QStringLiteral("mismatch")) {
+        Q_EMIT errorOccurred(tr("Verification Failed"),
+                             tr("%1 chunks of slot %2 differ from its recorded reference. "
+                                "The disk may be failing.")
+                                 .arg(m_verifyProgress.mismatches)
+                                 .arg(slot));
+    } else if (m_verifyResult == QStringLiteral("stale")) {
+        Q_EMIT errorOccurred(tr("Reference Out of Date"),
+                             tr("Slot %1 was changed since its reference was recorded. Record a new reference to verify it again.").arg(slot));
+    } else if (m_verifyResult == QStringLiteral("missing")) {
+        Q_EMIT errorOccurred(tr("No Reference"), tr("No reference has been recorded for slot %1 yet.").arg(slot));
+    } else {
+        QString errorMsg = m_log->tail().trimmed();
+        if (errorMsg.isEmpty()) {
+            errorMsg = tr("Operation failed with exit code %1").arg(exitCode);
+        }
+        Q_EMIT errorOccurred(tr("Error"), errorMsg);
+    }
+}
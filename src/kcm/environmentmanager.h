@@ -1,63 +1,122 @@
 #pragma once
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QProcess>
 #include <qqmlregistration.h>
 
+#include "commandexecutor.h"
+#include "logbuffer.h"
+#include "loglinemodel.h"
+#include "progressparser.h"
+
 class EnvironmentManager : public QObject
 {
     Q_OBJECT
     QML_ELEMENT
+    QML_UNCREATABLE("Provided by the KCM")
     Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
-    Q_PROPERTY(QString output READ output NOTIFY outputChanged)
+    Q_PROPERTY(LogBuffer* log READ log CONSTANT)
+    Q_PROPERTY(LogLineModel* outputModel READ outputModel CONSTANT)
     Q_PROPERTY(bool enableNetworking READ enableNetworking WRITE setEnableNetworking NOTIFY enableNetworkingChanged)
     Q_PROPERTY(bool mountEssentials READ mountEssentials WRITE setMountEssentials NOTIFY mountEssentialsChanged)
     Q_PROPERTY(bool mountHome READ mountHome WRITE setMountHome NOTIFY mountHomeChanged)
     Q_PROPERTY(bool mountRoot READ mountRoot WRITE setMountRoot NOTIFY mountRootChanged)
+    // Progress of a block verification, from the slot tool's records.
+    Q_PROPERTY(bool verifying READ verifying NOTIFY verifyProgressChanged)
+    Q_PROPERTY(double verifyProgress READ verifyProgress NOTIFY verifyProgressChanged)
+    Q_PROPERTY(qint64 verifyBytesDone READ verifyBytesDone NOTIFY verifyProgressChanged)
+    Q_PROPERTY(qint64 verifyBytesTotal READ verifyBytesTotal NOTIFY verifyProgressChanged)
+    // Bytes per second, smoothed.
+    Q_PROPERTY(double verifyThroughput READ verifyThroughput NOTIFY verifyProgressChanged)
+    Q_PROPERTY(qint64 verifyMismatches READ verifyMismatches NOTIFY verifyProgressChanged)
+    // "none", "idle" (idle I/O priority) or "limit" (verifyLimit MiB/s).
+    Q_PROPERTY(QString verifyThrottle READ verifyThrottle WRITE setVerifyThrottle NOTIFY verifyThrottleChanged)
+    Q_PROPERTY(int verifyLimit READ verifyLimit WRITE setVerifyLimit NOTIFY verifyThrottleChanged)
 
 public:
-    explicit EnvironmentManager(QObject *parent = nullptr);
+    explicit EnvironmentManager(CommandExecutor *executor, QObject *parent = nullptr);
     ~EnvironmentManager() override;
 
     bool busy() const;
-    QString output() const;
+    LogBuffer *log() const;
+    LogLineModel *outputModel() const;
     bool enableNetworking() const;
     bool mountEssentials() const;
     bool mountHome() const;
     bool mountRoot() const;
+    bool verifying() const;
+    double verifyProgress() const;
+    qint64 verifyBytesDone() const;
+    qint64 verifyBytesTotal() const;
+    double verifyThroughput() const;
+    qint64 verifyMismatches() const;
+    QString verifyThrottle() const;
+    int verifyLimit() const;
 
     void setEnableNetworking(bool enabled);
     void setMountEssentials(bool enabled);
     void setMountHome(bool enabled);
     void setMountRoot(bool enabled);
+    void setVerifyThrottle(const QString &throttle);
+    void setVerifyLimit(int limit);
 
     Q_INVOKABLE void enterSlot(const QString &slot);
     Q_INVOKABLE void verifyIntegrity(const QString &slot);
+    // Reads the whole partition of a slot other than the running one and
+    // compares it with the reference recorded for it, or records a new
+    // reference. A stopped run picks up where it left off next time.
+    Q_INVOKABLE void verifyBlocks(const QString &slot, bool record = false);
+    Q_INVOKABLE void cancelVerification();
     Q_INVOKABLE void clearOutput();
 
 Q_SIGNALS:
     void busyChanged();
-    void outputChanged();
     void enableNetworkingChanged();
     void mountEssentialsChanged();
     void mountHomeChanged();
     void mountRootChanged();
+    void verifyProgressChanged();
+    void verifyThrottleChanged();
     void errorOccurred(const QString &title, const QString &message);
     void operationSucceeded(const QString &title, const QString &message);
 
 private Q_SLOTS:
-    void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onProcessReadyRead();
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
 
 private:
-    void startProcess(const QString &command, const QStringList &args, bool usePolkit = true);
+    enum class Operation {
+        VerifyIntegrity,
+        VerifyBlocks
+    };
+
+    struct VerifyProgress {
+        qint64 bytesDone = 0;
+        qint64 bytesTotal = 0;
+        qint64 mismatches = 0;
+        RateMeter bytesRate;
+    };
 
-    QProcess *m_process;
-    bool m_busy;
-    QString m_output;
-    QString m_currentOperation;
+    quint64 submit(Operation operation, const CommandExecutor::Job &job);
+    void readVerifyLines(const QStringList &lines);
+    void finishVerification(int exitCode);
+
+    CommandExecutor *m_executor;
+    QHash<quint64, Operation> m_jobs;
+    LogBuffer *m_log;
+    LogLineModel *m_outputModel;
     bool m_enableNetworking;
     bool m_mountEssentials;
     bool m_mountHome;
     bool m_mountRoot;
+
+    quint64 m_verifyJob;
+    QString m_verifySlot;
+    LineReader m_verifyLines;
+    QString m_verifyResult;
+    VerifyProgress m_verifyProgress;
+    QElapsedTimer m_verifyClock;
 };
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "healthcheckmodel.h"
+#include "../slottool/slottoolprotocol.h"
+
+#include <algorithm>
+
+HealthCheckModel::HealthCheckModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_elapsed(0)
+    , m_running(false)
+{
+}
+
+int HealthCheckModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_results.count();
+}
+
+QVariant HealthCheckModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_results.count()) {
+        return QVariant();
+    }
+
+    const Result &result = m_results.at(index.row());
+    switch (role) {
+    case SlotRole:
+        return result.slot;
+    case CheckRole:
+        return result.check;
+    case Qt::DisplayRole:
+    case NameRole:
+        return checkName(result.check);
+    case StatusRole:
+        return result.status;
+    case DurationRole:
+        return result.duration;
+    case DetailsRole:
+        return result.details;
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> HealthCheckModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[SlotRole] = "slot";
+    roles[CheckRole] = "check";
+    roles[NameRole] = "name";
+    roles[StatusRole] = "status";
+    roles[DurationRole] = "duration";
+    roles[DetailsRole] = "details";
+    return roles;
+}
+
+bool HealthCheckModel::running() const
+{
+    return m_running;
+}
+
+int HealthCheckModel::passedCount() const
+{
+    return countStatus(SlotToolProtocol::CheckPassed);
+}
+
+int HealthCheckModel::warningCount() const
+{
+    return countStatus(SlotToolProtocol::CheckWarning);
+}
+
+int HealthCheckModel::failedCount() const
+{
+    return countStatus(SlotToolProtocol::CheckFailed);
+}
+
+qint64 HealthCheckModel::elapsed() const
+{
+    return m_running ? m_timer.elapsed() : m_elapsed;
+}
+
+qint64 HealthCheckModel::checkTime() const
+{
+    qint64 total = 0;
+    for (const Result &result : m_results) {
+        total += result.duration;
+    }
+    return total;
+}
+
+void HealthCheckModel::reset()
+{
+    beginResetModel();
+    m_results.clear();
+    m_lines.clear();
+    endResetModel();
+
+    m_timer.start();
+    m_elapsed = 0;
+    m_running = true;
+    Q_EMIT countsChanged();
+}
+
+QStringList HealthCheckModel::appendOutput(const QString &data)
+{
+    QStringList messages;
+    addRecords(m_lines.read(data), &messages);
+    return messages;
+}
+
+QStringList HealthCheckModel::finish()
+{
+    QStringList messages;
+    addRecords(m_lines.finish(), &messages);
+    return messages;
+}
+
+void HealthCheckModel::setResult(const QString &slot, const QString &check, const QString &status, qint64 duration, const QString &details)
+{
+    auto it = std::find_if(m_results.begin(), m_results.end(), [&slot, &check](const Result &result) {
+        return result.slot == slot && result.check == check;
+    });
+
+    if (it == m_results.end()) {
+        beginInsertRows(QModelIndex(), m_results.count(), m_results.count());
+        m_results.append(Result{slot, check, status, duration, details});
+        endInsertRows();
+    } else {
+        it->status = status;
+        it->duration = duration;
+        it->details = details;
+        const QModelIndex changed = index(int(it - m_results.begin()));
+        Q_EMIT dataChanged(changed, changed, {StatusRole, DurationRole, DetailsRole});
+    }
+    Q_EMIT countsChanged();
+}
+
+void HealthCheckModel::complete()
+{
+    for (int row = 0; row < m_results.count(); row++) {
+        Result &result = m_results[row];
+        if (result.status == SlotToolProtocol::CheckRunning) {
+            result.status = SlotToolProtocol::CheckSkipped;
+            Q_EMIT dataChanged(index(row), index(row), {StatusRole});
+        }
+    }
+
+    m_elapsed = m_timer.elapsed();
+    m_running = false;
+    Q_EMIT countsChanged();
+}
+
+QStringList HealthCheckModel::failedChecks() const
+{
+    QStringList names;
+    for (const Result &result : m_results) {
+        if (result.status != SlotToolProtocol::CheckFailed) {
+            continue;
+        }
+        names << (result.slot.isEmpty() ? checkName(result.check) : tr("%1 (slot %2)").arg(checkName(result.check), result.slot.toUpper()));
+    }
+    return names;
+}
+
+void HealthCheckModel::addRecords(const QStringList &lines, QStringList *messages)
+{
+    for (const QString &line : lines) {
+        // Details are last and escaped, so they never contain a tab.
+        const QStringList fields = line.split(QLatin1Char('\t'));
+        if (fields.count() != 6 || fields.at(0) != SlotToolProtocol::CheckField) {
+            messages->append(line);
+            continue;
+        }
+        setResult(fields.at(1), fields.at(2), fields.at(3), fields.at(4).toLongLong(), SlotToolProtocol::unescapePath(fields.at(5)));
+    }
+}
+
+int HealthCheckModel::countStatus(const QString &status) const
+{
+    return int(std::count_if(m_results.cbegin(), m_results.cend(), [&status](const Result &result) {
+        return result.status == status;
+    }));
+}
+
+QString HealthCheckModel::checkName(const QString &check)
+{
+    if (check == QStringLiteral("filesystem")) {
+        return tr("Filesystem");
+    }
+    if (check == QStringLiteral("boot-entries")) {
+        return tr("Boot entries");
+    }
+    if (check == QStringLiteral("kernel")) {
+        return tr("Kernel and initramfs");
+    }
+    if (check == QStringLiteral("free-space")) {
+        return tr("Free space");
+    }
+    if (check == QStringLiteral("packages")) {
+        return tr("Package database");
+    }
+    if (check == QStringLiteral("obsidianctl")) {
+        return tr("obsidianctl health check");
+    }
+    return check;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QList>
+#include <QStringList>
+#include <qqmlregistration.h>
+
+#include "progressparser.h"
+
+// Results of a health check, one row per check and slot in the order the
+// checks started. Rows show up as soon as a check starts and are updated
+// when it finishes, so slow checks don't hide the others.
+class HealthCheckModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by SlotManager")
+    Q_PROPERTY(bool running READ running NOTIFY countsChanged)
+    Q_PROPERTY(int passedCount READ passedCount NOTIFY countsChanged)
+    Q_PROPERTY(int warningCount READ warningCount NOTIFY countsChanged)
+    Q_PROPERTY(int failedCount READ failedCount NOTIFY countsChanged)
+    // Wall-clock time of the whole run in ms, and the checks' durations
+    // added up: the gap is what running them in parallel saved.
+    Q_PROPERTY(qint64 elapsed READ elapsed NOTIFY countsChanged)
+    Q_PROPERTY(qint64 checkTime READ checkTime NOTIFY countsChanged)
+
+public:
+    enum Roles {
+        SlotRole = Qt::UserRole + 1,
+        CheckRole,
+        NameRole,
+        StatusRole,
+        DurationRole,
+        DetailsRole
+    };
+
+    explicit HealthCheckModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    bool running() const;
+    int passedCount() const;
+    int warningCount() const;
+    int failedCount() const;
+    qint64 elapsed() const;
+    qint64 checkTime() const;
+
+    // Drops all results and starts timing a new run.
+    void reset();
+    // Adds the check records in a piece of the slot tool's output.
+    // Lines that aren't records (errors) are returned; a trailing partial
+    // line is kept for the next call.
+    QStringList appendOutput(const QString &data);
+    QStringList finish();
+    // Adds or updates the row of a check; status is one of
+    // SlotToolProtocol's check states. slot is empty for system-wide checks.
+    void setResult(const QString &slot, const QString &check, const QString &status, qint64 duration, const QString &details);
+    // Ends the run. Checks that never finished are marked skipped.
+    void complete();
+
+    // Names of the failed checks, with their slots.
+    QStringList failedChecks() const;
+
+Q_SIGNALS:
+    void countsChanged();
+
+private:
+    struct Result {
+        QString slot;
+        QString check;
+        QString status;
+        qint64 duration = 0;
+        QString details;
+    };
+
+    void addRecords(const QStringList &lines, QStringList *messages);
+    int countStatus(const QString &status) const;
+
+    static QString checkName(const QString &check);
+
+    QList<Result> m_results;
+    LineReader m_lines;
+    QElapsedTimer m_timer;
+    qint64 m_elapsed;
+    bool m_running;
+};
@@ -0,0 +1,259 @@
+#include "logbuffer.h"
+
+#include <QDir>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QTemporaryFile>
+
+namespace
+{
+
+constexpr qint64 DefaultMemoryLimit = 4 * 1024 * 1024;
+
+}
+
+LogBuffer::LogBuffer(QObject *parent)
+    : QObject(parent)
+    , m_length(0)
+    , m_spilledLength(0)
+    , m_memoryLimit(DefaultMemoryLimit)
+    , m_spillFile(nullptr)
+    , m_spillFailed(false)
+    , m_notifiedLength(0)
+    , m_coalescedNotifications(0)
+    , m_deliveredNotifications(0)
+{
+    // Some virtual outputs report a refresh rate of 0.
+    int interval = 16;
+    QScreen *screen = QGuiApplication::primaryScreen();
+    if (screen && screen->refreshRate() > 0) {
+        interval = qMax(1, qRound(1000.0 / screen->refreshRate()));
+    }
+
+    m_notifyTimer.setSingleShot(true);
+    m_notifyTimer.setInterval(interval);
+    connect(&m_notifyTimer, &QTimer::timeout, this, &LogBuffer::flush);
+}
+
+LogBuffer::~LogBuffer()
+{
+}
+
+bool LogBuffer::isEmpty() const
+{
+    return m_length == 0;
+}
+
+qint64 LogBuffer::length() const
+{
+    return m_length;
+}
+
+qint64 LogBuffer::memoryLimit() const
+{
+    return m_memoryLimit;
+}
+
+void LogBuffer::setMemoryLimit(qint64 bytes)
+{
+    if (m_memoryLimit == bytes) {
+        return;
+    }
+
+    m_memoryLimit = bytes;
+    while (m_chunks.count() > maxChunksInMemory()) {
+        spillOldestChunk();
+    }
+    Q_EMIT memoryLimitChanged();
+}
+
+int LogBuffer::notifyInterval() const
+{
+    return m_notifyTimer.interval();
+}
+
+void LogBuffer::setNotifyInterval(int msec)
+{
+    if (m_notifyTimer.interval() == msec) {
+        return;
+    }
+
+    m_notifyTimer.setInterval(msec);
+    Q_EMIT notifyIntervalChanged();
+}
+
+qint64 LogBuffer::coalescedNotifications() const
+{
+    return m_coalescedNotifications;
+}
+
+qint64 LogBuffer::deliveredNotifications() const
+{
+    return m_deliveredNotifications;
+}
+
+void LogBuffer::append(QStringView text)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+
+    const bool wasEmpty = isEmpty();
+
+    while (!text.isEmpty()) {
+        if (m_chunks.isEmpty() || m_chunks.constLast().data.size() >= ChunkSize) {
+            startChunk();
+        }
+
+        QString &data = m_chunks.last().data;
+        const qsizetype count = qMin(text.size(), ChunkSize - data.size());
+        data.append(text.first(count));
+        text = text.sliced(count);
+        m_length += count;
+    }
+
+    if (wasEmpty) {
+        Q_EMIT emptyChanged();
+    }
+
+    if (m_notifyTimer.isActive()) {
+        m_coalescedNotifications++;
+    } else {
+        m_notifyTimer.start();
+    }
+}
+
+void LogBuffer::clear()
+{
+    if (isEmpty()) {
+        return;
+    }
+
+    if (!m_chunks.isEmpty()) {
+        m_spareBuffer = std::move(m_chunks.last().data);
+        m_spareBuffer.resize(0);
+    }
+    m_chunks.clear();
+
+    if (m_spillFile) {
+        m_spillFile->resize(0);
+    }
+
+    m_notifyTimer.stop();
+    m_length = 0;
+    m_spilledLength = 0;
+    m_notifiedLength = 0;
+    m_spillFailed = false;
+
+    Q_EMIT cleared();
+    Q_EMIT emptyChanged();
+}
+
+void LogBuffer::flush()
+{
+    m_notifyTimer.stop();
+
+    if (m_notifiedLength == m_length) {
+        return;
+    }
+
+    const qint64 from = m_notifiedLength;
+    m_notifiedLength = m_length;
+    m_deliveredNotifications++;
+
+    Q_EMIT appended(from, m_length);
+    Q_EMIT statisticsChanged();
+}
+
+QString LogBuffer::text(qint64 from, qint64 to) const
+{
+    from = qBound<qint64>(0, from, m_length);
+    to = qBound<qint64>(from, to, m_length);
+
+    QString result;
+    result.reserve(to - from);
+
+    if (from < m_spilledLength) {
+        readSpilled(from, qMin(to, m_spilledLength), &result);
+        from = m_spilledLength;
+    }
+
+    for (const Chunk &chunk : m_chunks) {
+        const qint64 end = chunk.start + chunk.data.size();
+        if (end <= from) {
+            continue;
+        }
+        if (chunk.start >= to) {
+            break;
+        }
+
+        const qint64 begin = qMax(from, chunk.start) - chunk.start;
+        const qint64 count = qMin(to, end) - chunk.start - begin;
+        result.append(QStringView(chunk.data).sliced(begin, count));
+    }
+
+    return result;
+}
+
+QString LogBuffer::tail(qint64 maxLength) const
+{
+    return text(m_length - maxLength, m_length);
+}
+
+qsizetype LogBuffer::maxChunksInMemory() const
+{
+    return qMax<qsizetype>(2, m_memoryLimit / (ChunkSize * qint64(sizeof(QChar))));
+}
+
+void LogBuffer::startChunk()
+{
+    while (m_chunks.count() >= maxChunksInMemory()) {
+        spillOldestChunk();
+    }
+
+    Chunk chunk;
+    chunk.start = m_length;
+    chunk.data = std::move(m_spareBuffer);
+    m_spareBuffer = QString();
+    chunk.data.reserve(ChunkSize);
+    m_chunks.append(std::move(chunk));
+}
+
+void LogBuffer::spillOldestChunk()
+{
+    Chunk chunk = m_chunks.takeFirst();
+
+    if (!m_spillFile && !m_spillFailed) {
+        m_spillFile = new QTemporaryFile(QDir::tempPath() + QStringLiteral("/kcm_obsidianos-log-XXXXXX"), this);
+        m_spillFailed = !m_spillFile->open();
+    }
+
+    if (!m_spillFailed) {
+        const qint64 bytes = chunk.data.size() * qint64(sizeof(QChar));
+        m_spillFailed = !m_spillFile->seek(m_spilledLength * qint64(sizeof(QChar)))
+            || m_spillFile->write(reinterpret_cast<const char *>(chunk.data.constData()), bytes) != bytes;
+    }
+
+    // Without a spill file the oldest text is simply dropped; readSpilled()
+    // then returns nothing for that range.
+    m_spilledLength = chunk.start + chunk.data.size();
+
+    m_spareBuffer = std::move(chunk.data);
+    m_spareBuffer.resize(0);
+}
+
+void LogBuffer::readSpilled(qint64 from, qint64 to, QString *out) const
+{
+    if (m_spillFailed || !m_spillFile || from >= to) {
+        return;
+    }
+
+    const qsizetype offset = out->size();
+    out->resize(offset + (to - from));
+
+    const qint64 bytes = (to - from) * qint64(sizeof(QChar));
+    if (!m_spillFile->seek(from * qint64(sizeof(QChar)))
+        || m_spillFile->read(reinterpret_cast<char *>(out->data() + offset), bytes) != bytes) {
+        out->resize(offset);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <qqmlregistration.h>
+
+class QTemporaryFile;
+
+// Append-only text store for command output. Text lives in fixed-size chunks;
+// once the chunks in memory exceed memoryLimit the oldest ones are written to
+// a temporary file and their buffers reused, so memory stays flat no matter
+// how much a command prints. Offsets are in UTF-16 code units since clear().
+// appended() is emitted at most once per notifyInterval (one display frame by
+// default) and covers everything written since the previous emission.
+class LogBuffer : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    Q_PROPERTY(bool empty READ isEmpty NOTIFY emptyChanged)
+    Q_PROPERTY(qint64 memoryLimit READ memoryLimit WRITE setMemoryLimit NOTIFY memoryLimitChanged)
+    Q_PROPERTY(int notifyInterval READ notifyInterval WRITE setNotifyInterval NOTIFY notifyIntervalChanged)
+    Q_PROPERTY(qint64 coalescedNotifications READ coalescedNotifications NOTIFY statisticsChanged)
+    Q_PROPERTY(qint64 deliveredNotifications READ deliveredNotifications NOTIFY statisticsChanged)
+
+public:
+    static constexpr qsizetype ChunkSize = 64 * 1024;
+
+    explicit LogBuffer(QObject *parent = nullptr);
+    ~LogBuffer() override;
+
+    bool isEmpty() const;
+    qint64 length() const;
+    qint64 memoryLimit() const;
+    void setMemoryLimit(qint64 bytes);
+    int notifyInterval() const;
+    void setNotifyInterval(int msec);
+    qint64 coalescedNotifications() const;
+    qint64 deliveredNotifications() const;
+
+    void append(QStringView text);
+    void clear();
+    void flush();
+
+    Q_INVOKABLE QString text(qint64 from, qint64 to) const;
+    Q_INVOKABLE QString tail(qint64 maxLength = 4096) const;
+
+Q_SIGNALS:
+    void appended(qint64 from, qint64 to);
+    void cleared();
+    void emptyChanged();
+    void memoryLimitChanged();
+    void notifyIntervalChanged();
+    void statisticsChanged();
+
+private:
+    struct Chunk {
+        qint64 start = 0;
+        QString data;
+    };
+
+    qsizetype maxChunksInMemory() const;
+    void startChunk();
+    void spillOldestChunk();
+    void readSpilled(qint64 from, qint64 to, QString *out) const;
+
+    QList<Chunk> m_chunks;
+    QString m_spareBuffer;
+    qint64 m_length;
+    qint64 m_spilledLength;
+    qint64 m_memoryLimit;
+    QTemporaryFile *m_spillFile;
+    bool m_spillFailed;
+    QTimer m_notifyTimer;
+    qint64 m_notifiedLength;
+    qint64 m_coalescedNotifications;
+    qint64 m_deliveredNotifications;
+};
@@ -0,0 +1,91 @@
+#include "loglinemodel.h"
+#include "logbuffer.h"
+
+LogLineModel::LogLineModel(LogBuffer *log, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_log(log)
+    , m_lastLineOpen(false)
+    , m_announcedLength(0)
+{
+    connect(m_log, &LogBuffer::appended, this, &LogLineModel::onAppended);
+    connect(m_log, &LogBuffer::cleared, this, &LogLineModel::onCleared);
+}
+
+int LogLineModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_lineStarts.count();
+}
+
+QVariant LogLineModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_lineStarts.count()) {
+        return QVariant();
+    }
+
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    QString line = m_log->text(m_lineStarts.at(index.row()), lineEnd(index.row()));
+    if (line.endsWith(QLatin1Char('\r'))) {
+        line.chop(1);
+    }
+    return line;
+}
+
+void LogLineModel::onAppended(qint64 from, qint64 to)
+{
+    const QString text = m_log->text(from, to);
+    m_announcedLength = to;
+    if (text.isEmpty()) {
+        return;
+    }
+
+    QList<qint64> newStarts;
+    if (!m_lastLineOpen) {
+        newStarts.append(from);
+    }
+
+    for (qsizetype i = text.indexOf(QLatin1Char('\n')); i >= 0; i = text.indexOf(QLatin1Char('\n'), i + 1)) {
+        if (i + 1 < text.size()) {
+            newStarts.append(from + i + 1);
+        }
+    }
+
+    const bool grewLastLine = m_lastLineOpen;
+    const int previousLast = m_lineStarts.count() - 1;
+    m_lastLineOpen = !text.endsWith(QLatin1Char('\n'));
+
+    if (!newStarts.isEmpty()) {
+        const int first = m_lineStarts.count();
+        beginInsertRows(QModelIndex(), first, first + newStarts.count() - 1);
+        m_lineStarts.append(newStarts);
+        endInsertRows();
+    }
+
+    if (grewLastLine) {
+        const QModelIndex last = index(previousLast);
+        Q_EMIT dataChanged(last, last, {Qt::DisplayRole});
+    }
+}
+
+void LogLineModel::onCleared()
+{
+    beginResetModel();
+    m_lineStarts.clear();
+    m_lastLineOpen = false;
+    m_announcedLength = 0;
+    endResetModel();
+}
+
+qint64 LogLineModel::lineEnd(int row) const
+{
+    // The next line starts right after this line's '\n'.
+    if (row + 1 < m_lineStarts.count()) {
+        return m_lineStarts.at(row + 1) - 1;
+    }
+    return m_lastLineOpen ? m_announcedLength : m_announcedLength - 1;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QList>
+#include <qqmlregistration.h>
+
+class LogBuffer;
+
+// Exposes a LogBuffer as one row per line. Only line start offsets are kept
+// here; the text is fetched from the buffer when a delegate asks for it, so a
+// view only ever touches the lines it actually shows.
+class LogLineModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by the managers")
+
+public:
+    explicit LogLineModel(LogBuffer *log, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private Q_SLOTS:
+    void onAppended(qint64 from, qint64 to);
+    void onCleared();
+
+private:
+    qint64 lineEnd(int row) const;
+
+    LogBuffer *m_log;
+    QList<qint64> m_lineStarts;
+    bool m_lastLineOpen;
+    // End of the text announced so far. The buffer may already hold more,
+    // which isn't split into lines yet.
+    qint64 m_announcedLength;
+};
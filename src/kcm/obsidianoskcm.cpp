@@ -1,28 +1,41 @@
 #include "obsidianoskcm.h"
 #include "backupmanager.h"
+#include "commandexecutor.h"
 #include "slotmanager.h"
 #include "updatemanager.h"
 #include "environmentmanager.h"
 
 #include <KPluginFactory>
-#include <QProcess>
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
 
 K_PLUGIN_CLASS_WITH_JSON(ObsidianOSKCM, "../../kcm_obsidianos.json")
 
 ObsidianOSKCM::ObsidianOSKCM(QObject *parent, const KPluginMetaData &data)
     : KQuickManagedConfigModule(parent, data)
-    , m_backupManager(new BackupManager(this))
-    , m_slotManager(new SlotManager(this))
-    , m_updateManager(new UpdateManager(this))
-    , m_environmentManager(new EnvironmentManager(this))
-    , m_obsidianctlAvailable(false)
+    , m_executor(new CommandExecutor(this))
+    , m_systemState(new SystemState(m_executor, this))
+    , m_backupManager(new BackupManager(m_executor, this))
+    , m_slotManager(new SlotManager(m_executor, m_systemState, this))
+    , m_updateManager(new UpdateManager(m_executor, this))
+    , m_environmentManager(new EnvironmentManager(m_executor, this))
+    , m_startupTime(-1)
 {
+    m_startupTimer.start();
     setButtons(Help);
+
+    connect(m_systemState, &SystemState::currentSlotChanged, this, &ObsidianOSKCM::currentSlotChanged);
+    connect(m_systemState, &SystemState::versionChanged, this, &ObsidianOSKCM::systemVersionChanged);
+    connect(m_systemState, &SystemState::loadingChanged, this, &ObsidianOSKCM::loadingChanged);
+
+    // Time from construction until the first complete set of system facts.
+    connect(m_systemState, &SystemState::refreshed, this, [this]() {
+        if (m_startupTime < 0) {
+            m_startupTime = m_startupTimer.elapsed();
+            Q_EMIT startupTimeChanged();
+        }
+    });
+
     checkObsidianctl();
-    loadSystemInfo();
+    m_systemState->refresh();
 
     connect(m_backupManager, &BackupManager::errorOccurred, this, &ObsidianOSKCM::errorOccurred);
     connect(m_backupManager, &BackupManager::operationSucceeded, this, &ObsidianOSKCM::infoMessage);
@@ -58,89 +71,47 @@ EnvironmentManager *ObsidianOSKCM::environmentManager() const
     return m_environmentManager;
 }
 
+SystemState *ObsidianOSKCM::systemState() const
+{
+    return m_systemState;
+}
+
 bool ObsidianOSKCM::obsidianctlAvailable() const
 {
-    return m_obsidianctlAvailable;
+    return m_systemState->obsidianctlAvailable();
 }
 
 QString ObsidianOSKCM::currentSlot() const
 {
-    return m_currentSlot;
+    return m_systemState->currentSlot();
 }
 
 QString ObsidianOSKCM::systemVersion() const
 {
-    return m_systemVersion;
+    return m_systemState->version();
 }
 
-void ObsidianOSKCM::refreshSystemInfo()
+bool ObsidianOSKCM::loading() const
 {
-    loadSystemInfo();
+    return m_systemState->loading();
 }
 
-void ObsidianOSKCM::checkObsidianctl()
+qint64 ObsidianOSKCM::startupTime() const
 {
-    QProcess process;
-    process.start(QStringLiteral("which"), {QStringLiteral("obsidianctl")});
-    process.waitForFinished(3000);
-    m_obsidianctlAvailable = (process.exitCode() == 0);
-
-    if (!m_obsidianctlAvailable) {
-        Q_EMIT errorOccurred(tr("obsidianctl Not Found"),
-            tr("The 'obsidianctl' command was not found. Please ensure ObsidianOS system tools are correctly installed and in your PATH."));
-    }
+    return m_startupTime;
 }
 
-void ObsidianOSKCM::loadSystemInfo()
+void ObsidianOSKCM::refreshSystemInfo()
 {
-    if (!m_obsidianctlAvailable) {
-        return;
-    }
-
-    QProcess process;
-    process.start(QStringLiteral("obsidianctl"), {QStringLiteral("status"), QStringLiteral("--json")});
-    process.waitForFinished(5000);
-
-    if (process.exitCode() == 0) {
-        QString output = QString::fromUtf8(process.readAllStandardOutput()).trimmed();
-        QJsonDocument doc = QJsonDocument::fromJson(output.toUtf8());
-        if (doc.isObject()) {
-            QJsonObject obj = doc.object();
-            QString newSlot = obj.value(QStringLiteral("current_slot")).toString();
-            QString newVersion = obj.value(QStringLiteral("version")).toString();
-
-            if (m_currentSlot != newSlot) {
-                m_currentSlot = newSlot;
-                Q_EMIT currentSlotChanged();
-            }
-
-            if (m_systemVersion != newVersion) {
-                m_systemVersion = newVersion;
-                Q_EMIT systemVersionChanged();
-            }
-        }
-    } else {
-        QProcess fallbackProcess;
-        fallbackProcess.start(QStringLiteral("obsidianctl"), {QStringLiteral("current-slot")});
-        fallbackProcess.waitForFinished(3000);
-
-        if (fallbackProcess.exitCode() == 0) {
-            QString newSlot = QString::fromUtf8(fallbackProcess.readAllStandardOutput()).trimmed();
-            if (m_currentSlot != newSlot) {
-                m_currentSlot = newSlot;
-                Q_EMIT currentSlotChanged();
-            }
-        }
+    m_systemState->refresh();
+}
 
-        QFile versionFile(QStringLiteral("/etc/obsidianos-release"));
-        if (versionFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QString newVersion = QString::fromUtf8(versionFile.readAll()).trimmed();
-            if (m_systemVersion != newVersion) {
-                m_systemVersion = newVersion;
-                Q_EMIT systemVersionChanged();
-            }
-            versionFile.close();
-        }
+void ObsidianOSKCM::checkObsidianctl()
+{
+    if (!m_systemState->obsidianctlAvailable()) {
+        Q_EMIT errorOccurred(tr("obsidianctl Not Found"),
+            tr("The 'obsidianctl' command was not found. Please ensure ObsidianOS system tools are correctly installed and in your PATH."));
+        m_startupTime = m_startupTimer.elapsed();
     }
 }
 
@@ -1,11 +1,14 @@
 #pragma once
 
 #include <KQuickManagedConfigModule>
+#include <QElapsedTimer>
 #include <QObject>
 #include <qqmlregistration.h>
 
 #include "backupmanager.h"
+#include "commandexecutor.h"
 #include "slotmanager.h"
+#include "systemstate.h"
 #include "updatemanager.h"
 #include "environmentmanager.h"
 
@@ -17,9 +20,12 @@ class ObsidianOSKCM : public KQuickManagedConfigModule
     Q_PROPERTY(SlotManager* slotManager READ slotManager CONSTANT)
     Q_PROPERTY(UpdateManager* updateManager READ updateManager CONSTANT)
     Q_PROPERTY(EnvironmentManager* environmentManager READ environmentManager CONSTANT)
+    Q_PROPERTY(SystemState* systemState READ systemState CONSTANT)
     Q_PROPERTY(bool obsidianctlAvailable READ obsidianctlAvailable CONSTANT)
     Q_PROPERTY(QString currentSlot READ currentSlot NOTIFY currentSlotChanged)
     Q_PROPERTY(QString systemVersion READ systemVersion NOTIFY systemVersionChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(qint64 startupTime READ startupTime NOTIFY startupTimeChanged)
 
 public:
     explicit ObsidianOSKCM(QObject *parent, const KPluginMetaData &data);
@@ -29,28 +35,33 @@ public:
     SlotManager *slotManager() const;
     UpdateManager *updateManager() const;
     EnvironmentManager *environmentManager() const;
+    SystemState *systemState() const;
 
     bool obsidianctlAvailable() const;
     QString currentSlot() const;
     QString systemVersion() const;
+    bool loading() const;
+    qint64 startupTime() const;
 
     Q_INVOKABLE void refreshSystemInfo();
 
 Q_SIGNALS:
     void currentSlotChanged();
     void systemVersionChanged();
+    void loadingChanged();
+    void startupTimeChanged();
     void errorOccurred(const QString &title, const QString &message);
     void infoMessage(const QString &title, const QString &message);
 
 private:
     void checkObsidianctl();
-    void loadSystemInfo();
 
+    CommandExecutor *m_executor;
+    SystemState *m_systemState;
     BackupManager *m_backupManager;
     SlotManager *m_slotManager;
     UpdateManager *m_updateManager;
     EnvironmentManager *m_environmentManager;
-    bool m_obsidianctlAvailable;
-    QString m_currentSlot;
-    QString m_systemVersion;
+    QElapsedTimer m_startupTimer;
+    qint64 m_startupTime;
 };
\ No newline at end of file
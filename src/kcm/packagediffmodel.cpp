@@ -0,0 +1,232 @@
+#include "packagediffmodel.h"
+
+#include <QLocale>
+
+#include <algorithm>
+
+PackageDiffModel::PackageDiffModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_sortKey(QStringLiteral("name"))
+    , m_sortDescending(false)
+{
+}
+
+int PackageDiffModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_entries.count();
+}
+
+QVariant PackageDiffModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_entries.count()) {
+        return QVariant();
+    }
+
+    const Entry &entry = m_entries.at(index.row());
+    const qint64 delta = entry.newSize - entry.oldSize;
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return entry.name;
+    case ChangeRole:
+        return changeName(entry.change);
+    case OldVersionRole:
+        return entry.oldVersion;
+    case NewVersionRole:
+        return entry.newVersion;
+    case OldSizeRole:
+        return entry.oldSize;
+    case NewSizeRole:
+        return entry.newSize;
+    case SizeDeltaRole:
+        return delta;
+    case SizeDeltaStringRole:
+        if (delta == 0) {
+            return QString();
+        }
+        return (delta > 0 ? QStringLiteral("+") : QStringLiteral("-")) + QLocale().formattedDataSize(qAbs(delta));
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> PackageDiffModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[NameRole] = "name";
+    roles[ChangeRole] = "change";
+    roles[OldVersionRole] = "oldVersion";
+    roles[NewVersionRole] = "newVersion";
+    roles[OldSizeRole] = "oldSize";
+    roles[NewSizeRole] = "newSize";
+    roles[SizeDeltaRole] = "sizeDelta";
+    roles[SizeDeltaStringRole] = "sizeDeltaString";
+    return roles;
+}
+
+QString PackageDiffModel::baseSlot() const
+{
+    return m_baseSlot;
+}
+
+QString PackageDiffModel::targetSlot() const
+{
+    return m_targetSlot;
+}
+
+int PackageDiffModel::addedCount() const
+{
+    return m_counts.value(int(Change::Added));
+}
+
+int PackageDiffModel::removedCount() const
+{
+    return m_counts.value(int(Change::Removed));
+}
+
+int PackageDiffModel::upgradedCount() const
+{
+    return m_counts.value(int(Change::Upgraded));
+}
+
+int PackageDiffModel::downgradedCount() const
+{
+    return m_counts.value(int(Change::Downgraded));
+}
+
+QString PackageDiffModel::sortKey() const
+{
+    return m_sortKey;
+}
+
+void PackageDiffModel::setSortKey(const QString &key)
+{
+    if (m_sortKey == key) {
+        return;
+    }
+    m_sortKey = key;
+    Q_EMIT layoutAboutToBeChanged();
+    sortEntries();
+    Q_EMIT layoutChanged();
+    Q_EMIT sortChanged();
+}
+
+bool PackageDiffModel::sortDescending() const
+{
+    return m_sortDescending;
+}
+
+void PackageDiffModel::setSortDescending(bool descending)
+{
+    if (m_sortDescending == descending) {
+        return;
+    }
+    m_sortDescending = descending;
+    Q_EMIT layoutAboutToBeChanged();
+    sortEntries();
+    Q_EMIT layoutChanged();
+    Q_EMIT sortChanged();
+}
+
+void PackageDiffModel::compare(const QString &baseSlot, const PackageDatabase &base, const QString &targetSlot,
+                               const PackageDatabase &target)
+{
+    beginResetModel();
+    m_entries.clear();
+    m_counts.clear();
+    m_baseSlot = baseSlot;
+    m_targetSlot = targetSlot;
+
+    for (auto it = base.packages.cbegin(); it != base.packages.cend(); ++it) {
+        Entry entry;
+        entry.name = it.key();
+        entry.oldVersion = it->version;
+        entry.oldSize = it->installedSize;
+
+        const auto other = target.packages.constFind(it.key());
+        if (other == target.packages.cend()) {
+            entry.change = Change::Removed;
+        } else {
+            const int order = PackageDatabase::compareVersions(it->version, other->version);
+            if (order == 0) {
+                continue;
+            }
+            entry.change = order < 0 ? Change::Upgraded : Change::Downgraded;
+            entry.newVersion = other->version;
+            entry.newSize = other->installedSize;
+        }
+
+        m_counts[int(entry.change)]++;
+        m_entries.append(entry);
+    }
+
+    for (auto it = target.packages.cbegin(); it != target.packages.cend(); ++it) {
+        if (base.packages.contains(it.key())) {
+            continue;
+        }
+
+        Entry entry;
+        entry.name = it.key();
+        entry.change = Change::Added;
+        entry.newVersion = it->version;
+        entry.newSize = it->installedSize;
+        m_counts[int(entry.change)]++;
+        m_entries.append(entry);
+    }
+
+    sortEntries();
+    endResetModel();
+    Q_EMIT changed();
+}
+
+void PackageDiffModel::clear()
+{
+    beginResetModel();
+    m_entries.clear();
+    m_counts.clear();
+    endResetModel();
+    Q_EMIT changed();
+}
+
+void PackageDiffModel::sortEntries()
+{
+    const bool sizeOrder = m_sortKey == QStringLiteral("size");
+    const bool changeOrder = m_sortKey == QStringLiteral("change");
+
+    auto lessThan = [sizeOrder, changeOrder](const Entry &a, const Entry &b) {
+        if (sizeOrder && a.newSize - a.oldSize != b.newSize - b.oldSize) {
+            return a.newSize - a.oldSize < b.newSize - b.oldSize;
+        }
+        if (changeOrder && a.change != b.change) {
+            return a.change < b.change;
+        }
+        return a.name < b.name;
+    };
+
+    if (m_sortDescending) {
+        std::sort(m_entries.begin(), m_entries.end(), [&lessThan](const Entry &a, const Entry &b) {
+            return lessThan(b, a);
+        });
+    } else {
+        std::sort(m_entries.begin(), m_entries.end(), lessThan);
+    }
+}
+
+QString PackageDiffModel::changeName(Change change)
+{
+    switch (change) {
+    case Change::Added:
+        return QStringLiteral("added");
+    case Change::Removed:
+        return QStringLiteral("removed");
+    case Change::Upgraded:
+        return QStringLiteral("upgraded");
+    case Change::Downgraded:
+        return QStringLiteral("downgraded");
+    }
+    return QString();
+}
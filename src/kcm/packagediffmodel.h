@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QList>
+#include <qqmlregistration.h>
+
+#include "../slottool/packagedatabase.h"
+
+// Packages that differ between the running slot and the other one: added,
+// removed, upgraded or downgraded, going from the running slot to the other.
+class PackageDiffModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by SlotManager")
+    Q_PROPERTY(QString baseSlot READ baseSlot NOTIFY changed)
+    Q_PROPERTY(QString targetSlot READ targetSlot NOTIFY changed)
+    Q_PROPERTY(int addedCount READ addedCount NOTIFY changed)
+    Q_PROPERTY(int removedCount READ removedCount NOTIFY changed)
+    Q_PROPERTY(int upgradedCount READ upgradedCount NOTIFY changed)
+    Q_PROPERTY(int downgradedCount READ downgradedCount NOTIFY changed)
+    // "name", "change" or "size"; ties are broken by name.
+    Q_PROPERTY(QString sortKey READ sortKey WRITE setSortKey NOTIFY sortChanged)
+    Q_PROPERTY(bool sortDescending READ sortDescending WRITE setSortDescending NOTIFY sortChanged)
+
+public:
+    enum Roles {
+        NameRole = Qt::UserRole + 1,
+        ChangeRole,
+        OldVersionRole,
+        NewVersionRole,
+        OldSizeRole,
+        NewSizeRole,
+        SizeDeltaRole,
+        SizeDeltaStringRole
+    };
+
+    enum class Change {
+        Added,
+        Removed,
+        Upgraded,
+        Downgraded
+    };
+
+    explicit PackageDiffModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    QString baseSlot() const;
+    QString targetSlot() const;
+    int addedCount() const;
+    int removedCount() const;
+    int upgradedCount() const;
+    int downgradedCount() const;
+    QString sortKey() const;
+    void setSortKey(const QString &key);
+    bool sortDescending() const;
+    void setSortDescending(bool descending);
+
+    void compare(const QString &baseSlot, const PackageDatabase &base, const QString &targetSlot, const PackageDatabase &target);
+    void clear();
+
+Q_SIGNALS:
+    void changed();
+    void sortChanged();
+
+private:
+    struct Entry {
+        QString name;
+        Change change = Change::Added;
+        QString oldVersion;
+        QString newVersion;
+        qint64 oldSize = 0;
+        qint64 newSize = 0;
+    };
+
+    void sortEntries();
+
+    static QString changeName(Change change);
+
+    QString m_baseSlot;
+    QString m_targetSlot;
+    QList<Entry> m_entries;
+    QHash<int, int> m_counts;
+    QString m_sortKey;
+    bool m_sortDescending;
+};
@@ -0,0 +1,280 @@
+#include "progressparser.h"
+
+#include <QRegularExpression>
+
+#include <utility>
+
+namespace
+{
+
+// Longest unterminated text kept between reads; anything longer is not a
+// progress line worth waiting for.
+constexpr qsizetype MaxPendingLength = 4096;
+
+// Rates are only re-estimated this often so bursty pipes don't make them jump.
+constexpr qint64 SampleInterval = 500;
+// Weight of the newest sample in a smoothed rate.
+constexpr double Smoothing = 0.3;
+
+const QRegularExpression &percentPattern()
+{
+    static const QRegularExpression re(QStringLiteral("(\\d+(?:\\.\\d+)?)\\s*%"));
+    return re;
+}
+
+const QRegularExpression &sizePattern()
+{
+    static const QRegularExpression re(QStringLiteral("(\\d+(?:\\.\\d+)?)\\s*([KMGTP]i?B|B|bytes)?\\s*/\\s*"
+                                                      "(\\d+(?:\\.\\d+)?)\\s*([KMGTP]i?B|B|bytes)\\b"));
+    return re;
+}
+
+const QRegularExpression &ddPattern()
+{
+    static const QRegularExpression re(QStringLiteral("^\\s*(\\d+) bytes\\b.*\\bcopied\\b"));
+    return re;
+}
+
+qint64 toBytes(QStringView number, QStringView unit)
+{
+    double value = number.toDouble();
+    if (unit.isEmpty() || unit == u"B" || unit == u"bytes") {
+        return qint64(value);
+    }
+
+    const double base = unit.size() == 3 ? 1024.0 : 1000.0;
+    switch (unit.front().unicode()) {
+    case 'P':
+        value *= base;
+        Q_FALLTHROUGH();
+    case 'T':
+        value *= base;
+        Q_FALLTHROUGH();
+    case 'G':
+        value *= base;
+        Q_FALLTHROUGH();
+    case 'M':
+        value *= base;
+        Q_FALLTHROUGH();
+    case 'K':
+        value *= base;
+        break;
+    }
+    return qint64(value);
+}
+
+}
+
+ProgressParser::ProgressParser()
+{
+    reset();
+}
+
+void ProgressParser::reset()
+{
+    m_pending.clear();
+    m_percent = -1;
+    m_bytesDone = -1;
+    m_bytesTotal = -1;
+    m_throughput = 0;
+    m_percentRate = 0;
+    m_eta = -1;
+
+    m_clock.start();
+    m_sampleTime = 0;
+    m_sampleBytes = -1;
+    m_samplePercent = -1;
+}
+
+bool ProgressParser::feed(QStringView text)
+{
+    bool changed = false;
+
+    while (!text.isEmpty()) {
+        qsizetype end = -1;
+        for (qsizetype i = 0; i < text.size(); i++) {
+            if (text.at(i) == QLatin1Char('\n') || text.at(i) == QLatin1Char('\r')) {
+                end = i;
+                break;
+            }
+        }
+
+        if (end < 0) {
+            m_pending.append(text);
+            if (m_pending.size() > MaxPendingLength) {
+                changed |= parseSegment(m_pending);
+                m_pending.clear();
+            }
+            break;
+        }
+
+        if (m_pending.isEmpty()) {
+            changed |= parseSegment(text.first(end));
+        } else {
+            m_pending.append(text.first(end));
+            changed |= parseSegment(m_pending);
+            m_pending.clear();
+        }
+        text = text.sliced(end + 1);
+    }
+
+    if (changed) {
+        sample();
+    }
+    return changed;
+}
+
+int ProgressParser::percent() const
+{
+    return m_percent;
+}
+
+qint64 ProgressParser::bytesDone() const
+{
+    return m_bytesDone;
+}
+
+qint64 ProgressParser::bytesTotal() const
+{
+    return m_bytesTotal;
+}
+
+qint64 ProgressParser::eta() const
+{
+    return m_eta;
+}
+
+double ProgressParser::throughput() const
+{
+    return m_throughput;
+}
+
+bool ProgressParser::parseSegment(QStringView segment)
+{
+    if (segment.isEmpty()) {
+        return false;
+    }
+
+    bool changed = false;
+
+    QRegularExpressionMatch last;
+    QRegularExpressionMatchIterator it = percentPattern().globalMatchView(segment);
+    while (it.hasNext()) {
+        last = it.next();
+    }
+    if (last.hasMatch()) {
+        const int percent = qBound(0, int(last.capturedView(1).toDouble()), 100);
+        changed |= percent != m_percent;
+        m_percent = percent;
+    }
+
+    last = QRegularExpressionMatch();
+    it = sizePattern().globalMatchView(segment);
+    while (it.hasNext()) {
+        last = it.next();
+    }
+    if (last.hasMatch()) {
+        // "1.2 / 3.4 GiB" uses the total's unit for both sides.
+        const QStringView doneUnit = last.capturedView(2).isEmpty() ? last.capturedView(4) : last.capturedView(2);
+        const qint64 done = toBytes(last.capturedView(1), doneUnit);
+        const qint64 total = toBytes(last.capturedView(3), last.capturedView(4));
+        changed |= done != m_bytesDone || total != m_bytesTotal;
+        m_bytesDone = done;
+        m_bytesTotal = total;
+    } else {
+        const QRegularExpressionMatch dd = ddPattern().matchView(segment);
+        if (dd.hasMatch()) {
+            const qint64 done = dd.capturedView(1).toLongLong();
+            changed |= done != m_bytesDone;
+            m_bytesDone = done;
+        }
+    }
+
+    return changed;
+}
+
+void ProgressParser::sample()
+{
+    const qint64 now = m_clock.elapsed();
+    if (m_sampleBytes < 0 && m_samplePercent < 0) {
+        m_sampleTime = now;
+        m_sampleBytes = m_bytesDone;
+        m_samplePercent = m_percent;
+        return;
+    }
+
+    const qint64 elapsed = now - m_sampleTime;
+    if (elapsed < SampleInterval) {
+        return;
+    }
+
+    const double seconds = elapsed / 1000.0;
+    if (m_bytesDone >= 0 && m_sampleBytes >= 0 && m_bytesDone >= m_sampleBytes) {
+        const double rate = (m_bytesDone - m_sampleBytes) / seconds;
+        m_throughput = RateMeter::smooth(m_throughput, rate);
+    }
+    if (m_percent >= 0 && m_samplePercent >= 0 && m_percent >= m_samplePercent) {
+        const double rate = (m_percent - m_samplePercent) / seconds;
+        m_percentRate = RateMeter::smooth(m_percentRate, rate);
+    }
+
+    m_sampleTime = now;
+    m_sampleBytes = m_bytesDone;
+    m_samplePercent = m_percent;
+
+    if (m_bytesTotal > 0 && m_bytesDone >= 0 && m_throughput > 0) {
+        m_eta = qint64((m_bytesTotal - qMin(m_bytesDone, m_bytesTotal)) / m_throughput);
+    } else if (m_percent >= 0 && m_percentRate > 0) {
+        m_eta = qint64((100 - m_percent) / m_percentRate);
+    } else {
+        m_eta = -1;
+    }
+}
+
+QStringList LineReader::read(const QString &data)
+{
+    m_pending += data;
+    const qsizetype end = m_pending.lastIndexOf(QLatin1Char('\n'));
+    if (end < 0) {
+        return {};
+    }
+
+    const QStringList lines = m_pending.left(end).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    m_pending.remove(0, end + 1);
+    return lines;
+}
+
+QStringList LineReader::finish()
+{
+    if (m_pending.isEmpty()) {
+        return {};
+    }
+    return {std::exchange(m_pending, QString())};
+}
+
+void LineReader::clear()
+{
+    m_pending.clear();
+}
+
+double RateMeter::smooth(double smoothed, double sample)
+{
+    return smoothed > 0 ? Smoothing * sample + (1 - Smoothing) * smoothed : sample;
+}
+
+void RateMeter::sample(qint64 now, qint64 count)
+{
+    if (m_time >= 0) {
+        if (now <= m_time) {
+            return;
+        }
+        m_rate = smooth(m_rate, (count - m_count) / ((now - m_time) / 1000.0));
+    }
+    m_time = now;
+    m_count = count;
+}
+
+double RateMeter::rate() const
+{
+    return m_rate;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+
+// Picks progress out of command output as it streams in. Text may arrive in
+// arbitrary pieces, so only complete \r- or \n-terminated segments are parsed
+// and the most recent value always wins. Understands "45%", "1.2 GiB / 3.4 GiB"
+// and dd's "123456 bytes ... copied".
+class ProgressParser
+{
+public:
+    ProgressParser();
+
+    void reset();
+
+    // Returns true when any of the values below changed.
+    bool feed(QStringView text);
+
+    // -1 while unknown.
+    int percent() const;
+    qint64 bytesDone() const;
+    qint64 bytesTotal() const;
+    qint64 eta() const;
+
+    // Smoothed bytes per second, 0 while unknown.
+    double throughput() const;
+
+private:
+    bool parseSegment(QStringView segment);
+    void sample();
+
+    QString m_pending;
+    int m_percent;
+    qint64 m_bytesDone;
+    qint64 m_bytesTotal;
+    double m_throughput;
+    double m_percentRate;
+    qint64 m_eta;
+
+    QElapsedTimer m_clock;
+    qint64 m_sampleTime;
+    qint64 m_sampleBytes;
+    int m_samplePercent;
+};
+
+// Cuts streamed output into whole lines for tools that print one record per
+// line. The unterminated tail of a piece waits for the next one.
+class LineReader
+{
+public:
+    // The lines completed by data, empty ones left out.
+    QStringList read(const QString &data);
+    // Whatever was left unterminated when the output ended.
+    QStringList finish();
+    void clear();
+
+private:
+    QString m_pending;
+};
+
+// Smoothed per-second rate of a growing count, sampled whenever a progress
+// report comes in. The first sample only sets the baseline.
+class RateMeter
+{
+public:
+    // Blends a new rate sample into a smoothed one; ProgressParser's
+    // throughput is smoothed the same way.
+    static double smooth(double smoothed, double sample);
+
+    // now is in ms from any fixed start; samples no later than the last
+    // one are ignored.
+    void sample(qint64 now, qint64 count);
+    // 0 until a second sample.
+    double rate() const;
+
+private:
+    qint64 m_time = -1;
+    qint64 m_count = 0;
+    double m_rate = 0;
+};
@@ -0,0 +1,199 @@
+#include "retentionpolicy.h"
+#include "../chunkstore/chunkmanifest.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <algorithm>
+
+namespace
+{
+
+// Keeps the newest backup of each of the first `limit` periods that have a
+// backup at all, as restic and borg do, so gaps don't use up the allowance.
+template<typename KeyFunction>
+void keepPerPeriod(const QList<int> &newestFirst, const QList<BackupInfo> &backups, int limit,
+                   KeyFunction key, QList<bool> *keep)
+{
+    QSet<qint64> periods;
+    for (int index : newestFirst) {
+        if (periods.count() >= limit) {
+            return;
+        }
+
+        const qint64 period = key(backups.at(index).timestamp.date());
+        if (!periods.contains(period)) {
+            periods.insert(period);
+            (*keep)[index] = true;
+        }
+    }
+}
+
+}
+
+RetentionPolicy::ChunkUsage RetentionPolicy::ChunkUsage::load(const QList<BackupInfo> &backups)
+{
+    ChunkUsage usage;
+    for (const BackupInfo &backup : backups) {
+        if (!backup.deduplicated) {
+            continue;
+        }
+        usage.m_modified.insert(backup.path, backup.timestamp.toMSecsSinceEpoch());
+
+        ChunkManifest manifest;
+        if (!manifest.load(backup.path)) {
+            continue;
+        }
+
+        QList<QByteArray> &used = usage.m_manifests[backup.path];
+        for (const ChunkManifest::Chunk &chunk : std::as_const(manifest.chunks)) {
+            auto it = usage.m_chunks.find(chunk.digest);
+            if (it == usage.m_chunks.end()) {
+                it = usage.m_chunks.insert(chunk.digest, Chunk{chunk.length, 0});
+                usage.m_storedBytes += chunk.length;
+            } else if (!used.isEmpty() && used.constLast() == it.key()) {
+                // A run of the same chunk, as in zeroed space.
+                continue;
+            }
+            // Other repeats count as several uses, released as many times.
+            it->users++;
+            used.append(it.key());
+        }
+    }
+    return usage;
+}
+
+bool RetentionPolicy::ChunkUsage::isCurrent(const QList<BackupInfo> &backups) const
+{
+    qsizetype deduplicated = 0;
+    for (const BackupInfo &backup : backups) {
+        if (!backup.deduplicated) {
+            continue;
+        }
+        deduplicated++;
+        auto it = m_modified.constFind(backup.path);
+        if (it == m_modified.constEnd() || it.value() != backup.timestamp.toMSecsSinceEpoch()) {
+            return false;
+        }
+    }
+    return deduplicated == m_modified.count();
+}
+
+qint64 RetentionPolicy::ChunkUsage::storedBytes() const
+{
+    return m_storedBytes;
+}
+
+qint64 RetentionPolicy::ChunkUsage::release(const QString &manifest)
+{
+    qint64 freed = 0;
+    const QList<QByteArray> used = m_manifests.take(manifest);
+    for (const QByteArray &digest : used) {
+        auto it = m_chunks.find(digest);
+        if (it != m_chunks.end() && --it->users == 0) {
+            freed += it->length;
+            m_chunks.erase(it);
+        }
+    }
+    return freed;
+}
+
+RetentionPolicy::Rules RetentionPolicy::rulesFromMap(const QVariantMap &map)
+{
+    Rules rules;
+    rules.daily = map.value(QStringLiteral("daily"), rules.daily).toInt();
+    rules.weekly = map.value(QStringLiteral("weekly"), rules.weekly).toInt();
+    rules.monthly = map.value(QStringLiteral("monthly"), rules.monthly).toInt();
+    rules.minFullBackups = map.value(QStringLiteral("minFullBackups"), rules.minFullBackups).toInt();
+    rules.maxTotalBytes = map.value(QStringLiteral("maxTotalBytes"), rules.maxTotalBytes).toLongLong();
+    rules.minFreeBytes = map.value(QStringLiteral("minFreeBytes"), rules.minFreeBytes).toLongLong();
+    return rules;
+}
+
+RetentionPolicy::Plan RetentionPolicy::plan(const QList<BackupInfo> &backups, const Rules &rules, qint64 freeBytes, ChunkUsage chunks)
+{
+    QList<int> newestFirst(backups.count());
+    for (int i = 0; i < backups.count(); i++) {
+        newestFirst[i] = i;
+    }
+    std::stable_sort(newestFirst.begin(), newestFirst.end(), [&backups](int a, int b) {
+        return backups.at(a).timestamp > backups.at(b).timestamp;
+    });
+
+    QHash<QString, QList<int>> bySlot;
+    for (int index : std::as_const(newestFirst)) {
+        bySlot[backups.at(index).slot].append(index);
+    }
+
+    QList<bool> keep(backups.count(), false);
+    QList<bool> protect(backups.count(), false);
+
+    for (const QList<int> &slot : std::as_const(bySlot)) {
+        protect[slot.constFirst()] = true;
+
+        int fullKept = 0;
+        for (int index : slot) {
+            if (fullKept >= rules.minFullBackups) {
+                break;
+            }
+            if (backups.at(index).isFullBackup) {
+                protect[index] = true;
+                fullKept++;
+            }
+        }
+
+        keepPerPeriod(slot, backups, rules.daily, [](const QDate &date) {
+            return date.toJulianDay();
+        }, &keep);
+        keepPerPeriod(slot, backups, rules.weekly, [](const QDate &date) {
+            int year = 0;
+            const int week = date.weekNumber(&year);
+            return qint64(year) * 100 + week;
+        }, &keep);
+        keepPerPeriod(slot, backups, rules.monthly, [](const QDate &date) {
+            return qint64(date.year()) * 100 + date.month();
+        }, &keep);
+    }
+
+    Plan plan;
+    qint64 total = chunks.storedBytes();
+    for (int i = 0; i < backups.count(); i++) {
+        total += backups.at(i).size;
+        keep[i] = keep.at(i) || protect.at(i);
+    }
+
+    const auto remove = [&](int index) {
+        const BackupInfo &backup = backups.at(index);
+        plan.remove.append(backup);
+        plan.reclaimedBytes += backup.size + (backup.deduplicated ? chunks.release(backup.path) : 0);
+    };
+
+    // Oldest first, so both passes give up the least recent backups.
+    for (auto it = newestFirst.crbegin(); it != newestFirst.crend(); ++it) {
+        if (!keep.at(*it)) {
+            remove(*it);
+        }
+    }
+
+    const auto missingBytes = [&]() {
+        qint64 missing = 0;
+        if (rules.maxTotalBytes > 0) {
+            missing = qMax(missing, total - plan.reclaimedBytes - rules.maxTotalBytes);
+        }
+        if (rules.minFreeBytes > 0) {
+            missing = qMax(missing, rules.minFreeBytes - (freeBytes + plan.reclaimedBytes));
+        }
+        return missing;
+    };
+
+    for (auto it = newestFirst.crbegin(); it != newestFirst.crend() && missingBytes() > 0; ++it) {
+        if (keep.at(*it) && !protect.at(*it)) {
+            keep[*it] = false;
+            remove(*it);
+        }
+    }
+
+    plan.remainingBytes = total - plan.reclaimedBytes;
+    plan.budgetMet = missingBytes() <= 0;
+    return plan;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
+
+#include "backupinfo.h"
+
+// Decides which backups to delete. Rules apply per slot: the newest backup of
+// each of the last `daily` days, `weekly` ISO weeks and `monthly` months is
+// kept (grandfather-father-son), as are the newest `minFullBackups` full
+// backups. If a size budget is set and still exceeded, further backups are
+// dropped oldest first until it is met, but never the protected ones above
+// nor the newest backup of a slot.
+//
+// A deduplicated backup frees its manifest and only those chunks no
+// remaining backup still uses; ChunkUsage counts them.
+class RetentionPolicy
+{
+public:
+    // How many of the given deduplicated backups use each stored chunk.
+    class ChunkUsage
+    {
+    public:
+        // Reads the manifests of the deduplicated backups among these.
+        static ChunkUsage load(const QList<BackupInfo> &backups);
+
+        // Whether it was loaded from these backups' manifests as they are.
+        bool isCurrent(const QList<BackupInfo> &backups) const;
+        // Bytes of all chunks the manifests use, each counted once.
+        qint64 storedBytes() const;
+        // Drops a manifest's uses, returning the bytes of the chunks it was
+        // the last user of.
+        qint64 release(const QString &manifest);
+
+    private:
+        struct Chunk {
+            quint32 length = 0;
+            int users = 0;
+        };
+
+        QHash<QByteArray, Chunk> m_chunks;
+        // Each manifest's distinct chunks.
+        QHash<QString, QList<QByteArray>> m_manifests;
+        QHash<QString, qint64> m_modified;
+        qint64 m_storedBytes = 0;
+    };
+
+    struct Rules {
+        int daily = 7;
+        int weekly = 4;
+        int monthly = 6;
+        int minFullBackups = 1;
+        // 0 disables the budget.
+        qint64 maxTotalBytes = 0;
+        qint64 minFreeBytes = 0;
+    };
+
+    struct Plan {
+        QList<BackupInfo> remove;
+        qint64 reclaimedBytes = 0;
+        qint64 remainingBytes = 0;
+        // False when the size budget can't be met without touching
+        // protected backups.
+        bool budgetMet = true;
+    };
+
+    static Rules rulesFromMap(const QVariantMap &map);
+    // Without chunks, deleting a deduplicated backup only frees its
+    // manifest.
+    static Plan plan(const QList<BackupInfo> &backups, const Rules &rules, qint64 freeBytes, ChunkUsage chunks = ChunkUsage());
+};
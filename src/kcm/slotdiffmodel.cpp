@@ -0,0 +1,416 @@
+#include "slotdiffmodel.h"
+#include "../slottool/slottoolprotocol.h"
+
+#include <QLocale>
+
+#include <algorithm>
+
+SlotDiffModel::SlotDiffModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_sizeDelta(0)
+{
+}
+
+QModelIndex SlotDiffModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (column != 0 || row < 0) {
+        return QModelIndex();
+    }
+
+    if (!parent.isValid()) {
+        return row < m_rows.count() ? createIndex(row, column, quintptr(0)) : QModelIndex();
+    }
+
+    // Children carry their group's id, offset so 0 can mean a group row.
+    if (parent.internalId() != 0 || parent.row() >= m_rows.count()) {
+        return QModelIndex();
+    }
+    const int group = m_rows.at(parent.row());
+    if (row >= m_groups.at(group).visible.count()) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, quintptr(group) + 1);
+}
+
+QModelIndex SlotDiffModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() == 0) {
+        return QModelIndex();
+    }
+    return createIndex(rowOfGroup(int(child.internalId() - 1)), 0, quintptr(0));
+}
+
+int SlotDiffModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return m_rows.count();
+    }
+    if (parent.internalId() != 0 || parent.row() >= m_rows.count()) {
+        return 0;
+    }
+    return m_groups.at(m_rows.at(parent.row())).visible.count();
+}
+
+int SlotDiffModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return 1;
+}
+
+QVariant SlotDiffModel::data(const QModelIndex &index, int role) const
+{
+    const Group *group = groupFor(index);
+    if (!group) {
+        return QVariant();
+    }
+
+    const QString directory = QLatin1Char('/') + group->directory;
+
+    if (index.internalId() == 0) {
+        switch (role) {
+        case Qt::DisplayRole:
+        case NameRole:
+        case PathRole:
+            return directory;
+        case IsGroupRole:
+            return true;
+        case SizeDeltaRole:
+            return groupDelta(*group);
+        case SizeDeltaStringRole:
+            return formatDelta(groupDelta(*group));
+        case CountRole:
+            return group->visible.count();
+        case TypeRole:
+            return typeName('d');
+        }
+        return QVariant();
+    }
+
+    const Change &change = group->changes.at(group->visible.at(index.row()));
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return change.name;
+    case PathRole:
+        return group->directory.isEmpty() ? directory + change.name : directory + QLatin1Char('/') + change.name;
+    case ChangeRole:
+        return changeName(change.change);
+    case TypeRole:
+        return typeName(change.type);
+    case IsGroupRole:
+        return false;
+    case OldSizeRole:
+        return change.oldSize;
+    case NewSizeRole:
+        return change.newSize;
+    case SizeDeltaRole:
+        return change.newSize - change.oldSize;
+    case SizeDeltaStringRole:
+        return formatDelta(change.newSize - change.oldSize);
+    case CountRole:
+        return 0;
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> SlotDiffModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[NameRole] = "name";
+    roles[PathRole] = "path";
+    roles[ChangeRole] = "change";
+    roles[TypeRole] = "type";
+    roles[IsGroupRole] = "isGroup";
+    roles[OldSizeRole] = "oldSize";
+    roles[NewSizeRole] = "newSize";
+    roles[SizeDeltaRole] = "sizeDelta";
+    roles[SizeDeltaStringRole] = "sizeDeltaString";
+    roles[CountRole] = "count";
+    return roles;
+}
+
+QString SlotDiffModel::baseSlot() const
+{
+    return m_baseSlot;
+}
+
+QString SlotDiffModel::targetSlot() const
+{
+    return m_targetSlot;
+}
+
+QString SlotDiffModel::filter() const
+{
+    return m_filter;
+}
+
+void SlotDiffModel::setFilter(const QString &filter)
+{
+    if (m_filter == filter) {
+        return;
+    }
+    m_filter = filter;
+    refilter();
+    Q_EMIT filterChanged();
+}
+
+QString SlotDiffModel::searchText() const
+{
+    return m_searchText;
+}
+
+void SlotDiffModel::setSearchText(const QString &searchText)
+{
+    if (m_searchText == searchText) {
+        return;
+    }
+    m_searchText = searchText;
+    refilter();
+    Q_EMIT filterChanged();
+}
+
+int SlotDiffModel::addedCount() const
+{
+    return m_counts.value('A');
+}
+
+int SlotDiffModel::removedCount() const
+{
+    return m_counts.value('R');
+}
+
+int SlotDiffModel::modifiedCount() const
+{
+    return m_counts.value('M');
+}
+
+int SlotDiffModel::attributeCount() const
+{
+    return m_counts.value('T');
+}
+
+qint64 SlotDiffModel::sizeDelta() const
+{
+    return m_sizeDelta;
+}
+
+void SlotDiffModel::reset(const QString &baseSlot, const QString &targetSlot)
+{
+    beginResetModel();
+    m_groups.clear();
+    m_groupIndex.clear();
+    m_rows.clear();
+    m_counts.clear();
+    m_sizeDelta = 0;
+    m_lines.clear();
+    endResetModel();
+
+    if (m_baseSlot != baseSlot || m_targetSlot != targetSlot) {
+        m_baseSlot = baseSlot;
+        m_targetSlot = targetSlot;
+        Q_EMIT slotsChanged();
+    }
+    Q_EMIT countsChanged();
+}
+
+QStringList SlotDiffModel::appendOutput(const QString &data)
+{
+    QStringList messages;
+    addRecords(m_lines.read(data), &messages);
+    return messages;
+}
+
+QStringList SlotDiffModel::finish()
+{
+    QStringList messages;
+    addRecords(m_lines.finish(), &messages);
+    return messages;
+}
+
+void SlotDiffModel::addRecords(const QStringList &lines, QStringList *messages)
+{
+    // New visible changes per group, in the order the groups first showed
+    // up, so each group gets one insertion per batch.
+    QList<int> touched;
+    QHash<int, QList<int>> added;
+
+    for (const QString &line : lines) {
+        // The path is last and may contain (escaped) anything, so only the
+        // first four fields are split off.
+        qsizetype fieldEnds[4];
+        qsizetype from = 0;
+        bool valid = true;
+        for (qsizetype &fieldEnd : fieldEnds) {
+            fieldEnd = line.indexOf(QLatin1Char('\t'), from);
+            if (fieldEnd < 0) {
+                valid = false;
+                break;
+            }
+            from = fieldEnd + 1;
+        }
+        if (!valid || fieldEnds[0] != 1 || fieldEnds[1] != 3 || !QStringLiteral("ARMT").contains(line.at(0))) {
+            messages->append(line);
+            continue;
+        }
+
+        Change change;
+        change.change = line.at(0).toLatin1();
+        change.type = line.at(2).toLatin1();
+        change.oldSize = QStringView(line).mid(fieldEnds[1] + 1, fieldEnds[2] - fieldEnds[1] - 1).toLongLong();
+        change.newSize = QStringView(line).mid(fieldEnds[2] + 1, fieldEnds[3] - fieldEnds[2] - 1).toLongLong();
+
+        const QString path = SlotToolProtocol::unescapePath(QStringView(line).mid(fieldEnds[3] + 1));
+        const qsizetype slash = path.lastIndexOf(QLatin1Char('/'));
+        const QString directory = slash < 0 ? QString() : path.left(slash);
+        change.name = path.mid(slash + 1);
+
+        int group = m_groupIndex.value(directory, -1);
+        if (group < 0) {
+            group = m_groups.count();
+            m_groups.append(Group{directory, {}, {}});
+            m_groupIndex.insert(directory, group);
+        }
+
+        m_counts[change.change]++;
+        m_sizeDelta += change.newSize - change.oldSize;
+        m_groups[group].changes.append(change);
+
+        if (accepts(m_groups.at(group), change)) {
+            if (!added.contains(group)) {
+                touched.append(group);
+            }
+            added[group].append(m_groups.at(group).changes.count() - 1);
+        }
+    }
+
+    for (const int group : std::as_const(touched)) {
+        const QList<int> &changes = added.value(group);
+        Group &entry = m_groups[group];
+        const int row = rowOfGroup(group);
+
+        if (entry.visible.isEmpty()) {
+            beginInsertRows(QModelIndex(), row, row);
+            entry.visible = changes;
+            m_rows.insert(row, group);
+            endInsertRows();
+            continue;
+        }
+
+        const QModelIndex parent = index(row, 0);
+        const int first = entry.visible.count();
+        beginInsertRows(parent, first, first + changes.count() - 1);
+        entry.visible += changes;
+        endInsertRows();
+        Q_EMIT dataChanged(parent, parent, {SizeDeltaRole, SizeDeltaStringRole, CountRole});
+    }
+
+    if (!lines.isEmpty()) {
+        Q_EMIT countsChanged();
+    }
+}
+
+bool SlotDiffModel::accepts(const Group &group, const Change &change) const
+{
+    if (!m_filter.isEmpty() && changeName(change.change) != m_filter) {
+        return false;
+    }
+    if (m_searchText.isEmpty()) {
+        return true;
+    }
+    return change.name.contains(m_searchText, Qt::CaseInsensitive) || group.directory.contains(m_searchText, Qt::CaseInsensitive);
+}
+
+void SlotDiffModel::refilter()
+{
+    beginResetModel();
+    m_rows.clear();
+    for (int i = 0; i < m_groups.count(); i++) {
+        Group &group = m_groups[i];
+        group.visible.clear();
+        for (int j = 0; j < group.changes.count(); j++) {
+            if (accepts(group, group.changes.at(j))) {
+                group.visible.append(j);
+            }
+        }
+        if (!group.visible.isEmpty()) {
+            m_rows.append(i);
+        }
+    }
+    std::sort(m_rows.begin(), m_rows.end(), [this](int a, int b) {
+        return m_groups.at(a).directory < m_groups.at(b).directory;
+    });
+    endResetModel();
+}
+
+int SlotDiffModel::rowOfGroup(int group) const
+{
+    const QString &directory = m_groups.at(group).directory;
+    const auto it = std::lower_bound(m_rows.cbegin(), m_rows.cend(), directory, [this](int row, const QString &value) {
+        return m_groups.at(row).directory < value;
+    });
+    return int(it - m_rows.cbegin());
+}
+
+const SlotDiffModel::Group *SlotDiffModel::groupFor(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return nullptr;
+    }
+
+    if (index.internalId() == 0) {
+        return index.row() < m_rows.count() ? &m_groups.at(m_rows.at(index.row())) : nullptr;
+    }
+
+    const qsizetype group = qsizetype(index.internalId() - 1);
+    if (group >= m_groups.count() || index.row() >= m_groups.at(group).visible.count()) {
+        return nullptr;
+    }
+    return &m_groups.at(group);
+}
+
+qint64 SlotDiffModel::groupDelta(const Group &group) const
+{
+    qint64 delta = 0;
+    for (const int change : group.visible) {
+        delta += group.changes.at(change).newSize - group.changes.at(change).oldSize;
+    }
+    return delta;
+}
+
+QString SlotDiffModel::changeName(char change)
+{
+    switch (change) {
+    case 'A':
+        return QStringLiteral("added");
+    case 'R':
+        return QStringLiteral("removed");
+    case 'M':
+        return QStringLiteral("modified");
+    case 'T':
+        return QStringLiteral("attributes");
+    }
+    return QString();
+}
+
+QString SlotDiffModel::typeName(char type)
+{
+    switch (type) {
+    case 'f':
+        return QStringLiteral("file");
+    case 'd':
+        return QStringLiteral("directory");
+    case 'l':
+        return QStringLiteral("symlink");
+    }
+    return QStringLiteral("other");
+}
+
+QString SlotDiffModel::formatDelta(qint64 delta)
+{
+    if (delta == 0) {
+        return QString();
+    }
+    const QString size = QLocale().formattedDataSize(qAbs(delta));
+    return delta > 0 ? QLatin1Char('+') + size : QLatin1Char('-') + size;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <qqmlregistration.h>
+
+#include "progressparser.h"
+
+// Differences between the running slot and the other one, as the slot diff
+// tool reports them, grouped by directory. Directories are the top-level
+// rows, sorted by path; the changed entries in each are their children.
+// Results are added while the tool is still walking, and the filter only
+// hides rows, so changing it never discards anything.
+class SlotDiffModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by SlotManager")
+    Q_PROPERTY(QString baseSlot READ baseSlot NOTIFY slotsChanged)
+    Q_PROPERTY(QString targetSlot READ targetSlot NOTIFY slotsChanged)
+    // "added", "removed", "modified", "attributes" or empty for all.
+    Q_PROPERTY(QString filter READ filter WRITE setFilter NOTIFY filterChanged)
+    Q_PROPERTY(QString searchText READ searchText WRITE setSearchText NOTIFY filterChanged)
+    Q_PROPERTY(int addedCount READ addedCount NOTIFY countsChanged)
+    Q_PROPERTY(int removedCount READ removedCount NOTIFY countsChanged)
+    Q_PROPERTY(int modifiedCount READ modifiedCount NOTIFY countsChanged)
+    Q_PROPERTY(int attributeCount READ attributeCount NOTIFY countsChanged)
+    // Bytes the target slot's files take up beyond the running slot's.
+    Q_PROPERTY(qint64 sizeDelta READ sizeDelta NOTIFY countsChanged)
+
+public:
+    enum Roles {
+        NameRole = Qt::UserRole + 1,
+        PathRole,
+        ChangeRole,
+        TypeRole,
+        IsGroupRole,
+        OldSizeRole,
+        NewSizeRole,
+        SizeDeltaRole,
+        SizeDeltaStringRole,
+        CountRole
+    };
+
+    explicit SlotDiffModel(QObject *parent = nullptr);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    QString baseSlot() const;
+    QString targetSlot() const;
+    QString filter() const;
+    void setFilter(const QString &filter);
+    QString searchText() const;
+    void setSearchText(const QString &searchText);
+    int addedCount() const;
+    int removedCount() const;
+    int modifiedCount() const;
+    int attributeCount() const;
+    qint64 sizeDelta() const;
+
+    // Drops all results and starts over for a new comparison.
+    void reset(const QString &baseSlot, const QString &targetSlot);
+    // Adds the records in a piece of the tool's output. Lines that aren't
+    // records (errors) are returned; a trailing partial line is kept for
+    // the next call.
+    QStringList appendOutput(const QString &data);
+    QStringList finish();
+
+Q_SIGNALS:
+    void slotsChanged();
+    void filterChanged();
+    void countsChanged();
+
+private:
+    struct Change {
+        QString name;
+        char change = 0;
+        char type = 0;
+        qint64 oldSize = 0;
+        qint64 newSize = 0;
+    };
+
+    struct Group {
+        QString directory;
+        QList<Change> changes;
+        // Indexes into changes that pass the filter.
+        QList<int> visible;
+    };
+
+    void addRecords(const QStringList &lines, QStringList *messages);
+    bool accepts(const Group &group, const Change &change) const;
+    void refilter();
+    // Position among the top-level rows where the group is or would go.
+    int rowOfGroup(int group) const;
+    const Group *groupFor(const QModelIndex &index) const;
+    qint64 groupDelta(const Group &group) const;
+
+    static QString changeName(char change);
+    static QString typeName(char type);
+    static QString formatDelta(qint64 delta);
+
+    QString m_baseSlot;
+    QString m_targetSlot;
+    QString m_filter;
+    QString m_searchText;
+    LineReader m_lines;
+
+    // Append-only, so a group's position here identifies it for good.
+    QList<Group> m_groups;
+    QHash<QString, int> m_groupIndex;
+    // Groups with visible changes, sorted by directory.
+    QList<int> m_rows;
+
+    QHash<char, int> m_counts;
+    qint64 m_sizeDelta;
+};
@@ -1,224 +1,493 @@
 #include "slotmanager.h"
+#include "../slottool/slottoolprotocol.h"
 
-SlotManager::SlotManager(QObject *parent)
+#include <QLocale>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+SlotManager::SlotManager(CommandExecutor *executor, SystemState *state, QObject *parent)
     : QObject(parent)
-    , m_process(nullptr)
-    , m_busy(false)
+    , m_executor(executor)
+    , m_state(state)
+    , m_log(new LogBuffer(this))
+    , m_outputModel(new LogLineModel(m_log, this))
+    , m_diffModel(new SlotDiffModel(this))
+    , m_packageDiff(new PackageDiffModel(this))
+    , m_healthChecks(new HealthCheckModel(this))
 {
-    refreshCurrentSlot();
+    connect(m_executor, &CommandExecutor::jobOutput, this, &SlotManager::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &SlotManager::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &SlotManager::onJobFailed);
+    connect(m_state, &SystemState::currentSlotChanged, this, &SlotManager::currentSlotChanged);
 }
 
 SlotManager::~SlotManager()
 {
-    if (m_process) {
-        m_process->kill();
-        m_process->waitForFinished();
-        delete m_process;
-    }
 }
 
 bool SlotManager::busy() const
 {
-    return m_busy;
+    return !m_jobs.isEmpty();
+}
+
+LogBuffer *SlotManager::log() const
+{
+    return m_log;
+}
+
+LogLineModel *SlotManager::outputModel() const
+{
+    return m_outputModel;
+}
+
+SlotDiffModel *SlotManager::diffModel() const
+{
+    return m_diffModel;
+}
+
+PackageDiffModel *SlotManager::packageDiff() const
+{
+    return m_packageDiff;
+}
+
+HealthCheckModel *SlotManager::healthChecks() const
+{
+    return m_healthChecks;
+}
+
+bool SlotManager::syncing() const
+{
+    return std::any_of(m_jobs.cbegin(), m_jobs.cend(), [](Operation operation) {
+        return operation == Operation::IncrementalSync;
+    });
+}
+
+qint64 SlotManager::syncFilesChecked() const
+{
+    return m_syncProgress.filesChecked;
+}
+
+qint64 SlotManager::syncFilesUpdated() const
+{
+    return m_syncProgress.filesUpdated;
+}
+
+qint64 SlotManager::syncBytesCopied() const
+{
+    return m_syncProgress.bytesCopied;
+}
+
+qint64 SlotManager::syncBytesSkipped() const
+{
+    return m_syncProgress.bytesSkipped;
+}
+
+double SlotManager::syncFilesPerSecond() const
+{
+    return m_syncProgress.filesRate.rate();
 }
 
-QString SlotManager::output() const
+double SlotManager::syncBytesPerSecond() const
 {
-    return m_output;
+    return m_syncProgress.bytesRate.rate();
 }
 
 QString SlotManager::currentSlot() const
 {
-    return m_currentSlot;
+    return m_state->currentSlot();
 }
 
 void SlotManager::switchSlot(const QString &slot)
 {
-    m_currentOperation = QStringLiteral("switch");
-    startProcess(QStringLiteral("switch"), {slot});
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("switch"), {slot});
+    job.resources << QStringLiteral("bootloader");
+    submit(Operation::Switch, job);
 }
 
 void SlotManager::switchOnce(const QString &slot)
 {
-    m_currentOperation = QStringLiteral("switch-once");
-    startProcess(QStringLiteral("switch-once"), {slot});
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("switch-once"), {slot});
+    job.resources << QStringLiteral("bootloader");
+    submit(Operation::SwitchOnce, job);
 }
 
-void SlotManager::syncSlots(const QString &targetSlot)
+void SlotManager::syncSlots(const QString &targetSlot, bool incremental)
 {
-    m_currentOperation = QStringLiteral("sync");
-    startProcess(QStringLiteral("sync"), {targetSlot});
+    if (!incremental) {
+        CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("sync"), {targetSlot});
+        job.resources << QStringLiteral("slot:%1").arg(targetSlot);
+        submit(Operation::Sync, job);
+        return;
+    }
+
+    // The slot tool walks both slots and applies what differs.
+    m_syncProgress = SyncProgress();
+    m_syncLines.clear();
+    m_syncClock.start();
+
+    CommandExecutor::Job job;
+    job.program = SlotToolProtocol::program();
+    job.arguments = {QStringLiteral("sync"), targetSlot};
+    job.resources << QStringLiteral("slot:%1").arg(targetSlot);
+    submit(Operation::IncrementalSync, job);
+    Q_EMIT syncProgressChanged();
 }
 
 void SlotManager::showSlotDiff()
 {
-    m_currentOperation = QStringLiteral("slot-diff");
-    startProcess(QStringLiteral("slot-diff"));
+    const QString other = otherSlot();
+    if (other.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Error"), tr("The running slot is not known yet."));
+        return;
+    }
+
+    m_diffModel->reset(currentSlot(), other);
+
+    CommandExecutor::Job job;
+    job.program = SlotToolProtocol::program();
+    job.arguments = QStringList{other};
+    // Its tree must hold still while it is walked.
+    job.resources << QStringLiteral("slot:%1").arg(other);
+    submit(Operation::SlotDiff, job);
 }
 
-void SlotManager::checkHealth()
+void SlotManager::comparePackages()
 {
-    m_currentOperation = QStringLiteral("health-check");
-    startProcess(QStringLiteral("health-check"));
+    const QString other = otherSlot();
+    if (other.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Error"), tr("The running slot is not known yet."));
+        return;
+    }
+
+    // The running slot's database is world-readable and read right here,
+    // unless the cached copy is still current.
+    const QString current = currentSlot();
+    if (!m_runningPackages.load(packageCachePath(current)) || m_runningPackages.modified != PackageDatabase::modifiedTime(QStringLiteral("/"))) {
+        if (!m_runningPackages.read(QStringLiteral("/"))) {
+            Q_EMIT errorOccurred(tr("Error"), tr("The running slot has no package database."));
+            return;
+        }
+        m_runningPackages.save(packageCachePath(current));
+    }
+
+    // The other slot's has to be read by the tool, which only lists it if
+    // it changed since the cached copy.
+    PackageDatabase cached;
+    QStringList args = {QStringLiteral("packages"), other};
+    if (cached.load(packageCachePath(other))) {
+        args << QStringLiteral("--since") << QString::number(cached.modified);
+    }
+
+    m_packageSlot = other;
+    m_packageOutput.clear();
+
+    CommandExecutor::Job job;
+    job.program = SlotToolProtocol::program();
+    job.arguments = args;
+    job.resources << QStringLiteral("slot:%1").arg(other);
+    submit(Operation::PackageDiff, job);
 }
 
-void SlotManager::refreshCurrentSlot()
+void SlotManager::checkHealth()
 {
-    QProcess process;
-    process.start(QStringLiteral("obsidianctl"), {QStringLiteral("current-slot")});
-    process.waitForFinished(3000);
+    const QString other = otherSlot();
+    if (other.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Error"), tr("The running slot is not known yet."));
+        return;
+    }
 
-    if (process.exitCode() == 0) {
-        QString newSlot = QString::fromUtf8(process.readAllStandardOutput()).trimmed();
-        if (m_currentSlot != newSlot) {
-            m_currentSlot = newSlot;
-            Q_EMIT currentSlotChanged();
-        }
+    m_healthChecks->reset();
+
+    CommandExecutor::Job job;
+    job.program = SlotToolProtocol::program();
+    job.arguments = {QStringLiteral("health"), other};
+    job.resources << QStringLiteral("slot:%1").arg(other);
+    submit(Operation::HealthCheck, job);
+
+    if (m_state->obsidianctlAvailable()) {
+        m_healthChecks->setResult(QString(), QStringLiteral("obsidianctl"), SlotToolProtocol::CheckRunning, 0, QString());
+        m_obsidianctlCheckOutput.clear();
+        m_obsidianctlCheckTimer.start();
+        submit(Operation::ObsidianctlHealthCheck, CommandExecutor::obsidianctl(QStringLiteral("health-check")));
     }
 }
 
+void SlotManager::refreshCurrentSlot()
+{
+    m_state->refresh();
+}
+
 void SlotManager::clearOutput()
 {
-    m_output.clear();
-    Q_EMIT outputChanged();
+    m_log->clear();
+}
+
+quint64 SlotManager::submit(Operation operation, const CommandExecutor::Job &job)
+{
+    const bool wasBusy = busy();
+    if (!wasBusy) {
+        m_log->clear();
+    }
+
+    const quint64 id = m_executor->submit(job);
+    m_jobs.insert(id, operation);
+
+    if (!wasBusy) {
+        Q_EMIT busyChanged();
+    }
+    return id;
 }
 
-void SlotManager::startProcess(const QString &command, const QStringList &args, bool usePolkit)
+void SlotManager::onJobOutput(quint64 id, const QString &data)
 {
-    if (m_busy) {
+    auto it = m_jobs.constFind(id);
+    if (it == m_jobs.constEnd()) {
         return;
     }
 
-    if (m_process) {
-        m_process->disconnect();
-        m_process->kill();
-        m_process->waitForFinished(1000);
-        delete m_process;
-        m_process = nullptr;
+    if (it.value() == Operation::PackageDiff) {
+        m_packageOutput += data;
+        return;
     }
 
-    m_process = new QProcess(this);
-    m_process->setProcessChannelMode(QProcess::MergedChannels);
+    if (it.value() == Operation::IncrementalSync) {
+        readSyncLines(m_syncLines.read(data));
+        return;
+    }
 
-    connect(m_process, &QProcess::readyReadStandardOutput, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardOutput());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
-        }
-    });
+    if (it.value() == Operation::ObsidianctlHealthCheck) {
+        m_obsidianctlCheckOutput += data;
+        return;
+    }
 
-    connect(m_process, &QProcess::readyReadStandardError, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardError());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
+    if (it.value() == Operation::HealthCheck || it.value() == Operation::SlotDiff) {
+        // Records go to the model; only messages are worth logging.
+        const QStringList messages = it.value() == Operation::HealthCheck ? m_healthChecks->appendOutput(data) : m_diffModel->appendOutput(data);
+        for (const QString &message : messages) {
+            m_log->append(message + QLatin1Char('\n'));
         }
-    });
+        return;
+    }
 
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
-        Q_UNUSED(exitStatus)
-
-        if (m_process) {
-            QString remainingOutput = QString::fromUtf8(m_process->readAllStandardOutput());
-            QString remainingError = QString::fromUtf8(m_process->readAllStandardError());
-
-            if (!remainingOutput.isEmpty()) {
-                m_output += remainingOutput;
-            }
-            if (!remainingError.isEmpty()) {
-                m_output += remainingError;
-            }
-            Q_EMIT outputChanged();
+    m_log->append(data);
+}
+
+void SlotManager::onJobFinished(quint64 id, int exitCode)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
+
+    const Operation operation = it.value();
+    m_jobs.erase(it);
+
+    if (operation == Operation::SlotDiff) {
+        const QStringList messages = m_diffModel->finish();
+        for (const QString &message : messages) {
+            m_log->append(message + QLatin1Char('\n'));
         }
+    }
+    if (operation == Operation::IncrementalSync) {
+        readSyncLines(m_syncLines.finish());
+        Q_EMIT syncProgressChanged();
+    }
+    if (operation == Operation::PackageDiff && exitCode != 0) {
+        // Only errors are worth showing.
+        m_log->append(m_packageOutput);
+    }
 
-        m_busy = false;
+    if (m_jobs.isEmpty()) {
         Q_EMIT busyChanged();
+    }
 
-        if (exitCode == 0) {
-            if (m_currentOperation == QStringLiteral("switch")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("Slot switch scheduled. Please reboot to apply."));
-                refreshCurrentSlot();
-            } else if (m_currentOperation == QStringLiteral("switch-once")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("One-time slot switch scheduled for next boot."));
-            } else if (m_currentOperation == QStringLiteral("sync")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("Slot synchronization completed successfully!"));
-            } else if (m_currentOperation == QStringLiteral("health-check")) {
-                m_output += QStringLiteral("\n\nHealth check completed successfully.");
-                Q_EMIT outputChanged();
-            } else if (m_currentOperation == QStringLiteral("slot-diff")) {
-                m_output += QStringLiteral("\n\nSlot comparison completed.");
-                Q_EMIT outputChanged();
-            }
-        } else {
-            QString errorMsg = m_output.isEmpty() ? tr("Operation failed with exit code %1").arg(exitCode) : m_output;
-            Q_EMIT errorOccurred(tr("Error"), errorMsg);
+    if (operation == Operation::HealthCheck || operation == Operation::ObsidianctlHealthCheck) {
+        finishHealthCheck(operation, exitCode);
+        return;
+    }
+
+    if (exitCode == 0) {
+        switch (operation) {
+        case Operation::Switch:
+            Q_EMIT operationSucceeded(tr("Success"), tr("Slot switch scheduled. Please reboot to apply."));
+            m_state->invalidate();
+            m_state->refresh();
+            break;
+        case Operation::SwitchOnce:
+            Q_EMIT operationSucceeded(tr("Success"), tr("One-time slot switch scheduled for next boot."));
+            m_state->invalidate();
+            m_state->refresh();
+            break;
+        case Operation::Sync:
+            Q_EMIT operationSucceeded(tr("Success"), tr("Slot synchronization completed successfully!"));
+            break;
+        case Operation::IncrementalSync:
+            Q_EMIT operationSucceeded(tr("Success"),
+                                      tr("Slot synchronization completed: %1 of %2 entries updated, %3 copied, %4 already up to date.")
+                                          .arg(m_syncProgress.filesUpdated)
+                                          .arg(m_syncProgress.filesChecked)
+                                          .arg(QLocale().formattedDataSize(m_syncProgress.bytesCopied))
+                                          .arg(QLocale().formattedDataSize(m_syncProgress.bytesSkipped)));
+            break;
+        case Operation::PackageDiff:
+            finishPackageDiff();
+            break;
+        case Operation::SlotDiff:
+            m_log->append(QStringLiteral("Slot comparison completed: %1 added, %2 removed, %3 modified, %4 with changed attributes.")
+                              .arg(m_diffModel->addedCount())
+                              .arg(m_diffModel->removedCount())
+                              .arg(m_diffModel->modifiedCount())
+                              .arg(m_diffModel->attributeCount()));
+            break;
         }
+    } else {
+        QString errorMsg = m_log->isEmpty() ? tr("Operation failed with exit code %1").arg(exitCode) : m_log->tail();
+        Q_EMIT errorOccurred(tr("Error"), errorMsg);
+    }
+}
+
+QString SlotManager::otherSlot() const
+{
+    const QString current = currentSlot();
+    if (current.isEmpty()) {
+        return QString();
+    }
+    return current == QStringLiteral("a") ? QStringLiteral("b") : QStringLiteral("a");
+}
+
+void SlotManager::finishPackageDiff()
+{
+    PackageDatabase target;
+    if (!target.fromRecords(m_packageOutput)) {
+        Q_EMIT errorOccurred(tr("Error"), tr("Could not read the packages of slot %1.").arg(m_packageSlot.toUpper()));
+        return;
+    }
+    m_packageOutput.clear();
 
-        m_currentOperation.clear();
-        
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
+    // No packages listed means the cached copy is still current.
+    const QString cachePath = packageCachePath(m_packageSlot);
+    if (target.packages.isEmpty()) {
+        PackageDatabase cached;
+        if (!cached.load(cachePath) || cached.modified != target.modified) {
+            Q_EMIT errorOccurred(tr("Error"), tr("Could not read the packages of slot %1.").arg(m_packageSlot.toUpper()));
+            return;
         }
-    });
+        target = cached;
+    } else {
+        target.save(cachePath);
+    }
 
-    connect(m_process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
-        m_busy = false;
-        Q_EMIT busyChanged();
+    m_packageDiff->compare(currentSlot(), m_runningPackages, m_packageSlot, target);
+    m_log->append(QStringLiteral("Package comparison completed: %1 added, %2 removed, %3 upgraded, %4 downgraded.")
+                      .arg(m_packageDiff->addedCount())
+                      .arg(m_packageDiff->removedCount())
+                      .arg(m_packageDiff->upgradedCount())
+                      .arg(m_packageDiff->downgradedCount()));
+}
 
-        QString errorMsg;
-        switch (error) {
-            case QProcess::FailedToStart:
-                errorMsg = tr("Failed to start process. Make sure pkexec and obsidianctl are installed.");
-                break;
-            case QProcess::Crashed:
-                errorMsg = tr("Process crashed.");
-                break;
-            case QProcess::Timedout:
-                errorMsg = tr("Process timed out.");
-                break;
-            default:
-                errorMsg = tr("Unknown process error occurred.");
-                break;
+void SlotManager::finishHealthCheck(Operation operation, int exitCode)
+{
+    if (operation == Operation::ObsidianctlHealthCheck) {
+        m_healthChecks->setResult(QString(),
+                                  QStringLiteral("obsidianctl"),
+                                  exitCode == 0 ? SlotToolProtocol::CheckPassed : SlotToolProtocol::CheckFailed,
+                                  m_obsidianctlCheckTimer.elapsed(),
+                                  m_obsidianctlCheckOutput.trimmed());
+        m_obsidianctlCheckOutput.clear();
+    } else {
+        const QStringList messages = m_healthChecks->finish();
+        for (const QString &message : messages) {
+            m_log->append(message + QLatin1Char('\n'));
         }
-        Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        m_currentOperation.clear();
-        
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
+        // The tool also exits with an error when a check failed, which the
+        // summary below covers; anything else means it couldn't check.
+        if (exitCode != 0 && m_healthChecks->failedCount() == 0) {
+            const QString errorMsg = m_log->isEmpty() ? tr("Operation failed with exit code %1").arg(exitCode) : m_log->tail();
+            Q_EMIT errorOccurred(tr("Error"), errorMsg);
         }
+    }
+
+    if (healthCheckPending()) {
+        return;
+    }
+
+    m_healthChecks->complete();
+    const QStringList failed = m_healthChecks->failedChecks();
+    if (!failed.isEmpty()) {
+        Q_EMIT errorOccurred(tr("Health Check"), tr("These checks failed: %1").arg(failed.join(QStringLiteral(", "))));
+        return;
+    }
+    m_log->append(QStringLiteral("Health check completed: %1 passed, %2 with warnings in %3 ms (%4 ms of checks).\n")
+                      .arg(m_healthChecks->passedCount())
+                      .arg(m_healthChecks->warningCount())
+                      .arg(m_healthChecks->elapsed())
+                      .arg(m_healthChecks->checkTime()));
+}
+
+bool SlotManager::healthCheckPending() const
+{
+    return std::any_of(m_jobs.cbegin(), m_jobs.cend(), [](Operation operation) {
+        return operation == Operation::HealthCheck || operation == Operation::ObsidianctlHealthCheck;
     });
+}
 
-    m_busy = true;
-    Q_EMIT busyChanged();
+void SlotManager::readSyncLines(const QStringList &lines)
+{
+    bool progressed = false;
+    for (const QString &line : lines) {
+        const QStringList fields = line.split(QLatin1Char('\t'));
+        if (fields.count() != 5 || fields.at(0) != SlotToolProtocol::ProgressField) {
+            m_log->append(line + QLatin1Char('\n'));
+            continue;
+        }
 
-    m_output.clear();
-    Q_EMIT outputChanged();
+        SyncProgress &progress = m_syncProgress;
+        const qint64 filesChecked = fields.at(1).toLongLong();
+        const qint64 bytesCopied = fields.at(3).toLongLong();
+        const qint64 now = m_syncClock.elapsed();
+        progress.filesRate.sample(now, filesChecked);
+        progress.bytesRate.sample(now, bytesCopied);
+        progress.filesChecked = filesChecked;
+        progress.filesUpdated = fields.at(2).toLongLong();
+        progress.bytesCopied = bytesCopied;
+        progress.bytesSkipped = fields.at(4).toLongLong();
+        progressed = true;
+    }
 
-    if (usePolkit) {
-        QStringList fullArgs;
-        fullArgs << QStringLiteral("obsidianctl") << command << args;
-        m_process->start(QStringLiteral("pkexec"), fullArgs);
-    } else {
-        QStringList fullArgs;
-        fullArgs << command << args;
-        m_process->start(QStringLiteral("obsidianctl"), fullArgs);
+    if (progressed) {
+        Q_EMIT syncProgressChanged();
     }
 }
 
-void SlotManager::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+QString SlotManager::packageCachePath(const QString &slot)
 {
-    Q_UNUSED(exitCode)
-    Q_UNUSED(exitStatus)
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kcm_obsidianos/packages-")
+        + slot + QStringLiteral(".bin");
 }
 
-void SlotManager::onProcessReadyRead()
+void SlotManager::onJobFailed(quint64 id, QProcess::ProcessError error)
 {
-}
\ No newline at end of file
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
+
+    const Operation operation = it.value();
+    m_jobs.erase(it);
+
+    if (m_jobs.isEmpty()) {
+        Q_EMIT busyChanged();
+    }
+
+    if (operation == Operation::IncrementalSync) {
+        Q_EMIT syncProgressChanged();
+    }
+    if (operation == Operation::HealthCheck || operation == Operation::ObsidianctlHealthCheck) {
+        if (!healthCheckPending()) {
+            m_healthChecks->complete();
+        }
+    }
+
+    Q_EMIT errorOccurred(tr("Error"), CommandExecutor::errorString(error));
+}
@@ -1,50 +1,134 @@
 #pragma once
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QProcess>
 #include <qqmlregistration.h>
 
+#include "commandexecutor.h"
+#include "healthcheckmodel.h"
+#include "logbuffer.h"
+#include "loglinemodel.h"
+#include "packagediffmodel.h"
+#include "progressparser.h"
+#include "slotdiffmodel.h"
+#include "systemstate.h"
+
 class SlotManager : public QObject
 {
     Q_OBJECT
     QML_ELEMENT
+    QML_UNCREATABLE("Provided by the KCM")
     Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
-    Q_PROPERTY(QString output READ output NOTIFY outputChanged)
+    Q_PROPERTY(LogBuffer* log READ log CONSTANT)
+    Q_PROPERTY(LogLineModel* outputModel READ outputModel CONSTANT)
+    Q_PROPERTY(SlotDiffModel* diffModel READ diffModel CONSTANT)
+    Q_PROPERTY(PackageDiffModel* packageDiff READ packageDiff CONSTANT)
+    Q_PROPERTY(HealthCheckModel* healthChecks READ healthChecks CONSTANT)
     Q_PROPERTY(QString currentSlot READ currentSlot NOTIFY currentSlotChanged)
+    // Live figures of the incremental sync that is running, or last ran.
+    Q_PROPERTY(bool syncing READ syncing NOTIFY syncProgressChanged)
+    Q_PROPERTY(qint64 syncFilesChecked READ syncFilesChecked NOTIFY syncProgressChanged)
+    Q_PROPERTY(qint64 syncFilesUpdated READ syncFilesUpdated NOTIFY syncProgressChanged)
+    Q_PROPERTY(qint64 syncBytesCopied READ syncBytesCopied NOTIFY syncProgressChanged)
+    Q_PROPERTY(qint64 syncBytesSkipped READ syncBytesSkipped NOTIFY syncProgressChanged)
+    Q_PROPERTY(double syncFilesPerSecond READ syncFilesPerSecond NOTIFY syncProgressChanged)
+    Q_PROPERTY(double syncBytesPerSecond READ syncBytesPerSecond NOTIFY syncProgressChanged)
 
 public:
-    explicit SlotManager(QObject *parent = nullptr);
+    explicit SlotManager(CommandExecutor *executor, SystemState *state, QObject *parent = nullptr);
     ~SlotManager() override;
 
     bool busy() const;
-    QString output() const;
+    LogBuffer *log() const;
+    LogLineModel *outputModel() const;
+    SlotDiffModel *diffModel() const;
+    PackageDiffModel *packageDiff() const;
+    HealthCheckModel *healthChecks() const;
     QString currentSlot() const;
+    bool syncing() const;
+    qint64 syncFilesChecked() const;
+    qint64 syncFilesUpdated() const;
+    qint64 syncBytesCopied() const;
+    qint64 syncBytesSkipped() const;
+    double syncFilesPerSecond() const;
+    double syncBytesPerSecond() const;
 
     Q_INVOKABLE void switchSlot(const QString &slot);
     Q_INVOKABLE void switchOnce(const QString &slot);
-    Q_INVOKABLE void syncSlots(const QString &targetSlot);
+    // An incremental sync only copies what differs from the target slot,
+    // instead of having obsidianctl copy the whole slot.
+    Q_INVOKABLE void syncSlots(const QString &targetSlot, bool incremental = false);
+    // Compares the running slot with the other one into diffModel.
     Q_INVOKABLE void showSlotDiff();
+    // Compares the installed packages of both slots into packageDiff.
+    Q_INVOKABLE void comparePackages();
+    // Checks both slots into healthChecks, alongside obsidianctl's own check.
     Q_INVOKABLE void checkHealth();
     Q_INVOKABLE void refreshCurrentSlot();
     Q_INVOKABLE void clearOutput();
 
 Q_SIGNALS:
     void busyChanged();
-    void outputChanged();
     void currentSlotChanged();
+    void syncProgressChanged();
     void errorOccurred(const QString &title, const QString &message);
     void operationSucceeded(const QString &title, const QString &message);
 
 private Q_SLOTS:
-    void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onProcessReadyRead();
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
 
 private:
-    void startProcess(const QString &command, const QStringList &args = QStringList(), bool usePolkit = true);
+    enum class Operation {
+        Switch,
+        SwitchOnce,
+        Sync,
+        IncrementalSync,
+        SlotDiff,
+        PackageDiff,
+        HealthCheck,
+        ObsidianctlHealthCheck
+    };
+
+    quint64 submit(Operation operation, const CommandExecutor::Job &job);
+    QString otherSlot() const;
+    void finishPackageDiff();
+    void readSyncLines(const QStringList &lines);
+    void finishHealthCheck(Operation operation, int exitCode);
+    bool healthCheckPending() const;
+
+    static QString packageCachePath(const QString &slot);
+
+    CommandExecutor *m_executor;
+    SystemState *m_state;
+    QHash<quint64, Operation> m_jobs;
+    LogBuffer *m_log;
+    LogLineModel *m_outputModel;
+    SlotDiffModel *m_diffModel;
+    PackageDiffModel *m_packageDiff;
+    HealthCheckModel *m_healthChecks;
+    // The running slot's packages and the other slot's listing while it
+    // is being read.
+    PackageDatabase m_runningPackages;
+    QString m_packageSlot;
+    QString m_packageOutput;
+
+    struct SyncProgress {
+        qint64 filesChecked = 0;
+        qint64 filesUpdated = 0;
+        qint64 bytesCopied = 0;
+        qint64 bytesSkipped = 0;
+        RateMeter filesRate;
+        RateMeter bytesRate;
+    };
+    SyncProgress m_syncProgress;
+    QElapsedTimer m_syncClock;
+    LineReader m_syncLines;
 
-    QProcess *m_process;
-    bool m_busy;
-    QString m_output;
-    QString m_currentSlot;
-    QString m_currentOperation;
+    // obsidianctl's health check reports as a whole, timed from here.
+    QElapsedTimer m_obsidianctlCheckTimer;
+    QString m_obsidianctlCheckOutput;
 };
\ No newline at end of file
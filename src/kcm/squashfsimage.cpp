@@ -0,0 +1,322 @@
+#include "squashfsimage.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QtEndian>
+
+namespace
+{
+
+constexpr quint32 Magic = 0x73717368; // "hsqs"
+constexpr qsizetype SuperblockSize = 96;
+constexpr quint64 NoTable = ~quint64(0);
+constexpr quint32 NoFragment = 0xffffffff;
+constexpr int MetadataBlockSize = 8192;
+// Walking a larger inode table is no longer cheap enough to do unasked.
+constexpr quint64 MaxInodeTableSize = 64 * 1024 * 1024;
+
+enum InodeType : quint16 {
+    BasicDirectory = 1,
+    BasicFile,
+    BasicSymlink,
+    BasicBlockDevice,
+    BasicCharDevice,
+    BasicFifo,
+    BasicSocket,
+    ExtendedDirectory,
+    ExtendedFile,
+    ExtendedSymlink,
+    ExtendedBlockDevice,
+    ExtendedCharDevice,
+    ExtendedFifo,
+    ExtendedSocket
+};
+
+struct Superblock {
+    quint32 inodeCount;
+    quint32 modificationTime;
+    quint32 blockSize;
+    quint16 compressionId;
+    quint16 blockLog;
+    quint16 idCount;
+    quint16 versionMajor;
+    quint16 versionMinor;
+    quint64 bytesUsed;
+    quint64 idTableStart;
+    quint64 inodeTableStart;
+    quint64 directoryTableStart;
+};
+
+QString tr(const char *text)
+{
+    return QCoreApplication::translate("SquashfsImage", text);
+}
+
+QString compressorName(quint16 id)
+{
+    switch (id) {
+    case 1:
+        return QStringLiteral("gzip");
+    case 2:
+        return QStringLiteral("lzma");
+    case 3:
+        return QStringLiteral("lzo");
+    case 4:
+        return QStringLiteral("xz");
+    case 5:
+        return QStringLiteral("lz4");
+    case 6:
+        return QStringLiteral("zstd");
+    }
+    return QString();
+}
+
+// Reads one metadata block at *offset and advances past it. Returns false on
+// a malformed block; *supported is cleared if it uses a codec we can't
+// inflate.
+bool readMetadataBlock(QFile &file, quint16 compressionId, quint64 *offset, QByteArray *out, bool *supported)
+{
+    uchar header[2];
+    if (!file.seek(*offset) || file.read(reinterpret_cast<char *>(header), 2) != 2) {
+        return false;
+    }
+
+    const quint16 word = qFromLittleEndian<quint16>(header);
+    const int size = word & 0x7fff;
+    if (size == 0 || size > MetadataBlockSize) {
+        return false;
+    }
+
+    QByteArray data = file.read(size);
+    if (data.size() != size) {
+        return false;
+    }
+    *offset += 2 + size;
+
+    if (word & 0x8000) {
+        out->append(data);
+        return true;
+    }
+
+    if (compressionId != 1) {
+        *supported = false;
+        return true;
+    }
+
+    // SquashFS stores zlib streams; qUncompress only wants the expected size
+    // in front.
+    uchar expected[4];
+    qToBigEndian<quint32>(MetadataBlockSize, expected);
+    data.prepend(reinterpret_cast<const char *>(expected), 4);
+    const QByteArray inflated = qUncompress(data);
+    if (inflated.isEmpty()) {
+        return false;
+    }
+    out->append(inflated);
+    return true;
+}
+
+// Walks every inode, returning the number seen and adding up the sizes of
+// regular files. Returns -1 if the table doesn't parse.
+qint64 walkInodes(const QByteArray &table, quint32 blockSize, qint64 *uncompressedSize)
+{
+    const auto *data = reinterpret_cast<const uchar *>(table.constData());
+    const qsizetype end = table.size();
+    qsizetype pos = 0;
+    qint64 count = 0;
+    qint64 total = 0;
+
+    const auto blockListSize = [blockSize](quint64 fileSize, quint32 fragment) {
+        const quint64 blocks = fragment == NoFragment ? (fileSize + blockSize - 1) / blockSize : fileSize / blockSize;
+        return qsizetype(blocks * 4);
+    };
+
+    while (pos < end) {
+        if (end - pos < 16) {
+            return -1;
+        }
+        const quint16 type = qFromLittleEndian<quint16>(data + pos);
+        const uchar *body = data + pos + 16;
+        const qsizetype available = end - pos - 16;
+        qsizetype size = 0;
+
+        switch (type) {
+        case BasicDirectory:
+            size = 16;
+            break;
+        case BasicFile: {
+            if (available < 16) {
+                return -1;
+            }
+            const quint32 fragment = qFromLittleEndian<quint32>(body + 4);
+            const quint32 fileSize = qFromLittleEndian<quint32>(body + 12);
+            total += fileSize;
+            size = 16 + blockListSize(fileSize, fragment);
+            break;
+        }
+        case BasicSymlink:
+        case ExtendedSymlink:
+            if (available < 8) {
+                return -1;
+            }
+            size = 8 + qFromLittleEndian<quint32>(body + 4) + (type == ExtendedSymlink ? 4 : 0);
+            break;
+        case BasicBlockDevice:
+        case BasicCharDevice:
+            size = 8;
+            break;
+        case BasicFifo:
+        case BasicSocket:
+            size = 4;
+            break;
+        case ExtendedDirectory: {
+            if (available < 24) {
+                return -1;
+            }
+            const quint16 indexCount = qFromLittleEndian<quint16>(body + 16);
+            size = 24;
+            for (quint16 i = 0; i < indexCount; i++) {
+                if (available < size + 12) {
+                    return -1;
+                }
+                size += 12 + qFromLittleEndian<quint32>(body + size + 8) + 1;
+            }
+            break;
+        }
+        case ExtendedFile: {
+            if (available < 40) {
+                return -1;
+            }
+            const quint64 fileSize = qFromLittleEndian<quint64>(body + 8);
+            const quint32 fragment = qFromLittleEndian<quint32>(body + 28);
+            total += fileSize;
+            size = 40 + blockListSize(fileSize, fragment);
+            break;
+        }
+        case ExtendedBlockDevice:
+        case ExtendedCharDevice:
+            size = 12;
+            break;
+        case ExtendedFifo:
+        case ExtendedSocket:
+            size = 8;
+            break;
+        default:
+            return -1;
+        }
+
+        if (size > available) {
+            return -1;
+        }
+        pos += 16 + size;
+        count++;
+    }
+
+    *uncompressedSize = total;
+    return count;
+}
+
+}
+
+SquashfsImage::Info SquashfsImage::inspect(const QString &path, bool scanInodes)
+{
+    Info info;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        info.error = tr("The image cannot be opened.");
+        return info;
+    }
+
+    const QByteArray raw = file.read(SuperblockSize);
+    if (raw.size() != SuperblockSize || qFromLittleEndian<quint32>(raw.constData()) != Magic) {
+        info.error = tr("Not a SquashFS image.");
+        return info;
+    }
+
+    const auto *data = reinterpret_cast<const uchar *>(raw.constData());
+    Superblock sb;
+    sb.inodeCount = qFromLittleEndian<quint32>(data + 4);
+    sb.modificationTime = qFromLittleEndian<quint32>(data + 8);
+    sb.blockSize = qFromLittleEndian<quint32>(data + 12);
+    sb.compressionId = qFromLittleEndian<quint16>(data + 20);
+    sb.blockLog = qFromLittleEndian<quint16>(data + 22);
+    sb.idCount = qFromLittleEndian<quint16>(data + 26);
+    sb.versionMajor = qFromLittleEndian<quint16>(data + 28);
+    sb.versionMinor = qFromLittleEndian<quint16>(data + 30);
+    sb.bytesUsed = qFromLittleEndian<quint64>(data + 40);
+    sb.idTableStart = qFromLittleEndian<quint64>(data + 48);
+    sb.inodeTableStart = qFromLittleEndian<quint64>(data + 64);
+    sb.directoryTableStart = qFromLittleEndian<quint64>(data + 72);
+
+    info.compressor = compressorName(sb.compressionId);
+    info.blockSize = sb.blockSize;
+    info.inodeCount = sb.inodeCount;
+    info.created = QDateTime::fromSecsSinceEpoch(sb.modificationTime);
+    info.bytesUsed = qint64(sb.bytesUsed);
+
+    if (sb.versionMajor != 4 || sb.versionMinor != 0) {
+        info.error = tr("Unsupported SquashFS version %1.%2.").arg(sb.versionMajor).arg(sb.versionMinor);
+    } else if (info.compressor.isEmpty()) {
+        info.error = tr("Unknown compressor %1.").arg(sb.compressionId);
+    } else if (sb.blockSize < 4096 || sb.blockSize > 1024 * 1024 || sb.blockLog >= 32 || (1u << sb.blockLog) != sb.blockSize) {
+        info.error = tr("The block size is invalid.");
+    } else if (sb.bytesUsed > quint64(file.size())) {
+        info.error = tr("The image is truncated: %1 of %2 bytes present.").arg(file.size()).arg(sb.bytesUsed);
+    } else if (sb.inodeTableStart < SuperblockSize || sb.inodeTableStart >= sb.directoryTableStart
+               || sb.directoryTableStart >= sb.bytesUsed || sb.idTableStart == NoTable || sb.idTableStart >= sb.bytesUsed
+               || sb.idTableStart < sb.directoryTableStart) {
+        info.error = tr("The table offsets are inconsistent.");
+    }
+    if (!info.isValid()) {
+        return info;
+    }
+
+    // The id table is a list of pointers to metadata blocks, which must lie
+    // between the directory table and the list itself.
+    const qsizetype idBlocks = (qsizetype(sb.idCount) * 4 + MetadataBlockSize - 1) / MetadataBlockSize;
+    file.seek(qint64(sb.idTableStart));
+    const QByteArray idPointers = file.read(idBlocks * 8);
+    if (idPointers.size() != idBlocks * 8) {
+        info.error = tr("The id table is truncated.");
+        return info;
+    }
+    for (qsizetype i = 0; i < idBlocks; i++) {
+        const quint64 pointer = qFromLittleEndian<quint64>(idPointers.constData() + i * 8);
+        if (pointer < sb.directoryTableStart || pointer >= sb.idTableStart) {
+            info.error = tr("The id table is corrupt.");
+            return info;
+        }
+    }
+
+    if (!scanInodes || sb.directoryTableStart - sb.inodeTableStart > MaxInodeTableSize) {
+        return info;
+    }
+
+    QByteArray table;
+    bool supported = true;
+    quint64 offset = sb.inodeTableStart;
+    while (offset < sb.directoryTableStart && supported) {
+        if (!readMetadataBlock(file, sb.compressionId, &offset, &table, &supported)) {
+            info.error = tr("The inode table is corrupt.");
+            return info;
+        }
+    }
+    if (!supported) {
+        return info;
+    }
+
+    if (offset != sb.directoryTableStart) {
+        info.error = tr("The inode table overruns the directory table.");
+        return info;
+    }
+
+    qint64 uncompressedSize = 0;
+    const qint64 inodes = walkInodes(table, sb.blockSize, &uncompressedSize);
+    if (inodes != sb.inodeCount) {
+        info.error = tr("The inode table is corrupt.");
+        return info;
+    }
+    info.uncompressedSize = uncompressedSize;
+    return info;
+}
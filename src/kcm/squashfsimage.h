@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QDateTime>
+#include <QString>
+
+// Reads what a SquashFS image says about itself straight from the file,
+// without mounting it or running unsquashfs. The superblock alone gives the
+// compressor, block size, inode count and creation time, and its table
+// offsets are checked against each other and the file size. With
+// scanInodes the inode table is walked as well, which confirms the inode
+// count and yields the uncompressed size; that needs its metadata blocks to
+// be stored plain or with gzip, the only codec Qt can inflate.
+class SquashfsImage
+{
+public:
+    struct Info {
+        // Empty when the image looks intact.
+        QString error;
+        QString compressor;
+        quint32 blockSize = 0;
+        quint32 inodeCount = 0;
+        QDateTime created;
+        qint64 bytesUsed = 0;
+        // -1 unless the inode table could be walked.
+        qint64 uncompressedSize = -1;
+
+        bool isValid() const
+        {
+            return error.isEmpty();
+        }
+    };
+
+    static Info inspect(const QString &path, bool scanInodes = false);
+};
@@ -0,0 +1,331 @@
+#include "systemstate.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace
+{
+
+// Bump when the cache layout changes.
+constexpr int CacheVersion = 1;
+
+}
+
+SystemState::SystemState(CommandExecutor *executor, QObject *parent)
+    : QObject(parent)
+    , m_executor(executor)
+    , m_obsidianctlAvailable(!QStandardPaths::findExecutable(QStringLiteral("obsidianctl")).isEmpty())
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_cachePath(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                  + QStringLiteral("/kcm_obsidianos/system-state.json"))
+    , m_stale(true)
+{
+    // Requests made in the same event loop pass (e.g. every page refreshing
+    // at once) collapse into a single probe.
+    m_refreshTimer.setSingleShot(true);
+    m_refreshTimer.setInterval(0);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &SystemState::startProbes);
+
+    connect(m_executor, &CommandExecutor::jobOutput, this, &SystemState::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &SystemState::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &SystemState::onJobFailed);
+
+    for (const QString &path : watchedPaths()) {
+        if (QFileInfo::exists(path)) {
+            m_watcher->addPath(path);
+        }
+    }
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &SystemState::onWatchedPathChanged);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &SystemState::onWatchedPathChanged);
+
+    m_stale = !loadCache();
+}
+
+SystemState::~SystemState()
+{
+}
+
+bool SystemState::obsidianctlAvailable() const
+{
+    return m_obsidianctlAvailable;
+}
+
+bool SystemState::loading() const
+{
+    return m_refreshTimer.isActive() || !m_probes.isEmpty();
+}
+
+QString SystemState::currentSlot() const
+{
+    return m_currentSlot;
+}
+
+QString SystemState::version() const
+{
+    return m_version;
+}
+
+QString SystemState::nextBootSlot() const
+{
+    return m_nextBootSlot;
+}
+
+QVariantMap SystemState::slotHealth() const
+{
+    return m_slotHealth;
+}
+
+void SystemState::refresh()
+{
+    if (!m_obsidianctlAvailable || loading()) {
+        return;
+    }
+
+    if (!m_stale) {
+        Q_EMIT refreshed();
+        return;
+    }
+
+    m_refreshTimer.start();
+    Q_EMIT loadingChanged();
+}
+
+void SystemState::invalidate()
+{
+    m_stale = true;
+}
+
+void SystemState::onJobOutput(quint64 id, const QString &data)
+{
+    if (m_probes.contains(id)) {
+        m_probeOutput[id] += data;
+    }
+}
+
+void SystemState::onJobFinished(quint64 id, int exitCode)
+{
+    probeFinished(id, exitCode == 0);
+}
+
+void SystemState::onJobFailed(quint64 id, QProcess::ProcessError error)
+{
+    Q_UNUSED(error)
+    probeFinished(id, false);
+}
+
+void SystemState::onWatchedPathChanged(const QString &path)
+{
+    // Files replaced by rename drop out of the watch list.
+    if (!m_watcher->files().contains(path) && !m_watcher->directories().contains(path) && QFileInfo::exists(path)) {
+        m_watcher->addPath(path);
+    }
+
+    m_stale = true;
+    refresh();
+}
+
+void SystemState::startProbes()
+{
+    // Changes seen from here on mark the result stale again.
+    m_stale = false;
+    m_statusResult.clear();
+    m_currentSlotResult.clear();
+
+    // current-slot only runs if status --json turns out to be unsupported.
+    m_probes.insert(m_executor->submit(CommandExecutor::obsidianctl(QStringLiteral("status"), {QStringLiteral("--json")}, false)),
+                    Probe::Status);
+}
+
+void SystemState::probeFinished(quint64 id, bool success)
+{
+    auto it = m_probes.find(id);
+    if (it == m_probes.end()) {
+        return;
+    }
+
+    const Probe probe = it.value();
+    m_probes.erase(it);
+    const QString output = m_probeOutput.take(id).trimmed();
+
+    if (success) {
+        switch (probe) {
+        case Probe::Status:
+            m_statusResult = output;
+            break;
+        case Probe::CurrentSlot:
+            m_currentSlotResult = output;
+            break;
+        }
+    }
+
+    if (probe == Probe::Status && !QJsonDocument::fromJson(m_statusResult.toUtf8()).isObject()) {
+        m_probes.insert(m_executor->submit(CommandExecutor::obsidianctl(QStringLiteral("current-slot"), {}, false)),
+                        Probe::CurrentSlot);
+        return;
+    }
+
+    if (m_probes.isEmpty()) {
+        // With nothing learned, the cache must not vouch for the old facts
+        // for the rest of the boot.
+        const bool learned = QJsonDocument::fromJson(m_statusResult.toUtf8()).isObject() || !m_currentSlotResult.isEmpty();
+        apply();
+        if (learned) {
+            saveCache();
+        }
+        Q_EMIT loadingChanged();
+        Q_EMIT refreshed();
+
+        if (m_stale) {
+            refresh();
+        } else if (!learned) {
+            // Probed again on the next refresh, not right away.
+            m_stale = true;
+        }
+    }
+}
+
+void SystemState::apply()
+{
+    const QJsonDocument doc = QJsonDocument::fromJson(m_statusResult.toUtf8());
+    if (doc.isObject()) {
+        const QJsonObject obj = doc.object();
+        setCurrentSlot(obj.value(QStringLiteral("current_slot")).toString());
+        setVersion(obj.value(QStringLiteral("version")).toString());
+        setNextBootSlot(obj.value(QStringLiteral("next_boot_slot")).toString());
+
+        // "slots": {"a": {"health": "ok"}, ...} on versions that report it.
+        QVariantMap health;
+        const QJsonObject slots = obj.value(QStringLiteral("slots")).toObject();
+        for (auto slot = slots.constBegin(); slot != slots.constEnd(); ++slot) {
+            health.insert(slot.key(), slot.value().toObject().value(QStringLiteral("health")).toString());
+        }
+        setSlotHealth(health);
+        return;
+    }
+
+    if (!m_currentSlotResult.isEmpty()) {
+        setCurrentSlot(m_currentSlotResult);
+    }
+
+    QFile versionFile(QStringLiteral("/etc/obsidianos-release"));
+    if (versionFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        setVersion(QString::fromUtf8(versionFile.readAll()).trimmed());
+        versionFile.close();
+    }
+}
+
+void SystemState::setCurrentSlot(const QString &slot)
+{
+    if (m_currentSlot != slot) {
+        m_currentSlot = slot;
+        Q_EMIT currentSlotChanged();
+    }
+}
+
+void SystemState::setVersion(const QString &version)
+{
+    if (m_version != version) {
+        m_version = version;
+        Q_EMIT versionChanged();
+    }
+}
+
+void SystemState::setNextBootSlot(const QString &slot)
+{
+    if (m_nextBootSlot != slot) {
+        m_nextBootSlot = slot;
+        Q_EMIT nextBootSlotChanged();
+    }
+}
+
+void SystemState::setSlotHealth(const QVariantMap &health)
+{
+    if (m_slotHealth != health) {
+        m_slotHealth = health;
+        Q_EMIT slotHealthChanged();
+    }
+}
+
+QStringList SystemState::watchedPaths()
+{
+    // Everything status --json derives from, other than the running kernel's
+    // command line, which only changes with a reboot.
+    return {
+        QStringLiteral("/etc/obsidianos-release"),
+        QStringLiteral("/boot/loader/loader.conf"),
+        QStringLiteral("/boot/loader/entries"),
+        QStringLiteral("/boot/grub/grubenv"),
+        QStringLiteral("/var/lib/obsidianctl"),
+    };
+}
+
+QString SystemState::bootId()
+{
+    QFile file(QStringLiteral("/proc/sys/kernel/random/boot_id"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    return QString::fromLatin1(file.readAll()).trimmed();
+}
+
+QJsonObject SystemState::pathStamps()
+{
+    QJsonObject stamps;
+    for (const QString &path : watchedPaths()) {
+        const QFileInfo info(path);
+        if (info.exists()) {
+            stamps.insert(path, QStringLiteral("%1:%2").arg(info.lastModified().toMSecsSinceEpoch()).arg(info.size()));
+        }
+    }
+    return stamps;
+}
+
+bool SystemState::loadCache()
+{
+    QFile file(m_cachePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QJsonObject cache = QJsonDocument::fromJson(file.readAll()).object();
+    if (cache.value(QStringLiteral("cache_version")).toInt() != CacheVersion) {
+        return false;
+    }
+
+    // Serve the cached facts either way; they are only trusted without a
+    // new probe when nothing they depend on has changed since.
+    setCurrentSlot(cache.value(QStringLiteral("current_slot")).toString());
+    setVersion(cache.value(QStringLiteral("version")).toString());
+    setNextBootSlot(cache.value(QStringLiteral("next_boot_slot")).toString());
+    setSlotHealth(cache.value(QStringLiteral("slot_health")).toObject().toVariantMap());
+
+    const QString boot = bootId();
+    return !boot.isEmpty()
+        && cache.value(QStringLiteral("boot_id")).toString() == boot
+        && cache.value(QStringLiteral("stamps")).toObject() == pathStamps();
+}
+
+void SystemState::saveCache() const
+{
+    QDir().mkpath(QFileInfo(m_cachePath).absolutePath());
+
+    QJsonObject cache;
+    cache.insert(QStringLiteral("cache_version"), CacheVersion);
+    cache.insert(QStringLiteral("boot_id"), bootId());
+    cache.insert(QStringLiteral("stamps"), pathStamps());
+    cache.insert(QStringLiteral("current_slot"), m_currentSlot);
+    cache.insert(QStringLiteral("version"), m_version);
+    cache.insert(QStringLiteral("next_boot_slot"), m_nextBootSlot);
+    cache.insert(QStringLiteral("slot_health"), QJsonObject::fromVariantMap(m_slotHealth));
+
+    QSaveFile file(m_cachePath);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QProcess>
+#include <QTimer>
+#include <QVariantMap>
+#include <qqmlregistration.h>
+
+#include "commandexecutor.h"
+
+class QFileSystemWatcher;
+
+// Owns the system facts every page shows (current slot, version, next-boot
+// slot, per-slot health). Any number of refresh() calls made while a probe
+// is pending or running are served by that one probe.
+//
+// The last result is cached on disk and served immediately on the next open.
+// It is only probed again after a reboot or when one of the files it depends
+// on changes; refresh() on fresh state costs nothing.
+class SystemState : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by the KCM")
+    Q_PROPERTY(bool obsidianctlAvailable READ obsidianctlAvailable CONSTANT)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(QString currentSlot READ currentSlot NOTIFY currentSlotChanged)
+    Q_PROPERTY(QString version READ version NOTIFY versionChanged)
+    Q_PROPERTY(QString nextBootSlot READ nextBootSlot NOTIFY nextBootSlotChanged)
+    Q_PROPERTY(QVariantMap slotHealth READ slotHealth NOTIFY slotHealthChanged)
+
+public:
+    explicit SystemState(CommandExecutor *executor, QObject *parent = nullptr);
+    ~SystemState() override;
+
+    bool obsidianctlAvailable() const;
+    bool loading() const;
+    QString currentSlot() const;
+    QString version() const;
+    QString nextBootSlot() const;
+    QVariantMap slotHealth() const;
+
+    Q_INVOKABLE void refresh();
+    // Forces the next refresh() to probe, e.g. after a command changed the
+    // boot configuration.
+    void invalidate();
+
+Q_SIGNALS:
+    void loadingChanged();
+    void currentSlotChanged();
+    void versionChanged();
+    void nextBootSlotChanged();
+    void slotHealthChanged();
+    void refreshed();
+
+private Q_SLOTS:
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
+    void onWatchedPathChanged(const QString &path);
+
+private:
+    enum class Probe {
+        Status,
+        CurrentSlot
+    };
+
+    void startProbes();
+    void probeFinished(quint64 id, bool success);
+    void apply();
+    void setCurrentSlot(const QString &slot);
+    void setVersion(const QString &version);
+    void setNextBootSlot(const QString &slot);
+    void setSlotHealth(const QVariantMap &health);
+
+    static QStringList watchedPaths();
+    static QString bootId();
+    static QJsonObject pathStamps();
+    bool loadCache();
+    void saveCache() const;
+
+    CommandExecutor *m_executor;
+    bool m_obsidianctlAvailable;
+    QTimer m_refreshTimer;
+    QFileSystemWatcher *m_watcher;
+    QString m_cachePath;
+    bool m_stale;
+
+    QHash<quint64, Probe> m_probes;
+    QHash<quint64, QString> m_probeOutput;
+    QString m_statusResult;
+    QString m_currentSlotResult;
+
+    QString m_currentSlot;
+    QString m_version;
+    QString m_nextBootSlot;
+    QVariantMap m_slotHealth;
+};
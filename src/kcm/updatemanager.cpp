@@ -1,34 +1,64 @@
 #include "updatemanager.h"
+#include "squashfsimage.h"
 
 #include <QFile>
 #include <QFileInfo>
-#include <QRegularExpression>
+#include <QLocale>
 
-UpdateManager::UpdateManager(QObject *parent)
+UpdateManager::UpdateManager(CommandExecutor *executor, QObject *parent)
     : QObject(parent)
-    , m_process(nullptr)
-    , m_busy(false)
+    , m_executor(executor)
+    , m_log(new LogBuffer(this))
+    , m_outputModel(new LogLineModel(m_log, this))
     , m_breakSystemEnabled(false)
 {
+    connect(m_executor, &CommandExecutor::jobOutput, this, &UpdateManager::onJobOutput);
+    connect(m_executor, &CommandExecutor::jobFinished, this, &UpdateManager::onJobFinished);
+    connect(m_executor, &CommandExecutor::jobFailed, this, &UpdateManager::onJobFailed);
 }
 
 UpdateManager::~UpdateManager()
 {
-    if (m_process) {
-        m_process->kill();
-        m_process->waitForFinished();
-        delete m_process;
-    }
 }
 
 bool UpdateManager::busy() const
 {
-    return m_busy;
+    return !m_jobs.isEmpty();
+}
+
+LogBuffer *UpdateManager::log() const
+{
+    return m_log;
 }
 
-QString UpdateManager::output() const
+LogLineModel *UpdateManager::outputModel() const
 {
-    return m_output;
+    return m_outputModel;
+}
+
+int UpdateManager::progress() const
+{
+    return m_progress.percent();
+}
+
+qint64 UpdateManager::bytesDone() const
+{
+    return m_progress.bytesDone();
+}
+
+qint64 UpdateManager::bytesTotal() const
+{
+    return m_progress.bytesTotal();
+}
+
+double UpdateManager::throughput() const
+{
+    return m_progress.throughput();
+}
+
+qint64 UpdateManager::eta() const
+{
+    return m_progress.eta();
 }
 
 bool UpdateManager::breakSystemEnabled() const
@@ -47,18 +77,19 @@ void UpdateManager::setBreakSystemEnabled(bool enabled)
 void UpdateManager::updateFromFile(const QString &slot, const QString &imagePath)
 {
     if (!validateImagePath(imagePath)) {
-        Q_EMIT errorOccurred(tr("Error"), tr("Please select a valid system image file."));
+        const QString reason = imagePath.isEmpty() ? QString() : SquashfsImage::inspect(imagePath).error;
+        Q_EMIT errorOccurred(tr("Error"), reason.isEmpty() ? tr("Please select a valid system image file.")
+                                                           : tr("%1 is not a valid system image: %2").arg(QFileInfo(imagePath).fileName(), reason));
         return;
     }
 
-    m_currentOperation = QStringLiteral("update");
-    startProcess(QStringLiteral("update"), {slot, imagePath});
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("update"), {slot, imagePath});
+    job.resources << QStringLiteral("slot:%1").arg(slot);
+    submit(Operation::Update, job);
 }
 
 void UpdateManager::networkUpdate(const QString &slot)
 {
-    m_currentOperation = QStringLiteral("netupdate");
-
     QStringList args;
     args << slot;
 
@@ -66,13 +97,14 @@ void UpdateManager::networkUpdate(const QString &slot)
         args << QStringLiteral("--break-system");
     }
 
-    startProcess(QStringLiteral("netupdate"), args);
+    CommandExecutor::Job job = CommandExecutor::obsidianctl(QStringLiteral("netupdate"), args);
+    job.resources << QStringLiteral("slot:%1").arg(slot);
+    submit(Operation::NetworkUpdate, job);
 }
 
 void UpdateManager::clearOutput()
 {
-    m_output.clear();
-    Q_EMIT outputChanged();
+    m_log->clear();
 }
 
 bool UpdateManager::validateImagePath(const QString &path)
@@ -82,146 +114,103 @@ bool UpdateManager::validateImagePath(const QString &path)
     }
 
     QFileInfo fileInfo(path);
-    return fileInfo.exists() && fileInfo.isFile();
+    return fileInfo.exists() && fileInfo.isFile() && SquashfsImage::inspect(path).isValid();
 }
 
-void UpdateManager::startProcess(const QString &command, const QStringList &args, bool usePolkit)
+QVariantMap UpdateManager::inspectImage(const QString &path) const
 {
-    if (m_busy) {
-        return;
+    if (path.isEmpty() || !QFileInfo(path).isFile()) {
+        return {};
     }
 
-    if (m_process) {
-        m_process->disconnect();
-        m_process->kill();
-        m_process->waitForFinished(1000);
-        delete m_process;
-        m_process = nullptr;
+    const SquashfsImage::Info image = SquashfsImage::inspect(path);
+    const QLocale locale;
+    return {
+        {QStringLiteral("error"), image.error},
+        {QStringLiteral("compressor"), image.compressor},
+        {QStringLiteral("blockSize"), image.blockSize ? locale.formattedDataSize(image.blockSize) : QString()},
+        {QStringLiteral("inodeCount"), locale.toString(image.inodeCount)},
+        {QStringLiteral("created"), locale.toString(image.created, QLocale::ShortFormat)},
+        {QStringLiteral("size"), locale.formattedDataSize(image.bytesUsed)}
+    };
+}
+
+quint64 UpdateManager::submit(Operation operation, const CommandExecutor::Job &job)
+{
+    const bool wasBusy = busy();
+    if (!wasBusy) {
+        m_log->clear();
+        m_progress.reset();
+        Q_EMIT progressChanged();
     }
 
-    m_process = new QProcess(this);
-    m_process->setProcessChannelMode(QProcess::MergedChannels);
-
-    connect(m_process, &QProcess::readyReadStandardOutput, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardOutput());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-
-                QRegularExpression re(QStringLiteral("(\\d+)%"));
-                QRegularExpressionMatch match = re.match(data);
-                if (match.hasMatch()) {
-                    int percent = match.captured(1).toInt();
-                    Q_EMIT updateProgress(percent);
-                }
-            }
-        }
-    });
-
-    connect(m_process, &QProcess::readyReadStandardError, this, [this]() {
-        if (m_process) {
-            QString data = QString::fromUtf8(m_process->readAllStandardError());
-            if (!data.isEmpty()) {
-                m_output += data;
-                Q_EMIT outputChanged();
-            }
-        }
-    });
-
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
-        Q_UNUSED(exitStatus)
-
-        if (m_process) {
-            QString remainingOutput = QString::fromUtf8(m_process->readAllStandardOutput());
-            QString remainingError = QString::fromUtf8(m_process->readAllStandardError());
-
-            if (!remainingOutput.isEmpty()) {
-                m_output += remainingOutput;
-            }
-            if (!remainingError.isEmpty()) {
-                m_output += remainingError;
-            }
-            Q_EMIT outputChanged();
-        }
+    const quint64 id = m_executor->submit(job);
+    m_jobs.insert(id, operation);
 
-        m_busy = false;
+    if (!wasBusy) {
         Q_EMIT busyChanged();
+    }
+    return id;
+}
 
-        if (exitCode == 0) {
-            if (m_currentOperation == QStringLiteral("update")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("System update completed successfully!"));
-            } else if (m_currentOperation == QStringLiteral("netupdate")) {
-                Q_EMIT operationSucceeded(tr("Success"), tr("Network update completed successfully!"));
-            }
-        } else {
-            QString errorMsg = m_output.trimmed();
-            if (errorMsg.isEmpty()) {
-                errorMsg = tr("Update failed with exit code %1").arg(exitCode);
-            }
-            Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        }
-
-        m_currentOperation.clear();
-
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
-        }
-    });
+void UpdateManager::onJobOutput(quint64 id, const QString &data)
+{
+    if (!m_jobs.contains(id)) {
+        return;
+    }
 
-    connect(m_process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
-        m_busy = false;
-        Q_EMIT busyChanged();
+    m_log->append(data);
 
-        QString errorMsg;
-        switch (error) {
-            case QProcess::FailedToStart:
-                errorMsg = tr("Failed to start process. Make sure pkexec and obsidianctl are installed.");
-                break;
-            case QProcess::Crashed:
-                errorMsg = tr("Process crashed.");
-                break;
-            case QProcess::Timedout:
-                errorMsg = tr("Process timed out.");
-                break;
-            default:
-                errorMsg = tr("Unknown process error occurred.");
-                break;
+    const int percent = m_progress.percent();
+    if (m_progress.feed(data)) {
+        Q_EMIT progressChanged();
+        if (m_progress.percent() != percent) {
+            Q_EMIT updateProgress(m_progress.percent());
         }
-        Q_EMIT errorOccurred(tr("Error"), errorMsg);
-        m_currentOperation.clear();
+    }
+}
 
-        if (m_process) {
-            m_process->deleteLater();
-            m_process = nullptr;
-        }
-    });
+void UpdateManager::onJobFinished(quint64 id, int exitCode)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return;
+    }
 
-    m_busy = true;
-    Q_EMIT busyChanged();
+    const Operation operation = it.value();
+    m_jobs.erase(it);
 
-    m_output.clear();
-    Q_EMIT outputChanged();
+    if (m_jobs.isEmpty()) {
+        Q_EMIT busyChanged();
+    }
 
-    if (usePolkit) {
-        QStringList fullArgs;
-        fullArgs << QStringLiteral("obsidianctl") << command << args;
-        m_process->start(QStringLiteral("pkexec"), fullArgs);
+    if (exitCode == 0) {
+        switch (operation) {
+        case Operation::Update:
+            Q_EMIT operationSucceeded(tr("Success"), tr("System update completed successfully!"));
+            break;
+        case Operation::NetworkUpdate:
+            Q_EMIT operationSucceeded(tr("Success"), tr("Network update completed successfully!"));
+            break;
+        }
     } else {
-        QStringList fullArgs;
-        fullArgs << command << args;
-        m_process->start(QStringLiteral("obsidianctl"), fullArgs);
+        QString errorMsg = m_log->tail().trimmed();
+        if (errorMsg.isEmpty()) {
+            errorMsg = tr("Update failed with exit code %1").arg(exitCode);
+        }
+        Q_EMIT errorOccurred(tr("Error"), errorMsg);
     }
 }
 
-void UpdateManager::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void UpdateManager::onJobFailed(quint64 id, QProcess::ProcessError error)
 {
-    Q_UNUSED(exitCode)
-    Q_UNUSED(exitStatus)
-}
+    if (!m_jobs.remove(id)) {
+        return;
+    }
 
-void UpdateManager::onProcessReadyRead()
-{
-}
\ No newline at end of file
+    if (m_jobs.isEmpty()) {
+        Q_EMIT busyChanged();
+    }
+
+    Q_EMIT errorOccurred(tr("Error"), CommandExecutor::errorString(error));
+}
@@ -1,23 +1,43 @@
 #pragma once
 
+#include <QHash>
 #include <QObject>
 #include <QProcess>
+#include <QVariantMap>
 #include <qqmlregistration.h>
 
+#include "commandexecutor.h"
+#include "logbuffer.h"
+#include "loglinemodel.h"
+#include "progressparser.h"
+
 class UpdateManager : public QObject
 {
     Q_OBJECT
     QML_ELEMENT
+    QML_UNCREATABLE("Provided by the KCM")
     Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
-    Q_PROPERTY(QString output READ output NOTIFY outputChanged)
+    Q_PROPERTY(LogBuffer* log READ log CONSTANT)
+    Q_PROPERTY(LogLineModel* outputModel READ outputModel CONSTANT)
+    Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(qint64 bytesDone READ bytesDone NOTIFY progressChanged)
+    Q_PROPERTY(qint64 bytesTotal READ bytesTotal NOTIFY progressChanged)
+    Q_PROPERTY(double throughput READ throughput NOTIFY progressChanged)
+    Q_PROPERTY(qint64 eta READ eta NOTIFY progressChanged)
     Q_PROPERTY(bool breakSystemEnabled READ breakSystemEnabled WRITE setBreakSystemEnabled NOTIFY breakSystemEnabledChanged)
 
 public:
-    explicit UpdateManager(QObject *parent = nullptr);
+    explicit UpdateManager(CommandExecutor *executor, QObject *parent = nullptr);
     ~UpdateManager() override;
 
     bool busy() const;
-    QString output() const;
+    LogBuffer *log() const;
+    LogLineModel *outputModel() const;
+    int progress() const;
+    qint64 bytesDone() const;
+    qint64 bytesTotal() const;
+    double throughput() const;
+    qint64 eta() const;
     bool breakSystemEnabled() const;
 
     void setBreakSystemEnabled(bool enabled);
@@ -26,25 +46,35 @@ public:
     Q_INVOKABLE void networkUpdate(const QString &slot);
     Q_INVOKABLE void clearOutput();
     Q_INVOKABLE bool validateImagePath(const QString &path);
+    // Superblock details of the image at path, plus "error" if it isn't
+    // a usable SquashFS image.
+    Q_INVOKABLE QVariantMap inspectImage(const QString &path) const;
 
 Q_SIGNALS:
     void busyChanged();
-    void outputChanged();
+    void progressChanged();
     void breakSystemEnabledChanged();
     void errorOccurred(const QString &title, const QString &message);
     void operationSucceeded(const QString &title, const QString &message);
     void updateProgress(int percent);
 
 private Q_SLOTS:
-    void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onProcessReadyRead();
+    void onJobOutput(quint64 id, const QString &data);
+    void onJobFinished(quint64 id, int exitCode);
+    void onJobFailed(quint64 id, QProcess::ProcessError error);
 
 private:
-    void startProcess(const QString &command, const QStringList &args, bool usePolkit = true);
+    enum class Operation {
+        Update,
+        NetworkUpdate
+    };
+
+    quint64 submit(Operation operation, const CommandExecutor::Job &job);
 
-    QProcess *m_process;
-    bool m_busy;
-    QString m_output;
-    QString m_currentOperation;
+    CommandExecutor *m_executor;
+    QHash<quint64, Operation> m_jobs;
+    LogBuffer *m_log;
+    LogLineModel *m_outputModel;
+    ProgressParser m_progress;
     bool m_breakSystemEnabled;
 };
\ No newline at end of file
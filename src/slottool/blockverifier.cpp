@@ -0,0 +1,428 @@
+#include "blockverifier.h"
+#include "slottoolprotocol.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+namespace
+{
+
+constexpr quint32 ManifestMagic = 0x4f42564d; // "OBVM"
+constexpr quint32 CheckpointMagic = 0x4f425643; // "OBVC"
+constexpr quint32 FormatVersion = 1;
+
+// Large, and aligned for any logical block size so O_DIRECT reads take a
+// chunk whole.
+constexpr qint64 ChunkSize = 4 * 1024 * 1024;
+constexpr qint64 Alignment = 4096;
+constexpr int ProgressIntervalMs = 250;
+constexpr int CheckpointIntervalMs = 2000;
+// Mismatching ranges printed before the rest are only counted.
+constexpr int MaxListed = 100;
+
+// From linux/ioprio.h, which older kernel headers lack.
+constexpr int IoprioWhoProcess = 1;
+constexpr int IoprioClassIdle = 3;
+constexpr int IoprioClassShift = 13;
+
+const QString StateDirectory = QStringLiteral("/var/lib/kcm_obsidianos/verify");
+
+// ext4 updates s_wtime in its superblock whenever it is written. If that
+// moved since the manifest was recorded, mismatches come from the slot
+// being used, not from the disk.
+quint32 ext4WriteTime(int fd)
+{
+    uchar superblock[1024];
+    if (pread(fd, superblock, sizeof(superblock), 1024) != qint64(sizeof(superblock))) {
+        return 0;
+    }
+    const quint16 magic = superblock[0x38] | superblock[0x39] << 8;
+    if (magic != 0xef53) {
+        return 0;
+    }
+    return quint32(superblock[0x30]) | quint32(superblock[0x31]) << 8 | quint32(superblock[0x32]) << 16 | quint32(superblock[0x33]) << 24;
+}
+
+void writeRecord(const QByteArray &record)
+{
+    fwrite(record.constData(), 1, record.size(), stdout);
+    fflush(stdout);
+}
+
+}
+
+bool BlockVerifier::Manifest::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != ManifestMagic || version != FormatVersion) {
+        return false;
+    }
+    in >> size >> chunkSize >> recorded >> writeTime >> digests;
+    return in.status() == QDataStream::Ok && chunkSize > 0 && digests.count() == (size + chunkSize - 1) / chunkSize;
+}
+
+bool BlockVerifier::Manifest::save(const QString &path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << ManifestMagic << FormatVersion << size << chunkSize << recorded << writeTime << digests;
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool BlockVerifier::Checkpoint::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != CheckpointMagic || version != FormatVersion) {
+        return false;
+    }
+    in >> recording >> manifest >> size >> chunkSize >> done >> mismatches >> digests;
+    return in.status() == QDataStream::Ok;
+}
+
+bool BlockVerifier::Checkpoint::save(const QString &path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << CheckpointMagic << FormatVersion << recording << manifest << size << chunkSize << done << mismatches << digests;
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+BlockVerifier::BlockVerifier(const QString &slot, const QString &device, const Options &options)
+    : m_slot(slot)
+    , m_device(device)
+    , m_options(options)
+    , m_directFd(-1)
+    , m_bufferedFd(-1)
+    , m_size(0)
+    , m_chunkCount(0)
+    , m_next(0)
+    , m_failed(false)
+    , m_done(0)
+    , m_bytesDone(0)
+    , m_nextRead(0)
+{
+    // Enough readers to keep an NVMe queue busy; a single disk is shared
+    // fairly among them.
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), 4));
+}
+
+BlockVerifier::~BlockVerifier()
+{
+    if (m_directFd >= 0) {
+        close(m_directFd);
+    }
+    if (m_bufferedFd >= 0) {
+        close(m_bufferedFd);
+    }
+}
+
+bool BlockVerifier::run()
+{
+    // Threads inherit the priority, so this goes before any start.
+    if (m_options.idle) {
+        syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift);
+    }
+
+    const QByteArray device = QFile::encodeName(m_device);
+    m_bufferedFd = open(device.constData(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (m_bufferedFd < 0 || fstat(m_bufferedFd, &info) != 0) {
+        writeResult(QStringLiteral("failed"), QStringLiteral("Cannot open the partition of slot %1").arg(m_slot));
+        return false;
+    }
+    // Images on filesystems without O_DIRECT are read through the cache.
+    m_directFd = open(device.constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+
+    quint64 deviceSize = 0;
+    m_size = S_ISBLK(info.st_mode) ? (ioctl(m_bufferedFd, BLKGETSIZE64, &deviceSize) == 0 ? qint64(deviceSize) : 0) : qint64(info.st_size);
+    if (m_size <= 0) {
+        writeResult(QStringLiteral("failed"), QStringLiteral("Cannot tell the size of slot %1").arg(m_slot));
+        return false;
+    }
+    m_chunkCount = (m_size + ChunkSize - 1) / ChunkSize;
+
+    QDir().mkpath(StateDirectory);
+    if (m_options.record) {
+        m_manifest.size = m_size;
+        m_manifest.chunkSize = ChunkSize;
+        m_manifest.recorded = QDateTime::currentMSecsSinceEpoch();
+        m_manifest.writeTime = ext4WriteTime(m_bufferedFd);
+        m_manifest.digests.resize(m_chunkCount);
+    } else if (!m_manifest.load(manifestPath())) {
+        writeResult(QStringLiteral("missing"), QStringLiteral("No reference has been recorded for slot %1").arg(m_slot));
+        return false;
+    } else if (m_manifest.size != m_size || m_manifest.chunkSize != ChunkSize) {
+        writeResult(QStringLiteral("stale"), QStringLiteral("The partition of slot %1 changed size since its reference was recorded").arg(m_slot));
+        return false;
+    }
+
+    // Pick up an interrupted run of the same kind, on the same manifest.
+    Checkpoint checkpoint;
+    if (checkpoint.load(checkpointPath()) && checkpoint.recording == m_options.record && checkpoint.size == m_size
+        && checkpoint.chunkSize == ChunkSize && checkpoint.done > 0 && checkpoint.done <= m_chunkCount
+        && (m_options.record ? checkpoint.digests.count() == checkpoint.done : checkpoint.manifest == m_manifest.recorded)) {
+        if (m_options.record) {
+            m_manifest.recorded = checkpoint.manifest;
+            std::copy(checkpoint.digests.cbegin(), checkpoint.digests.cend(), m_manifest.digests.begin());
+        }
+        m_done = checkpoint.done;
+        m_next = checkpoint.done;
+        m_mismatches = checkpoint.mismatches;
+        m_bytesDone = qMin(m_done * ChunkSize, m_size);
+        writeRecord(QStringLiteral("Resuming at %1%\n").arg(m_bytesDone * 100 / m_size).toUtf8());
+    }
+
+    m_clock.start();
+    for (int i = 0; i < m_pool.maxThreadCount(); i++) {
+        m_pool.start([this]() {
+            verifyChunks();
+        });
+    }
+
+    QElapsedTimer sinceCheckpoint;
+    sinceCheckpoint.start();
+    while (!m_pool.waitForDone(ProgressIntervalMs)) {
+        writeProgress();
+        if (sinceCheckpoint.elapsed() >= CheckpointIntervalMs) {
+            saveCheckpoint();
+            sinceCheckpoint.restart();
+        }
+    }
+    writeProgress();
+
+    if (m_failed) {
+        saveCheckpoint();
+        writeResult(QStringLiteral("failed"), m_error);
+        return false;
+    }
+    QFile::remove(checkpointPath());
+
+    if (m_options.record) {
+        if (!m_manifest.save(manifestPath())) {
+            writeResult(QStringLiteral("failed"), QStringLiteral("Cannot save the reference of slot %1").arg(m_slot));
+            return false;
+        }
+        writeResult(QStringLiteral("recorded"));
+        return true;
+    }
+
+    if (m_mismatches.isEmpty()) {
+        writeResult(QStringLiteral("verified"));
+        return true;
+    }
+
+    // Neighbouring chunks are reported as one range.
+    std::sort(m_mismatches.begin(), m_mismatches.end());
+    QByteArray ranges;
+    int listed = 0;
+    for (qsizetype i = 0; i < m_mismatches.count() && listed < MaxListed; listed++) {
+        const qint64 first = m_mismatches.at(i);
+        qint64 last = first;
+        while (++i < m_mismatches.count() && m_mismatches.at(i) == last + 1) {
+            last++;
+        }
+        const qint64 offset = first * ChunkSize;
+        ranges += SlotToolProtocol::MismatchField.toUtf8() + '\t' + QByteArray::number(offset) + '\t'
+            + QByteArray::number(qMin((last + 1) * ChunkSize, m_size) - offset) + '\n';
+    }
+    writeRecord(ranges);
+
+    const quint32 writeTime = ext4WriteTime(m_bufferedFd);
+    if (m_manifest.writeTime != 0 && writeTime != m_manifest.writeTime) {
+        writeResult(QStringLiteral("stale"), QStringLiteral("Slot %1 was written since its reference was recorded").arg(m_slot));
+    } else {
+        writeResult(QStringLiteral("mismatch"));
+    }
+    return false;
+}
+
+void BlockVerifier::verifyChunks()
+{
+    const std::unique_ptr<char, decltype(&free)> buffer(static_cast<char *>(aligned_alloc(Alignment, ChunkSize)), &free);
+    if (!buffer) {
+        m_failed = true;
+        return;
+    }
+
+    while (!m_failed) {
+        const qint64 index = m_next++;
+        if (index >= m_chunkCount) {
+            break;
+        }
+
+        throttle(ChunkSize);
+        qint64 length = 0;
+        if (!readChunk(index, buffer.get(), &length)) {
+            QMutexLocker locker(&m_stateLock);
+            m_error = QStringLiteral("Cannot read slot %1 at offset %2").arg(m_slot).arg(index * ChunkSize);
+            m_failed = true;
+            break;
+        }
+
+        finishChunk(index, QCryptographicHash::hash(QByteArrayView(buffer.get(), length), QCryptographicHash::Sha256), length);
+    }
+}
+
+bool BlockVerifier::readChunk(qint64 index, char *buffer, qint64 *length)
+{
+    const qint64 offset = index * ChunkSize;
+    *length = qMin(ChunkSize, m_size - offset);
+
+    // Only the last chunk of an odd-sized image can be unaligned.
+    const bool direct = m_directFd >= 0 && *length % Alignment == 0;
+    const int fd = direct ? m_directFd : m_bufferedFd;
+    for (qint64 done = 0; done < *length;) {
+        const ssize_t got = pread(fd, buffer + done, size_t(*length - done), offset + done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        done += got;
+    }
+
+    if (!direct) {
+        posix_fadvise(fd, offset, *length, POSIX_FADV_DONTNEED);
+    }
+    return true;
+}
+
+void BlockVerifier::throttle(qint64 bytes)
+{
+    if (m_options.limit <= 0) {
+        return;
+    }
+
+    // Each chunk books its share of the bandwidth, and waits for its turn.
+    qint64 start;
+    {
+        QMutexLocker locker(&m_throttleLock);
+        start = qMax(m_clock.nsecsElapsed(), m_nextRead);
+        m_nextRead = start + bytes * 1000000000LL / m_options.limit;
+    }
+    const qint64 wait = start - m_clock.nsecsElapsed();
+    if (wait > 0) {
+        QThread::usleep(wait / 1000);
+    }
+}
+
+void BlockVerifier::finishChunk(qint64 index, const QByteArray &digest, qint64 length)
+{
+    QMutexLocker locker(&m_stateLock);
+    if (m_options.record) {
+        m_manifest.digests[index] = digest;
+    } else if (digest != m_manifest.digests.at(index)) {
+        m_mismatches.append(index);
+    }
+    m_bytesDone += length;
+
+    // Chunks finish out of order; the checkpoint only moves past a run
+    // that is complete.
+    m_finished.insert(index);
+    while (m_finished.remove(m_done)) {
+        m_done++;
+    }
+}
+
+void BlockVerifier::saveCheckpoint()
+{
+    Checkpoint checkpoint;
+    {
+        QMutexLocker locker(&m_stateLock);
+        checkpoint.recording = m_options.record;
+        checkpoint.manifest = m_manifest.recorded;
+        checkpoint.size = m_size;
+        checkpoint.chunkSize = ChunkSize;
+        checkpoint.done = m_done;
+        for (const qint64 index : std::as_const(m_mismatches)) {
+            if (index < m_done) {
+                checkpoint.mismatches.append(index);
+            }
+        }
+        if (m_options.record) {
+            checkpoint.digests = m_manifest.digests.mid(0, m_done);
+        }
+    }
+    if (checkpoint.done > 0) {
+        checkpoint.save(checkpointPath());
+    }
+}
+
+void BlockVerifier::writeProgress()
+{
+    QByteArray record;
+    {
+        QMutexLocker locker(&m_stateLock);
+        record = SlotToolProtocol::VerifyField.toUtf8() + '\t' + QByteArray::number(m_bytesDone) + '\t' + QByteArray::number(m_size) + '\t'
+            + QByteArray::number(m_mismatches.count()) + '\n';
+    }
+    writeRecord(record);
+}
+
+void BlockVerifier::writeResult(const QString &result, const QString &message)
+{
+    QByteArray records;
+    if (!message.isEmpty()) {
+        records += message.toUtf8() + '\n';
+    }
+    records += SlotToolProtocol::ResultField.toUtf8() + '\t' + result.toUtf8() + '\n';
+    writeRecord(records);
+}
+
+QString BlockVerifier::manifestPath() const
+{
+    return StateDirectory + QStringLiteral("/slot_%1.manifest").arg(m_slot);
+}
+
+QString BlockVerifier::checkpointPath() const
+{
+    return StateDirectory + QStringLiteral("/slot_%1.checkpoint").arg(m_slot);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+#include <atomic>
+
+// Verifies a slot's partition block by block against a manifest of chunk
+// digests recorded earlier, or records one. Several threads read large
+// aligned chunks with O_DIRECT, so the page cache is left alone. A
+// checkpoint is saved every few seconds, and an interrupted run resumes
+// from it. The run can be throttled to idle I/O priority or to a bandwidth
+// cap, to keep the desktop responsive.
+class BlockVerifier
+{
+public:
+    struct Options {
+        bool record = false;
+        // Only read while nothing else wants the disk.
+        bool idle = false;
+        // Bytes per second over all threads, 0 for no limit.
+        qint64 limit = 0;
+    };
+
+    // The digests a partition had when its manifest was recorded.
+    struct Manifest {
+        qint64 size = 0;
+        qint64 chunkSize = 0;
+        // ms since the epoch; also tells checkpoints which manifest they
+        // belong to.
+        qint64 recorded = 0;
+        // ext4's last write time then, 0 for other filesystems.
+        quint32 writeTime = 0;
+        QList<QByteArray> digests;
+
+        bool load(const QString &path);
+        bool save(const QString &path) const;
+    };
+
+    BlockVerifier(const QString &slot, const QString &device, const Options &options);
+    ~BlockVerifier();
+
+    // Blocks until done; false on a mismatch or error.
+    bool run();
+
+private:
+    struct Checkpoint {
+        bool recording = false;
+        qint64 manifest = 0;
+        qint64 size = 0;
+        qint64 chunkSize = 0;
+        // Every chunk below this one is done.
+        qint64 done = 0;
+        QList<qint64> mismatches;
+        // The digests recorded so far, when recording.
+        QList<QByteArray> digests;
+
+        bool load(const QString &path);
+        bool save(const QString &path) const;
+    };
+
+    void verifyChunks();
+    bool readChunk(qint64 index, char *buffer, qint64 *length);
+    void throttle(qint64 bytes);
+    void finishChunk(qint64 index, const QByteArray &digest, qint64 length);
+    void saveCheckpoint();
+    void writeProgress();
+    void writeResult(const QString &result, const QString &message = QString());
+
+    QString manifestPath() const;
+    QString checkpointPath() const;
+
+    QString m_slot;
+    QString m_device;
+    Options m_options;
+
+    int m_directFd;
+    int m_bufferedFd;
+    qint64 m_size;
+    qint64 m_chunkCount;
+    Manifest m_manifest;
+
+    QThreadPool m_pool;
+    std::atomic<qint64> m_next;
+    std::atomic<bool> m_failed;
+
+    // Guards everything below it.
+    QMutex m_stateLock;
+    qint64 m_done;
+    QSet<qint64> m_finished;
+    QList<qint64> m_mismatches;
+    qint64 m_bytesDone;
+    QString m_error;
+
+    QMutex m_throttleLock;
+    QElapsedTimer m_clock;
+    qint64 m_nextRead;
+};
@@ -0,0 +1,345 @@
+#include "healthcheck.h"
+#include "packagedatabase.h"
+#include "slottoolprotocol.h"
+#include "slotmount.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QLocale>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QSet>
+#include <QThread>
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+
+#include <cstdio>
+
+namespace
+{
+
+// Where the boot loader entries can be, following the Boot Loader
+// Specification: the ESP or XBOOTLDR partition, wherever it is mounted.
+const QStringList BootRoots = {QStringLiteral("/efi"), QStringLiteral("/boot"), QStringLiteral("/boot/efi")};
+
+// Problems listed in full before the rest are only counted.
+constexpr int MaxListed = 10;
+
+struct BootEntry {
+    QString file;
+    QString bootRoot;
+    QString kernel;
+    QStringList initrds;
+};
+
+// Entries that boot the slot, by the root_<slot> label in their options.
+QList<BootEntry> bootEntries(const QString &slot)
+{
+    const QRegularExpression slotRoot(QStringLiteral("\\broot_%1\\b").arg(slot));
+    QList<BootEntry> entries;
+    QSet<QString> seen;
+
+    for (const QString &bootRoot : BootRoots) {
+        const QDir directory(bootRoot + QStringLiteral("/loader/entries"));
+        const QFileInfoList files = directory.entryInfoList({QStringLiteral("*.conf")}, QDir::Files, QDir::Name);
+        for (const QFileInfo &info : files) {
+            // /boot and /efi may be the same partition.
+            if (seen.contains(info.canonicalFilePath())) {
+                continue;
+            }
+            seen.insert(info.canonicalFilePath());
+
+            QFile file(info.filePath());
+            if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                continue;
+            }
+
+            BootEntry entry;
+            entry.file = info.fileName();
+            entry.bootRoot = bootRoot;
+            bool matches = false;
+            while (!file.atEnd()) {
+                const QString line = QString::fromUtf8(file.readLine()).trimmed();
+                const qsizetype space = line.indexOf(QLatin1Char(' '));
+                if (line.startsWith(QLatin1Char('#')) || space < 0) {
+                    continue;
+                }
+                const QString key = line.left(space);
+                const QString value = line.mid(space + 1).trimmed();
+                if (key == QStringLiteral("linux")) {
+                    entry.kernel = value;
+                } else if (key == QStringLiteral("initrd")) {
+                    entry.initrds << value;
+                } else if (key == QStringLiteral("options") && slotRoot.match(value).hasMatch()) {
+                    matches = true;
+                }
+            }
+            if (matches) {
+                entries << entry;
+            }
+        }
+    }
+    return entries;
+}
+
+QString worse(const QString &a, const QString &b)
+{
+    static const QStringList order = {SlotToolProtocol::CheckPassed, SlotToolProtocol::CheckWarning, SlotToolProtocol::CheckFailed};
+    return order.indexOf(a) >= order.indexOf(b) ? a : b;
+}
+
+QString listed(const QStringList &items)
+{
+    QString text = items.mid(0, MaxListed).join(QLatin1Char('\n'));
+    if (items.count() > MaxListed) {
+        text += QStringLiteral("\n... and %1 more").arg(items.count() - MaxListed);
+    }
+    return text;
+}
+
+}
+
+HealthCheck::HealthCheck(const QString &runningSlot, const QString &otherSlot)
+    : m_runningSlot(runningSlot)
+    , m_otherSlot(otherSlot)
+    , m_failed(false)
+{
+    // Mostly waiting on disks and fsck, not computing.
+    m_pool.setMaxThreadCount(qMax(8, QThread::idealThreadCount()));
+}
+
+bool HealthCheck::run()
+{
+    start(m_runningSlot, QStringLiteral("filesystem"), [this]() {
+        return checkRunningFilesystem();
+    });
+    startSlotChecks(m_runningSlot, QStringLiteral("/"));
+
+    start(m_otherSlot, QStringLiteral("boot-entries"), [this]() {
+        return checkBootEntries(m_otherSlot);
+    });
+    // Only the boot entries live outside the slot; everything else waits
+    // for it to be checked and mounted.
+    start(m_otherSlot, QStringLiteral("filesystem"), [this]() {
+        return checkOtherFilesystem();
+    });
+
+    m_pool.waitForDone();
+    return !m_failed;
+}
+
+void HealthCheck::start(const QString &slot, const QString &id, const Check &check)
+{
+    write(slot, id, SlotToolProtocol::CheckRunning, 0, QString());
+
+    m_pool.start([this, slot, id, check]() {
+        QElapsedTimer timer;
+        timer.start();
+        const Result result = check();
+        if (result.status == SlotToolProtocol::CheckFailed) {
+            m_failed = true;
+        }
+        write(slot, id, result.status, timer.elapsed(), result.details);
+    });
+}
+
+void HealthCheck::startSlotChecks(const QString &slot, const QString &root)
+{
+    const bool running = slot == m_runningSlot;
+    if (running) {
+        start(slot, QStringLiteral("boot-entries"), [this, slot]() {
+            return checkBootEntries(slot);
+        });
+    }
+    start(slot, QStringLiteral("kernel"), [this, slot, root]() {
+        return checkKernel(slot, root);
+    });
+    start(slot, QStringLiteral("free-space"), [this, root]() {
+        return checkFreeSpace(root);
+    });
+    start(slot, QStringLiteral("packages"), [this, root, running]() {
+        return checkPackages(root, running);
+    });
+}
+
+void HealthCheck::write(const QString &slot, const QString &id, const QString &status, qint64 duration, const QString &details)
+{
+    const QByteArray record = SlotToolProtocol::CheckField.toUtf8() + '\t' + slot.toUtf8() + '\t' + id.toUtf8() + '\t' + status.toUtf8()
+        + '\t' + QByteArray::number(duration) + '\t' + SlotToolProtocol::escapePath(details.toUtf8()) + '\n';
+
+    QMutexLocker locker(&m_outputLock);
+    fwrite(record.constData(), 1, record.size(), stdout);
+    fflush(stdout);
+}
+
+HealthCheck::Result HealthCheck::checkRunningFilesystem() const
+{
+    struct stat rootInfo;
+    struct statvfs rootFs;
+    if (stat("/", &rootInfo) != 0 || statvfs("/", &rootFs) != 0) {
+        return {SlotToolProtocol::CheckFailed, QStringLiteral("Cannot read the root filesystem")};
+    }
+    const QString mode = rootFs.f_flag & ST_RDONLY ? QStringLiteral("read-only") : QStringLiteral("read-write");
+
+    // A mounted filesystem can't be checked, but ext4 counts the errors it
+    // ran into since the last check.
+    const QString block = QFileInfo(QStringLiteral("/sys/dev/block/%1:%2").arg(major(rootInfo.st_dev)).arg(minor(rootInfo.st_dev)))
+                              .canonicalFilePath();
+    QFile errors(QStringLiteral("/sys/fs/ext4/%1/errors_count").arg(QFileInfo(block).fileName()));
+    if (!block.isEmpty() && errors.open(QIODevice::ReadOnly)) {
+        const int count = errors.readAll().trimmed().toInt();
+        if (count > 0) {
+            return {SlotToolProtocol::CheckFailed,
+                    QStringLiteral("Mounted %1; %2 filesystem errors recorded since the last check").arg(mode).arg(count)};
+        }
+    }
+    return {SlotToolProtocol::CheckPassed, QStringLiteral("Mounted %1").arg(mode)};
+}
+
+HealthCheck::Result HealthCheck::checkOtherFilesystem()
+{
+    Result result{SlotToolProtocol::CheckPassed, QString()};
+
+    // -n answers no to every repair, so this only reads the partition.
+    QProcess fsck;
+    fsck.setProcessChannelMode(QProcess::MergedChannels);
+    fsck.start(QStringLiteral("fsck"), {QStringLiteral("-n"), QStringLiteral("-T"), SlotMount::device(m_otherSlot)});
+    if (!fsck.waitForFinished(-1) || fsck.exitStatus() != QProcess::NormalExit) {
+        result = {SlotToolProtocol::CheckWarning, QStringLiteral("fsck could not run")};
+    } else if (fsck.exitCode() & 4) {
+        result = {SlotToolProtocol::CheckFailed, QString::fromLocal8Bit(fsck.readAll()).trimmed()};
+    } else if (fsck.exitCode() != 0) {
+        result = {SlotToolProtocol::CheckWarning, QString::fromLocal8Bit(fsck.readAll()).trimmed()};
+    }
+
+    QString error;
+    if (!SlotMount::mount(m_otherSlot, false, &error)) {
+        const QString skipped = QStringLiteral("Slot %1 could not be mounted").arg(m_otherSlot);
+        for (const QString &id : {QStringLiteral("kernel"), QStringLiteral("free-space"), QStringLiteral("packages")}) {
+            write(m_otherSlot, id, SlotToolProtocol::CheckSkipped, 0, skipped);
+        }
+        return {SlotToolProtocol::CheckFailed, result.details.isEmpty() ? error : result.details + QLatin1Char('\n') + error};
+    }
+
+    startSlotChecks(m_otherSlot, SlotMount::mountPoint());
+    if (result.details.isEmpty()) {
+        result.details = QStringLiteral("Checked and mounted");
+    }
+    return result;
+}
+
+HealthCheck::Result HealthCheck::checkBootEntries(const QString &slot) const
+{
+    const QList<BootEntry> entries = bootEntries(slot);
+    if (entries.isEmpty()) {
+        return {SlotToolProtocol::CheckFailed, QStringLiteral("No boot entry uses root_%1").arg(slot)};
+    }
+
+    QStringList files;
+    for (const BootEntry &entry : entries) {
+        files << entry.bootRoot + QStringLiteral("/loader/entries/") + entry.file;
+    }
+    return {SlotToolProtocol::CheckPassed, files.join(QLatin1Char('\n'))};
+}
+
+HealthCheck::Result HealthCheck::checkKernel(const QString &slot, const QString &root) const
+{
+    Result result{SlotToolProtocol::CheckPassed, QString()};
+    QStringList details;
+
+    // pacman installs every kernel with its modules.
+    QStringList kernels;
+    const QDir modules(QDir::cleanPath(root + QStringLiteral("/usr/lib/modules")));
+    for (const QString &version : modules.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+        if (QFileInfo::exists(modules.filePath(version) + QStringLiteral("/vmlinuz"))) {
+            kernels << version;
+        }
+    }
+    if (kernels.isEmpty()) {
+        result.status = SlotToolProtocol::CheckFailed;
+        details << QStringLiteral("No kernel installed");
+    } else {
+        details << QStringLiteral("Installed: %1").arg(kernels.join(QStringLiteral(", ")));
+    }
+
+    // And what the boot entries load has to be there.
+    const QList<BootEntry> entries = bootEntries(slot);
+    QStringList missing;
+    for (const BootEntry &entry : entries) {
+        const QStringList files = QStringList(entry.kernel) + entry.initrds;
+        for (const QString &file : files) {
+            if (!file.isEmpty() && !QFileInfo::exists(entry.bootRoot + QLatin1Char('/') + file)) {
+                missing << QStringLiteral("%1 (%2)").arg(file, entry.file);
+            }
+        }
+        if (entry.kernel.isEmpty()) {
+            missing << QStringLiteral("No kernel in %1").arg(entry.file);
+        }
+    }
+    if (entries.isEmpty()) {
+        result.status = worse(result.status, SlotToolProtocol::CheckWarning);
+        details << QStringLiteral("No boot entry to check");
+    } else if (!missing.isEmpty()) {
+        result.status = SlotToolProtocol::CheckFailed;
+        details << QStringLiteral("Missing:") << listed(missing);
+    } else {
+        details << QStringLiteral("Boot files of %1 entries present").arg(entries.count());
+    }
+
+    result.details = details.join(QLatin1Char('\n'));
+    return result;
+}
+
+HealthCheck::Result HealthCheck::checkFreeSpace(const QString &root) const
+{
+    struct statvfs fs;
+    if (statvfs(QFile::encodeName(root).constData(), &fs) != 0 || fs.f_blocks == 0) {
+        return {SlotToolProtocol::CheckFailed, QStringLiteral("Cannot read the filesystem size")};
+    }
+
+    const qint64 total = qint64(fs.f_blocks) * fs.f_frsize;
+    const qint64 available = qint64(fs.f_bavail) * fs.f_frsize;
+    const double share = double(available) / total;
+    const QString details =
+        QStringLiteral("%1 free of %2").arg(QLocale::c().formattedDataSize(available), QLocale::c().formattedDataSize(total));
+
+    // An update needs room for a new kernel and package cache at least.
+    if (share < 0.02 || available < 256LL * 1024 * 1024) {
+        return {SlotToolProtocol::CheckFailed, details};
+    }
+    if (share < 0.10 || available < 1024LL * 1024 * 1024) {
+        return {SlotToolProtocol::CheckWarning, details};
+    }
+    return {SlotToolProtocol::CheckPassed, details};
+}
+
+HealthCheck::Result HealthCheck::checkPackages(const QString &root, bool running) const
+{
+    if (PackageDatabase::modifiedTime(root) < 0) {
+        return {SlotToolProtocol::CheckFailed, QStringLiteral("No package database")};
+    }
+
+    bool locked = false;
+    const QStringList problems = PackageDatabase::problems(root, &locked);
+
+    Result result{SlotToolProtocol::CheckPassed, QString()};
+    QStringList details;
+    if (locked) {
+        // On the running slot pacman may just be busy.
+        result.status = running ? SlotToolProtocol::CheckWarning : SlotToolProtocol::CheckFailed;
+        details << (running ? QStringLiteral("Locked: pacman is running, or was interrupted")
+                            : QStringLiteral("Locked by an interrupted transaction"));
+    }
+    if (!problems.isEmpty()) {
+        result.status = SlotToolProtocol::CheckFailed;
+        details << listed(problems);
+    }
+    result.details = details.isEmpty() ? QStringLiteral("Consistent") : details.join(QLatin1Char('\n'));
+    return result;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+#include <atomic>
+#include <functional>
+
+// Checks the health of both slots. Every check is a task on a thread pool,
+// so a slow one (the filesystem check of the other slot, say) holds up only
+// the checks that need its result. Each check is printed when it starts and
+// again with its result and how long it took.
+class HealthCheck
+{
+public:
+    // The other slot is checked and then mounted, see SlotMount.
+    HealthCheck(const QString &runningSlot, const QString &otherSlot);
+
+    // Blocks until every check is done; false if any failed.
+    bool run();
+
+    struct Result {
+        // One of SlotToolProtocol's check states.
+        QString status;
+        QString details;
+    };
+
+private:
+    using Check = std::function<Result()>;
+
+    void start(const QString &slot, const QString &id, const Check &check);
+    // The checks that need the slot's files, once it is mounted at root.
+    void startSlotChecks(const QString &slot, const QString &root);
+    void write(const QString &slot, const QString &id, const QString &status, qint64 duration, const QString &details);
+
+    Result checkRunningFilesystem() const;
+    Result checkOtherFilesystem();
+    Result checkBootEntries(const QString &slot) const;
+    Result checkKernel(const QString &slot, const QString &root) const;
+    Result checkFreeSpace(const QString &root) const;
+    Result checkPackages(const QString &root, bool running) const;
+
+    QString m_runningSlot;
+    QString m_otherSlot;
+
+    QThreadPool m_pool;
+    QMutex m_outputLock;
+    std::atomic<bool> m_failed;
+};
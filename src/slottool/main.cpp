@@ -0,0 +1,113 @@
+#include "blockverifier.h"
+#include "healthcheck.h"
+#include "packagedatabase.h"
+#include "slotdiff.h"
+#include "slotmount.h"
+
+#include <QCoreApplication>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTextStream>
+
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QTextStream out(stdout);
+    const QStringList args = app.arguments().mid(1);
+    static const QRegularExpression slotName(QStringLiteral("^[a-z]$"));
+
+    const bool packages = args.value(0) == QStringLiteral("packages");
+    const bool sync = args.value(0) == QStringLiteral("sync");
+    const bool health = args.value(0) == QStringLiteral("health");
+    const bool verify = args.value(0) == QStringLiteral("verify");
+    const QStringList slotArgs = packages || sync || health || verify ? args.mid(1) : args;
+    bool validSince = true;
+    const qint64 since = slotArgs.count() == 3 && slotArgs.at(1) == QStringLiteral("--since") ? slotArgs.at(2).toLongLong(&validSince) : -1;
+
+    BlockVerifier::Options options;
+    bool validOptions = verify;
+    for (qsizetype i = 1; verify && i < slotArgs.count(); i++) {
+        if (slotArgs.at(i) == QStringLiteral("--record")) {
+            options.record = true;
+        } else if (slotArgs.at(i) == QStringLiteral("--idle")) {
+            options.idle = true;
+        } else if (slotArgs.at(i) == QStringLiteral("--limit") && i + 1 < slotArgs.count()) {
+            bool valid = false;
+            options.limit = slotArgs.at(++i).toLongLong(&valid) * 1024 * 1024;
+            validOptions = validOptions && valid && options.limit > 0;
+        } else {
+            validOptions = false;
+        }
+    }
+
+    if (!slotName.match(slotArgs.value(0)).hasMatch() || !validSince
+        || (slotArgs.count() != 1 && !(packages && since >= 0) && !validOptions)) {
+        out << "Usage: kcm_obsidianos_slottool <slot>\n"
+               "       kcm_obsidianos_slottool packages <slot> [--since <mtime>]\n"
+               "       kcm_obsidianos_slottool sync <slot>\n"
+               "       kcm_obsidianos_slottool health <slot>\n"
+               "       kcm_obsidianos_slottool verify <slot> [--record] [--idle] [--limit <MiB/s>]\n"
+               "Compares the running slot with the given one, lists its packages,\n"
+               "copies what changed over to it, checks the health of both, or\n"
+               "verifies its partition against a recorded reference.\n";
+        return 2;
+    }
+
+    const QString slot = slotArgs.constFirst();
+    if (verify) {
+        // The partition is read raw, and a mounted one would change under
+        // the reads.
+        if (SlotMount::runningSlot() == slot) {
+            out << "Cannot verify the running slot " << slot << "\n";
+            return 1;
+        }
+        out.flush();
+        BlockVerifier verifier(slot, SlotMount::device(slot), options);
+        return verifier.run() ? 0 : 1;
+    }
+
+    QString error;
+    if (!SlotMount::enterPrivateNamespace(&error)) {
+        out << error << "\n";
+        return 1;
+    }
+
+    if (health) {
+        // The checks mount the slot themselves, once they know it's sound.
+        const QString running = SlotMount::runningSlot();
+        if (running.isEmpty() || running == slot) {
+            out << "Cannot check slot " << slot << " against the running slot\n";
+            return 1;
+        }
+        out.flush();
+        HealthCheck check(running, slot);
+        return check.run() ? 0 : 1;
+    }
+
+    if (!SlotMount::mount(slot, sync, &error)) {
+        out << error << "\n";
+        return 1;
+    }
+    out.flush();
+
+    if (packages) {
+        // With --since and an unchanged database only its mtime is printed,
+        // telling the caller its cached copy is still good.
+        PackageDatabase database;
+        if (since >= 0 && PackageDatabase::modifiedTime(SlotMount::mountPoint()) == since) {
+            database.modified = since;
+        } else if (!database.read(SlotMount::mountPoint())) {
+            out << "Slot " << slot << " has no package database\n";
+            return 1;
+        }
+        const QByteArray records = database.toRecords();
+        fwrite(records.constData(), 1, records.size(), stdout);
+        return 0;
+    }
+
+    SlotDiff diff(QStringLiteral("/"), SlotMount::mountPoint(), sync ? SlotDiff::Mode::Sync : SlotDiff::Mode::Compare);
+    return diff.run() ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+#include "packagedatabase.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace
+{
+
+constexpr quint32 CacheMagic = 0x4f42504b; // "OBPK"
+constexpr quint32 CacheVersion = 1;
+
+const QString ModifiedField = QStringLiteral("%MODIFIED%");
+
+// The C locale's classes, which is what pacman compares with.
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool isAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool isAlnum(char c)
+{
+    return isDigit(c) || isAlpha(c);
+}
+
+// rpmvercmp() from libalpm: alternating runs of digits and letters are
+// compared in turn, numerically or alphabetically, and separators only
+// matter by their length.
+int compareSegments(QByteArrayView a, QByteArrayView b)
+{
+    if (a == b) {
+        return 0;
+    }
+
+    qsizetype one = 0;
+    qsizetype two = 0;
+    qsizetype end1 = 0;
+    qsizetype end2 = 0;
+
+    while (one < a.size() && two < b.size()) {
+        while (one < a.size() && !isAlnum(a.at(one))) {
+            one++;
+        }
+        while (two < b.size() && !isAlnum(b.at(two))) {
+            two++;
+        }
+        if (one == a.size() || two == b.size()) {
+            break;
+        }
+
+        // Different separator lengths decide on their own.
+        if (one - end1 != two - end2) {
+            return one - end1 < two - end2 ? -1 : 1;
+        }
+
+        end1 = one;
+        end2 = two;
+        const bool numeric = isDigit(a.at(end1));
+        const auto inSegment = numeric ? isDigit : isAlpha;
+        while (end1 < a.size() && inSegment(a.at(end1))) {
+            end1++;
+        }
+        while (end2 < b.size() && inSegment(b.at(end2))) {
+            end2++;
+        }
+
+        // A number is newer than letters in the same place.
+        if (two == end2) {
+            return numeric ? 1 : -1;
+        }
+
+        QByteArrayView segment1 = a.sliced(one, end1 - one);
+        QByteArrayView segment2 = b.sliced(two, end2 - two);
+        if (numeric) {
+            while (segment1.startsWith('0')) {
+                segment1 = segment1.sliced(1);
+            }
+            while (segment2.startsWith('0')) {
+                segment2 = segment2.sliced(1);
+            }
+            if (segment1.size() != segment2.size()) {
+                return segment1.size() > segment2.size() ? 1 : -1;
+            }
+        }
+
+        const int result = segment1.compare(segment2);
+        if (result != 0) {
+            return result < 0 ? -1 : 1;
+        }
+
+        one = end1;
+        two = end2;
+    }
+
+    if (one == a.size() && two == b.size()) {
+        return 0;
+    }
+
+    // Whatever is left over wins, except that letters never beat nothing:
+    // 1.0 is newer than 1.0alpha, older than 1.0.1.
+    const char rest1 = one < a.size() ? a.at(one) : '\0';
+    const char rest2 = two < b.size() ? b.at(two) : '\0';
+    return (!rest1 && !isAlpha(rest2)) || isAlpha(rest1) ? -1 : 1;
+}
+
+struct Evr {
+    QByteArrayView epoch;
+    QByteArrayView version;
+    QByteArrayView release;
+    bool hasRelease = false;
+};
+
+Evr parseEvr(QByteArrayView evr)
+{
+    Evr parsed;
+
+    qsizetype digits = 0;
+    while (digits < evr.size() && isDigit(evr.at(digits))) {
+        digits++;
+    }
+
+    qsizetype versionStart = 0;
+    parsed.epoch = QByteArrayView("0");
+    if (digits < evr.size() && evr.at(digits) == ':') {
+        if (digits > 0) {
+            parsed.epoch = evr.first(digits);
+        }
+        versionStart = digits + 1;
+    }
+
+    const qsizetype dash = evr.lastIndexOf('-');
+    parsed.hasRelease = dash >= versionStart;
+    parsed.version = evr.sliced(versionStart, (parsed.hasRelease ? dash : evr.size()) - versionStart);
+    if (parsed.hasRelease) {
+        parsed.release = evr.sliced(dash + 1);
+    }
+    return parsed;
+}
+
+// Fields are a %HEADER% line followed by one value per line; only the
+// first three matter, and they come first.
+bool readDesc(const QString &directory, QString *name, PackageDatabase::Package *package)
+{
+    QFile desc(directory + QStringLiteral("/desc"));
+    if (!desc.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = desc.readAll();
+    QByteArrayView field;
+    bool hasVersion = false;
+    bool hasSize = false;
+    for (qsizetype start = 0; start < data.size() && !(hasVersion && hasSize && !name->isEmpty());) {
+        qsizetype end = data.indexOf('\n', start);
+        if (end < 0) {
+            end = data.size();
+        }
+        const QByteArrayView line = QByteArrayView(data).sliced(start, end - start);
+        start = end + 1;
+
+        if (line.startsWith('%') && line.endsWith('%')) {
+            field = line;
+        } else if (line.isEmpty()) {
+            field = QByteArrayView();
+        } else if (field == "%NAME%") {
+            *name = QString::fromUtf8(line);
+        } else if (field == "%VERSION%") {
+            package->version = QString::fromUtf8(line);
+            hasVersion = true;
+        } else if (field == "%SIZE%") {
+            package->installedSize = line.toLongLong();
+            hasSize = true;
+        }
+    }
+
+    return !name->isEmpty() && hasVersion;
+}
+
+}
+
+bool PackageDatabase::read(const QString &root)
+{
+    packages.clear();
+    modified = modifiedTime(root);
+    if (modified < 0) {
+        return false;
+    }
+
+    QDirIterator it(localPath(root), QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        QString name;
+        Package package;
+        if (readDesc(it.next(), &name, &package)) {
+            packages.insert(name, package);
+        }
+    }
+
+    return true;
+}
+
+QStringList PackageDatabase::problems(const QString &root, bool *locked)
+{
+    const QString path = localPath(root);
+    *locked = QFileInfo::exists(QDir::cleanPath(path + QStringLiteral("/../db.lck")));
+
+    QStringList problems;
+    QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        const QString entry = it.next();
+        const QString entryName = it.fileName();
+
+        // Every package has both, and its directory is named after it.
+        QString name;
+        Package package;
+        if (!readDesc(entry, &name, &package)) {
+            problems << QStringLiteral("%1: unreadable desc").arg(entryName);
+        } else if (entryName != name + QLatin1Char('-') + package.version) {
+            problems << QStringLiteral("%1: describes %2 %3").arg(entryName, name, package.version);
+        }
+        if (!QFileInfo::exists(entry + QStringLiteral("/files"))) {
+            problems << QStringLiteral("%1: no files list").arg(entryName);
+        }
+    }
+    return problems;
+}
+
+QByteArray PackageDatabase::toRecords() const
+{
+    QByteArray records = ModifiedField.toUtf8() + '\t' + QByteArray::number(modified) + '\n';
+    for (auto it = packages.cbegin(); it != packages.cend(); ++it) {
+        records += it.key().toUtf8() + '\t' + it->version.toUtf8() + '\t' + QByteArray::number(it->installedSize) + '\n';
+    }
+    return records;
+}
+
+bool PackageDatabase::fromRecords(const QString &records)
+{
+    packages.clear();
+    modified = -1;
+
+    const QStringList lines = records.split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    for (const QString &line : lines) {
+        const QStringList fields = line.split(QLatin1Char('\t'));
+        if (fields.count() == 2 && fields.at(0) == ModifiedField) {
+            modified = fields.at(1).toLongLong();
+        } else if (fields.count() == 3) {
+            packages.insert(fields.at(0), Package{fields.at(1), fields.at(2).toLongLong()});
+        }
+    }
+
+    return modified >= 0;
+}
+
+bool PackageDatabase::load(const QString &cachePath)
+{
+    packages.clear();
+    modified = -1;
+
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> modified >> count;
+    if (magic != CacheMagic || version != CacheVersion) {
+        modified = -1;
+        return false;
+    }
+
+    packages.reserve(count);
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString name;
+        Package package;
+        in >> name >> package.version >> package.installedSize;
+        packages.insert(name, package);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        packages.clear();
+        modified = -1;
+        return false;
+    }
+    return true;
+}
+
+bool PackageDatabase::save(const QString &cachePath) const
+{
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << CacheMagic << CacheVersion << modified << quint32(packages.count());
+    for (auto it = packages.cbegin(); it != packages.cend(); ++it) {
+        out << it.key() << it->version << it->installedSize;
+    }
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+QString PackageDatabase::localPath(const QString &root)
+{
+    return QDir::cleanPath(root + QStringLiteral("/var/lib/pacman/local"));
+}
+
+qint64 PackageDatabase::modifiedTime(const QString &root)
+{
+    const QFileInfo info(localPath(root));
+    return info.isDir() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+int PackageDatabase::compareVersions(QStringView a, QStringView b)
+{
+    if (a == b) {
+        return 0;
+    }
+
+    const QByteArray full1 = a.toUtf8();
+    const QByteArray full2 = b.toUtf8();
+    const Evr evr1 = parseEvr(full1);
+    const Evr evr2 = parseEvr(full2);
+
+    int result = compareSegments(evr1.epoch, evr2.epoch);
+    if (result == 0) {
+        result = compareSegments(evr1.version, evr2.version);
+        // A missing release matches any release.
+        if (result == 0 && evr1.hasRelease && evr2.hasRelease) {
+            result = compareSegments(evr1.release, evr2.release);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+// The packages a slot has installed, read from pacman's local database: one
+// directory per package, each with a desc file listing its fields.
+struct PackageDatabase {
+    struct Package {
+        QString version;
+        qint64 installedSize = 0;
+    };
+
+    // mtime of the local database directory in ms, -1 if unknown. pacman
+    // adds and removes a package's directory on every transaction, so this
+    // changes whenever the package set does.
+    qint64 modified = -1;
+    QHash<QString, Package> packages;
+
+    // Reads the database of the system mounted at root.
+    bool read(const QString &root);
+
+    // The slot tool's package listing, see SlotToolProtocol.
+    QByteArray toRecords() const;
+    bool fromRecords(const QString &records);
+
+    // Cached copy of a slot's database, so an unchanged one isn't read again.
+    bool load(const QString &cachePath);
+    bool save(const QString &cachePath) const;
+
+    // Entries missing files or not matching their directory's name, one
+    // line each. locked is set if a transaction holds the lock, or was
+    // interrupted and left it behind.
+    static QStringList problems(const QString &root, bool *locked);
+
+    static QString localPath(const QString &root);
+    static qint64 modifiedTime(const QString &root);
+    // pacman's version ordering ([epoch:]version[-release], compared
+    // segment by segment the way rpm does): negative if a is older than b,
+    // 0 if equal, positive if newer. Mirrors alpm_pkg_vercmp().
+    static int compareVersions(QStringView a, QStringView b);
+};
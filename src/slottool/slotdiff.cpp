@@ -0,0 +1,360 @@
+#include "slotdiff.h"
+#include "slottoolprotocol.h"
+#include "slotsync.h"
+
+#include <QFile>
+#include <QList>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+
+constexpr qint64 CompareBlock = 1024 * 1024;
+
+struct Entry {
+    QByteArray name;
+    struct stat st;
+};
+
+char typeOf(const struct stat &st)
+{
+    if (S_ISREG(st.st_mode)) {
+        return 'f';
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return 'd';
+    }
+    if (S_ISLNK(st.st_mode)) {
+        return 'l';
+    }
+    return 'o';
+}
+
+qint64 sizeOf(const struct stat &st)
+{
+    return S_ISREG(st.st_mode) ? qint64(st.st_size) : 0;
+}
+
+bool sameAttributes(const struct stat &a, const struct stat &b)
+{
+    return a.st_mode == b.st_mode && a.st_uid == b.st_uid && a.st_gid == b.st_gid;
+}
+
+bool sameMtime(const struct stat &a, const struct stat &b)
+{
+    return a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+QByteArray childPath(const QByteArray &parent, const QByteArray &name)
+{
+    return parent.isEmpty() ? name : parent + '/' + name;
+}
+
+// root is empty for "/".
+QByteArray absolutePath(const QByteArray &root, const QByteArray &path)
+{
+    if (path.isEmpty()) {
+        return root.isEmpty() ? QByteArrayLiteral("/") : root;
+    }
+    return root + '/' + path;
+}
+
+// Sorted by name; false if the directory can't be read.
+bool listDirectory(const QByteArray &path, QList<Entry> *entries)
+{
+    const int fd = open(path.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return false;
+    }
+
+    while (const dirent *ent = readdir(dir)) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+            continue;
+        }
+        Entry entry;
+        entry.name = QByteArray(ent->d_name);
+        if (fstatat(fd, ent->d_name, &entry.st, AT_SYMLINK_NOFOLLOW) == 0) {
+            entries->append(entry);
+        }
+    }
+    closedir(dir);
+
+    std::sort(entries->begin(), entries->end(), [](const Entry &a, const Entry &b) {
+        return a.name < b.name;
+    });
+    return true;
+}
+
+QByteArray readLink(const QByteArray &path)
+{
+    QByteArray target(4096, Qt::Uninitialized);
+    const ssize_t length = readlink(path.constData(), target.data(), target.size());
+    target.resize(length < 0 ? 0 : length);
+    return target;
+}
+
+QByteArray record(char change, const struct stat *base, const struct stat *target, const QByteArray &path)
+{
+    const struct stat &typed = target ? *target : *base;
+    return QByteArray(1, change) + '\t' + typeOf(typed) + '\t' + QByteArray::number(base ? sizeOf(*base) : 0) + '\t'
+        + QByteArray::number(target ? sizeOf(*target) : 0) + '\t' + SlotToolProtocol::escapePath(path) + '\n';
+}
+
+}
+
+SlotDiff::SlotDiff(const QString &baseRoot, const QString &targetRoot, Mode mode)
+    : m_baseRoot(QFile::encodeName(baseRoot))
+    , m_targetRoot(QFile::encodeName(targetRoot))
+    , m_baseDevice(0)
+    , m_targetDevice(0)
+    , m_sync(mode == Mode::Sync ? std::make_unique<SlotSync>() : nullptr)
+    , m_failed(false)
+{
+    // Mostly waiting on metadata reads, so more threads than cores help.
+    m_pool.setMaxThreadCount(qMax(8, QThread::idealThreadCount() * 2));
+
+    // "/" + "/" + path would double the slash.
+    if (m_baseRoot.endsWith('/')) {
+        m_baseRoot.chop(1);
+    }
+    if (m_targetRoot.endsWith('/')) {
+        m_targetRoot.chop(1);
+    }
+}
+
+SlotDiff::~SlotDiff() = default;
+
+bool SlotDiff::run()
+{
+    struct stat base;
+    struct stat target;
+    if (stat(absolutePath(m_baseRoot, QByteArray()).constData(), &base) != 0
+        || stat(absolutePath(m_targetRoot, QByteArray()).constData(), &target) != 0) {
+        write("Cannot read the slot roots\n");
+        return false;
+    }
+    m_baseDevice = base.st_dev;
+    m_targetDevice = target.st_dev;
+
+    queueDirectory(QByteArray(), Both);
+    m_pool.waitForDone();
+
+    if (m_sync) {
+        QByteArray records;
+        if (!m_sync->flush(absolutePath(m_targetRoot, QByteArray()), &records)) {
+            m_failed = true;
+        }
+        write(records + m_sync->progress(true));
+    }
+    return !m_failed;
+}
+
+void SlotDiff::queueDirectory(const QByteArray &path, int sides)
+{
+    m_pool.start([this, path, sides]() {
+        compareDirectory(path, sides);
+    });
+}
+
+void SlotDiff::compareDirectory(const QByteArray &path, int sides)
+{
+    QList<Entry> baseEntries;
+    QList<Entry> targetEntries;
+    QByteArray records;
+
+    if ((sides & Base) && !listDirectory(absolutePath(m_baseRoot, path), &baseEntries)) {
+        records += "Cannot read " + absolutePath(m_baseRoot, path) + '\n';
+        m_failed = true;
+    }
+    if ((sides & Target) && !listDirectory(absolutePath(m_targetRoot, path), &targetEntries)) {
+        records += "Cannot read " + absolutePath(m_targetRoot, path) + '\n';
+        m_failed = true;
+    }
+
+    // A directory that only exists on one side is listed in full, so
+    // everything below it is reported too. Mount points of other
+    // filesystems are left out, e.g. /proc on the running slot. When
+    // syncing, the directory is created before its entries are, and
+    // removed as a whole.
+    auto onlyBase = [&](const Entry &entry) {
+        const QByteArray child = childPath(path, entry.name);
+        const bool directory = S_ISDIR(entry.st.st_mode);
+        if (directory && entry.st.st_dev != m_baseDevice) {
+            return;
+        }
+        if (report('R', &entry.st, nullptr, child, &records) && directory) {
+            queueDirectory(child, Base);
+        }
+    };
+    auto onlyTarget = [&](const Entry &entry) {
+        const QByteArray child = childPath(path, entry.name);
+        const bool directory = S_ISDIR(entry.st.st_mode);
+        if (directory && entry.st.st_dev != m_targetDevice) {
+            return;
+        }
+        if (report('A', nullptr, &entry.st, child, &records) && directory && !m_sync) {
+            queueDirectory(child, Target);
+        }
+    };
+
+    if (m_sync) {
+        m_sync->addEntries(baseEntries.size());
+    }
+
+    qsizetype b = 0;
+    qsizetype t = 0;
+    while (b < baseEntries.size() || t < targetEntries.size()) {
+        if (t == targetEntries.size() || (b < baseEntries.size() && baseEntries.at(b).name < targetEntries.at(t).name)) {
+            onlyBase(baseEntries.at(b++));
+            continue;
+        }
+        if (b == baseEntries.size() || targetEntries.at(t).name < baseEntries.at(b).name) {
+            onlyTarget(targetEntries.at(t++));
+            continue;
+        }
+
+        const Entry &base = baseEntries.at(b++);
+        const Entry &target = targetEntries.at(t++);
+        const QByteArray child = childPath(path, base.name);
+
+        if (typeOf(base.st) != typeOf(target.st)) {
+            onlyTarget(target);
+            onlyBase(base);
+            continue;
+        }
+
+        switch (typeOf(base.st)) {
+        case 'd':
+            // Mount points of other filesystems, e.g. /proc on the running slot.
+            if (base.st.st_dev != m_baseDevice || target.st.st_dev != m_targetDevice) {
+                break;
+            }
+            if (!sameAttributes(base.st, target.st)) {
+                report('T', &base.st, &target.st, child, &records);
+            }
+            queueDirectory(child, Both);
+            break;
+        case 'f':
+            // Syncing compares the content block by block as it updates it.
+            if (base.st.st_size != target.st.st_size
+                || (!sameMtime(base.st, target.st) && (m_sync || !sameContent(child, base.st.st_size)))) {
+                report('M', &base.st, &target.st, child, &records);
+            } else if (!sameAttributes(base.st, target.st)) {
+                report('T', &base.st, &target.st, child, &records);
+            } else if (m_sync) {
+                m_sync->addSkipped(base.st.st_size);
+            }
+            break;
+        case 'l':
+            if (readLink(absolutePath(m_baseRoot, child)) != readLink(absolutePath(m_targetRoot, child))) {
+                report('M', &base.st, &target.st, child, &records);
+            } else if (base.st.st_uid != target.st.st_uid || base.st.st_gid != target.st.st_gid) {
+                report('T', &base.st, &target.st, child, &records);
+            }
+            break;
+        default:
+            if (base.st.st_rdev != target.st.st_rdev) {
+                report('M', &base.st, &target.st, child, &records);
+            } else if (!sameAttributes(base.st, target.st)) {
+                report('T', &base.st, &target.st, child, &records);
+            }
+            break;
+        }
+    }
+
+    if (m_sync) {
+        records += m_sync->progress(false);
+    }
+    if (!records.isEmpty()) {
+        write(records);
+    }
+}
+
+bool SlotDiff::report(char change, const struct stat *base, const struct stat *target, const QByteArray &path, QByteArray *records)
+{
+    if (!m_sync) {
+        *records += record(change, base, target, path);
+        return true;
+    }
+
+    const QByteArray source = absolutePath(m_baseRoot, path);
+    const QByteArray dest = absolutePath(m_targetRoot, path);
+    bool applied = false;
+    switch (change) {
+    case 'R':
+        applied = m_sync->create(source, dest, *base, records);
+        break;
+    case 'A':
+        applied = m_sync->remove(dest, records);
+        break;
+    case 'M':
+        applied = S_ISREG(base->st_mode) ? m_sync->update(source, dest, records)
+                                         : m_sync->remove(dest, records) && m_sync->create(source, dest, *base, records);
+        break;
+    case 'T':
+        if (S_ISREG(base->st_mode)) {
+            m_sync->addSkipped(base->st_size);
+        }
+        applied = m_sync->setAttributes(source, dest, *base, records);
+        break;
+    }
+
+    if (!applied) {
+        m_failed = true;
+    }
+    return applied;
+}
+
+bool SlotDiff::sameContent(const QByteArray &path, off_t size) const
+{
+    const int baseFd = open(absolutePath(m_baseRoot, path).constData(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    const int targetFd = open(absolutePath(m_targetRoot, path).constData(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+    bool same = baseFd >= 0 && targetFd >= 0;
+    if (same) {
+        posix_fadvise(baseFd, 0, size, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(targetFd, 0, size, POSIX_FADV_SEQUENTIAL);
+    }
+
+    const std::unique_ptr<char[]> baseBuffer(new char[CompareBlock]);
+    const std::unique_ptr<char[]> targetBuffer(new char[CompareBlock]);
+    for (off_t done = 0; same && done < size;) {
+        const ssize_t wanted = ssize_t(qMin<qint64>(CompareBlock, size - done));
+        same = read(baseFd, baseBuffer.get(), wanted) == wanted && read(targetFd, targetBuffer.get(), wanted) == wanted
+            && !memcmp(baseBuffer.get(), targetBuffer.get(), wanted);
+        done += wanted;
+    }
+
+    if (baseFd >= 0) {
+        close(baseFd);
+    }
+    if (targetFd >= 0) {
+        close(targetFd);
+    }
+    return same;
+}
+
+void SlotDiff::write(const QByteArray &records)
+{
+    // Whole directories at a time, so lines from different threads never
+    // interleave, and flushed so the KCM sees them while the walk goes on.
+    QMutexLocker locker(&m_outputLock);
+    fwrite(records.constData(), 1, records.size(), stdout);
+    fflush(stdout);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+
+class SlotSync;
+
+// Compares two slot trees. Every directory pair is one task on a thread
+// pool, so the walk fans out over the whole tree at once. Entries are
+// compared by their metadata; file contents are only read where the size
+// matches but the mtime doesn't, and reading stops at the first difference.
+// Each directory's changes are printed as soon as it is done.
+//
+// In Sync mode the changes are applied to the target instead, making it a
+// copy of the base, and only progress and errors are printed.
+class SlotDiff
+{
+public:
+    enum class Mode {
+        Compare,
+        Sync
+    };
+
+    SlotDiff(const QString &baseRoot, const QString &targetRoot, Mode mode = Mode::Compare);
+    ~SlotDiff();
+
+    // Blocks until both trees have been walked.
+    bool run();
+
+private:
+    enum Side {
+        Base = 1,
+        Target = 2,
+        Both = Base | Target
+    };
+
+    void compareDirectory(const QByteArray &path, int sides);
+    // Prints a change, or applies it when syncing; false if that failed.
+    bool report(char change, const struct stat *base, const struct stat *target, const QByteArray &path, QByteArray *records);
+    bool sameContent(const QByteArray &path, off_t size) const;
+    void queueDirectory(const QByteArray &path, int sides);
+    void write(const QByteArray &records);
+
+    QByteArray m_baseRoot;
+    QByteArray m_targetRoot;
+    // Directories on other filesystems (/proc, /home, ...) are not part of
+    // the slot.
+    dev_t m_baseDevice;
+    dev_t m_targetDevice;
+
+    std::unique_ptr<SlotSync> m_sync;
+    QThreadPool m_pool;
+    QMutex m_outputLock;
+    std::atomic<bool> m_failed;
+};
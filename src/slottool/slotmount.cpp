@@ -0,0 +1,73 @@
+#include "slotmount.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+namespace SlotMount
+{
+
+QString mountPoint()
+{
+    return QStringLiteral("/mnt");
+}
+
+QString device(const QString &slot)
+{
+    return QStringLiteral("/dev/disk/by-label/root_") + slot;
+}
+
+QString runningSlot()
+{
+    struct stat rootInfo;
+    if (stat("/", &rootInfo) != 0) {
+        return QString();
+    }
+
+    const QStringList labels = QDir(QStringLiteral("/dev/disk/by-label")).entryList({QStringLiteral("root_?")}, QDir::System);
+    for (const QString &label : labels) {
+        struct stat deviceInfo;
+        const QString slot = label.mid(5);
+        if (stat(QFile::encodeName(device(slot)).constData(), &deviceInfo) == 0 && deviceInfo.st_rdev == rootInfo.st_dev) {
+            return slot;
+        }
+    }
+    return QString();
+}
+
+bool enterPrivateNamespace(QString *error)
+{
+    if (unshare(CLONE_NEWNS) != 0 || ::mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0) {
+        *error = QStringLiteral("Cannot create a private mount namespace");
+        return false;
+    }
+    return true;
+}
+
+bool mount(const QString &slot, bool writable, QString *error)
+{
+    const QString slotDevice = device(slot);
+    struct stat deviceInfo;
+    struct stat rootInfo;
+    if (stat(QFile::encodeName(slotDevice).constData(), &deviceInfo) != 0 || stat("/", &rootInfo) != 0) {
+        *error = QStringLiteral("Cannot find the partition of slot %1").arg(slot);
+        return false;
+    }
+    if (deviceInfo.st_rdev == rootInfo.st_dev) {
+        *error = QStringLiteral("Slot %1 is the running slot").arg(slot);
+        return false;
+    }
+
+    const QString options = writable ? QStringLiteral("rw") : QStringLiteral("ro,nosuid,nodev,noexec");
+    if (QProcess::execute(QStringLiteral("mount"), {QStringLiteral("-o"), options, slotDevice, mountPoint()}) != 0) {
+        *error = QStringLiteral("Cannot mount slot %1").arg(slot);
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QString>
+
+// Mounting the other slot for the slot tool. It is mounted inside the
+// process's own mount namespace: nobody else sees it, and it goes away with
+// the process even if it is killed.
+namespace SlotMount
+{
+
+QString mountPoint();
+// obsidianctl labels the slots' root partitions root_a and root_b.
+QString device(const QString &slot);
+// The slot whose partition is mounted at /, empty if none matches.
+QString runningSlot();
+
+// Has to happen before any threads are started, since a thread created
+// earlier would stay in the old namespace.
+bool enterPrivateNamespace(QString *error);
+// Refuses the running slot.
+bool mount(const QString &slot, bool writable, QString *error);
+
+}
@@ -0,0 +1,362 @@
+#include "slotsync.h"
+
+#include <QList>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+
+namespace
+{
+
+constexpr qint64 SyncBlock = 1024 * 1024;
+constexpr qint64 ProgressInterval = 250;
+
+QByteArray failure(const char *what, const QByteArray &path)
+{
+    const int error = errno;
+    return QByteArray(what) + ' ' + path + ": " + qt_error_string(error).toLocal8Bit() + '\n';
+}
+
+// Closes the descriptor when it goes out of scope.
+struct FileDescriptor {
+    explicit FileDescriptor(int fd)
+        : fd(fd)
+    {
+    }
+    ~FileDescriptor()
+    {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    const int fd;
+};
+
+bool writeAll(int fd, const char *data, qint64 length, off_t offset)
+{
+    while (length > 0) {
+        const ssize_t written = pwrite(fd, data, size_t(length), offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+// Copies length bytes at offset from in to out; returns how many were
+// copied, or -1. The slots are separate filesystems, and older kernels
+// refuse copy_file_range() between those, so that falls back to plain
+// reads and writes.
+qint64 copyData(int in, int out, off_t offset, qint64 length)
+{
+    off_t inOffset = offset;
+    off_t outOffset = offset;
+    while (length > 0) {
+        const ssize_t copied = copy_file_range(in, &inOffset, out, &outOffset, size_t(length), 0);
+        if (copied > 0) {
+            length -= copied;
+            continue;
+        }
+        if (copied == 0) {
+            // The source shrank meanwhile.
+            return inOffset - offset;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) {
+            return -1;
+        }
+        break;
+    }
+
+    const std::unique_ptr<char[]> buffer(new char[SyncBlock]);
+    while (length > 0) {
+        const ssize_t wanted = ssize_t(qMin(length, SyncBlock));
+        const ssize_t got = pread(in, buffer.get(), wanted, inOffset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        if (!writeAll(out, buffer.get(), got, inOffset)) {
+            return -1;
+        }
+        inOffset += got;
+        length -= got;
+    }
+    return inOffset - offset;
+}
+
+// Extended attributes carry file capabilities and SELinux labels, and
+// writing to a file or changing its owner drops the former.
+bool copyXattrs(const QByteArray &source, const QByteArray &dest)
+{
+    const ssize_t size = llistxattr(source.constData(), nullptr, 0);
+    if (size <= 0) {
+        return size == 0 || errno == ENOTSUP;
+    }
+
+    QByteArray names(size, Qt::Uninitialized);
+    const ssize_t namesSize = llistxattr(source.constData(), names.data(), names.size());
+    if (namesSize < 0) {
+        return false;
+    }
+    names.truncate(namesSize);
+
+    for (const QByteArray &name : names.split('\0')) {
+        if (name.isEmpty()) {
+            continue;
+        }
+        const ssize_t valueSize = lgetxattr(source.constData(), name.constData(), nullptr, 0);
+        if (valueSize < 0) {
+            continue;
+        }
+        QByteArray value(valueSize, Qt::Uninitialized);
+        const ssize_t got = lgetxattr(source.constData(), name.constData(), value.data(), value.size());
+        if (got < 0) {
+            continue;
+        }
+        // Symlinks can't carry user attributes, and some filesystems none.
+        if (lsetxattr(dest.constData(), name.constData(), value.constData(), size_t(got), 0) != 0 && errno != ENOTSUP
+            && errno != EPERM) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int removeEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+    return ::remove(path) == 0 ? 0 : -1;
+}
+
+}
+
+SlotSync::SlotSync()
+    : m_lastProgress(0)
+    , m_entries(0)
+    , m_changed(0)
+    , m_copied(0)
+    , m_skipped(0)
+{
+    m_clock.start();
+}
+
+bool SlotSync::create(const QByteArray &source, const QByteArray &dest, const struct stat &st, QByteArray *errors)
+{
+    m_changed++;
+
+    if (S_ISREG(st.st_mode)) {
+        const FileDescriptor in(open(source.constData(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+        struct stat current;
+        if (in.fd < 0 || fstat(in.fd, &current) != 0) {
+            *errors += failure("Cannot read", source);
+            return false;
+        }
+        const FileDescriptor out(open(dest.constData(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600));
+        if (out.fd < 0) {
+            *errors += failure("Cannot create", dest);
+            return false;
+        }
+        const qint64 copied = copyData(in.fd, out.fd, 0, current.st_size);
+        if (copied < 0) {
+            *errors += failure("Cannot write", dest);
+            return false;
+        }
+        m_copied += copied;
+        return copyAttributes(source, dest, out.fd, current, errors);
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (mkdir(dest.constData(), 0700) != 0) {
+            *errors += failure("Cannot create", dest);
+            return false;
+        }
+    } else if (S_ISLNK(st.st_mode)) {
+        QByteArray target(4096, Qt::Uninitialized);
+        const ssize_t length = readlink(source.constData(), target.data(), target.size());
+        if (length < 0) {
+            *errors += failure("Cannot read", source);
+            return false;
+        }
+        target.truncate(length);
+        if (symlink(target.constData(), dest.constData()) != 0) {
+            *errors += failure("Cannot create", dest);
+            return false;
+        }
+    } else if (mknod(dest.constData(), st.st_mode, st.st_rdev) != 0) {
+        *errors += failure("Cannot create", dest);
+        return false;
+    }
+
+    return copyAttributes(source, dest, -1, st, errors);
+}
+
+bool SlotSync::update(const QByteArray &source, const QByteArray &dest, QByteArray *errors)
+{
+    m_changed++;
+
+    const FileDescriptor in(open(source.constData(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    struct stat current;
+    if (in.fd < 0 || fstat(in.fd, &current) != 0) {
+        *errors += failure("Cannot read", source);
+        return false;
+    }
+    const FileDescriptor out(open(dest.constData(), O_RDWR | O_NOFOLLOW | O_CLOEXEC));
+    struct stat existing;
+    if (out.fd < 0 || fstat(out.fd, &existing) != 0) {
+        *errors += failure("Cannot open", dest);
+        return false;
+    }
+
+    if (existing.st_size != current.st_size) {
+        // Different sizes almost always mean the file was rewritten, and
+        // comparing it block by block would only add reads.
+        if (ftruncate(out.fd, 0) != 0) {
+            *errors += failure("Cannot write", dest);
+            return false;
+        }
+        const qint64 copied = copyData(in.fd, out.fd, 0, current.st_size);
+        if (copied < 0) {
+            *errors += failure("Cannot write", dest);
+            return false;
+        }
+        m_copied += copied;
+        return copyAttributes(source, dest, out.fd, current, errors);
+    }
+
+    // Same size: only some blocks changed, or none and just the mtime did.
+    posix_fadvise(in.fd, 0, current.st_size, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(out.fd, 0, current.st_size, POSIX_FADV_SEQUENTIAL);
+
+    const std::unique_ptr<char[]> sourceBuffer(new char[SyncBlock]);
+    const std::unique_ptr<char[]> destBuffer(new char[SyncBlock]);
+    for (off_t offset = 0; offset < current.st_size;) {
+        const ssize_t wanted = ssize_t(qMin<qint64>(SyncBlock, current.st_size - offset));
+        const ssize_t got = pread(in.fd, sourceBuffer.get(), wanted, offset);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                *errors += failure("Cannot read", source);
+                return false;
+            }
+            break;
+        }
+
+        if (pread(out.fd, destBuffer.get(), got, offset) == got && !memcmp(sourceBuffer.get(), destBuffer.get(), got)) {
+            m_skipped += got;
+        } else if (writeAll(out.fd, sourceBuffer.get(), got, offset)) {
+            m_copied += got;
+        } else {
+            *errors += failure("Cannot write", dest);
+            return false;
+        }
+        offset += got;
+    }
+
+    return copyAttributes(source, dest, out.fd, current, errors);
+}
+
+bool SlotSync::setAttributes(const QByteArray &source, const QByteArray &dest, const struct stat &st, QByteArray *errors)
+{
+    m_changed++;
+    return copyAttributes(source, dest, -1, st, errors);
+}
+
+bool SlotSync::remove(const QByteArray &dest, QByteArray *errors)
+{
+    m_changed++;
+    if (nftw(dest.constData(), removeEntry, 32, FTW_DEPTH | FTW_PHYS | FTW_MOUNT) != 0) {
+        *errors += failure("Cannot remove", dest);
+        return false;
+    }
+    return true;
+}
+
+bool SlotSync::flush(const QByteArray &root, QByteArray *errors)
+{
+    const FileDescriptor fd(open(root.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd.fd < 0 || syncfs(fd.fd) != 0) {
+        *errors += failure("Cannot write out", root);
+        return false;
+    }
+    return true;
+}
+
+void SlotSync::addEntries(qint64 count)
+{
+    m_entries += count;
+}
+
+void SlotSync::addSkipped(qint64 bytes)
+{
+    m_skipped += bytes;
+}
+
+QByteArray SlotSync::progress(bool final)
+{
+    const qint64 now = m_clock.elapsed();
+    qint64 last = m_lastProgress;
+    if (!final && (now - last < ProgressInterval || !m_lastProgress.compare_exchange_strong(last, now))) {
+        return QByteArray();
+    }
+
+    return "%PROGRESS%\t" + QByteArray::number(m_entries.load()) + '\t' + QByteArray::number(m_changed.load()) + '\t'
+        + QByteArray::number(m_copied.load()) + '\t' + QByteArray::number(m_skipped.load()) + '\n';
+}
+
+bool SlotSync::copyAttributes(const QByteArray &source, const QByteArray &dest, int fd, const struct stat &st, QByteArray *errors)
+{
+    // Owner first, since changing it clears the setuid and setgid bits.
+    const bool owned = fd >= 0 ? fchown(fd, st.st_uid, st.st_gid) == 0 : lchown(dest.constData(), st.st_uid, st.st_gid) == 0;
+    if (!owned) {
+        *errors += failure("Cannot change the owner of", dest);
+        return false;
+    }
+    if (!S_ISLNK(st.st_mode)) {
+        const bool moded = fd >= 0 ? fchmod(fd, st.st_mode & 07777) == 0 : chmod(dest.constData(), st.st_mode & 07777) == 0;
+        if (!moded) {
+            *errors += failure("Cannot change the mode of", dest);
+            return false;
+        }
+    }
+    if (!copyXattrs(source, dest)) {
+        *errors += failure("Cannot copy the attributes of", dest);
+        return false;
+    }
+
+    // The mtime is what lets the next comparison skip the file unread.
+    // Directories get theirs changed again as entries are added below.
+    if (S_ISDIR(st.st_mode)) {
+        return true;
+    }
+    const struct timespec times[2] = {st.st_atim, st.st_mtim};
+    const bool timed = fd >= 0 ? futimens(fd, times) == 0 : utimensat(AT_FDCWD, dest.constData(), times, AT_SYMLINK_NOFOLLOW) == 0;
+    if (!timed) {
+        *errors += failure("Cannot set the times of", dest);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include <sys/stat.h>
+
+#include <atomic>
+
+// Applies SlotDiff's changes to the target tree, so it ends up matching the
+// base one. Files of the same size are updated in place, writing only the
+// blocks that differ; anything else is copied with copy_file_range(), which
+// keeps the data in the kernel and shares it where the filesystem can.
+// Paths are absolute. The walk's threads call in concurrently, each on
+// different paths.
+class SlotSync
+{
+public:
+    SlotSync();
+
+    // Each of these appends a message to errors and returns false on failure.
+
+    // Creates dest as a copy of source; directories are created empty.
+    bool create(const QByteArray &source, const QByteArray &dest, const struct stat &st, QByteArray *errors);
+    // Brings the content of the regular file dest up to date with source.
+    bool update(const QByteArray &source, const QByteArray &dest, QByteArray *errors);
+    bool setAttributes(const QByteArray &source, const QByteArray &dest, const struct stat &st, QByteArray *errors);
+    // Removes dest and, for a directory, everything below it.
+    bool remove(const QByteArray &dest, QByteArray *errors);
+    // Writes everything below root out to disk.
+    bool flush(const QByteArray &root, QByteArray *errors);
+
+    void addEntries(qint64 count);
+    // Bytes that were already up to date.
+    void addSkipped(qint64 bytes);
+
+    // A progress record (see SlotToolProtocol), or nothing if the last one
+    // is more recent than ProgressInterval and final isn't set.
+    QByteArray progress(bool final);
+
+private:
+    bool copyAttributes(const QByteArray &source, const QByteArray &dest, int fd, const struct stat &st, QByteArray *errors);
+
+    QElapsedTimer m_clock;
+    std::atomic<qint64> m_lastProgress;
+    std::atomic<qint64> m_entries;
+    std::atomic<qint64> m_changed;
+    std::atomic<qint64> m_copied;
+    std::atomic<qint64> m_skipped;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+// What the slot tool prints, shared with the KCM that parses it. Given just
+// a slot it compares that slot with the running one, one record per line:
+//
+//     <change>\t<type>\t<old size>\t<new size>\t<path>
+//
+// change is A (only in the other slot), R (only in the running one),
+// M (content differs) or T (same content, different mode or owner). type is
+// f, d, l or o for files, directories, symlinks and anything else. The path
+// is relative to the slot root, with backslash, tab and newline escaped.
+//
+// With "packages <slot>" it lists the slot's pacman database instead:
+//
+//     %MODIFIED%\t<database mtime in ms>
+//     <name>\t<version>\t<installed size>
+//
+// and with "--since <mtime>" only the first line if the mtime matches.
+//
+// With "sync <slot>" it makes the slot a copy of the running one, printing
+//
+//     %PROGRESS%\t<entries checked>\t<entries changed>\t<bytes copied>\t<bytes skipped>
+//
+// every quarter of a second and once more at the end.
+//
+// With "health <slot>" it checks the running slot and the given one,
+// printing each check as it starts and again when it is done:
+//
+//     %CHECK%\t<slot>\t<check>\t<state>\t<duration in ms>\t<details>
+//
+// state is one of the Check* values below, details escaped like paths.
+//
+// With "verify <slot> [--record] [--idle] [--limit <MiB/s>]" it reads the
+// slot's partition and compares it with the chunk digests recorded by an
+// earlier --record run, printing
+//
+//     %VERIFY%\t<bytes read>\t<bytes total>\t<mismatching chunks>
+//
+// every quarter of a second, then each differing byte range and the outcome:
+//
+//     %MISMATCH%\t<offset>\t<length>
+//     %RESULT%\t<verified|recorded|mismatch|stale|missing|failed>
+namespace SlotToolProtocol
+{
+
+const QString ProgressField = QStringLiteral("%PROGRESS%");
+const QString CheckField = QStringLiteral("%CHECK%");
+const QString VerifyField = QStringLiteral("%VERIFY%");
+const QString MismatchField = QStringLiteral("%MISMATCH%");
+const QString ResultField = QStringLiteral("%RESULT%");
+
+const QString CheckRunning = QStringLiteral("running");
+const QString CheckPassed = QStringLiteral("passed");
+const QString CheckWarning = QStringLiteral("warning");
+const QString CheckFailed = QStringLiteral("failed");
+const QString CheckSkipped = QStringLiteral("skipped");
+
+inline QString program()
+{
+    return QStringLiteral(KCM_OBSIDIANOS_LIBEXECDIR "/kcm_obsidianos_slottool");
+}
+
+// Paths are raw file names, so this works on bytes.
+inline QByteArray escapePath(const QByteArray &path)
+{
+    QByteArray escaped;
+    escaped.reserve(path.size());
+    for (const char c : path) {
+        if (c == '\\') {
+            escaped += "\\\\";
+        } else if (c == '\t') {
+            escaped += "\\t";
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+inline QString unescapePath(QStringView escaped)
+{
+    QString path;
+    path.reserve(escaped.size());
+    for (qsizetype i = 0; i < escaped.size(); i++) {
+        const QChar c = escaped.at(i);
+        if (c != QLatin1Char('\\') || i + 1 == escaped.size()) {
+            path += c;
+            continue;
+        }
+        const QChar next = escaped.at(++i);
+        path += next == QLatin1Char('t') ? QChar(QLatin1Char('\t')) : next == QLatin1Char('n') ? QChar(QLatin1Char('\n')) : next;
+    }
+    return path;
+}
+
+}
@@ -17,6 +17,66 @@ ColumnLayout {
         backupManager.refreshBackups()
     }
 
+    onVisibleChanged: {
+        if (!visible) {
+            backupManager.cancelScan()
+        }
+    }
+
+    function verifyStateText(state, progress, throughput) {
+        switch (state) {
+        case "verifying":
+            return throughput > 0 ? qsTr("%1% (%2/s)").arg(Math.round(progress * 100)).arg(Qt.locale().formattedDataSize(throughput))
+                                  : qsTr("Queued")
+        case "verified":
+            return qsTr("Verified")
+        case "mismatch":
+            return qsTr("Corrupted")
+        case "nochecksum":
+            return qsTr("No checksum")
+        case "failed":
+            return qsTr("Unreadable")
+        }
+        return qsTr("Not verified")
+    }
+
+    // Profile ids are "compressor:level:threads", 0 meaning the default.
+    function compressionProfileText(profile) {
+        const parts = profile.split(":")
+        let text = parts[0]
+        if (parts.length > 1 && parts[1] !== "0") {
+            text += " " + parts[1]
+        }
+        if (parts.length > 2 && parts[2] !== "0") {
+            text += qsTr(", %1 threads").arg(parts[2])
+        }
+        return text
+    }
+
+    // Rescans only insert and remove the rows that changed, so keep the
+    // selection on the same backup as rows move around it.
+    Connections {
+        target: backupManager.model
+
+        function onRowsInserted(parent, first, last) {
+            if (backupsPage.selectedIndex >= first) {
+                backupsPage.selectedIndex += last - first + 1
+            }
+        }
+
+        function onRowsRemoved(parent, first, last) {
+            if (backupsPage.selectedIndex > last) {
+                backupsPage.selectedIndex -= last - first + 1
+            } else if (backupsPage.selectedIndex >= first) {
+                backupsPage.selectedIndex = -1
+            }
+        }
+
+        function onModelReset() {
+            backupsPage.selectedIndex = -1
+        }
+    }
+
     RowLayout {
         Layout.fillWidth: true
         spacing: Kirigami.Units.smallSpacing
@@ -39,12 +99,20 @@ ColumnLayout {
             icon.name: "edit-clear-history"
             text: qsTr("Cleanup")
             display: QQC2.AbstractButton.TextBesideIcon
+            enabled: !backupManager.cleanupActive
             onClicked: cleanupDialog.open()
         }
 
+        QQC2.ToolButton {
+            icon.name: backupManager.verifying ? "process-stop" : "security-high"
+            text: backupManager.verifying ? qsTr("Stop Verifying") : qsTr("Verify All")
+            display: QQC2.AbstractButton.TextBesideIcon
+            onClicked: backupManager.verifying ? backupManager.cancelVerification() : backupManager.verifyAllBackups()
+        }
+
         QQC2.BusyIndicator {
-            running: backupManager.busy
-            visible: backupManager.busy
+            running: backupManager.busy || backupManager.scanning
+            visible: backupManager.busy || backupManager.scanning
             Layout.preferredWidth: Kirigami.Units.iconSizes.medium
             Layout.preferredHeight: Kirigami.Units.iconSizes.medium
         }
@@ -54,6 +122,26 @@ ColumnLayout {
         Layout.fillWidth: true
     }
 
+    RowLayout {
+        Layout.fillWidth: true
+        spacing: Kirigami.Units.smallSpacing
+        visible: backupManager.cleanupActive
+
+        QQC2.Label {
+            text: qsTr("Cleaning up: %1 of %2 deleted, %3 freed")
+                .arg(backupManager.cleanupRemoved)
+                .arg(backupManager.cleanupTotal)
+                .arg(Qt.locale().formattedDataSize(backupManager.cleanupFreedBytes))
+        }
+
+        QQC2.ProgressBar {
+            Layout.fillWidth: true
+            from: 0
+            to: Math.max(backupManager.cleanupTotal, 1)
+            value: backupManager.cleanupRemoved
+        }
+    }
+
     Rectangle {
         Layout.fillWidth: true
         height: headerRow.implicitHeight + Kirigami.Units.smallSpacing * 2
@@ -86,6 +174,11 @@ ColumnLayout {
                 font.bold: true
                 Layout.preferredWidth: 80
             }
+            QQC2.Label {
+                text: qsTr("Integrity")
+                font.bold: true
+                Layout.preferredWidth: 110
+            }
             QQC2.Label {
                 text: qsTr("Path")
                 font.bold: true
@@ -129,7 +222,10 @@ ColumnLayout {
                         color: index === backupsPage.selectedIndex ? Kirigami.Theme.highlightedTextColor : Kirigami.Theme.textColor
                     }
                     QQC2.Label {
-                        text: model.isFullBackup ? qsTr("Full") : qsTr("Partial")
+                        text: {
+                            const type = model.isFullBackup ? qsTr("Full") : qsTr("Partial")
+                            return model.deduplicated ? qsTr("%1, dedup").arg(type) : type
+                        }
                         Layout.preferredWidth: 80
                         color: index === backupsPage.selectedIndex ? Kirigami.Theme.highlightedTextColor : Kirigami.Theme.textColor
                     }
@@ -143,6 +239,21 @@ ColumnLayout {
                         Layout.preferredWidth: 80
                         color: index === backupsPage.selectedIndex ? Kirigami.Theme.highlightedTextColor : Kirigami.Theme.textColor
                     }
+                    QQC2.Label {
+                        text: backupsPage.verifyStateText(model.verifyState, model.verifyProgress, model.verifyThroughput)
+                        Layout.preferredWidth: 110
+                        elide: Text.ElideRight
+                        color: {
+                            if (index === backupsPage.selectedIndex) {
+                                return Kirigami.Theme.highlightedTextColor
+                            } else if (model.verifyState === "mismatch") {
+                                return Kirigami.Theme.negativeTextColor
+                            } else if (model.verifyState === "verified") {
+                                return Kirigami.Theme.positiveTextColor
+                            }
+                            return Kirigami.Theme.textColor
+                        }
+                    }
                     QQC2.Label {
                         text: model.path || ""
                         Layout.fillWidth: true
@@ -166,7 +277,7 @@ ColumnLayout {
 
             Kirigami.PlaceholderMessage {
                 anchors.centerIn: parent
-                visible: backupList.count === 0 && !backupManager.busy
+                visible: backupList.count === 0 && !backupManager.busy && !backupManager.scanning
                 text: qsTr("No backups found")
                 explanation: qsTr("Create a backup to protect your system")
                 icon.name: "folder-backup"
@@ -205,6 +316,24 @@ ColumnLayout {
             }
         }
 
+        QQC2.Button {
+            text: qsTr("Browse")
+            icon.name: "folder-open"
+            // unsquashfs can't read a manifest.
+            enabled: backupsPage.selectedIndex >= 0 && !backupManager.backupIsDeduplicated(backupsPage.selectedIndex)
+            onClicked: {
+                backupManager.browseBackup(backupsPage.selectedIndex)
+                browseDialog.open()
+            }
+        }
+
+        QQC2.Button {
+            text: qsTr("Verify")
+            icon.name: "security-high"
+            enabled: backupsPage.selectedIndex >= 0
+            onClicked: backupManager.verifyBackup(backupsPage.selectedIndex)
+        }
+
         QQC2.Button {
             text: qsTr("Restore")
             icon.name: "edit-undo"
@@ -240,7 +369,8 @@ ColumnLayout {
             backupManager.createBackup(
                 slotCombo.currentText,
                 customDirField.text,
-                fullBackupCheck.checked
+                fullBackupCheck.checked,
+                deduplicateCheck.checked
             )
         }
 
@@ -248,6 +378,7 @@ ColumnLayout {
             slotCombo.currentIndex = 0
             customDirField.text = ""
             fullBackupCheck.checked = false
+            deduplicateCheck.checked = false
         }
 
         GridLayout {
@@ -273,6 +404,7 @@ ColumnLayout {
             RowLayout {
                 Layout.fillWidth: true
                 spacing: Kirigami.Units.smallSpacing
+                enabled: !deduplicateCheck.checked
 
                 QQC2.TextField {
                     id: customDirField
@@ -294,6 +426,256 @@ ColumnLayout {
                 id: fullBackupCheck
                 text: qsTr("Full system backup (includes shared partitions)")
             }
+
+            Item {}
+
+            QQC2.CheckBox {
+                id: deduplicateCheck
+                text: qsTr("Deduplicate (store only what changed since earlier backups)")
+            }
+
+            QQC2.Label {
+                text: qsTr("Compression:")
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: Kirigami.Units.smallSpacing
+
+                // obsidianctl picks the compressor; the benchmark only
+                // helps choose what to configure there.
+                QQC2.Label {
+                    Layout.fillWidth: true
+                    elide: Text.ElideRight
+                    text: backupManager.compressionProfile !== ""
+                        ? qsTr("Set by obsidianctl (benchmark picked %1)").arg(backupsPage.compressionProfileText(backupManager.compressionProfile))
+                        : qsTr("Set by obsidianctl")
+                }
+
+                QQC2.Button {
+                    text: qsTr("Benchmark...")
+                    icon.name: "chronometer"
+                    onClicked: benchmarkDialog.open()
+                }
+            }
+        }
+    }
+
+    QQC2.Dialog {
+        id: benchmarkDialog
+        title: qsTr("Compression Benchmark")
+        standardButtons: QQC2.Dialog.Close
+        modal: true
+        parent: QQC2.Overlay.overlay
+        anchors.centerIn: parent
+        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 36)
+        height: Math.min(parent.height - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 28)
+
+        readonly property var benchmark: backupManager.benchmark
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: Kirigami.Units.smallSpacing
+
+            QQC2.Label {
+                Layout.fillWidth: true
+                wrapMode: Text.WordWrap
+                text: qsTr("Compresses a sample of this system with each profile and projects the size and time of a backup of slot %1.")
+                    .arg(slotCombo.currentText)
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: Kirigami.Units.smallSpacing
+
+                QQC2.ProgressBar {
+                    Layout.fillWidth: true
+                    visible: benchmarkDialog.benchmark.running
+                    indeterminate: benchmarkDialog.benchmark.sampleBytes === 0
+                    value: benchmarkDialog.benchmark.progress
+                }
+
+                QQC2.Label {
+                    Layout.fillWidth: true
+                    visible: !benchmarkDialog.benchmark.running && benchmarkDialog.benchmark.sampleBytes > 0
+                    opacity: 0.7
+                    text: qsTr("Sample: %1").arg(Qt.locale().formattedDataSize(benchmarkDialog.benchmark.sampleBytes))
+                }
+
+                QQC2.Button {
+                    text: benchmarkDialog.benchmark.running ? qsTr("Stop") : qsTr("Run")
+                    icon.name: benchmarkDialog.benchmark.running ? "process-stop" : "media-playback-start"
+                    onClicked: benchmarkDialog.benchmark.running ? backupManager.cancelBenchmark()
+                                                                 : backupManager.benchmarkCompression(slotCombo.currentText)
+                }
+            }
+
+            QQC2.ScrollView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+
+                ListView {
+                    clip: true
+                    model: benchmarkDialog.benchmark
+
+                    delegate: QQC2.ItemDelegate {
+                        width: ListView.view.width
+                        highlighted: model.profileId === backupManager.compressionProfile
+
+                        contentItem: RowLayout {
+                            spacing: Kirigami.Units.largeSpacing
+
+                            QQC2.Label {
+                                text: model.recommended ? qsTr("%1 (recommended)").arg(model.label) : model.label
+                                font.bold: model.recommended
+                                elide: Text.ElideRight
+                                Layout.fillWidth: true
+                            }
+                            QQC2.Label {
+                                visible: model.state === "done"
+                                text: model.projectedSizeString
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 5
+                            }
+                            QQC2.Label {
+                                visible: model.state === "done"
+                                text: qsTr("%1 min").arg(Math.max(1, Math.round(model.projectedSeconds / 60)))
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 4
+                            }
+                            QQC2.Label {
+                                visible: model.state === "done"
+                                text: qsTr("%1 cores").arg(model.cpuUsage.toFixed(1))
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 4
+                            }
+                            QQC2.Label {
+                                visible: model.state !== "done"
+                                opacity: 0.7
+                                elide: Text.ElideRight
+                                text: model.state === "running" ? qsTr("Running...")
+                                    : model.state === "failed" ? model.error : qsTr("Queued")
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 13
+                            }
+                        }
+
+                        enabled: model.state === "done"
+                        onClicked: backupManager.compressionProfile = model.profileId
+                    }
+                }
+            }
+
+            QQC2.Label {
+                Layout.fillWidth: true
+                wrapMode: Text.WordWrap
+                opacity: 0.7
+                text: qsTr("Click a profile to remember it. New backups use the compression configured in obsidianctl.")
+            }
+        }
+    }
+
+    FolderDialog {
+        id: extractFolderDialog
+        title: qsTr("Extract To")
+        onAccepted: {
+            backupManager.extractFromBackup([browseDialog.selectedPath], selectedFolder.toString().replace("file://", ""))
+        }
+    }
+
+    QQC2.Dialog {
+        id: browseDialog
+        title: qsTr("Backup Contents")
+        standardButtons: QQC2.Dialog.Close
+        modal: true
+        parent: QQC2.Overlay.overlay
+        anchors.centerIn: parent
+        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 36)
+        height: Math.min(parent.height - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 30)
+
+        property string selectedPath: ""
+
+        onOpened: selectedPath = ""
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: Kirigami.Units.smallSpacing
+
+            QQC2.Label {
+                text: backupManager.contents.imagePath
+                font.family: "monospace"
+                opacity: 0.7
+                elide: Text.ElideMiddle
+                Layout.fillWidth: true
+            }
+
+            QQC2.ScrollView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+
+                TreeView {
+                    id: contentsTree
+                    clip: true
+                    model: backupManager.contents
+
+                    delegate: QQC2.TreeViewDelegate {
+                        id: entryDelegate
+                        implicitWidth: contentsTree.width
+                        highlighted: model.path === browseDialog.selectedPath
+
+                        contentItem: RowLayout {
+                            spacing: Kirigami.Units.smallSpacing
+
+                            Kirigami.Icon {
+                                source: model.isDir ? "folder" : (model.linkTarget ? "inode-symlink" : "text-x-generic")
+                                Layout.preferredWidth: Kirigami.Units.iconSizes.small
+                                Layout.preferredHeight: Kirigami.Units.iconSizes.small
+                            }
+                            QQC2.Label {
+                                text: model.linkTarget ? qsTr("%1 -> %2").arg(model.name).arg(model.linkTarget) : model.name
+                                elide: Text.ElideRight
+                                Layout.fillWidth: true
+                            }
+                            QQC2.BusyIndicator {
+                                running: model.loading
+                                visible: model.loading
+                                Layout.preferredWidth: Kirigami.Units.iconSizes.small
+                                Layout.preferredHeight: Kirigami.Units.iconSizes.small
+                            }
+                            QQC2.Label {
+                                text: model.sizeString
+                                opacity: 0.7
+                            }
+                        }
+
+                        onClicked: {
+                            browseDialog.selectedPath = model.path
+                        }
+                        // Expanding a directory fetches it from the model the
+                        // first time.
+                        onDoubleClicked: {
+                            if (model.isDir) {
+                                contentsTree.toggleExpanded(entryDelegate.row)
+                            }
+                        }
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: Kirigami.Units.smallSpacing
+
+                QQC2.Label {
+                    text: browseDialog.selectedPath !== "" ? "/" + browseDialog.selectedPath : qsTr("Select a file or folder to extract")
+                    opacity: 0.7
+                    elide: Text.ElideMiddle
+                    Layout.fillWidth: true
+                }
+
+                QQC2.Button {
+                    text: qsTr("Extract...")
+                    icon.name: "archive-extract"
+                    enabled: browseDialog.selectedPath !== "" && !backupManager.busy
+                    onClicked: extractFolderDialog.open()
+                }
+            }
         }
     }
 
@@ -417,6 +799,7 @@ ColumnLayout {
         width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 25)
 
         property int backupIndex: -1
+        readonly property var image: backupIndex >= 0 ? backupManager.backupImageInfo(backupIndex) : ({})
 
         GridLayout {
             anchors.fill: parent
@@ -460,6 +843,111 @@ ColumnLayout {
                 Layout.fillWidth: true
             }
 
+            QQC2.Label {
+                text: qsTr("Compression:")
+                font.bold: true
+                visible: compressorLabel.text !== ""
+            }
+            QQC2.Label {
+                id: compressorLabel
+                text: propertiesDialog.backupIndex >= 0 ? backupManager.backupCompressor(propertiesDialog.backupIndex) : ""
+                visible: text !== ""
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Block size:")
+                font.bold: true
+                visible: !!propertiesDialog.image.blockSize
+            }
+            QQC2.Label {
+                text: propertiesDialog.image.blockSize || ""
+                visible: text !== ""
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Uncompressed:")
+                font.bold: true
+                visible: !!propertiesDialog.image.uncompressedSize
+            }
+            QQC2.Label {
+                text: propertiesDialog.image.uncompressedSize || ""
+                visible: text !== ""
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Inodes:")
+                font.bold: true
+                visible: !!propertiesDialog.image.inodeCount
+            }
+            QQC2.Label {
+                text: propertiesDialog.image.inodeCount || ""
+                visible: text !== ""
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Image built:")
+                font.bold: true
+                visible: !!propertiesDialog.image.created
+            }
+            QQC2.Label {
+                text: propertiesDialog.image.created || ""
+                visible: text !== ""
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Image problem:")
+                font.bold: true
+                visible: !!propertiesDialog.image.error
+            }
+            QQC2.Label {
+                text: propertiesDialog.image.error || ""
+                visible: text !== ""
+                color: Kirigami.Theme.negativeTextColor
+                wrapMode: Text.WordWrap
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Source version:")
+                font.bold: true
+                visible: sourceVersionLabel.text !== ""
+            }
+            QQC2.Label {
+                id: sourceVersionLabel
+                text: propertiesDialog.backupIndex >= 0 ? backupManager.backupSourceVersion(propertiesDialog.backupIndex) : ""
+                visible: text !== ""
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Checksum:")
+                font.bold: true
+                visible: checksumLabel.text !== ""
+            }
+            QQC2.Label {
+                id: checksumLabel
+                text: propertiesDialog.backupIndex >= 0 ? backupManager.backupChecksum(propertiesDialog.backupIndex) : ""
+                visible: text !== ""
+                wrapMode: Text.WrapAnywhere
+                font.family: "monospace"
+                Layout.fillWidth: true
+            }
+
+            QQC2.Label {
+                text: qsTr("Integrity:")
+                font.bold: true
+            }
+            QQC2.Label {
+                text: propertiesDialog.backupIndex >= 0 ? backupManager.backupVerification(propertiesDialog.backupIndex) : ""
+                wrapMode: Text.WordWrap
+                Layout.fillWidth: true
+            }
+
             QQC2.Label {
                 text: qsTr("Path:")
                 font.bold: true
@@ -479,10 +967,25 @@ ColumnLayout {
         modal: true
         parent: QQC2.Overlay.overlay
         anchors.centerIn: parent
-        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 22)
+        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 26)
+
+        readonly property var rules: ({
+            daily: dailySpinBox.value,
+            weekly: weeklySpinBox.value,
+            monthly: monthlySpinBox.value,
+            minFullBackups: minFullSpinBox.value,
+            maxTotalBytes: maxTotalSpinBox.value * 1024 * 1024 * 1024,
+            minFreeBytes: minFreeSpinBox.value * 1024 * 1024 * 1024
+        })
+        // Recomputed whenever a rule changes; the plan only reads the model.
+        readonly property var plan: visible && policyRadio.checked ? backupManager.planRetention(rules) : null
 
         onAccepted: {
-            backupManager.cleanupBackups(daysSpinBox.value)
+            if (policyRadio.checked) {
+                backupManager.applyRetention(rules)
+            } else {
+                backupManager.cleanupBackups(daysSpinBox.value)
+            }
         }
 
         GridLayout {
@@ -495,17 +998,20 @@ ColumnLayout {
                 source: "edit-clear-history"
                 Layout.preferredWidth: Kirigami.Units.iconSizes.large
                 Layout.preferredHeight: Kirigami.Units.iconSizes.large
-                Layout.rowSpan: 2
+                Layout.alignment: Qt.AlignTop
+                Layout.rowSpan: 4
             }
 
-            QQC2.Label {
-                text: qsTr("Delete backups older than:")
-                wrapMode: Text.WordWrap
+            QQC2.RadioButton {
+                id: ageRadio
+                text: qsTr("Delete backups older than a number of days")
+                checked: true
                 Layout.fillWidth: true
             }
 
             RowLayout {
                 Layout.fillWidth: true
+                enabled: ageRadio.checked
                 spacing: Kirigami.Units.smallSpacing
 
                 QQC2.SpinBox {
@@ -520,6 +1026,93 @@ ColumnLayout {
                     text: qsTr("days")
                 }
             }
+
+            QQC2.RadioButton {
+                id: policyRadio
+                text: qsTr("Apply a retention policy")
+                Layout.fillWidth: true
+            }
+
+            Kirigami.FormLayout {
+                Layout.fillWidth: true
+                enabled: policyRadio.checked
+
+                QQC2.SpinBox {
+                    id: dailySpinBox
+                    Kirigami.FormData.label: qsTr("Daily backups to keep:")
+                    from: 0
+                    to: 365
+                    value: 7
+                }
+
+                QQC2.SpinBox {
+                    id: weeklySpinBox
+                    Kirigami.FormData.label: qsTr("Weekly backups to keep:")
+                    from: 0
+                    to: 104
+                    value: 4
+                }
+
+                QQC2.SpinBox {
+                    id: monthlySpinBox
+                    Kirigami.FormData.label: qsTr("Monthly backups to keep:")
+                    from: 0
+                    to: 120
+                    value: 6
+                }
+
+                QQC2.SpinBox {
+                    id: minFullSpinBox
+                    Kirigami.FormData.label: qsTr("Full backups to keep:")
+                    from: 0
+                    to: 50
+                    value: 1
+                }
+
+                QQC2.SpinBox {
+                    id: maxTotalSpinBox
+                    Kirigami.FormData.label: qsTr("Maximum total size (GiB):")
+                    from: 0
+                    to: 100000
+                    value: 0
+                    textFromValue: (value, locale) => value === 0 ? qsTr("No limit") : Number(value).toLocaleString(locale, 'f', 0)
+                }
+
+                QQC2.SpinBox {
+                    id: minFreeSpinBox
+                    Kirigami.FormData.label: qsTr("Keep free at least (GiB):")
+                    from: 0
+                    to: 100000
+                    value: 0
+                    textFromValue: (value, locale) => value === 0 ? qsTr("No limit") : Number(value).toLocaleString(locale, 'f', 0)
+                }
+            }
+
+            QQC2.Label {
+                Layout.column: 1
+                Layout.fillWidth: true
+                visible: cleanupDialog.plan !== null
+                wrapMode: Text.WordWrap
+                text: {
+                    const plan = cleanupDialog.plan
+                    if (!plan) {
+                        return ""
+                    }
+                    if (plan.count === 0) {
+                        return qsTr("Nothing to delete; %1 of backups kept.").arg(plan.remaining)
+                    }
+                    return qsTr("Deletes %1 backups, freeing %2; %3 of backups kept.")
+                        .arg(plan.count).arg(plan.reclaimed).arg(plan.remaining)
+                }
+            }
+
+            Kirigami.InlineMessage {
+                Layout.column: 1
+                Layout.fillWidth: true
+                type: Kirigami.MessageType.Warning
+                visible: cleanupDialog.plan !== null && !cleanupDialog.plan.budgetMet
+                text: qsTr("The size limits cannot be met without deleting the newest or the required full backups.")
+            }
         }
     }
 }
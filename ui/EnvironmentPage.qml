@@ -151,6 +151,105 @@ ColumnLayout {
                     Layout.columnSpan: 2
                     Layout.fillWidth: true
                 }
+
+                QQC2.Label {
+                    text: qsTr("Read the whole partition of a slot that isn't running and compare every block with a reference recorded earlier. A stopped run continues where it left off.")
+                    wrapMode: Text.WordWrap
+                    opacity: 0.7
+                    Layout.columnSpan: 2
+                    Layout.fillWidth: true
+                }
+
+                QQC2.Label {
+                    text: qsTr("Disk usage:")
+                }
+
+                RowLayout {
+                    Layout.fillWidth: true
+                    spacing: Kirigami.Units.smallSpacing
+
+                    QQC2.ComboBox {
+                        id: verifyThrottleCombo
+                        textRole: "text"
+                        valueRole: "value"
+                        model: [
+                            { text: qsTr("Full speed"), value: "none" },
+                            { text: qsTr("Only when idle"), value: "idle" },
+                            { text: qsTr("Limited"), value: "limit" }
+                        ]
+                        enabled: !environmentManager.verifying
+                        Component.onCompleted: currentIndex = indexOfValue(environmentManager.verifyThrottle)
+                        onActivated: environmentManager.verifyThrottle = currentValue
+                        Layout.fillWidth: true
+                    }
+
+                    QQC2.SpinBox {
+                        from: 1
+                        to: 10000
+                        stepSize: 10
+                        value: environmentManager.verifyLimit
+                        visible: verifyThrottleCombo.currentValue === "limit"
+                        enabled: !environmentManager.verifying
+                        onValueModified: environmentManager.verifyLimit = value
+                        Layout.preferredWidth: Kirigami.Units.gridUnit * 6
+                    }
+
+                    QQC2.Label {
+                        text: qsTr("MB/s")
+                        visible: verifyThrottleCombo.currentValue === "limit"
+                    }
+                }
+
+                QQC2.ProgressBar {
+                    from: 0
+                    to: 1
+                    value: environmentManager.verifyProgress
+                    indeterminate: environmentManager.verifyBytesTotal === 0
+                    visible: environmentManager.verifying
+                    Layout.columnSpan: 2
+                    Layout.fillWidth: true
+                }
+
+                QQC2.Label {
+                    text: {
+                        const parts = [qsTr("%1% of %2")
+                            .arg(Math.floor(environmentManager.verifyProgress * 100))
+                            .arg(Qt.locale().formattedDataSize(environmentManager.verifyBytesTotal))]
+                        if (environmentManager.verifying) {
+                            parts.push(qsTr("%1/s").arg(Qt.locale().formattedDataSize(environmentManager.verifyThroughput)))
+                        }
+                        parts.push(qsTr("%1 mismatching chunks").arg(environmentManager.verifyMismatches))
+                        return parts.join(" · ")
+                    }
+                    visible: environmentManager.verifyBytesTotal > 0
+                    opacity: 0.7
+                    wrapMode: Text.WordWrap
+                    Layout.columnSpan: 2
+                    Layout.fillWidth: true
+                }
+
+                RowLayout {
+                    Layout.columnSpan: 2
+                    Layout.fillWidth: true
+                    spacing: Kirigami.Units.smallSpacing
+
+                    QQC2.Button {
+                        text: environmentManager.verifying ? qsTr("Stop") : qsTr("Verify Blocks")
+                        icon.name: environmentManager.verifying ? "process-stop" : "security-high"
+                        enabled: environmentManager.verifying || !environmentManager.busy
+                        onClicked: environmentManager.verifying ? environmentManager.cancelVerification()
+                                                                : environmentManager.verifyBlocks(verifySlotCombo.currentText)
+                        Layout.fillWidth: true
+                    }
+
+                    QQC2.Button {
+                        text: qsTr("Record Reference")
+                        icon.name: "document-save"
+                        enabled: !environmentManager.busy
+                        onClicked: environmentManager.verifyBlocks(verifySlotCombo.currentText, true)
+                        Layout.fillWidth: true
+                    }
+                }
             }
         }
     }
@@ -173,7 +272,7 @@ ColumnLayout {
             icon.name: "edit-clear"
             text: qsTr("Clear")
             display: QQC2.AbstractButton.TextBesideIcon
-            enabled: environmentManager.output !== ""
+            enabled: !environmentManager.log.empty
             onClicked: environmentManager.clearOutput()
         }
     }
@@ -182,25 +281,45 @@ ColumnLayout {
         Layout.fillWidth: true
         Layout.fillHeight: true
 
-        QQC2.TextArea {
-            id: outputArea
-            readOnly: true
-            wrapMode: TextEdit.Wrap
-            font.family: "monospace"
-            text: environmentManager.output
-            background: Rectangle {
-                color: Kirigami.Theme.backgroundColor
-                border.color: Kirigami.Theme.disabledTextColor
-                border.width: 1
+        background: Rectangle {
+            color: Kirigami.Theme.backgroundColor
+            border.color: Kirigami.Theme.disabledTextColor
+            border.width: 1
+        }
+
+        ListView {
+            id: outputView
+            clip: true
+            reuseItems: true
+            model: environmentManager.outputModel
+
+            property bool followTail: true
+
+            onCountChanged: {
+                if (count === 0) {
+                    followTail = true
+                } else if (followTail) {
+                    positionViewAtEnd()
+                }
+            }
+
+            onMovementEnded: {
+                followTail = atYEnd
             }
 
-            onTextChanged: {
-                cursorPosition = text.length
+            delegate: QQC2.Label {
+                width: ListView.view.width
+                leftPadding: Kirigami.Units.smallSpacing
+                rightPadding: Kirigami.Units.smallSpacing
+                text: model.display
+                textFormat: Text.PlainText
+                wrapMode: Text.Wrap
+                font.family: "monospace"
             }
 
             Kirigami.PlaceholderMessage {
                 anchors.centerIn: parent
-                visible: environmentManager.output === "" && !environmentManager.busy
+                visible: environmentManager.log.empty && !environmentManager.busy
                 text: qsTr("No output")
                 explanation: qsTr("Run a command to see output here")
                 icon.name: "utilities-terminal"
@@ -7,15 +7,12 @@ ColumnLayout {
     id: slotsPage
 
     required property var slotManager
+    required property var systemState
 
     property bool wideMode: width > Kirigami.Units.gridUnit * 35
 
     spacing: Kirigami.Units.smallSpacing
 
-    Component.onCompleted: {
-        slotManager.refreshCurrentSlot()
-    }
-
     RowLayout {
         Layout.fillWidth: true
         spacing: Kirigami.Units.smallSpacing
@@ -32,6 +29,12 @@ ColumnLayout {
             font.bold: true
         }
 
+        QQC2.Label {
+            text: qsTr("Next boot: Slot %1").arg(systemState.nextBootSlot.toUpperCase())
+            opacity: 0.7
+            visible: systemState.nextBootSlot !== "" && systemState.nextBootSlot !== slotManager.currentSlot
+        }
+
         QQC2.BusyIndicator {
             running: slotManager.busy
             visible: slotManager.busy
@@ -112,6 +115,13 @@ ColumnLayout {
                     Layout.fillWidth: true
                 }
 
+                QQC2.CheckBox {
+                    id: incrementalSyncCheck
+                    text: qsTr("Only copy changes")
+                    checked: false
+                    Layout.columnSpan: 2
+                }
+
                 QQC2.Button {
                     text: qsTr("Sync Current to Target")
                     icon.name: "folder-sync"
@@ -120,6 +130,25 @@ ColumnLayout {
                     Layout.columnSpan: 2
                     Layout.fillWidth: true
                 }
+
+                QQC2.Label {
+                    visible: slotManager.syncing || slotManager.syncFilesChecked > 0
+                    text: {
+                        var parts = [qsTr("%1 of %2 entries updated").arg(slotManager.syncFilesUpdated).arg(slotManager.syncFilesChecked)]
+                        parts.push(qsTr("%1 copied, %2 skipped")
+                            .arg(Qt.locale().formattedDataSize(slotManager.syncBytesCopied))
+                            .arg(Qt.locale().formattedDataSize(slotManager.syncBytesSkipped)))
+                        if (slotManager.syncing) {
+                            parts.push(qsTr("%1 files/s").arg(Math.round(slotManager.syncFilesPerSecond)))
+                            parts.push(qsTr("%1/s").arg(Qt.locale().formattedDataSize(slotManager.syncBytesPerSecond)))
+                        }
+                        return parts.join(" · ")
+                    }
+                    opacity: 0.7
+                    wrapMode: Text.WordWrap
+                    Layout.columnSpan: 2
+                    Layout.fillWidth: true
+                }
             }
         }
 
@@ -140,6 +169,19 @@ ColumnLayout {
                     onClicked: {
                         slotManager.clearOutput()
                         slotManager.showSlotDiff()
+                        slotDiffDialog.open()
+                    }
+                    Layout.fillWidth: true
+                }
+
+                QQC2.Button {
+                    text: qsTr("Compare Packages")
+                    icon.name: "package-x-generic"
+                    enabled: !slotManager.busy
+                    onClicked: {
+                        slotManager.clearOutput()
+                        slotManager.comparePackages()
+                        packageDiffDialog.open()
                     }
                     Layout.fillWidth: true
                 }
@@ -147,10 +189,11 @@ ColumnLayout {
                 QQC2.Button {
                     text: qsTr("Check Slot Health")
                     icon.name: "dialog-ok-apply"
-                    enabled: !slotManager.busy
+                    enabled: !slotManager.healthChecks.running
                     onClicked: {
                         slotManager.clearOutput()
                         slotManager.checkHealth()
+                        healthDialog.open()
                     }
                     Layout.fillWidth: true
                 }
@@ -176,7 +219,7 @@ ColumnLayout {
             icon.name: "edit-clear"
             text: qsTr("Clear")
             display: QQC2.AbstractButton.TextBesideIcon
-            enabled: slotManager.output !== ""
+            enabled: !slotManager.log.empty
             onClicked: slotManager.clearOutput()
         }
     }
@@ -185,25 +228,45 @@ ColumnLayout {
         Layout.fillWidth: true
         Layout.fillHeight: true
 
-        QQC2.TextArea {
-            id: outputArea
-            readOnly: true
-            wrapMode: TextEdit.Wrap
-            font.family: "monospace"
-            text: slotManager.output
-            background: Rectangle {
-                color: Kirigami.Theme.backgroundColor
-                border.color: Kirigami.Theme.disabledTextColor
-                border.width: 1
+        background: Rectangle {
+            color: Kirigami.Theme.backgroundColor
+            border.color: Kirigami.Theme.disabledTextColor
+            border.width: 1
+        }
+
+        ListView {
+            id: outputView
+            clip: true
+            reuseItems: true
+            model: slotManager.outputModel
+
+            property bool followTail: true
+
+            onCountChanged: {
+                if (count === 0) {
+                    followTail = true
+                } else if (followTail) {
+                    positionViewAtEnd()
+                }
             }
 
-            onTextChanged: {
-                cursorPosition = text.length
+            onMovementEnded: {
+                followTail = atYEnd
+            }
+
+            delegate: QQC2.Label {
+                width: ListView.view.width
+                leftPadding: Kirigami.Units.smallSpacing
+                rightPadding: Kirigami.Units.smallSpacing
+                text: model.display
+                textFormat: Text.PlainText
+                wrapMode: Text.Wrap
+                font.family: "monospace"
             }
 
             Kirigami.PlaceholderMessage {
                 anchors.centerIn: parent
-                visible: slotManager.output === "" && !slotManager.busy
+                visible: slotManager.log.empty && !slotManager.busy
                 text: qsTr("No output")
                 explanation: qsTr("Run a command to see output here")
                 icon.name: "utilities-terminal"
@@ -309,7 +372,7 @@ ColumnLayout {
         width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 22)
 
         onAccepted: {
-            slotManager.syncSlots(syncSlotCombo.currentText)
+            slotManager.syncSlots(syncSlotCombo.currentText, incrementalSyncCheck.checked)
         }
 
         RowLayout {
@@ -342,4 +405,370 @@ ColumnLayout {
             }
         }
     }
+
+    QQC2.Dialog {
+        id: slotDiffDialog
+        title: qsTr("Slot Differences")
+        standardButtons: QQC2.Dialog.Close
+        modal: true
+        parent: QQC2.Overlay.overlay
+        anchors.centerIn: parent
+        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 36)
+        height: Math.min(parent.height - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 30)
+
+        readonly property var diff: slotManager.diffModel
+
+        function changeText(change) {
+            switch (change) {
+            case "added":
+                return qsTr("Only in %1").arg(slotDiffDialog.diff.targetSlot.toUpperCase())
+            case "removed":
+                return qsTr("Only in %1").arg(slotDiffDialog.diff.baseSlot.toUpperCase())
+            case "modified":
+                return qsTr("Modified")
+            case "attributes":
+                return qsTr("Attributes")
+            }
+            return ""
+        }
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: Kirigami.Units.smallSpacing
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: Kirigami.Units.smallSpacing
+
+                QQC2.ComboBox {
+                    textRole: "text"
+                    valueRole: "value"
+                    model: [
+                        { text: qsTr("All changes"), value: "" },
+                        { text: qsTr("Only in slot %1").arg(slotDiffDialog.diff.targetSlot.toUpperCase()), value: "added" },
+                        { text: qsTr("Only in slot %1").arg(slotDiffDialog.diff.baseSlot.toUpperCase()), value: "removed" },
+                        { text: qsTr("Modified"), value: "modified" },
+                        { text: qsTr("Attributes changed"), value: "attributes" }
+                    ]
+                    onActivated: slotDiffDialog.diff.filter = currentValue
+                }
+
+                Kirigami.SearchField {
+                    Layout.fillWidth: true
+                    onAccepted: slotDiffDialog.diff.searchText = text
+                }
+
+                QQC2.BusyIndicator {
+                    running: slotManager.busy
+                    visible: slotManager.busy
+                    Layout.preferredWidth: Kirigami.Units.iconSizes.medium
+                    Layout.preferredHeight: Kirigami.Units.iconSizes.medium
+                }
+            }
+
+            QQC2.Label {
+                Layout.fillWidth: true
+                opacity: 0.7
+                wrapMode: Text.WordWrap
+                text: qsTr("Slot %1 compared to %2: %3 added, %4 removed, %5 modified, %6 with changed attributes (%7)")
+                    .arg(slotDiffDialog.diff.targetSlot.toUpperCase())
+                    .arg(slotDiffDialog.diff.baseSlot.toUpperCase())
+                    .arg(slotDiffDialog.diff.addedCount)
+                    .arg(slotDiffDialog.diff.removedCount)
+                    .arg(slotDiffDialog.diff.modifiedCount)
+                    .arg(slotDiffDialog.diff.attributeCount)
+                    .arg((slotDiffDialog.diff.sizeDelta < 0 ? "-" : "+") + Qt.locale().formattedDataSize(Math.abs(slotDiffDialog.diff.sizeDelta)))
+            }
+
+            QQC2.ScrollView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+
+                TreeView {
+                    id: diffTree
+                    clip: true
+                    model: slotDiffDialog.diff
+
+                    delegate: QQC2.TreeViewDelegate {
+                        id: diffDelegate
+                        implicitWidth: diffTree.width
+
+                        contentItem: RowLayout {
+                            spacing: Kirigami.Units.smallSpacing
+
+                            Kirigami.Icon {
+                                source: model.isGroup || model.type === "directory" ? "folder"
+                                      : model.type === "symlink" ? "inode-symlink" : "text-x-generic"
+                                Layout.preferredWidth: Kirigami.Units.iconSizes.small
+                                Layout.preferredHeight: Kirigami.Units.iconSizes.small
+                            }
+                            QQC2.Label {
+                                text: model.isGroup ? qsTr("%1 (%2)").arg(model.name).arg(model.count) : model.name
+                                font.family: model.isGroup ? "monospace" : Kirigami.Theme.defaultFont.family
+                                elide: Text.ElideMiddle
+                                Layout.fillWidth: true
+                            }
+                            QQC2.Label {
+                                visible: !model.isGroup
+                                text: slotDiffDialog.changeText(model.change)
+                                opacity: 0.7
+                            }
+                            QQC2.Label {
+                                text: model.sizeDeltaString
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 5
+                                horizontalAlignment: Text.AlignRight
+                            }
+                        }
+
+                        onDoubleClicked: {
+                            if (model.isGroup) {
+                                diffTree.toggleExpanded(diffDelegate.row)
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    QQC2.Dialog {
+        id: packageDiffDialog
+        title: qsTr("Package Differences")
+        standardButtons: QQC2.Dialog.Close
+        modal: true
+        parent: QQC2.Overlay.overlay
+        anchors.centerIn: parent
+        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 36)
+        height: Math.min(parent.height - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 30)
+
+        readonly property var diff: slotManager.packageDiff
+
+        function changeText(change) {
+            switch (change) {
+            case "added":
+                return qsTr("Only in %1").arg(packageDiffDialog.diff.targetSlot.toUpperCase())
+            case "removed":
+                return qsTr("Only in %1").arg(packageDiffDialog.diff.baseSlot.toUpperCase())
+            case "upgraded":
+                return qsTr("Upgraded")
+            case "downgraded":
+                return qsTr("Downgraded")
+            }
+            return ""
+        }
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: Kirigami.Units.smallSpacing
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: Kirigami.Units.smallSpacing
+
+                QQC2.Label {
+                    text: qsTr("Sort by:")
+                }
+
+                QQC2.ComboBox {
+                    textRole: "text"
+                    valueRole: "value"
+                    model: [
+                        { text: qsTr("Name"), value: "name" },
+                        { text: qsTr("Change"), value: "change" },
+                        { text: qsTr("Size change"), value: "size" }
+                    ]
+                    Component.onCompleted: currentIndex = indexOfValue(packageDiffDialog.diff.sortKey)
+                    onActivated: packageDiffDialog.diff.sortKey = currentValue
+                }
+
+                QQC2.CheckBox {
+                    text: qsTr("Descending")
+                    checked: packageDiffDialog.diff.sortDescending
+                    onToggled: packageDiffDialog.diff.sortDescending = checked
+                }
+
+                Item {
+                    Layout.fillWidth: true
+                }
+
+                QQC2.BusyIndicator {
+                    running: slotManager.busy
+                    visible: slotManager.busy
+                    Layout.preferredWidth: Kirigami.Units.iconSizes.medium
+                    Layout.preferredHeight: Kirigami.Units.iconSizes.medium
+                }
+            }
+
+            QQC2.Label {
+                Layout.fillWidth: true
+                opacity: 0.7
+                wrapMode: Text.WordWrap
+                text: qsTr("Slot %1 compared to %2: %3 added, %4 removed, %5 upgraded, %6 downgraded")
+                    .arg(packageDiffDialog.diff.targetSlot.toUpperCase())
+                    .arg(packageDiffDialog.diff.baseSlot.toUpperCase())
+                    .arg(packageDiffDialog.diff.addedCount)
+                    .arg(packageDiffDialog.diff.removedCount)
+                    .arg(packageDiffDialog.diff.upgradedCount)
+                    .arg(packageDiffDialog.diff.downgradedCount)
+            }
+
+            QQC2.ScrollView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+
+                ListView {
+                    id: packageList
+                    clip: true
+                    model: packageDiffDialog.diff
+
+                    delegate: QQC2.ItemDelegate {
+                        width: packageList.width
+
+                        contentItem: RowLayout {
+                            spacing: Kirigami.Units.smallSpacing
+
+                            QQC2.Label {
+                                text: model.name
+                                elide: Text.ElideRight
+                                Layout.fillWidth: true
+                            }
+                            QQC2.Label {
+                                text: model.change === "added" ? model.newVersion
+                                    : model.change === "removed" ? model.oldVersion
+                                    : qsTr("%1 -> %2").arg(model.oldVersion).arg(model.newVersion)
+                                font.family: "monospace"
+                                elide: Text.ElideMiddle
+                                Layout.maximumWidth: Kirigami.Units.gridUnit * 14
+                            }
+                            QQC2.Label {
+                                text: packageDiffDialog.changeText(model.change)
+                                opacity: 0.7
+                            }
+                            QQC2.Label {
+                                text: model.sizeDeltaString
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 5
+                                horizontalAlignment: Text.AlignRight
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    QQC2.Dialog {
+        id: healthDialog
+        title: qsTr("Slot Health")
+        standardButtons: QQC2.Dialog.Close
+        modal: true
+        parent: QQC2.Overlay.overlay
+        anchors.centerIn: parent
+        width: Math.min(parent.width - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 32)
+        height: Math.min(parent.height - Kirigami.Units.gridUnit * 4, Kirigami.Units.gridUnit * 28)
+
+        readonly property var checks: slotManager.healthChecks
+
+        function durationText(ms) {
+            return ms < 1000 ? qsTr("%1 ms").arg(ms) : qsTr("%1 s").arg((ms / 1000).toFixed(1))
+        }
+
+        function statusIcon(status) {
+            switch (status) {
+            case "passed":
+                return "dialog-ok-apply"
+            case "warning":
+                return "dialog-warning"
+            case "failed":
+                return "dialog-error"
+            case "skipped":
+                return "media-skip-forward"
+            }
+            return "view-refresh"
+        }
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: Kirigami.Units.smallSpacing
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: Kirigami.Units.smallSpacing
+
+                QQC2.Label {
+                    Layout.fillWidth: true
+                    opacity: 0.7
+                    wrapMode: Text.WordWrap
+                    text: healthDialog.checks.running
+                        ? qsTr("Checking...")
+                        : qsTr("%1 passed, %2 with warnings, %3 failed in %4 (%5 of checks)")
+                            .arg(healthDialog.checks.passedCount)
+                            .arg(healthDialog.checks.warningCount)
+                            .arg(healthDialog.checks.failedCount)
+                            .arg(healthDialog.durationText(healthDialog.checks.elapsed))
+                            .arg(healthDialog.durationText(healthDialog.checks.checkTime))
+                }
+
+                QQC2.BusyIndicator {
+                    running: healthDialog.checks.running
+                    visible: healthDialog.checks.running
+                    Layout.preferredWidth: Kirigami.Units.iconSizes.medium
+                    Layout.preferredHeight: Kirigami.Units.iconSizes.medium
+                }
+            }
+
+            QQC2.ScrollView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+
+                ListView {
+                    id: healthList
+                    clip: true
+                    model: healthDialog.checks
+
+                    delegate: QQC2.ItemDelegate {
+                        width: healthList.width
+
+                        contentItem: RowLayout {
+                            spacing: Kirigami.Units.smallSpacing
+
+                            Kirigami.Icon {
+                                source: healthDialog.statusIcon(model.status)
+                                Layout.preferredWidth: Kirigami.Units.iconSizes.small
+                                Layout.preferredHeight: Kirigami.Units.iconSizes.small
+                                Layout.alignment: Qt.AlignTop
+                            }
+
+                            ColumnLayout {
+                                Layout.fillWidth: true
+                                spacing: 0
+
+                                QQC2.Label {
+                                    text: model.slot ? qsTr("%1 (slot %2)").arg(model.name).arg(model.slot.toUpperCase()) : model.name
+                                    Layout.fillWidth: true
+                                    elide: Text.ElideRight
+                                }
+                                QQC2.Label {
+                                    visible: text !== ""
+                                    text: model.details
+                                    opacity: 0.7
+                                    font: Kirigami.Theme.smallFont
+                                    wrapMode: Text.WordWrap
+                                    maximumLineCount: 6
+                                    elide: Text.ElideRight
+                                    Layout.fillWidth: true
+                                }
+                            }
+
+                            QQC2.Label {
+                                text: model.status === "running" || model.status === "skipped" ? "" : healthDialog.durationText(model.duration)
+                                Layout.preferredWidth: Kirigami.Units.gridUnit * 4
+                                Layout.alignment: Qt.AlignTop
+                                horizontalAlignment: Text.AlignRight
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
 }
@@ -84,6 +84,28 @@ ColumnLayout {
                     }
                 }
 
+                QQC2.Label {
+                    readonly property var image: updateManager.inspectImage(imagePathField.text)
+
+                    visible: imagePathField.text !== ""
+                    text: {
+                        if (!image.compressor && !image.error) {
+                            return ""
+                        }
+                        if (image.error) {
+                            return image.error
+                        }
+                        return qsTr("%1 image, %2 compressed in %3 blocks, %4 inodes, built %5")
+                            .arg(image.size).arg(image.compressor).arg(image.blockSize)
+                            .arg(image.inodeCount).arg(image.created)
+                    }
+                    color: image.error ? Kirigami.Theme.negativeTextColor : Kirigami.Theme.textColor
+                    opacity: image.error ? 1 : 0.7
+                    wrapMode: Text.WordWrap
+                    Layout.columnSpan: 2
+                    Layout.fillWidth: true
+                }
+
                 QQC2.Button {
                     text: qsTr("Apply Local Update")
                     icon.name: "system-software-update"
@@ -140,6 +162,40 @@ ColumnLayout {
         Layout.fillWidth: true
     }
 
+    ColumnLayout {
+        Layout.fillWidth: true
+        spacing: Kirigami.Units.smallSpacing
+        visible: updateManager.busy && updateManager.progress >= 0
+
+        QQC2.ProgressBar {
+            Layout.fillWidth: true
+            from: 0
+            to: 100
+            value: Math.max(updateManager.progress, 0)
+        }
+
+        QQC2.Label {
+            Layout.fillWidth: true
+            opacity: 0.7
+            text: {
+                var parts = [qsTr("%1%").arg(updateManager.progress)]
+                if (updateManager.bytesDone >= 0 && updateManager.bytesTotal > 0) {
+                    parts.push(qsTr("%1 of %2").arg(Qt.locale().formattedDataSize(updateManager.bytesDone))
+                                               .arg(Qt.locale().formattedDataSize(updateManager.bytesTotal)))
+                }
+                if (updateManager.throughput > 0) {
+                    parts.push(qsTr("%1/s").arg(Qt.locale().formattedDataSize(updateManager.throughput)))
+                }
+                if (updateManager.eta >= 0) {
+                    var minutes = Math.floor(updateManager.eta / 60)
+                    var seconds = updateManager.eta % 60
+                    parts.push(qsTr("%1:%2 remaining").arg(minutes).arg(seconds < 10 ? "0" + seconds : seconds))
+                }
+                return parts.join(" · ")
+            }
+        }
+    }
+
     RowLayout {
         Layout.fillWidth: true
 
@@ -154,7 +210,7 @@ ColumnLayout {
             icon.name: "edit-clear"
             text: qsTr("Clear")
             display: QQC2.AbstractButton.TextBesideIcon
-            enabled: updateManager.output !== ""
+            enabled: !updateManager.log.empty
             onClicked: updateManager.clearOutput()
         }
     }
@@ -163,25 +219,45 @@ ColumnLayout {
         Layout.fillWidth: true
         Layout.fillHeight: true
 
-        QQC2.TextArea {
-            id: outputArea
-            readOnly: true
-            wrapMode: TextEdit.Wrap
-            font.family: "monospace"
-            text: updateManager.output
-            background: Rectangle {
-                color: Kirigami.Theme.backgroundColor
-                border.color: Kirigami.Theme.disabledTextColor
-                border.width: 1
+        background: Rectangle {
+            color: Kirigami.Theme.backgroundColor
+            border.color: Kirigami.Theme.disabledTextColor
+            border.width: 1
+        }
+
+        ListView {
+            id: outputView
+            clip: true
+            reuseItems: true
+            model: updateManager.outputModel
+
+            property bool followTail: true
+
+            onCountChanged: {
+                if (count === 0) {
+                    followTail = true
+                } else if (followTail) {
+                    positionViewAtEnd()
+                }
+            }
+
+            onMovementEnded: {
+                followTail = atYEnd
             }
 
-            onTextChanged: {
-                cursorPosition = text.length
+            delegate: QQC2.Label {
+                width: ListView.view.width
+                leftPadding: Kirigami.Units.smallSpacing
+                rightPadding: Kirigami.Units.smallSpacing
+                text: model.display
+                textFormat: Text.PlainText
+                wrapMode: Text.Wrap
+                font.family: "monospace"
             }
 
             Kirigami.PlaceholderMessage {
                 anchors.centerIn: parent
-                visible: updateManager.output === "" && !updateManager.busy
+                visible: updateManager.log.empty && !updateManager.busy
                 text: qsTr("No output")
                 explanation: qsTr("Start an update to see progress here")
                 icon.name: "system-software-update"
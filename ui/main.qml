@@ -92,6 +92,13 @@ KCMUtils.SimpleKCM {
                     Layout.fillWidth: true
                 }
 
+                QQC2.BusyIndicator {
+                    running: kcm.loading
+                    visible: kcm.loading
+                    Layout.preferredWidth: Kirigami.Units.iconSizes.smallMedium
+                    Layout.preferredHeight: Kirigami.Units.iconSizes.smallMedium
+                }
+
                 QQC2.Label {
                     text: kcm.currentSlot ? qsTr("Slot %1").arg(kcm.currentSlot.toUpperCase()) : ""
                     opacity: 0.7
@@ -99,6 +106,7 @@ KCMUtils.SimpleKCM {
 
                 QQC2.ToolButton {
                     icon.name: "view-refresh"
+                    enabled: !kcm.loading
                     onClicked: refreshAll()
                 }
             }
@@ -139,7 +147,8 @@ KCMUtils.SimpleKCM {
                         }
 
                         QQC2.Label {
-                            text: kcm.currentSlot ? qsTr("Active: Slot %1").arg(kcm.currentSlot.toUpperCase()) : qsTr("Active: Unknown")
+                            text: kcm.currentSlot ? qsTr("Active: Slot %1").arg(kcm.currentSlot.toUpperCase())
+                                  : kcm.loading ? qsTr("Active: Loading…") : qsTr("Active: Unknown")
                             opacity: 0.7
                             font.pointSize: Kirigami.Theme.smallFont.pointSize
                             Layout.alignment: Qt.AlignHCenter
@@ -212,6 +221,7 @@ KCMUtils.SimpleKCM {
 
                     SlotsPage {
                         slotManager: kcm.slotManager
+                        systemState: kcm.systemState
                     }
 
                     UpdatesPage {
@@ -257,7 +267,8 @@ KCMUtils.SimpleKCM {
                     }
 
                     QQC2.Label {
-                        text: kcm.currentSlot ? qsTr("Slot %1").arg(kcm.currentSlot.toUpperCase()) : qsTr("Unknown")
+                        text: kcm.currentSlot ? qsTr("Slot %1").arg(kcm.currentSlot.toUpperCase())
+                              : kcm.loading ? qsTr("Loading…") : qsTr("Unknown")
                         opacity: 0.7
                         font.pointSize: Kirigami.Theme.smallFont.pointSize
                     }
@@ -313,6 +324,5 @@ KCMUtils.SimpleKCM {
     function refreshAll() {
         kcm.refreshSystemInfo()
         kcm.backupManager.refreshBackups()
-        kcm.slotManager.refreshCurrentSlot()
     }
 }